@@ -114,11 +114,12 @@ C4SliceResult c4blob_getContents(C4BlobStore* store, C4BlobKey key, C4Error* out
 
 C4StringResult c4blob_getFilePath(C4BlobStore* store, C4BlobKey key, C4Error* outError) noexcept {
     try {
-        auto path = store->get(internal(key)).path();
+        auto blob = store->get(internal(key));
+        auto path = blob.path();
         if (!path.exists()) {
             recordError(LiteCoreDomain, kC4ErrorNotFound, outError);
             return {nullptr, 0};
-        } else if (store->isEncrypted()) {
+        } else if (store->isEncrypted() || blob.isCompressed()) {
             recordError(LiteCoreDomain, kC4ErrorWrongFormat, outError);
             return {nullptr, 0};
         }
@@ -31,6 +31,7 @@ using namespace fleece;
 
 
 CBL_CORE_API C4StorageEngine const kC4SQLiteStorageEngine   = "SQLite";
+CBL_CORE_API C4StorageEngine const kC4LogStorageEngine      = "Log";
 
 
 #pragma mark - C4DATABASE METHODS:
@@ -134,18 +135,94 @@ bool c4db_compact(C4Database* database, C4Error *outError) noexcept {
 }
 
 
+bool c4db_compactIncrementally(C4Database* database, uint32_t maxMillis,
+                               C4Error *outError) noexcept
+{
+    if (outError)
+        *outError = {};     // returns false when finished, as well as on error
+    return tryCatch<bool>(outError, [&]{
+        return database->compactIncrementally(chrono::milliseconds(maxMillis));
+    });
+}
+
+
+bool c4db_needsCompaction(C4Database* database) noexcept {
+    try {
+        return database->compactionNeeded();
+    } catchExceptions()
+    return false;
+}
+
+
 bool c4db_isCompacting(C4Database *database) noexcept {
     return database ? database->dataFile()->isCompacting() : DataFile::isAnyCompacting();
 }
 
 
 void c4db_setOnCompactCallback(C4Database *database, C4OnCompactCallback cb, void *context) noexcept {
-    database->setOnCompact([cb,context](bool compacting) {
-        cb(context, compacting);
+    // Only report the start and end, not the progress in between:
+    bool wasCompacting = false;
+    database->setOnCompact([cb,context,wasCompacting](bool compacting,
+                                                      const DataFile::CompactProgress&) mutable {
+        if (compacting != wasCompacting) {
+            wasCompacting = compacting;
+            cb(context, compacting);
+        }
     });
 }
 
 
+void c4db_setOnCompactProgressCallback(C4Database *database,
+                                       C4OnCompactProgressCallback cb,
+                                       void *context) noexcept
+{
+    if (!cb)
+        return database->setOnCompact(nullptr);
+    database->setOnCompact([cb,context](bool compacting,
+                                        const DataFile::CompactProgress &progress) {
+        cb(context, compacting, {progress.docsScanned, progress.blobsDeleted,
+                                 progress.bytesReclaimed});
+    });
+}
+
+
+bool c4db_trainCompressionDictionary(C4Database* database, C4Error *outError) noexcept {
+    if (outError)
+        *outError = {};     // returns false when there's too little data, as well as on error
+    return tryCatch<bool>(outError, bind(&Database::trainCompressionDictionary, database));
+}
+
+
+bool c4db_needsDictionaryTraining(C4Database* database) noexcept {
+    try {
+        return database->dictionaryTrainingNeeded();
+    } catchExceptions()
+    return false;
+}
+
+
+void c4db_setOnDictionaryTrainingCallback(C4Database *database,
+                                          C4OnDictionaryTrainingCallback cb,
+                                          void *context) noexcept
+{
+    if (!cb)
+        return database->setOnDictionaryTrainingNeeded(nullptr);
+    database->setOnDictionaryTrainingNeeded([cb,context] {
+        cb(context);
+    });
+}
+
+
+bool c4db_beginBulkLoad(C4Database* database, C4Error *outError) noexcept {
+    return tryCatch(outError, bind(&Database::beginBulkLoad, database));
+}
+
+
+bool c4db_endBulkLoad(C4Database* database, C4Error *outError) noexcept {
+    return tryCatch(outError, bind(&Database::endBulkLoad, database));
+}
+
+
 bool c4db_rekey(C4Database* database, const C4EncryptionKey *newKey, C4Error *outError) noexcept {
     return tryCatch(outError, bind(&Database::rekey, database, newKey));
 }
@@ -280,3 +357,23 @@ bool c4raw_put(C4Database* database,
     c4db_endTransaction(database, commit, outError);
     return commit;
 }
+
+
+bool c4raw_putMany(C4Database* database,
+                   C4Slice storeName,
+                   const C4RawDocument docs[],
+                   size_t count,
+                   C4Error *outError) noexcept
+{
+    if (!c4db_beginTransaction(database, outError))
+        return false;
+    bool commit = tryCatch(outError, [&]{
+        vector<KeyStore::SetEntry> entries;
+        entries.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            entries.push_back({docs[i].key, docs[i].meta, docs[i].body});
+        database->putRawDocuments((string)storeName, entries.data(), count);
+    });
+    c4db_endTransaction(database, commit, outError);
+    return commit;
+}
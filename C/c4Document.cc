@@ -23,6 +23,9 @@
 
 #include "Document.hh"
 #include "Database.hh"
+#include "DocumentMeta.hh"
+#include "RawRevTree.hh"
+#include "RevID.hh"
 #include "SecureRandomize.hh"
 #include "Fleece.hh"
 #include "Fleece.h"
@@ -39,8 +42,14 @@ C4Document* c4doc_get(C4Database *database,
                       C4Error *outError) noexcept
 {
     return tryCatch<C4Document*>(outError, [&]{
-        WITH_LOCK(database);
-        auto doc = database->documentFactory().newDocumentInstance(docID);
+        Document *doc;
+        Record rec(docID);
+        if (database->withReader([&](DataFile &reader) {reader.defaultKeyStore().read(rec);})) {
+            doc = database->documentFactory().newDocumentInstance(rec);
+        } else {
+            WITH_LOCK(database);
+            doc = database->documentFactory().newDocumentInstance(docID);
+        }
         if (mustExist && !internal(doc)->exists()) {
             delete doc;
             doc = nullptr;
@@ -51,13 +60,48 @@ C4Document* c4doc_get(C4Database *database,
 }
 
 
+bool c4doc_getMany(C4Database *database,
+                   const C4Slice docIDs[],
+                   size_t count,
+                   C4Document* outDocs[],
+                   C4Error *outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        vector<slice> keys(docIDs, docIDs + count);
+        vector<Record> records;
+        if (!database->withReader([&](DataFile &reader) {
+                records = reader.defaultKeyStore().getMany(keys);
+            })) {
+            WITH_LOCK(database);
+            records = database->defaultKeyStore().getMany(keys);
+        }
+        auto &factory = database->documentFactory();
+        size_t i = 0;
+        try {
+            for (; i < count; ++i)
+                outDocs[i] = factory.newDocumentInstance(records[i]);
+        } catch (...) {
+            while (i > 0)
+                c4doc_free(outDocs[--i]);
+            throw;
+        }
+    });
+}
+
+
 C4Document* c4doc_getBySequence(C4Database *database,
                                 C4SequenceNumber sequence,
                                 C4Error *outError) noexcept
 {
     return tryCatch<C4Document*>(outError, [&]{
-        WITH_LOCK(database);
-        auto doc = database->documentFactory().newDocumentInstance(database->defaultKeyStore().get(sequence));
+        Document *doc;
+        Record rec;
+        if (database->withReader([&](DataFile &reader) {rec = reader.defaultKeyStore().get(sequence);})) {
+            doc = database->documentFactory().newDocumentInstance(rec);
+        } else {
+            WITH_LOCK(database);
+            doc = database->documentFactory().newDocumentInstance(database->defaultKeyStore().get(sequence));
+        }
         if (!internal(doc)->exists()) {
             delete doc;
             doc = nullptr;
@@ -164,6 +208,71 @@ bool c4doc_selectNextPossibleAncestorOf(C4Document* doc, C4Slice revID) noexcept
 }
 
 
+static alloc_slice encodeRevIDs(const vector<revid> &revIDs) {
+    fleece::Encoder enc;
+    enc.beginArray(revIDs.size());
+    for (auto &rev : revIDs)
+        enc.writeString(rev.expanded());
+    enc.endArray();
+    return enc.extractOutput();
+}
+
+
+bool c4db_findDocAncestors(C4Database *database,
+                           unsigned numRevs,
+                           unsigned maxAncestors,
+                           const C4String docIDs[],
+                           const C4String revIDs[],
+                           C4SliceResult outAncestors[],
+                           C4Error *outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        if (database->config.versioning != kC4RevisionTrees)
+            error::_throw(error::Unimplemented);
+        WITH_LOCK(database);
+        KeyStore &store = database->defaultKeyStore();
+        vector<alloc_slice> results(numRevs);
+        vector<revidBuffer> revs(numRevs);
+        alloc_slice noAncestors = encodeRevIDs({});
+
+        // First read only the metadata, which is enough to recognize a doc's current revision,
+        // the usual case when a revision already exists. It includes the rev tree too, unless
+        // the doc was saved with the tree and bodies together:
+        vector<slice> keys(docIDs, docIDs + numRevs);
+        vector<Record> recs = store.getMany(keys, kMetaOnly);
+        vector<unsigned> remaining;
+        vector<revid> ancestors;
+        for (unsigned i = 0; i < numRevs; ++i) {
+            bool validRevID = revs[i].tryParse(revIDs[i], false);
+            if (!recs[i].exists() || !validRevID)
+                results[i] = noAncestors;
+            else if (DocumentMeta(recs[i]).version == revs[i])
+                continue;
+            else if (!recs[i].extra())
+                remaining.push_back(i);
+            else if (!RawRevision::findRevision(recs[i].extra(), revs[i], maxAncestors, ancestors))
+                results[i] = encodeRevIDs(ancestors);
+        }
+
+        // Then scan the rev trees of the other docs, without decoding them:
+        if (!remaining.empty()) {
+            keys.clear();
+            for (unsigned i : remaining)
+                keys.push_back(docIDs[i]);
+            recs = store.getMany(keys);
+            for (size_t n = 0; n < remaining.size(); ++n) {
+                unsigned i = remaining[n];
+                if (!RawRevision::findRevision(recs[n].body(), revs[i], maxAncestors, ancestors))
+                    results[i] = encodeRevIDs(ancestors);
+            }
+        }
+
+        for (unsigned i = 0; i < numRevs; ++i)
+            outAncestors[i] = sliceResult(results[i]);
+    });
+}
+
+
 #pragma mark - SAVING:
 
 
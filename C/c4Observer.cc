@@ -68,6 +68,14 @@ uint32_t c4dbobs_getChanges(C4DatabaseObserver *obs,
 }
 
 
+bool c4dbobs_missedChanges(C4DatabaseObserver *obs) noexcept {
+    return tryCatch<bool>(nullptr, [&]{
+        lock_guard<mutex> lock(obs->_notifier.tracker.mutex());
+        return obs->_notifier.missedChanges();
+    });
+}
+
+
 void c4dbobs_free(C4DatabaseObserver* obs) noexcept {
     if (obs) {
         Retained<Database> retainDB((Database*)obs->_db);   // keep db from being deleted too early
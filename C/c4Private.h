@@ -34,6 +34,16 @@ C4Document* c4doc_getForPut(C4Database *database,
                             bool deleting,
                             bool allowConflict,
                             C4Error *outError) C4API;
+
+/** Returns the number of hits and misses of the database's cache of compiled queries,
+    and the number of queries currently cached. (For testing and benchmarking.) */
+void c4db_getQueryCacheStats(C4Database *database,
+                             uint64_t *outHits,
+                             uint64_t *outMisses,
+                             size_t *outCount) C4API;
+
+/** Empties the database's cache of compiled queries. (For testing and benchmarking.) */
+void c4db_clearQueryCache(C4Database *database) C4API;
     
 #ifdef __cplusplus
 }
@@ -15,10 +15,12 @@
 
 #include "c4Internal.hh"
 #include "c4Query.h"
+#include "c4Private.h"
 
 #include "Database.hh"
 #include "DataFile.hh"
 #include "Query.hh"
+#include "LiveQuery.hh"
 #include "DocumentMeta.hh"
 #include <math.h>
 #include <limits.h>
@@ -32,7 +34,8 @@ using namespace litecore;
 CBL_CORE_API const C4QueryOptions kC4DefaultQueryOptions = {
     0,
     UINT_MAX,
-    true
+    true,
+    false
 };
 
 
@@ -94,14 +97,17 @@ void c4queryenum_free(C4QueryEnumerator *e) noexcept {
 struct c4Query : C4InstanceCounted {
     c4Query(Database *db, C4Slice queryExpression)
     :_database(db),
+     _expression(queryExpression),
      _query(db->defaultKeyStore().compileQuery(queryExpression))
     { }
 
     Database* database() const      {return _database;}
     Query* query() const            {return _query.get();}
+    slice expression() const        {return _expression;}
 
 private:
     Retained<Database> _database;
+    alloc_slice _expression;
     unique_ptr<Query> _query;
 };
 
@@ -111,6 +117,7 @@ C4Query* c4query_new(C4Database *database,
                      C4Error *outError) noexcept
 {
     return tryCatch<C4Query*>(outError, [&]{
+        WITH_LOCK(database);
         return new c4Query(database, expression);
     });
 }
@@ -121,16 +128,40 @@ void c4query_free(C4Query *query) noexcept {
 }
 
 
+void c4db_getQueryCacheStats(C4Database *database,
+                             uint64_t *outHits,
+                             uint64_t *outMisses,
+                             size_t *outCount) noexcept
+{
+    WITH_LOCK(database);
+    auto stats = database->dataFile()->queryCacheStats();
+    if (outHits)
+        *outHits = stats.hits;
+    if (outMisses)
+        *outMisses = stats.misses;
+    if (outCount)
+        *outCount = stats.count;
+}
+
+
+void c4db_clearQueryCache(C4Database *database) noexcept {
+    WITH_LOCK(database);
+    database->dataFile()->clearQueryCache();
+}
+
+
 struct C4DBQueryEnumerator : public C4QueryEnumInternal {
     C4DBQueryEnumerator(C4Query *query,
-                        const QueryEnumerator::Options *options)
+                        const QueryEnumerator::Options *options,
+                        Query *runOn =nullptr)
     :C4QueryEnumInternal(
 #if C4DB_THREADSAFE
         query->database()->_mutex
 #endif
     )
     ,_database(query->database())
-    ,_enum(query->query(), options)
+    ,_enum(runOn ? QueryEnumerator(query->query(), runOn, options)
+                 : QueryEnumerator(query->query(), options))
     ,_hasFullText(_enum.hasFullText())
     { }
 
@@ -170,14 +201,29 @@ C4QueryEnumerator* c4query_run(C4Query *query,
                                C4Error *outError) noexcept
 {
     return tryCatch<C4QueryEnumerator*>(outError, [&]{
-        WITH_LOCK(query->database());
         QueryEnumerator::Options qeOpts;
         if (options) {
             qeOpts.skip = options->skip;
             qeOpts.limit = options->limit;
+            qeOpts.streaming = options->streaming;
         }
         qeOpts.paramBindings = encodedParameters;
-        return new C4DBQueryEnumerator(query, &qeOpts);
+
+        if (!qeOpts.streaming) {
+            // Collect the rows on a pooled reader connection if possible, without the db lock.
+            // (A streaming enumerator would tie up the reader until it's closed.)
+            C4DBQueryEnumerator *e = nullptr;
+            auto database = query->database();
+            if (database->withReader([&](DataFile &reader) {
+                    unique_ptr<Query> readerQuery(
+                                    reader.defaultKeyStore().compileQuery(query->expression()));
+                    e = new C4DBQueryEnumerator(query, &qeOpts, readerQuery.get());
+                }))
+                return (C4QueryEnumerator*)e;
+        }
+
+        WITH_LOCK(query->database());
+        return (C4QueryEnumerator*)new C4DBQueryEnumerator(query, &qeOpts);
     });
 }
 
@@ -222,6 +268,87 @@ C4SliceResult c4queryenum_fullTextMatched(C4QueryEnumerator *e,
 }
 
 
+#pragma mark - LIVE QUERIES:
+
+
+struct c4LiveQuery : C4InstanceCounted {
+    c4LiveQuery(C4Query *query, C4Slice encodedParameters)
+    :_database(query->database()),
+     _liveQuery(_database->defaultKeyStore(), _database->sequenceTracker(),
+                query->expression(), encodedParameters)
+    { }
+
+    Retained<Database> _database;
+    LiveQuery _liveQuery;
+    //NOTE: _liveQuery must be destructed before _database, since it uses its SequenceTracker.
+};
+
+
+C4LiveQuery* c4livequery_new(C4Query *query,
+                             C4Slice encodedParameters,
+                             C4Error *outError) noexcept
+{
+    return tryCatch<C4LiveQuery*>(outError, [&]{
+        WITH_LOCK(query->database());
+        return new c4LiveQuery(query, encodedParameters);
+    });
+}
+
+
+bool c4livequery_update(C4LiveQuery *lq,
+                        C4LiveQueryCallback callback,
+                        void *context,
+                        C4Error *outError) noexcept
+{
+    static_assert(kC4LiveQueryRowAdded == (int)LiveQuery::kAdded &&
+                  kC4LiveQueryRowRemoved == (int)LiveQuery::kRemoved &&
+                  kC4LiveQueryRowUpdated == (int)LiveQuery::kUpdated,
+                  "C4LiveQueryChangeType doesn't match LiveQuery::ChangeType");
+    return tryCatch<bool>(outError, [&]{
+        // Copy the changes, so the callback can be called after the database is unlocked:
+        vector<C4LiveQueryChange> c4changes;
+        vector<alloc_slice> buffers;
+        bool changed = false, reset = false;
+        {
+            WITH_LOCK(lq->_database);
+            lq->_liveQuery.update([&](const vector<LiveQuery::Change> &changes, bool r) {
+                changed = true;
+                reset = r;
+                c4changes.reserve(changes.size());
+                buffers.reserve(2 * changes.size());
+                for (auto &change : changes) {
+                    buffers.emplace_back(change.docID);
+                    slice docID = buffers.back();
+                    buffers.emplace_back(change.customColumns);
+                    slice columns = buffers.back();
+                    c4changes.push_back({(C4LiveQueryChangeType)change.type,
+                                         toc4slice(docID),
+                                         change.sequence,
+                                         toc4slice(columns)});
+                }
+            });
+        }
+        if (changed)
+            callback(lq, c4changes.data(), (uint32_t)c4changes.size(), reset, context);
+        return true;
+    });
+}
+
+
+bool c4livequery_isIncremental(C4LiveQuery *lq) noexcept {
+    return lq->_liveQuery.isIncremental();
+}
+
+
+void c4livequery_free(C4LiveQuery *lq) noexcept {
+    if (lq) {
+        Retained<Database> retainDB(lq->_database);     // keep db from being deleted too early
+        WITH_LOCK(retainDB);
+        delete lq;
+    }
+}
+
+
 #pragma mark - INDEXES:
 
 
@@ -85,8 +85,8 @@ extern "C" {
     C4SliceResult c4blob_getContents(C4BlobStore*, C4BlobKey, C4Error*) C4API;
 
     /** Returns the path of the file that stores the blob, if possible. This call may fail with
-        error kC4ErrorWrongFormat if the blob is encrypted (in which case the file would be
-        unreadable by the caller) or with kC4ErrorUnsupported if for some implementation reason
+        error kC4ErrorWrongFormat if the blob is encrypted or compressed (in which case the file
+        would be unreadable by the caller) or with kC4ErrorUnsupported if for some implementation reason
         the blob isn't stored as a standalone file.
         Thus, the caller MUST use this function only as an optimization, and fall back to reading
         the contents via the API if it fails.
@@ -33,6 +33,7 @@ extern "C" {
         kC4DB_AutoCompact   = 4,    ///< Enable auto-compaction
         kC4DB_Bundled       = 8,    ///< Store db & attachments inside a directory
         kC4DB_SharedKeys    = 0x10, ///< Enable shared-keys optimization at creation time
+        kC4DB_GroupCommit   = 0x20, ///< Commit concurrent transactions on this handle together
     };
 
     /** Document versioning system (also determines database storage schema) */
@@ -56,6 +57,60 @@ extern "C" {
     /** Underlying storage engines that can be used. */
     typedef const char* C4StorageEngine;
     CBL_CORE_API extern C4StorageEngine const kC4SQLiteStorageEngine;
+    /** Append-only log-structured storage. Faster writes, but doesn't support queries,
+        indexes or encryption, and a database can only be opened by one process at a time. */
+    CBL_CORE_API extern C4StorageEngine const kC4LogStorageEngine;
+
+    /** Sets of storage tuning settings for C4DatabaseTuning. */
+    typedef C4_ENUM(uint32_t, C4TuningPreset) {
+        kC4TuningDefault,           ///< Balanced settings suitable for most apps
+        kC4TuningMobile,            ///< Small memory footprint, for phones and embedded devices
+        kC4TuningServer,            ///< Large caches and sort threads, for machines with RAM to spare
+        kC4TuningBulkLoad,          ///< Big caches and rare checkpoints, for importing lots of data
+    };
+
+    /** Where SQLite keeps temporary tables and indexes, as used by big sorts. */
+    typedef C4_ENUM(uint32_t, C4TempStore) {
+        kC4TempStoreDefault,        ///< SQLite's compiled-in default
+        kC4TempStoreFile,           ///< In temporary files
+        kC4TempStoreMemory,         ///< In memory
+    };
+
+    /** How document bodies and blobs are compressed. */
+    typedef C4_ENUM(uint32_t, C4Compression) {
+        kC4CompressionNone,         ///< Not compressed (default)
+        kC4CompressionSnappy,       ///< Snappy: fast, with moderate compression
+        kC4CompressionDictionary,   ///< Small bodies use a dictionary trained on the database;
+                                    ///< see c4db_trainCompressionDictionary. Else like Snappy
+    };
+
+    /** Storage performance settings in a C4DatabaseConfig. Settings are taken from the `preset`,
+        except that any nonzero field overrides the preset's value. c4db_open fails with
+        kC4ErrorInvalidParameter if a value is out of range.
+        With `readerConnections` nonzero (at most 64), document reads and non-streaming queries
+        made outside a transaction run on a pool of read-only connections, so they run in
+        parallel with each other and with a writer instead of waiting for the database lock.
+        They see the database as of the last commit.
+        With `maxTrackedChanges` nonzero, database observers that fall further behind than that
+        many changes lose the oldest ones; see c4dbobs_missedChanges.
+        With `compression` set, document bodies and large blobs written from then on are
+        compressed; existing ones stay readable either way, so it can be changed at any time.
+        kC4CompressionDictionary compresses blobs with Snappy.
+        Except for `maxTrackedChanges` and blob compression, these apply only to the SQLite
+        storage engine. */
+    typedef struct C4DatabaseTuning {
+        C4TuningPreset preset;      ///< Base settings
+        int64_t mmapSize;           ///< Bytes of the file to memory-map; -1 to disable mmap
+        int64_t cacheSize;          ///< Bytes of page cache per connection
+        uint32_t pageSize;          ///< Page size of a new database; a power of 2, 512 to 65536
+        uint32_t walAutoCheckpoint; ///< Checkpoint when the WAL grows to this many pages
+        int64_t journalSizeLimit;   ///< Bytes the WAL is truncated to after a checkpoint
+        int32_t workerThreads;      ///< Extra threads SQLite may use for sorting; -1 for none
+        C4TempStore tempStore;      ///< Where to keep temporary tables and indexes
+        uint32_t readerConnections; ///< Extra read-only connections for concurrent reads
+        uint32_t maxTrackedChanges; ///< Most changes kept in memory for observers; 0 for no limit
+        C4Compression compression;  ///< Compression of document bodies and blobs
+    } C4DatabaseTuning;
 
     /** Main database configuration struct. */
     typedef struct C4DatabaseConfig {
@@ -63,6 +118,7 @@ extern "C" {
         C4StorageEngine storageEngine;  ///< Which storage to use, or NULL for no preference
         C4DocumentVersioning versioning;///< Type of document versioning
         C4EncryptionKey encryptionKey;  ///< Encryption to use creating/opening the db
+        C4DatabaseTuning tuning;        ///< Performance settings (all zero for defaults)
     } C4DatabaseConfig;
 
 
@@ -158,6 +214,34 @@ extern "C" {
                        C4Error *outError) C4API;
 
 
+    /** @} */
+    /** \name Bulk loading
+        @{ */
+
+
+    /** Puts the database in bulk-load mode, for importing lots of documents quickly. Until
+        c4db_endBulkLoad is called:
+        * Indexes (including full-text ones) aren't updated as documents are saved; queries
+          still work, but may be slower and full-text queries miss new documents. (Covering
+          indexes' tables are still updated, since queries may be answered from them alone.)
+        * The database is locked exclusively, so no other connection can read or write it.
+          This call fails with kC4ErrorBusy if this process has another connection open.
+        * The rollback journal is kept in memory and commits don't sync to disk.
+        Use a few large transactions rather than many small ones.
+
+        Closing the database ends bulk-load mode, as c4db_endBulkLoad does.
+
+        Crash safety: committed transactions aren't durable until c4db_endBulkLoad returns.
+        If the process crashes during a bulk load, the file may be damaged in ways that can't
+        be detected, so the next c4db_open fails with kC4ErrorCorruptData; the database should
+        be deleted and the import restarted. */
+    bool c4db_beginBulkLoad(C4Database* database, C4Error *outError) C4API;
+
+    /** Ends bulk-load mode: rebuilds the indexes and restores normal journaling and locking.
+        Does nothing if the database isn't in bulk-load mode. */
+    bool c4db_endBulkLoad(C4Database* database, C4Error *outError) C4API;
+
+
     /** @} */
     /** \name Compaction
         @{ */
@@ -166,6 +250,20 @@ extern "C" {
     /** Manually compacts the database. */
     bool c4db_compact(C4Database* database, C4Error *outError) C4API;
 
+    /** Does up to about `maxMillis` of compaction work and returns. The work is done in short
+        transactions, so other connections, and other threads using this one, can keep writing
+        with little added latency. Call it periodically (e.g. from a background timer or idle
+        handler) while c4db_needsCompaction returns true. Unlike c4db_compact, this doesn't
+        delete unreferenced blobs.
+        @return  True if there is more compaction work to do; false when it's finished, or on
+                 error, in which case outError->code is nonzero. */
+    bool c4db_compactIncrementally(C4Database* database, uint32_t maxMillis,
+                                   C4Error *outError) C4API;
+
+    /** Returns true if the database has deleted documents or free space that compaction would
+        reclaim, or an incremental compaction is in progress. */
+    bool c4db_needsCompaction(C4Database* database) C4API;
+
     /** Returns true if the database is compacting.
         If NULL is passed, returns true if _any_ database is compacting. */
     bool c4db_isCompacting(C4Database*) C4API;
@@ -177,6 +275,56 @@ extern "C" {
         careful of thread safety. */
     void c4db_setOnCompactCallback(C4Database *database, C4OnCompactCallback cb, void *context) C4API;
 
+    /** Progress of a compaction. Compacting a bundled database also deletes blobs that are no
+        longer referenced by any document revision. */
+    typedef struct {
+        uint64_t docsScanned;       ///< Documents checked for blob references so far
+        uint64_t blobsDeleted;      ///< Unreferenced blobs deleted so far
+        uint64_t bytesReclaimed;    ///< Total size of the blobs deleted
+    } C4CompactProgress;
+
+    typedef void (*C4OnCompactProgressCallback)(void *context,
+                                                bool compacting,
+                                                C4CompactProgress progress);
+
+    /** Like c4db_setOnCompactCallback, but the callback is also called periodically while
+        compacting, and is given the progress; the final call (with `compacting` false) reports
+        the total blobs deleted and bytes reclaimed.
+        This replaces any callback registered by c4db_setOnCompactCallback, and vice versa. */
+    void c4db_setOnCompactProgressCallback(C4Database *database,
+                                           C4OnCompactProgressCallback cb,
+                                           void *context) C4API;
+
+
+    /** @} */
+    /** \name Compression dictionary
+        @{ */
+
+
+    /** Trains a compression dictionary on a sample of the most recently saved document bodies
+        and saves it in the database; bodies saved from then on are compressed with it. Bodies
+        compressed with earlier dictionaries stay readable. Requires `tuning.compression` to be
+        kC4CompressionDictionary, and must not be called in a transaction.
+        Training takes a while, so call this on a background thread; the database is only
+        locked while the sample is read and while the dictionary is saved.
+        @return  True if a dictionary was saved; false if there's too little data to train on,
+                 or on error, in which case outError->code is nonzero. */
+    bool c4db_trainCompressionDictionary(C4Database* database, C4Error *outError) C4API;
+
+    /** Returns true if this handle has saved enough documents since the dictionary was last
+        trained (or, if there's none yet, since it was opened) that training is worthwhile. */
+    bool c4db_needsDictionaryTraining(C4Database* database) C4API;
+
+    typedef void (*C4OnDictionaryTrainingCallback)(void *context);
+
+    /** Registers a callback to be invoked after a commit makes c4db_needsDictionaryTraining
+        true. It's called once until c4db_trainCompressionDictionary is next called. The
+        database is locked during the callback, so it should only schedule the training on
+        another thread. Pass NULL to unregister. */
+    void c4db_setOnDictionaryTrainingCallback(C4Database *database,
+                                              C4OnDictionaryTrainingCallback cb,
+                                              void *context) C4API;
+
 
     /** @} */
     /** \name Transactions
@@ -190,7 +338,15 @@ extern "C" {
 
     /** Commits or aborts a transaction. If there have been multiple calls to beginTransaction, it
         takes the same number of calls to endTransaction to actually end the transaction; only the
-        last one commits or aborts the database transaction. */
+        last one commits or aborts the database transaction.
+        If the database was opened with kC4DB_GroupCommit, and other threads are waiting to begin
+        transactions on the same handle, the commit may be deferred so their transactions are
+        committed along with it. This call still doesn't return until the changes are durably
+        committed (or fail to be), but the cost of the commit is shared.
+        Until the group commits, c4doc_get, c4doc_getMany, c4doc_getBySequence and non-streaming
+        c4query_run called from threads outside it see only what was committed before it.
+        Document enumerators, change feeds and streaming queries read the main connection, and
+        may see the group's uncommitted changes. */
     bool c4db_endTransaction(C4Database* database,
                              bool commit,
                              C4Error *outError) C4API;
@@ -234,6 +390,15 @@ extern "C" {
                    C4String body,
                    C4Error *outError) C4API;
 
+    /** Writes multiple raw documents to a store, in a single transaction. This is much faster
+        than calling `c4raw_put` for each one. Unlike `c4raw_put` it can't delete documents;
+        NULL meta and body are stored as-is. */
+    bool c4raw_putMany(C4Database* database,
+                       C4String storeName,
+                       const C4RawDocument docs[],
+                       size_t count,
+                       C4Error *outError) C4API;
+
     // Store used for database metadata.
     #define kC4InfoStore C4STR("info")
 
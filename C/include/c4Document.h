@@ -72,6 +72,17 @@ extern "C" {
                           bool mustExist,
                           C4Error *outError) C4API;
 
+    /** Gets multiple documents at once; this is much faster than calling `c4doc_get` on each.
+        On success, each item of `outDocs` is set to the document whose ID is at the same index
+        of `docIDs`. A document that doesn't exist is still returned, without the `kExists`
+        flag (as with `c4doc_get` when `mustExist` is false.) Each document must be freed.
+        On failure, no documents are returned. */
+    bool c4doc_getMany(C4Database *database,
+                       const C4String docIDs[],
+                       size_t count,
+                       C4Document* outDocs[],
+                       C4Error *outError) C4API;
+
     /** Gets a document from the database given its sequence number. */
     C4Document* c4doc_getBySequence(C4Database *database,
                                     C4SequenceNumber,
@@ -146,6 +157,30 @@ extern "C" {
     bool c4doc_selectNextPossibleAncestorOf(C4Document* doc,
                                             C4String revID) C4API;
 
+    /** Checks a batch of revisions at once, and finds possible ancestors of the ones that
+        aren't in the database; this is much faster than calling c4doc_get and
+        c4doc_selectFirstPossibleAncestorOf on each document.
+        For each revision, `outAncestors[i]` is set to null if the revision exists; otherwise to
+        a Fleece-encoded array of up to `maxAncestors` revID strings of revisions that could be
+        its ancestors (an empty array if the document doesn't exist.) The caller must free each
+        result with c4slice_free.
+        Only works with revision trees.
+        @param database  The database.
+        @param numRevs  The number of revisions to look up.
+        @param maxAncestors  The maximum number of ancestors to return for each revision.
+        @param docIDs  The documents' IDs.
+        @param revIDs  The revisions' IDs.
+        @param outAncestors  An array of `numRevs` slices that will be filled in.
+        @param outError  Error information is stored here on failure.
+        @return  True on success, false on failure. */
+    bool c4db_findDocAncestors(C4Database *database,
+                               unsigned numRevs,
+                               unsigned maxAncestors,
+                               const C4String docIDs[],
+                               const C4String revIDs[],
+                               C4SliceResult outAncestors[],
+                               C4Error *outError) C4API;
+
     /** Given a revision ID, returns its generation number (the decimal number before
         the hyphen), or zero if it's unparseable. */
     unsigned c4rev_getGeneration(C4String revID) C4API;
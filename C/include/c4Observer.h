@@ -61,6 +61,12 @@ extern "C" {
                                 uint32_t maxChanges,
                                 bool *outExternal) C4API;
 
+    /** Returns true if some changes were discarded before the observer read them, because the
+        database's `tuning.maxTrackedChanges` limit was reached. The observer carries on with the
+        later changes; to find the missing ones, enumerate changes since the last sequence it
+        read. This resets the flag, so it returns false until more changes are missed. */
+    bool c4dbobs_missedChanges(C4DatabaseObserver *observer) C4API;
+
     /** Stops an observer and frees the resources it's using.
         It is safe to pass NULL to this call. */
     void c4dbobs_free(C4DatabaseObserver*) C4API;
@@ -45,7 +45,8 @@ extern "C" {
 
     /** Returns a string describing the implementation of the compiled query.
         This is intended to be read by a developer for purposes of optimizing the query, especially
-        to add database indexes. */
+        to add database indexes. If the query is answered entirely from a covering index, the
+        last line names that index. */
     C4StringResult c4query_explain(C4Query *query) C4API;
 
 
@@ -57,10 +58,11 @@ extern "C" {
         uint64_t skip;          ///< Number of initial rows to skip
         uint64_t limit;         ///< Max number of rows to return (set to UINT_MAX for unlimited)
         bool rankFullText;      ///< Should full-text results be ranked by relevance?
+        bool streaming;         ///< Read rows lazily instead of collecting them all up front?
     } C4QueryOptions;
 
 
-    /** Default query options. Has skip=0, limit=UINT_MAX, rankFullText=true. */
+    /** Default query options. Has skip=0, limit=UINT_MAX, rankFullText=true, streaming=false. */
 	CBL_CORE_API extern const C4QueryOptions kC4DefaultQueryOptions;
 
 
@@ -95,7 +97,13 @@ extern "C" {
         NOTE: Queries will run much faster if the appropriate properties are indexed.
         Indexes must be created explicitly by calling `c4db_createIndex`.
         @param query  The compiled query to run.
-        @param options  Query options; only `skip` and `limit` are currently recognized.
+        @param options  Query options; only `skip`, `limit` and `streaming` are currently
+                recognized. By default all the rows are collected before this returns. With
+                `streaming` set, rows are instead read as `c4queryenum_next` is called, which
+                lowers the latency to the first row and the memory used by big result sets;
+                the enumerator then sees a snapshot of the database as of this call, and should
+                be closed or freed promptly since it keeps that snapshot alive. Changes made
+                through the same C4Database while it's open may or may not be visible to it.
         @param encodedParameters  Optional JSON object whose keys correspond to the named
                 parameters in the query expression, and values correspond to the values to
                 bind. Any unbound parameters will be `null`.
@@ -137,6 +145,83 @@ extern "C" {
     /** @} */
 
 
+    //////// LIVE QUERIES:
+
+
+    /** \name Live Queries
+     @{ */
+
+
+    /** Opaque handle to a live query. */
+    typedef struct c4LiveQuery C4LiveQuery;
+
+    /** Types of changes to a live query's results. */
+    typedef C4_ENUM(uint8_t, C4LiveQueryChangeType) {
+        kC4LiveQueryRowAdded,       ///< A document now matches the query
+        kC4LiveQueryRowRemoved,     ///< A document no longer matches the query
+        kC4LiveQueryRowUpdated,     ///< A matching document changed
+    };
+
+    /** A change to a live query's results. */
+    typedef struct {
+        C4LiveQueryChangeType type;
+        C4String docID;                 ///< Document ID (null for an aggregate query's rows)
+        C4SequenceNumber docSequence;   ///< Document's current sequence (0 if removed)
+        C4Slice customColumns;          ///< Fleece array of the WHAT columns (null if removed)
+    } C4LiveQueryChange;
+
+    /** Callback that receives the changes found by `c4livequery_update`. The slices in the
+        changes are only valid until the callback returns.
+        @param liveQuery  The live query being updated.
+        @param changes  The changes to the results.
+        @param count  The number of changes.
+        @param reset  If true, the previous results should be discarded; the changes are the
+                    entire new result set, all of type kC4LiveQueryRowAdded.
+        @param context  The value given to `c4livequery_update`. */
+    typedef void (*C4LiveQueryCallback)(C4LiveQuery *liveQuery,
+                                        const C4LiveQueryChange changes[],
+                                        uint32_t count,
+                                        bool reset,
+                                        void *context);
+
+    /** Creates a live query, which keeps a query's results up to date as the database changes.
+        Instead of re-running the query after every change, `c4livequery_update` re-evaluates
+        just the documents that changed, and reports how the results differ.
+        Queries whose rows don't correspond to single documents (aggregates, GROUP_BY, joins or
+        nested SELECTs), and queries with a LIMIT or OFFSET, are re-run in full after each change.
+        The order of the rows (ORDER_BY) is not tracked; nor are `skip` and `limit`.
+        @param query  The compiled query. It doesn't need to outlive the live query.
+        @param encodedParameters  Optional JSON object of values for the query's parameters,
+                    as in `c4query_run`.
+        @param outError  On failure, will be set to the error status.
+        @return  The new live query, or NULL on failure. */
+    C4LiveQuery* c4livequery_new(C4Query *query,
+                                 C4String encodedParameters,
+                                 C4Error *outError) C4API;
+
+    /** Brings a live query's results up to date, and reports any changes to the callback.
+        The callback is called at most once, before this function returns, and without the
+        database locked. The first call runs the entire query and reports it as a reset.
+        Call this after a C4DatabaseObserver notifies you of changes.
+        @param liveQuery  The live query.
+        @param callback  The function to call if there are changes.
+        @param context  An arbitrary value that will be passed to the callback.
+        @param outError  On failure, will be set to the error status.
+        @return  True on success, false on failure. */
+    bool c4livequery_update(C4LiveQuery *liveQuery,
+                            C4LiveQueryCallback callback,
+                            void *context,
+                            C4Error *outError) C4API;
+
+    /** Returns true if the live query is updated incrementally, false if it's re-run. */
+    bool c4livequery_isIncremental(C4LiveQuery *liveQuery) C4API;
+
+    /** Frees a live query. It is legal to pass NULL. */
+    void c4livequery_free(C4LiveQuery *liveQuery) C4API;
+
+    /** @} */
+
+
     //////// INDEXES:
 
 
@@ -166,6 +251,13 @@ extern "C" {
         /** Should diacritical marks (accents) be ignored? Defaults to false.
             Generally this should be left false for non-English text. */
         bool ignoreDiacritics;
+
+        /** Value indexes only: if non-NULL, creates a _covering_ index, which stores the values of
+            the indexed properties, plus any listed in this JSON array (e.g. `[[".name.last"]]`,
+            or `[]` for none), along with each document's ID and metadata. A query that doesn't
+            use any other document properties is then answered from the index alone, without
+            reading document bodies. All the index's expressions must be plain properties. */
+        const char *includedPropertiesJSON;
     } C4IndexOptions;
 
 
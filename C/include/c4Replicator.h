@@ -44,11 +44,23 @@ extern "C" {
         uint64_t    total;
     } C4Progress;
 
+    /** The push flow-control limits, which adapt to the measured latency and throughput of the
+        connection. (All zero if not pushing.) */
+    typedef struct {
+        uint32_t    changesBatchSize;           ///< Max changes sent per 'changes' message
+        uint32_t    maxRevsInFlight;            ///< Max revisions being sent at once
+        uint64_t    maxRevBytesAwaitingReply;   ///< Max bytes of revisions awaiting replies
+        uint32_t    latencyMS;                  ///< Smoothed time for a revision to be acknowledged
+        uint32_t    minLatencyMS;               ///< Lowest recent acknowledgement time
+        uint64_t    bytesPerSec;                ///< Recent throughput of revisions
+    } C4FlowControl;
+
     /** Current status of replication. Passed to callback. */
     typedef struct {
         C4ReplicatorActivityLevel level;
         C4Progress progress;
         C4Error error;
+        C4FlowControl flowControl;
     } C4ReplicatorStatus;
 
 
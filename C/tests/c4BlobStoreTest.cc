@@ -262,3 +262,70 @@ N_WAY_TEST_CASE_METHOD(BlobStoreTest, "write blob and cancel", "[blob][C]") {
 
     c4stream_closeWriter(stream);
 }
+
+
+N_WAY_TEST_CASE_METHOD(C4Test, "compressed blobs", "[blob][C]") {
+    // Reopen the database with compression enabled:
+    auto config = *c4db_getConfig(db);
+    config.tuning.compression = kC4CompressionSnappy;
+    C4Error error;
+    REQUIRE(c4db_close(db, &error));
+    c4db_free(db);
+    db = c4db_open(databasePath(), &config, &error);
+    REQUIRE(db);
+    C4BlobStore *store = c4db_getBlobStore(db, &error);
+    REQUIRE(store);
+
+    string bigBlob, smallBlob = "This blob is too small to be worth compressing.";
+    for (int i = 0; i < 10000; ++i)
+        bigBlob += "This is line " + to_string(i) + " of a big blob.\n";
+    C4BlobKey bigKey, smallKey;
+    REQUIRE(c4blob_create(store, {bigBlob.data(), bigBlob.size()}, &bigKey, &error));
+    REQUIRE(c4blob_create(store, {smallBlob.data(), smallBlob.size()}, &smallKey, &error));
+
+    // The big blob is compressed, so its file can't be read directly:
+    CHECK(c4blob_getSize(store, bigKey) == (int64_t)bigBlob.size());
+    C4SliceResult p = c4blob_getFilePath(store, bigKey, &error);
+    CHECK(p.buf == nullptr);
+    CHECK(error.code == kC4ErrorWrongFormat);
+
+    // The small one isn't:
+    CHECK(c4blob_getSize(store, smallKey) == (int64_t)smallBlob.size());
+    p = c4blob_getFilePath(store, smallKey, &error);
+    CHECK(p.buf != nullptr);
+    c4slice_free(p);
+
+    // Random access to the compressed blob:
+    C4ReadStream *stream = c4blob_openReadStream(store, bigKey, &error);
+    REQUIRE(stream);
+    CHECK(c4stream_getLength(stream, &error) == (int64_t)bigBlob.size());
+    char buf[100];
+    for (uint64_t pos : {(uint64_t)200000, (uint64_t)65500, (uint64_t)0}) {
+        REQUIRE(c4stream_seek(stream, pos, &error));
+        REQUIRE(c4stream_read(stream, buf, sizeof(buf), &error) == sizeof(buf));
+        CHECK(memcmp(buf, &bigBlob[pos], sizeof(buf)) == 0);
+    }
+    c4stream_close(stream);
+
+    // With compression turned off, both are still readable:
+    config.tuning.compression = kC4CompressionNone;
+    REQUIRE(c4db_close(db, &error));
+    c4db_free(db);
+    db = c4db_open(databasePath(), &config, &error);
+    REQUIRE(db);
+    store = c4db_getBlobStore(db, &error);
+    REQUIRE(store);
+    C4SliceResult contents = c4blob_getContents(store, bigKey, &error);
+    CHECK(string((char*)contents.buf, contents.size) == bigBlob);
+    c4slice_free(contents);
+    contents = c4blob_getContents(store, smallKey, &error);
+    CHECK(string((char*)contents.buf, contents.size) == smallBlob);
+    c4slice_free(contents);
+
+    // Storing the big blob again keeps the compressed copy:
+    C4BlobKey key2;
+    REQUIRE(c4blob_create(store, {bigBlob.data(), bigBlob.size()}, &key2, &error));
+    CHECK(memcmp(&key2, &bigKey, sizeof(key2)) == 0);
+    p = c4blob_getFilePath(store, bigKey, &error);
+    CHECK(p.buf == nullptr);
+}
@@ -127,6 +127,118 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database OpenBundle", "[Database][C][!th
     c4log_warnOnErrors(true);
 }
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Tuning", "[Database][C][!throws]") {
+    auto config = *c4db_getConfig(db);
+    std::string pathStr = TempDir() + "cbl_core_test_tuning";
+    C4Slice path = c4str(pathStr.c_str());
+    C4Error error;
+
+    for (C4TuningPreset preset : {kC4TuningMobile, kC4TuningServer, kC4TuningBulkLoad}) {
+        config.tuning = {};
+        config.tuning.preset = preset;
+        if (preset == kC4TuningServer)
+            config.tuning.pageSize = 8192;      // override one of the preset's values
+        if (!c4db_deleteAtPath(path, &config, &error))
+            REQUIRE(error.code == 0);
+        auto tuned = c4db_open(path, &config, &error);
+        REQUIRE(tuned);
+        createRev(tuned, kDocID, kRevID, kBody);
+        CHECK(c4db_getDocumentCount(tuned) == 1);
+        CHECK(c4db_getConfig(tuned)->tuning.preset == preset);
+        REQUIRE(c4db_delete(tuned, &error));
+        c4db_free(tuned);
+    }
+
+    // Invalid values are rejected:
+    c4log_warnOnErrors(false);
+    C4DatabaseTuning badTunings[4] = {};
+    badTunings[0].preset = (C4TuningPreset)99;
+    badTunings[1].pageSize = 1000;
+    badTunings[2].pageSize = 128;
+    badTunings[3].cacheSize = -1;
+    for (auto &bad : badTunings) {
+        config.tuning = bad;
+        CHECK(!c4db_open(path, &config, &error));
+        CHECK(error.domain == LiteCoreDomain);
+        CHECK(error.code == kC4ErrorInvalidParameter);
+    }
+    c4log_warnOnErrors(true);
+}
+
+static std::string orderBody(unsigned num) {
+    char body[200];
+    sprintf(body, "{\"num\":%u,\"status\":\"shipped\",\"notes\":\"Leave the package at the "
+                  "front desk, or with a neighbor if nobody answers.\"}", num);
+    return body;
+}
+
+static void createOrderDocs(C4Database *db, C4Slice revID, unsigned first, unsigned last) {
+    TransactionHelper t(db);
+    char docID[20];
+    for (unsigned i = first; i <= last; i++) {
+        sprintf(docID, "doc-%04u", i);
+        C4Test::createRev(db, c4str(docID), revID, c4str(orderBody(i).c_str()));
+    }
+}
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Compression Dictionary", "[Database][C][!throws]") {
+    C4Error error;
+    c4log_warnOnErrors(false);
+    CHECK(!c4db_trainCompressionDictionary(db, &error));
+    CHECK(error.domain == LiteCoreDomain);
+    CHECK(error.code == kC4ErrorUnsupported);
+    c4log_warnOnErrors(true);
+    CHECK(!c4db_needsDictionaryTraining(db));
+    if (!isSQLite())
+        return;
+
+    auto config = *c4db_getConfig(db);
+    config.tuning.compression = kC4CompressionDictionary;
+    std::string pathStr = TempDir() + "cbl_core_test_dictionary";
+    C4Slice path = c4str(pathStr.c_str());
+    if (!c4db_deleteAtPath(path, &config, &error))
+        REQUIRE(error.code == 0);
+    auto compressed = c4db_open(path, &config, &error);
+    REQUIRE(compressed);
+    int callbacks = 0;
+    c4db_setOnDictionaryTrainingCallback(compressed, [](void *context) {
+        ++*(int*)context;
+    }, &callbacks);
+
+    // Too little data to train on:
+    createOrderDocs(compressed, kRevID, 1, 5);
+    CHECK(!c4db_trainCompressionDictionary(compressed, &error));
+    CHECK(error.code == 0);
+
+    // The callback is called once enough documents have been saved:
+    createOrderDocs(compressed, kRevID, 6, 1005);
+    CHECK(callbacks == 1);
+    CHECK(c4db_needsDictionaryTraining(compressed));
+    createOrderDocs(compressed, kRevID, 1006, 1010);
+    CHECK(callbacks == 1);
+    REQUIRE(c4db_trainCompressionDictionary(compressed, &error));
+    CHECK(!c4db_needsDictionaryTraining(compressed));
+    createOrderDocs(compressed, kRevID, 1011, 1020);
+
+    // Documents compressed with the dictionary are readable without it:
+    REQUIRE(c4db_close(compressed, &error));
+    c4db_free(compressed);
+    config.tuning.compression = kC4CompressionNone;
+    compressed = c4db_open(path, &config, &error);
+    REQUIRE(compressed);
+    for (unsigned i : {1u, 1010u, 1020u}) {
+        char docID[20];
+        sprintf(docID, "doc-%04u", i);
+        C4Document *doc = c4doc_get(compressed, c4str(docID), true, &error);
+        REQUIRE(doc);
+        std::string body = orderBody(i);
+        CHECK(doc->selectedRev.body == c4str(body.c_str()));
+        c4doc_free(doc);
+    }
+    REQUIRE(c4db_delete(compressed, &error));
+    c4db_free(compressed);
+}
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Transaction", "[Database][C]") {
     REQUIRE(c4db_getDocumentCount(db) == (C4SequenceNumber)0);
     REQUIRE(!c4db_isInTransaction(db));
@@ -164,6 +276,25 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database CreateRawDoc", "[Database][C]")
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database PutMany RawDocs", "[Database][C]") {
+    const C4RawDocument docs[3] = {
+        {c4str("key1"), c4str("meta1"), c4str("body1")},
+        {c4str("key2"), c4str("meta2"), c4str("body2")},
+        {c4str("key3"), kC4SliceNull,   c4str("body3")},
+    };
+    C4Error error;
+    REQUIRE(c4raw_putMany(db, c4str("test"), docs, 3, &error));
+
+    for (auto &expected : docs) {
+        C4RawDocument *doc = c4raw_get(db, c4str("test"), expected.key, &error);
+        REQUIRE(doc != nullptr);
+        CHECK(doc->meta == expected.meta);
+        CHECK(doc->body == expected.body);
+        c4raw_free(doc);
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database AllDocs", "[Database][C]") {
     setupAllDocs();
     C4Error error;
@@ -427,3 +558,81 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database BlobStore", "[Database][C]")
     C4BlobStore *blobs = c4db_getBlobStore(db, &err);
     REQUIRE(blobs != nullptr);
 }
+
+
+static void onCompactProgress(void *context, bool compacting, C4CompactProgress progress) {
+    auto result = (C4CompactProgress*)context;
+    if (!compacting)
+        *result = progress;
+}
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Compact Blobs", "[Database][blob][C]")
+{
+    C4Error err;
+    C4BlobStore *blobs = c4db_getBlobStore(db, &err);
+    REQUIRE(blobs != nullptr);
+    C4BlobKey keys[3];
+    for (int i = 0; i < 3; ++i) {
+        char contents[50];
+        sprintf(contents, "This is the contents of blob #%d", i);
+        REQUIRE(c4blob_create(blobs, c4str(contents), &keys[i], &err));
+    }
+
+    // Only blob 0 is referenced by a document:
+    C4SliceResult digest = c4blob_keyToString(keys[0]);
+    std::string json = "{\"_attachments\":{\"a.txt\":{\"digest\":\""
+                     + std::string((const char*)digest.buf, digest.size) + "\"}}}";
+    c4slice_free(digest);
+    {
+        TransactionHelper t(db);
+        C4SliceResult body = c4db_encodeJSON(db, c4str(json.c_str()), &err);
+        REQUIRE(body.buf);
+        createRev(C4STR("doc"), kRevID, {body.buf, body.size}, kRevHasAttachments);
+        c4slice_free(body);
+    }
+
+    // Blobs newer than the start of compaction are never deleted, so wait a moment:
+    sleep(2);
+
+    C4CompactProgress progress = {};
+    c4db_setOnCompactProgressCallback(db, onCompactProgress, &progress);
+    REQUIRE(c4db_compact(db, &err));
+    c4db_setOnCompactProgressCallback(db, nullptr, nullptr);
+    CHECK(progress.docsScanned == 1);
+    CHECK(progress.blobsDeleted == 2);
+    CHECK(progress.bytesReclaimed > 0);
+
+    CHECK(c4blob_getSize(blobs, keys[0]) > 0);
+    CHECK(c4blob_getSize(blobs, keys[1]) < 0);
+    CHECK(c4blob_getSize(blobs, keys[2]) < 0);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Compact Incrementally", "[Database][C]")
+{
+    static const unsigned kNumDocs = 2000;
+    createNumberedDocs(kNumDocs);
+    C4Error err;
+    {
+        TransactionHelper t(db);
+        char docID[20];
+        for (unsigned i = 1; i <= kNumDocs; i += 2) {
+            sprintf(docID, "doc-%03u", i);
+            REQUIRE(c4db_purgeDoc(db, c4str(docID), &err));
+        }
+    }
+    if (isSQLite())
+        CHECK(c4db_needsCompaction(db));
+
+    // Each call does a little work; the database stays usable in between:
+    int calls = 0;
+    while (c4db_compactIncrementally(db, 1, &err)) {
+        ++calls;
+        REQUIRE(calls < 10000);
+        createRev(c4str(("new-" + std::to_string(calls)).c_str()), kRevID, kBody);
+    }
+    REQUIRE(err.code == 0);
+    CHECK(!c4db_needsCompaction(db));
+    CHECK(!c4db_isCompacting(db));
+    CHECK(c4db_getDocumentCount(db) == kNumDocs / 2 + calls);
+}
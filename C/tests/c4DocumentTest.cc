@@ -44,6 +44,65 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document PossibleAncestors", "[Document][C]") {
 }
 
 
+static std::vector<std::string> ancestorsOf(C4SliceResult result) {
+    std::vector<std::string> revIDs;
+    for (Array::iterator i(Value::fromData((FLSlice)result).asArray()); i; ++i)
+        revIDs.push_back(toString(i.value().asString()));
+    c4slice_free(result);
+    return revIDs;
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4Test, "Document FindDocAncestors", "[Document][C]") {
+    if (!isRevTrees()) return;
+
+    createRev(kDocID, kRevID, kBody);
+    createRev(kDocID, kRev2ID, kBody);
+    createRev(kDocID, kRev3ID, kBody);
+
+    const C4String docIDs[6] = {kDocID, kDocID, kDocID, kDocID, C4STR("missing"), kDocID};
+    const C4String revIDs[6] = {kRev3ID, kRevID, C4STR("3-f00f00"), C4STR("1-f00f00"),
+                                kRevID, C4STR("bogus")};
+    C4SliceResult results[6];
+    C4Error error;
+    REQUIRE(c4db_findDocAncestors(db, 6, 10, docIDs, revIDs, results, &error));
+    CHECK(results[0].buf == nullptr);           // current revision
+    CHECK(results[1].buf == nullptr);           // older revision
+    std::string rev1 = toString(kRevID), rev2 = toString(kRev2ID);
+    CHECK(ancestorsOf(results[2]) == (std::vector<std::string>{rev2, rev1}));
+    CHECK(ancestorsOf(results[3]).empty());
+    CHECK(ancestorsOf(results[4]).empty());     // missing doc
+    CHECK(ancestorsOf(results[5]).empty());     // invalid revID
+
+    // Limit the number of ancestors:
+    REQUIRE(c4db_findDocAncestors(db, 1, 1, &docIDs[2], &revIDs[2], results, &error));
+    CHECK(ancestorsOf(results[0]) == (std::vector<std::string>{rev2}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4Test, "Document GetMany", "[Document][C]") {
+    createRev(C4STR("doc1"), kRevID, kBody);
+    createRev(C4STR("doc3"), kRev2ID, kBody);
+
+    const C4Slice docIDs[4] = {C4STR("doc3"), C4STR("doc2"), C4STR("doc1"), C4STR("doc3")};
+    C4Document* docs[4];
+    C4Error error;
+    REQUIRE(c4doc_getMany(db, docIDs, 4, docs, &error));
+    for (int i = 0; i < 4; ++i) {
+        INFO("Checking doc #" << i);
+        REQUIRE(docs[i]);
+        CHECK(docs[i]->docID == docIDs[i]);
+    }
+    CHECK(docs[0]->revID == kRev2ID);
+    CHECK(docs[1]->flags == (C4DocumentFlags)0);
+    CHECK(docs[2]->revID == kRevID);
+    CHECK((docs[2]->flags & kExists) != 0);
+    CHECK(docs[3]->revID == kRev2ID);
+    for (auto doc : docs)
+        c4doc_free(doc);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document CreateVersionedDoc", "[Database][C]") {
     // Try reading doc with mustExist=true, which should fail:
     C4Error error;
@@ -142,3 +142,47 @@ TEST_CASE_METHOD(C4ObserverTest, "Multi-DB Observer", "[Observer][C]") {
     c4db_close(otherdb, NULL);
     c4db_free(otherdb);
 }
+
+
+TEST_CASE_METHOD(C4ObserverTest, "DB Observer MaxTrackedChanges", "[Observer][C]") {
+    // Open another database on the same file, that only keeps 2 changes for observers:
+    auto config = *c4db_getConfig(db);
+    config.tuning.maxTrackedChanges = 2;
+    C4Database* tuned = c4db_open(databasePath(), &config, nullptr);
+    REQUIRE(tuned);
+    dbObserver = c4dbobs_create(tuned, dbObserverCallback, this);
+    {
+        TransactionHelper t(tuned);
+        createRev(tuned, C4STR("A"), C4STR("1-aa"), kBody);
+        createRev(tuned, C4STR("B"), C4STR("1-bb"), kBody);
+        createRev(tuned, C4STR("C"), C4STR("1-cc"), kBody);
+        createRev(tuned, C4STR("D"), C4STR("1-dd"), kBody);
+    }
+
+    C4DatabaseChange changes[10];
+    bool external;
+    CHECK(c4dbobs_missedChanges(dbObserver));
+    CHECK(!c4dbobs_missedChanges(dbObserver));
+    REQUIRE(c4dbobs_getChanges(dbObserver, changes, 10, &external) == 2);
+    CHECK(changes[0].docID == C4STR("C"));
+    CHECK(changes[1].docID == C4STR("D"));
+    CHECK(!external);
+
+    // Changes made by another connection count toward the limit too:
+    {
+        TransactionHelper t(db);
+        createRev(C4STR("e"), C4STR("1-ee"), kBody);
+        createRev(C4STR("f"), C4STR("1-ff"), kBody);
+        createRev(C4STR("g"), C4STR("1-gg"), kBody);
+    }
+    CHECK(c4dbobs_missedChanges(dbObserver));
+    REQUIRE(c4dbobs_getChanges(dbObserver, changes, 10, &external) == 2);
+    CHECK(changes[0].docID == C4STR("f"));
+    CHECK(changes[1].docID == C4STR("g"));
+    CHECK(external);
+
+    c4dbobs_free(dbObserver);
+    dbObserver = nullptr;
+    c4db_close(tuned, NULL);
+    c4db_free(tuned);
+}
@@ -9,6 +9,7 @@
 #include "Fleece.h"     // including this before c4 makes FLSlice and C4Slice compatible
 #include "c4Test.hh"
 #include "c4Document+Fleece.h"
+#include "c4Private.h"
 #include "Base.hh"
 #include "Benchmark.hh"
 #include <fcntl.h>
@@ -19,6 +20,7 @@
 #include <thread>
 #ifndef _MSC_VER
 #include <unistd.h>
+#include <sys/resource.h>
 #endif
 
 using namespace fleece;
@@ -122,6 +124,75 @@ public:
     }
 
 
+    // Runs a query, returning the row count; reports the time taken to get the first row.
+    unsigned queryTimingFirstRow(const char *queryStr, bool streaming) {
+        C4Error error;
+        C4Query *query = c4query_new(db, c4str(queryStr), &error);
+        REQUIRE(query);
+        C4QueryOptions options = kC4DefaultQueryOptions;
+        options.streaming = streaming;
+        Stopwatch st;
+        auto e = c4query_run(query, &options, kC4SliceNull, &error);
+        REQUIRE(e);
+        unsigned n = 0;
+        while (c4queryenum_next(e, &error)) {
+            if (n++ == 0)
+                fprintf(stderr, "    First row after %.3f ms\n", st.elapsed()*1000);
+        }
+        CHECK(error.code == 0);
+        c4queryenum_free(e);
+        c4query_free(query);
+        st.printReport(streaming ? "Streaming query" : "Prerecorded query", n, "row");
+        return n;
+    }
+
+
+    // Returns the peak resident set size of this process in KB, or 0 if unknown.
+    static long peakRSS() {
+#ifndef _MSC_VER
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+            return usage.ru_maxrss / 1024;  // macOS reports bytes, not KB
+#else
+            return usage.ru_maxrss;
+#endif
+        }
+#endif
+        return 0;
+    }
+
+
+    // Returns the user + system CPU time this process has used, in seconds, or 0 if unknown.
+    static double cpuTime() {
+#ifndef _MSC_VER
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+                 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1.0e6;
+#endif
+        return 0;
+    }
+
+
+    void purgeAllDocs() {
+        C4Error error;
+        std::vector<std::string> docIDs;
+        auto e = c4db_enumerateAllDocs(db, kC4SliceNull, kC4SliceNull, nullptr, &error);
+        REQUIRE(e);
+        while (c4enum_next(e, &error)) {
+            C4Document *doc = c4enum_getDocument(e, &error);
+            REQUIRE(doc);
+            docIDs.emplace_back((const char*)doc->docID.buf, doc->docID.size);
+            c4doc_free(doc);
+        }
+        c4enum_free(e);
+        TransactionHelper t(db);
+        for (auto &docID : docIDs)
+            REQUIRE(c4db_purgeDoc(db, c4str(docID.c_str()), &error));
+    }
+
+
     void readRandomDocs(size_t numDocs, size_t numDocsToRead) {
         std::cerr << "Reading " <<numDocsToRead<< " random docs...\n";
         Benchmark b;
@@ -160,6 +231,91 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Performance", "[Perf][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(PerfTest, "Tuning presets", "[Perf][C][.slow]") {
+    auto jsonData = readFile(sFixturesDir + "iTunesMusicLibrary.json");
+    FLError flError;
+    FLSliceResult fleeceData = FLData_ConvertJSON({jsonData.buf, jsonData.size}, &flError);
+    free((void*)jsonData.buf);
+    Array root = FLValue_AsArray(FLValue_FromTrustedData((C4Slice)fleeceData));
+
+    static const char* const kPresetNames[] = {"Default", "Mobile", "Server", "Bulk-load"};
+    for (C4TuningPreset preset : {kC4TuningDefault, kC4TuningMobile,
+                                  kC4TuningServer, kC4TuningBulkLoad}) {
+        // Start over with an empty database using this preset:
+        auto config = *c4db_getConfig(db);
+        config.tuning = {};
+        config.tuning.preset = preset;
+        C4Error error;
+        REQUIRE(c4db_delete(db, &error));
+        c4db_free(db);
+        db = c4db_open(databasePath(), &config, &error);
+        REQUIRE(db);
+
+        fprintf(stderr, "---- %s preset:\n", kPresetNames[preset]);
+        {
+            Stopwatch st;
+            unsigned numDocs = insertDocs(root);
+            CHECK(numDocs == 12189);
+            st.printReport("Writing docs", numDocs, "doc");
+        }
+        {
+            Stopwatch st;
+            auto n = queryWhere("{\"WHERE\": [\">\", [\".Year\"], 0],"
+                                " \"ORDER_BY\": [[\".Artist\"], [\".Album\"], [\".Name\"]]}");
+            st.printReport("Sorted query", n, "row");
+        }
+        reopenDB();
+        {
+            Stopwatch st;
+            unsigned n = 0;
+            C4Error error;
+            auto e = c4db_enumerateAllDocs(db, kC4SliceNull, kC4SliceNull, nullptr, &error);
+            REQUIRE(e);
+            while (c4enum_next(e, &error))
+                ++n;
+            c4enum_free(e);
+            st.printReport("Reading all docs after reopen", n, "doc");
+        }
+    }
+    FLSliceResult_Free(fleeceData);
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Query compile cache", "[Perf][C]") {
+    importJSONLines(sFixturesDir + "names_100.json");
+    const char *queryStr = "{\"WHAT\": [\".name.first\"],"
+                           " \"WHERE\": [\"=\", [\".contact.address.state\"], [\"$\", \"state\"]],"
+                           " \"ORDER_BY\": [[\".name.last\"]]}";
+    const int kIterations = 2000;
+    for (int warm = 0; warm <= 1; ++warm) {
+        c4db_clearQueryCache(db);
+        Benchmark b;
+        for (int i = 0; i < kIterations; ++i) {
+            if (!warm)
+                c4db_clearQueryCache(db);
+            b.start();
+            C4Error error;
+            C4Query *query = c4query_new(db, c4str(queryStr), &error);
+            REQUIRE(query);
+            auto e = c4query_run(query, nullptr, C4STR("{\"state\": \"CA\"}"), &error);
+            REQUIRE(e);
+            unsigned n = 0;
+            while (c4queryenum_next(e, &error))
+                ++n;
+            CHECK(n == 8);
+            c4queryenum_free(e);
+            c4query_free(query);
+            b.stop();
+        }
+        fprintf(stderr, "%s cache: ", (warm ? "Warm" : "Cold"));
+        b.printReport(1, "query");
+    }
+    uint64_t hits, misses;
+    c4db_getQueryCacheStats(db, &hits, &misses, nullptr);
+    CHECK(hits >= kIterations - 1);
+}
+
+
 N_WAY_TEST_CASE_METHOD(PerfTest, "Import names", "[Perf][C][.slow]") {
     // Download https://github.com/arangodb/example-datasets/raw/master/RandomUsers/names_300000.json
     // to C/tests/data/ before running this test.
@@ -189,6 +345,42 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Import names", "[Perf][C][.slow]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(PerfTest, "Import names bulk load", "[Perf][C][.slow]") {
+    // Download https://github.com/arangodb/example-datasets/raw/master/RandomUsers/names_300000.json
+    // to C/tests/data/ before running this test.
+    for (int bulk = 0; bulk <= 1; ++bulk) {
+        // Start over with an empty database that has a value index and a full-text index:
+        auto config = *c4db_getConfig(db);
+        C4Error error;
+        REQUIRE(c4db_delete(db, &error));
+        c4db_free(db);
+        db = c4db_open(databasePath(), &config, &error);
+        REQUIRE(db);
+        REQUIRE(c4db_createIndex(db, C4STR("[[\".contact.address.state\"]]"),
+                                 kC4ValueIndex, nullptr, &error));
+        REQUIRE(c4db_createIndex(db, C4STR("[[\".contact.address.street\"]]"),
+                                 kC4FullTextIndex, nullptr, &error));
+
+        Stopwatch st;
+        if (bulk)
+            REQUIRE(c4db_beginBulkLoad(db, &error));
+        auto numDocs = importJSONLines(sFixturesDir + "names_300000.json", 60.0, false);
+        double importTime = st.elapsed();
+        if (bulk)
+            REQUIRE(c4db_endBulkLoad(db, &error));
+        double totalTime = st.elapsed();
+        fprintf(stderr, "%s: imported %u docs in %.3f sec (%.3f sec to rebuild indexes):"
+                        " %.0f docs/sec\n",
+                (bulk ? "Bulk load" : "Normal   "), numDocs, totalTime,
+                totalTime - importTime, numDocs / totalTime);
+
+        auto n = queryWhere("[\"=\", [\".contact.address.state\"], \"WA\"]");
+        if (numDocs == 300000)
+            CHECK(n == 5053);
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(PerfTest, "Import geoblocks", "[Perf][C][.slow]") {
     // Download https://github.com/arangodb/example-datasets/raw/master/IPRanges/geoblocks.json
     // to C/tests/data/ before running this test.
@@ -212,3 +404,396 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Import Wikipedia", "[Perf][C][.slow]") {
     reopenDB();
     readRandomDocs(numDocs, 100000);
 }
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Query streaming", "[Perf][C][.slow]") {
+    // Download https://github.com/arangodb/example-datasets/raw/master/RandomUsers/names_300000.json
+    // to C/tests/data/ before running this test.
+    auto numDocs = importJSONLines(sFixturesDir + "names_300000.json", 30.0, true);
+    reopenDB();
+
+    // Peak RSS never goes down, so run the streaming query first; any growth seen during the
+    // prerecorded query is then memory that streaming didn't need.
+    const char *queryStr = "[\"SELECT\", {\"WHAT\": [[\".name\"], [\".contact\"]]}]";
+    long rss0 = peakRSS();
+    auto n1 = queryTimingFirstRow(queryStr, true);
+    long rss1 = peakRSS();
+    auto n2 = queryTimingFirstRow(queryStr, false);
+    long rss2 = peakRSS();
+    CHECK(n1 == numDocs);
+    CHECK(n2 == numDocs);
+    fprintf(stderr, "Peak RSS growth: streaming %ld KB, prerecorded %ld KB\n",
+            rss1 - rss0, rss2 - rss1);
+}
+
+
+static void countLiveQueryChanges(C4LiveQuery*, const C4LiveQueryChange[], uint32_t count,
+                                  bool reset, void *context)
+{
+    *(uint32_t*)context += count;
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Live query update", "[Perf][C][.slow]") {
+    // Compares updating a live query after a single-document change with re-running the query.
+    const char *queryStr = "{\"WHAT\": [\".num\"], \"WHERE\": [\"<\", [\".num\"], 1000]}";
+    const int kIterations = 200;
+    C4Error error;
+    REQUIRE(c4db_createIndex(db, C4STR("[[\".num\"]]"), kC4ValueIndex, nullptr, &error));
+
+    // Writes {"num": num} to a doc, as a new revision of whatever is there:
+    auto writeDoc = [&](unsigned docNo, unsigned num) {
+        char docID[20];
+        sprintf(docID, "doc-%07u", docNo);
+        Encoder enc;
+        enc.beginDict();
+        enc.writeKey(FLSTR("num"));
+        enc.writeUInt(num);
+        enc.endDict();
+        FLSliceResult body = enc.finish(nullptr);
+        REQUIRE(body.buf);
+
+        C4Document *curDoc = c4doc_get(db, c4str(docID), false, &error);
+        C4DocPutRequest rq = {};
+        rq.docID = c4str(docID);
+        rq.body = (C4Slice)body;
+        if (curDoc) {
+            rq.history = &curDoc->revID;
+            rq.historyCount = 1;
+        }
+        rq.save = true;
+        C4Document *doc = c4doc_put(db, &rq, nullptr, &error);
+        REQUIRE(doc != nullptr);
+        c4doc_free(doc);
+        c4doc_free(curDoc);
+        FLSliceResult_Free(body);
+    };
+
+    unsigned numDocs = 0;
+    for (unsigned size : {1000, 10000, 100000}) {
+        {
+            TransactionHelper t(db);
+            for (; numDocs < size; ++numDocs)
+                writeDoc(numDocs, numDocs);
+        }
+
+        C4Query *query = c4query_new(db, c4str(queryStr), &error);
+        REQUIRE(query);
+        C4LiveQuery *lq = c4livequery_new(query, kC4SliceNull, &error);
+        REQUIRE(lq);
+        REQUIRE(c4livequery_isIncremental(lq));
+        uint32_t count = 0;
+        REQUIRE(c4livequery_update(lq, countLiveQueryChanges, &count, &error));
+        CHECK(count == 1000);
+
+        Benchmark live, rerun;
+        for (int i = 0; i < kIterations; ++i) {
+            {
+                TransactionHelper t(db);
+                writeDoc(i % 1000, i % 1000);
+            }
+            live.start();
+            count = 0;
+            REQUIRE(c4livequery_update(lq, countLiveQueryChanges, &count, &error));
+            live.stop();
+            CHECK(count == 1);
+
+            rerun.start();
+            auto e = c4query_run(query, nullptr, kC4SliceNull, &error);
+            REQUIRE(e);
+            unsigned n = 0;
+            while (c4queryenum_next(e, &error))
+                ++n;
+            c4queryenum_free(e);
+            rerun.stop();
+            CHECK(n == 1000);
+        }
+        fprintf(stderr, "%u docs, live query update: ", size);
+        live.printReport(1, "update");
+        fprintf(stderr, "%u docs, query re-run:      ", size);
+        rerun.printReport(1, "query");
+
+        c4livequery_free(lq);
+        c4query_free(query);
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Find doc ancestors", "[Perf][C][.slow]") {
+    // Simulates handling a 500-entry 'changes' message: compares looking up each revision with
+    // c4doc_get and the possible-ancestor calls, with one c4db_findDocAncestors call.
+    if (!isRevTrees()) return;
+    const unsigned kNumDocs = 1000000, kBatchSize = 500, kBatches = 100;
+    {
+        TransactionHelper t(db);
+        char docID[20];
+        for (unsigned i = 0; i < kNumDocs; ++i) {
+            sprintf(docID, "doc-%07u", i);
+            createRev(c4str(docID), kRevID, kBody);
+            if (i % 2)
+                createRev(c4str(docID), kRev2ID, kBody);
+        }
+    }
+
+    // Each batch asks about random docs: half for a revision I have, half for a new one:
+    srandom(1234);
+    std::vector<std::string> docIDStrs(kBatchSize);
+    std::vector<C4String> docIDs(kBatchSize), revIDs(kBatchSize);
+    C4Error error;
+    Benchmark perDoc, batched;
+    unsigned missing = 0;
+    for (unsigned b = 0; b < kBatches; ++b) {
+        for (unsigned i = 0; i < kBatchSize; ++i) {
+            char docID[20];
+            unsigned docNo = random() % kNumDocs;
+            sprintf(docID, "doc-%07u", docNo);
+            docIDStrs[i] = docID;
+            docIDs[i] = c4str(docIDStrs[i].c_str());
+            revIDs[i] = (i % 2) ? C4STR("3-f00f00") : (docNo % 2 ? kRev2ID : kRevID);
+        }
+
+        perDoc.start();
+        unsigned perDocMissing = 0;
+        for (unsigned i = 0; i < kBatchSize; ++i) {
+            C4Document *doc = c4doc_get(db, docIDs[i], true, &error);
+            REQUIRE(doc);
+            if (!c4doc_selectRevision(doc, revIDs[i], false, &error)) {
+                ++perDocMissing;
+                unsigned n = 0;
+                if (c4doc_selectFirstPossibleAncestorOf(doc, revIDs[i])) {
+                    do {
+                        ++n;
+                    } while (c4doc_selectNextPossibleAncestorOf(doc, revIDs[i]) && n < 10);
+                }
+            }
+            c4doc_free(doc);
+        }
+        perDoc.stop();
+
+        batched.start();
+        REQUIRE(c4db_findDocAncestors(db, kBatchSize, 10, docIDs.data(), revIDs.data(),
+                                      results.data(), &error));
+        missing = 0;
+        for (auto &result : results) {
+            if (result.buf)
+                ++missing;
+            c4slice_free(result);
+        }
+        batched.stop();
+        CHECK(missing == perDocMissing);
+    }
+    CHECK(missing == kBatchSize / 2);
+    fprintf(stderr, "Per-doc lookup of %u revs:  ", kBatchSize);
+    perDoc.printReport(1, "batch");
+    fprintf(stderr, "Batched lookup of %u revs:  ", kBatchSize);
+    batched.printReport(1, "batch");
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Rev tree reads with large bodies", "[Perf][C][.slow]") {
+    // Looking for a revision other than the current one needs the doc's rev tree. That's stored
+    // apart from the bodies, so compare reading the whole docs with meta-only reads of the same
+    // docs, which decode just the trees.
+    if (!isRevTrees()) return;
+    const unsigned kNumDocs = 10000, kBodySize = 100000, kBatchSize = 500, kBatches = 20;
+    std::string text(kBodySize, 'x');
+    FLEncoder enc = FLEncoder_New();
+    FLEncoder_BeginDict(enc, 1);
+    FLEncoder_WriteKey(enc, FLSTR("text"));
+    FLEncoder_WriteString(enc, {text.data(), text.size()});
+    FLEncoder_EndDict(enc);
+    FLSliceResult body = FLEncoder_Finish(enc, nullptr);
+    FLEncoder_Free(enc);
+    REQUIRE(body.buf);
+    {
+        TransactionHelper t(db);
+        char docID[20];
+        for (unsigned i = 0; i < kNumDocs; ++i) {
+            sprintf(docID, "doc-%07u", i);
+            createRev(c4str(docID), kRevID, {body.buf, body.size});
+            createRev(c4str(docID), kRev2ID, {body.buf, body.size});
+        }
+    }
+    FLSliceResult_Free(body);
+
+    // Each batch asks about random docs: half for an old revision, half for a new one:
+    srandom(1234);
+    std::vector<std::string> docIDStrs(kBatchSize);
+    std::vector<C4String> docIDs(kBatchSize), revIDs(kBatchSize);
+    C4Error error;
+    Benchmark wholeDocs, treesOnly;
+    for (unsigned b = 0; b < kBatches; ++b) {
+        for (unsigned i = 0; i < kBatchSize; ++i) {
+            char docID[20];
+            sprintf(docID, "doc-%07u", (unsigned)(random() % kNumDocs));
+            docIDStrs[i] = docID;
+            docIDs[i] = c4str(docIDStrs[i].c_str());
+            revIDs[i] = (i % 2) ? C4STR("3-f00f00") : kRevID;
+        }
+
+        wholeDocs.start();
+        unsigned found = 0;
+        for (unsigned i = 0; i < kBatchSize; ++i) {
+            C4Document *doc = c4doc_get(db, docIDs[i], true, &error);
+            REQUIRE(doc);
+            if (c4doc_selectRevision(doc, revIDs[i], false, &error))
+                ++found;
+            c4doc_free(doc);
+        }
+        wholeDocs.stop();
+        CHECK(found == kBatchSize / 2);
+
+        treesOnly.start();
+        C4EnumeratorOptions options = kC4DefaultEnumeratorOptions;
+        options.flags &= ~kC4IncludeBodies;
+        C4DocEnumerator *e = c4db_enumerateSomeDocs(db, docIDs.data(), kBatchSize,
+                                                    &options, &error);
+        REQUIRE(e);
+        found = 0;
+        for (unsigned i = 0; c4enum_next(e, &error); ++i) {
+            C4Document *doc = c4enum_getDocument(e, &error);
+            REQUIRE(doc);
+            if (c4doc_selectRevision(doc, revIDs[i], false, &error))
+                ++found;
+            c4doc_free(doc);
+        }
+        c4enum_free(e);
+        treesOnly.stop();
+        CHECK(found == kBatchSize / 2);
+    }
+    fprintf(stderr, "Reading %u whole docs:  ", kBatchSize);
+    wholeDocs.printReport(1, "batch");
+    fprintf(stderr, "Reading %u rev trees:   ", kBatchSize);
+    treesOnly.printReport(1, "batch");
+}
+
+
+static void setObserverFlag(C4DatabaseObserver*, void *context) {
+    *(bool*)context = true;
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Commit latency with observers", "[Perf][C][.slow]") {
+    // Times small transactions while 1, 10 or 100 database observers read every change after
+    // each commit, as replicators and live queries do.
+    const unsigned kCommits = 1000, kDocsPerCommit = 10;
+    unsigned docNo = 0;
+    for (unsigned numObservers : {1, 10, 100}) {
+        std::unique_ptr<bool[]> notified(new bool[numObservers]());
+        std::vector<C4DatabaseObserver*> observers(numObservers);
+        for (unsigned i = 0; i < numObservers; ++i)
+            observers[i] = c4dbobs_create(db, setObserverFlag, &notified[i]);
+
+        Benchmark commits, reads;
+        C4DatabaseChange changes[100];
+        bool external;
+        for (unsigned c = 0; c < kCommits; ++c) {
+            commits.start();
+            {
+                TransactionHelper t(db);
+                for (unsigned d = 0; d < kDocsPerCommit; ++d) {
+                    char docID[20];
+                    sprintf(docID, "doc-%07u", docNo++);
+                    createRev(c4str(docID), kRevID, kBody);
+                }
+            }
+            commits.stop();
+
+            reads.start();
+            for (unsigned i = 0; i < numObservers; ++i) {
+                CHECK(notified[i]);
+                notified[i] = false;
+                uint32_t n = c4dbobs_getChanges(observers[i], changes, 100, &external);
+                CHECK(n == kDocsPerCommit);
+            }
+            reads.stop();
+        }
+        fprintf(stderr, "%3u observers, commit:          ", numObservers);
+        commits.printReport(1, "commit");
+        fprintf(stderr, "%3u observers, reading changes: ", numObservers);
+        reads.printReport(1, "commit");
+
+        for (auto obs : observers)
+            c4dbobs_free(obs);
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Document compression", "[Perf][C][.slow]") {
+    // Compares file size and read/write speed with and without compressing document bodies,
+    // for small docs (names_300000.json) and big, wordy ones (a Wikipedia dump.) See the
+    // "Import names" and "Import Wikipedia" tests for where to get the files.
+    static const char* const kModeNames[] = {"Uncompressed", "Snappy", "Dictionary"};
+    for (const char *dataset : {"names_300000.json", "en-wikipedia-articles-1000-1.json"}) {
+        for (C4Compression mode : {kC4CompressionNone, kC4CompressionSnappy,
+                                   kC4CompressionDictionary}) {
+            // Start over with an empty database:
+            auto config = *c4db_getConfig(db);
+            config.tuning.compression = mode;
+            C4Error error;
+            REQUIRE(c4db_delete(db, &error));
+            c4db_free(db);
+            db = c4db_open(databasePath(), &config, &error);
+            REQUIRE(db);
+
+            fprintf(stderr, "---- %s, %s:\n", dataset, kModeNames[mode]);
+            if (mode == kC4CompressionDictionary) {
+                // Train a dictionary on the data, then start over with it in place:
+                importJSONLines(sFixturesDir + dataset, 30.0, false);
+                Stopwatch st;
+                REQUIRE(c4db_trainCompressionDictionary(db, &error));
+                fprintf(stderr, "    Training the dictionary took %.3f sec\n", st.elapsed());
+                purgeAllDocs();
+                REQUIRE(c4db_compact(db, &error));
+            }
+            double cpu = cpuTime();
+            unsigned numDocs;
+            {
+                Stopwatch st;
+                numDocs = importJSONLines(sFixturesDir + dataset, 30.0, false);
+                st.printReport("Writing docs", numDocs, "doc");
+            }
+            fprintf(stderr, "    Writing took %.3f sec of CPU time\n", cpuTime() - cpu);
+
+            // Reopening checkpoints the WAL, so the file holds all the data:
+            reopenDB();
+            struct stat st;
+            std::string path = std::string((const char*)databasePath().buf,
+                                           databasePath().size) + kPathSeparator + "db.sqlite3";
+            REQUIRE(stat(path.c_str(), &st) == 0);
+            fprintf(stderr, "    File size: %.1f MB (%.0f bytes/doc)\n",
+                    st.st_size / 1.0e6, (double)st.st_size / numDocs);
+
+            cpu = cpuTime();
+            {
+                Stopwatch sw;
+                unsigned n = 0;
+                auto e = c4db_enumerateAllDocs(db, kC4SliceNull, kC4SliceNull, nullptr, &error);
+                REQUIRE(e);
+                while (c4enum_next(e, &error)) {
+                    C4Document *doc = c4enum_getDocument(e, &error);
+                    REQUIRE(doc);
+                    CHECK(doc->selectedRev.body.size > 0);
+                    c4doc_free(doc);
+                    ++n;
+                }
+                c4enum_free(e);
+                CHECK(n == numDocs);
+                sw.printReport("Reading all docs", n, "doc");
+            }
+            fprintf(stderr, "    Reading took %.3f sec of CPU time\n", cpuTime() - cpu);
+
+            // Latency of single reads:
+            readRandomDocs(numDocs, 100000);
+
+            cpu = cpuTime();
+            {
+                Stopwatch sw;
+                // Matches no docs, but has to look inside every body:
+                queryWhere("[\"=\", [\".noSuchProperty\"], 1]");
+                sw.printReport("Full-scan query", numDocs, "doc");
+            }
+            fprintf(stderr, "    Query took %.3f sec of CPU time\n", cpuTime() - cpu);
+        }
+    }
+}
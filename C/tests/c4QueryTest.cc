@@ -8,7 +8,9 @@
 
 #include "c4Test.hh"
 #include "c4Query.h"
+#include "c4Private.h"
 #include <iostream>
+#include <thread>
 
 using namespace std;
 
@@ -48,13 +50,14 @@ public:
     }
 
     std::vector<std::string> run(uint64_t skip =0, uint64_t limit =UINT64_MAX,
-                                 const char *bindings =nullptr)
+                                 const char *bindings =nullptr, bool streaming =false)
     {
         REQUIRE(query);
         std::vector<std::string> docIDs;
         C4QueryOptions options = kC4DefaultQueryOptions;
         options.skip = skip;
         options.limit = limit;
+        options.streaming = streaming;
         C4Error error;
         auto e = c4query_run(query, &options, c4str(bindings), &error);
         INFO("c4query_run got error " << error.domain << "/" << error.code);
@@ -109,6 +112,30 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query bindings", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query streaming", "[Query][C]") {
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+    CHECK(run(0, UINT64_MAX, nullptr, true) == run());
+    CHECK(run(1, 4, nullptr, true) == (vector<string>{"0000015", "0000036", "0000043", "0000053"}));
+    CHECK(run(100, 4, nullptr, true) == (vector<string>{}));
+
+    // Two streaming enumerators on the same query don't interfere with each other:
+    C4QueryOptions options = kC4DefaultQueryOptions;
+    options.streaming = true;
+    C4Error error;
+    auto e1 = c4query_run(query, &options, kC4SliceNull, &error);
+    REQUIRE(e1);
+    auto e2 = c4query_run(query, &options, kC4SliceNull, &error);
+    REQUIRE(e2);
+    REQUIRE(c4queryenum_next(e1, &error));
+    REQUIRE(c4queryenum_next(e2, &error));
+    REQUIRE(c4queryenum_next(e2, &error));
+    CHECK(e1->docID == c4str("0000001"));
+    CHECK(e2->docID == c4str("0000015"));
+    c4queryenum_free(e1);
+    c4queryenum_free(e2);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query ANY", "[Query][C]") {
     compile(json5("['ANY', 'like', ['.', 'likes'], ['=', ['?', 'like'], 'climbing']]"));
     CHECK(run() == (vector<string>{"0000017", "0000021", "0000023", "0000045", "0000060"}));
@@ -129,6 +156,46 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query ANY", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query cache", "[Query][C]") {
+    c4db_clearQueryCache(db);
+    uint64_t hits0, misses0, hits, misses;
+    size_t count;
+    c4db_getQueryCacheStats(db, &hits0, &misses0, &count);
+    CHECK(count == 0);
+
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+    c4db_getQueryCacheStats(db, &hits, &misses, &count);
+    CHECK(hits == hits0);
+    CHECK(misses == misses0 + 1);
+    CHECK(count == 1);
+
+    // The same expression, formatted differently, should hit the cache:
+    C4Error error;
+    C4Query *query2 = c4query_new(db, C4STR("[\"=\",  [\".\", \"contact\", \"address\", \"state\"], \"CA\"]"),
+                                  &error);
+    REQUIRE(query2);
+    c4db_getQueryCacheStats(db, &hits, &misses, &count);
+    CHECK(hits == hits0 + 1);
+    CHECK(misses == misses0 + 1);
+    CHECK(count == 1);
+
+    // Queries compiled from the same expression still work independently:
+    CHECK(run() == (vector<string>{"0000001", "0000015", "0000036", "0000043", "0000053", "0000064", "0000072", "0000073"}));
+    c4query_free(query);
+    query = query2;
+    CHECK(run(1, 8) == (vector<string>{"0000015", "0000036", "0000043", "0000053", "0000064", "0000072", "0000073"}));
+
+    // Creating an index invalidates the cache:
+    REQUIRE(c4db_createIndex(db, C4STR("[[\".contact.address.state\"]]"), kC4ValueIndex, nullptr, &error));
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+    c4db_getQueryCacheStats(db, &hits, &misses, &count);
+    CHECK(hits == hits0 + 1);
+    CHECK(misses == misses0 + 2);
+    CHECK(count == 1);
+    CHECK(run() == (vector<string>{"0000001", "0000015", "0000036", "0000043", "0000053", "0000064", "0000072", "0000073"}));
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query expression index", "[Query][C]") {
     C4Error err;
     REQUIRE(c4db_createIndex(db, c4str(json5("[['length()', ['.name.first']]]").c_str()), kC4ValueIndex, nullptr, &err));
@@ -138,6 +205,201 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query expression index", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query covering index", "[Query][C]") {
+    C4Error err;
+    C4IndexOptions options = {};
+    options.includedPropertiesJSON = "[[\".name.last\"]]";
+    REQUIRE(c4db_createIndex(db, c4str(json5("[['.name.first']]").c_str()), kC4ValueIndex, &options, &err));
+
+    compile(json5("{WHAT: ['.name.first', '.name.last'], \
+                   WHERE: ['>=', ['.name.first'], 'Margaretta'],\
+                ORDER_BY: [['.name.first']]}"));
+    C4SliceResult explanation = c4query_explain(query);
+    string explain((const char*)explanation.buf, explanation.size);
+    c4slice_free(explanation);
+    INFO("Explanation: " << explain);
+    CHECK(explain.find("(covered by index kv_default::[['.name.first']]::covering)") != string::npos);
+    CHECK(explain.find("fl_value") == string::npos);
+
+    auto expected = run();
+    CHECK(expected.size() > 0);
+
+    // Results must stay current as documents change:
+    {
+        TransactionHelper t(db);
+        FLEncoder enc = c4db_createFleeceEncoder(db);
+        FLEncoder_BeginDict(enc, 1);
+        FLEncoder_WriteKey(enc, FLSTR("name"));
+        FLEncoder_BeginDict(enc, 2);
+        FLEncoder_WriteKey(enc, FLSTR("first"));
+        FLEncoder_WriteString(enc, FLSTR("Zelda"));
+        FLEncoder_WriteKey(enc, FLSTR("last"));
+        FLEncoder_WriteString(enc, FLSTR("Zork"));
+        FLEncoder_EndDict(enc);
+        FLEncoder_EndDict(enc);
+        FLSliceResult body = FLEncoder_Finish(enc, nullptr);
+        FLEncoder_Free(enc);
+        createRev(C4STR("zzz"), kRevID, (C4Slice)body);
+        FLSliceResult_Free(body);
+    }
+    auto withNewDoc = run();
+    CHECK(withNewDoc.size() == expected.size() + 1);
+    CHECK(find(withNewDoc.begin(), withNewDoc.end(), "zzz") != withNewDoc.end());
+
+    // A query using other properties can't be covered:
+    compile(json5("{WHAT: ['.name.first', '.gender'], WHERE: ['>=', ['.name.first'], 'Margaretta']}"));
+    explanation = c4query_explain(query);
+    explain = string((const char*)explanation.buf, explanation.size);
+    c4slice_free(explanation);
+    CHECK(explain.find("covered by index") == string::npos);
+    CHECK(run().size() == withNewDoc.size());
+
+    // Re-creating the index without included properties drops the covering table:
+    REQUIRE(c4db_createIndex(db, c4str(json5("[['.name.first']]").c_str()), kC4ValueIndex, nullptr, &err));
+    compile(json5("{WHAT: ['.name.first', '.name.last'], \
+                   WHERE: ['>=', ['.name.first'], 'Margaretta'],\
+                ORDER_BY: [['.name.first']]}"));
+    explanation = c4query_explain(query);
+    explain = string((const char*)explanation.buf, explanation.size);
+    c4slice_free(explanation);
+    CHECK(explain.find("covered by index") == string::npos);
+    CHECK(run() == withNewDoc);
+    REQUIRE(c4db_createIndex(db, c4str(json5("[['.name.first']]").c_str()), kC4ValueIndex, &options, &err));
+
+    // Deleting the index deletes the covering table too:
+    REQUIRE(c4db_deleteIndex(db, c4str(json5("[['.name.first']]").c_str()), kC4ValueIndex, &err));
+    compile(json5("{WHAT: ['.name.first', '.name.last'], \
+                   WHERE: ['>=', ['.name.first'], 'Margaretta'],\
+                ORDER_BY: [['.name.first']]}"));
+    explanation = c4query_explain(query);
+    explain = string((const char*)explanation.buf, explanation.size);
+    c4slice_free(explanation);
+    CHECK(explain.find("covered by index") == string::npos);
+    CHECK(run() == withNewDoc);
+}
+
+
+// Records the changes reported by c4livequery_update as "+docID", "-docID" or "*docID".
+struct LiveQueryResults {
+    vector<string> changes;
+    int calls {0};
+    bool reset {false};
+};
+
+static void liveQueryCallback(C4LiveQuery *lq, const C4LiveQueryChange changes[], uint32_t count,
+                              bool reset, void *context)
+{
+    auto results = (LiveQueryResults*)context;
+    ++results->calls;
+    results->reset = reset;
+    results->changes.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        static const char kPrefix[] = {'+', '-', '*'};
+        results->changes.push_back(kPrefix[changes[i].type] + toString(changes[i].docID));
+    }
+    sort(results->changes.begin(), results->changes.end());
+}
+
+// Encodes a person document like those in names_100.json (with fewer properties.)
+static FLSliceResult encodePerson(C4Database *db, FLSlice first, FLSlice state) {
+    FLEncoder enc = c4db_createFleeceEncoder(db);
+    FLEncoder_BeginDict(enc, 2);
+    FLEncoder_WriteKey(enc, FLSTR("name"));
+    FLEncoder_BeginDict(enc, 1);
+    FLEncoder_WriteKey(enc, FLSTR("first"));
+    FLEncoder_WriteString(enc, first);
+    FLEncoder_EndDict(enc);
+    FLEncoder_WriteKey(enc, FLSTR("contact"));
+    FLEncoder_BeginDict(enc, 1);
+    FLEncoder_WriteKey(enc, FLSTR("address"));
+    FLEncoder_BeginDict(enc, 1);
+    FLEncoder_WriteKey(enc, FLSTR("state"));
+    FLEncoder_WriteString(enc, state);
+    FLEncoder_EndDict(enc);
+    FLEncoder_EndDict(enc);
+    FLEncoder_EndDict(enc);
+    FLSliceResult body = FLEncoder_Finish(enc, nullptr);
+    FLEncoder_Free(enc);
+    REQUIRE(body.buf);
+    return body;
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Live query", "[Query][C]") {
+    compile(json5("{WHAT: ['.name.first'], WHERE: ['=', ['.contact.address.state'], ['$STATE']]}"));
+    C4Error error;
+    C4LiveQuery *lq = c4livequery_new(query, C4STR("{\"STATE\": \"CA\"}"), &error);
+    REQUIRE(lq);
+    CHECK(c4livequery_isIncremental(lq));
+
+    // The first update reports the entire result set:
+    LiveQueryResults results;
+    REQUIRE(c4livequery_update(lq, liveQueryCallback, &results, &error));
+    CHECK(results.calls == 1);
+    CHECK(results.reset);
+    CHECK(results.changes == (vector<string>{"+0000001", "+0000015", "+0000036", "+0000043",
+                                             "+0000053", "+0000064", "+0000072", "+0000073"}));
+
+    // Nothing changed, so the callback isn't called:
+    REQUIRE(c4livequery_update(lq, liveQueryCallback, &results, &error));
+    CHECK(results.calls == 1);
+
+    {
+        TransactionHelper t(db);
+        FLSliceResult body = encodePerson(db, FLSTR("Zelda"), FLSTR("CA"));     // new matching doc
+        createRev(C4STR("zzz"), kRevID, (C4Slice)body);
+        FLSliceResult_Free(body);
+        body = encodePerson(db, FLSTR("Moved"), FLSTR("WA"));            // no longer matches
+        createRev(C4STR("0000001"), kRev2ID, (C4Slice)body);
+        FLSliceResult_Free(body);
+        body = encodePerson(db, FLSTR("Changed"), FLSTR("CA"));          // still matches
+        createRev(C4STR("0000015"), kRev2ID, (C4Slice)body);
+        FLSliceResult_Free(body);
+        body = encodePerson(db, FLSTR("Other"), FLSTR("NY"));            // never matched
+        createRev(C4STR("0000002"), kRev2ID, (C4Slice)body);
+        FLSliceResult_Free(body);
+    }
+    REQUIRE(c4livequery_update(lq, liveQueryCallback, &results, &error));
+    CHECK(results.calls == 2);
+    CHECK(!results.reset);
+    CHECK(results.changes == (vector<string>{"*0000015", "+zzz", "-0000001"}));
+    c4livequery_free(lq);
+
+    // An aggregate query has to be re-run, and reports a reset:
+    compile(json5("{WHAT: [['count()', ['.name.first']]], WHERE: ['=', ['.contact.address.state'], 'CA']}"));
+    lq = c4livequery_new(query, kC4SliceNull, &error);
+    REQUIRE(lq);
+    CHECK(!c4livequery_isIncremental(lq));
+    results = {};
+    REQUIRE(c4livequery_update(lq, liveQueryCallback, &results, &error));
+    CHECK(results.calls == 1);
+    CHECK(results.reset);
+    CHECK(results.changes.size() == 1);
+    {
+        TransactionHelper t(db);
+        FLSliceResult body = encodePerson(db, FLSTR("Yolanda"), FLSTR("CA"));
+        createRev(C4STR("yyy"), kRevID, (C4Slice)body);
+        FLSliceResult_Free(body);
+    }
+    REQUIRE(c4livequery_update(lq, liveQueryCallback, &results, &error));
+    CHECK(results.calls == 2);
+    CHECK(results.reset);
+    c4livequery_free(lq);
+
+    // So does a query with a LIMIT or OFFSET, since a change can shift rows across the window:
+    compile(json5("{WHAT: [['.name.first']], WHERE: ['=', ['.contact.address.state'], 'CA'], LIMIT: 3}"));
+    lq = c4livequery_new(query, kC4SliceNull, &error);
+    REQUIRE(lq);
+    CHECK(!c4livequery_isIncremental(lq));
+    c4livequery_free(lq);
+    compile(json5("{WHAT: [['.name.first']], WHERE: ['=', ['.contact.address.state'], 'CA'], OFFSET: 1}"));
+    lq = c4livequery_new(query, kC4SliceNull, &error);
+    REQUIRE(lq);
+    CHECK(!c4livequery_isIncremental(lq));
+    c4livequery_free(lq);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "Delete indexed doc", "[Query][C]") {
     // Create the same index as the above test:
     C4Error err;
@@ -178,6 +440,173 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "Full-text query", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "Bulk load", "[Query][C]") {
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, nullptr, &err));
+    REQUIRE(c4db_createIndex(db, c4str(json5("[['length()', ['.name.first']]]").c_str()), kC4ValueIndex, nullptr, &err));
+    C4IndexOptions options = {};
+    options.includedPropertiesJSON = "[[\".name.last\"]]";
+    REQUIRE(c4db_createIndex(db, c4str(json5("[['.name.first']]").c_str()), kC4ValueIndex, &options, &err));
+    const char *coveredQuery = "{WHAT: ['.name.first', '.name.last'], \
+                                 WHERE: ['<', ['.name.first'], 'B'],\
+                              ORDER_BY: [['.name.first']]}";
+    compile(json5(coveredQuery));
+    auto before = run();
+
+    REQUIRE(c4db_beginBulkLoad(db, &err));
+    {
+        // Add a doc and purge one, while the indexes aren't being maintained:
+        TransactionHelper t(db);
+        C4SliceResult body = c4db_encodeJSON(db, c4str(json5("{name: {first: 'Aardvark', last: 'Zork'},"
+                                                             " contact: {address: {street: '1 Hwy'}}}").c_str()), &err);
+        REQUIRE(body.buf);
+        createRev(C4STR("bulk"), kRevID, {body.buf, body.size});
+        c4slice_free(body);
+        REQUIRE(c4db_purgeDoc(db, C4STR("0000013"), &err));
+    }
+
+    // Covering indexes are still kept up to date, so queries using them see the changes,
+    // whether compiled before the bulk load or during it:
+    auto during = run();
+    REQUIRE(during.size() == before.size() + 1 - count(before.begin(), before.end(), "0000013"));
+    CHECK(during[0] == "bulk");
+    compile(json5(coveredQuery));
+    CHECK(run() == during);
+    REQUIRE(c4db_endBulkLoad(db, &err));
+    CHECK(run() == during);
+
+    compile(json5("['MATCH', ['.', 'contact', 'address', 'street'], 'Hwy']"));
+    CHECK(run(0, UINT64_MAX) == (vector<string>{"0000015", "0000043", "0000044", "0000052", "bulk"}));
+    compile(json5("['=', ['length()', ['.name.first']], 9]"));
+    CHECK(run(0, UINT64_MAX) == (vector<string>{ "0000015", "0000099" }));
+
+    compile(json5("{WHAT: ['.name.first', '.name.last'], \
+                   WHERE: ['<', ['.name.first'], 'B'],\
+                ORDER_BY: [['.name.first']]}"));
+    C4SliceResult explanation = c4query_explain(query);
+    string explain((const char*)explanation.buf, explanation.size);
+    c4slice_free(explanation);
+    INFO("Explanation: " << explain);
+    CHECK(explain.find("(covered by index kv_default::[['.name.first']]::covering)") != string::npos);
+    auto results = run();
+    REQUIRE(!results.empty());
+    CHECK(results[0] == "bulk");
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "Bulk load with index changes", "[Query][C]") {
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, nullptr, &err));
+    REQUIRE(c4db_createIndex(db, c4str(json5("[['length()', ['.name.first']]]").c_str()), kC4ValueIndex, nullptr, &err));
+    C4IndexOptions options = {};
+    options.includedPropertiesJSON = "[[\".name.last\"]]";
+    REQUIRE(c4db_createIndex(db, c4str(json5("[['.name.first']]").c_str()), kC4ValueIndex, &options, &err));
+
+    // Indexes deleted during a bulk load aren't restored at the end of it:
+    REQUIRE(c4db_beginBulkLoad(db, &err));
+    REQUIRE(c4db_deleteIndex(db, C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, &err));
+    REQUIRE(c4db_deleteIndex(db, c4str(json5("[['length()', ['.name.first']]]").c_str()), kC4ValueIndex, &err));
+    REQUIRE(c4db_deleteIndex(db, c4str(json5("[['.name.first']]").c_str()), kC4ValueIndex, &err));
+    REQUIRE(c4db_endBulkLoad(db, &err));
+
+    compile(json5("['=', ['length()', ['.name.first']], 9]"));
+    C4SliceResult explanation = c4query_explain(query);
+    string explain((const char*)explanation.buf, explanation.size);
+    c4slice_free(explanation);
+    INFO("Explanation: " << explain);
+    CHECK(explain.find("kv_default::[['length()'") == string::npos);
+    CHECK(run(0, UINT64_MAX) == (vector<string>{ "0000015", "0000099" }));
+
+    compile(json5("{WHAT: ['.name.first', '.name.last'], WHERE: ['<', ['.name.first'], 'B']}"));
+    explanation = c4query_explain(query);
+    explain = string((const char*)explanation.buf, explanation.size);
+    c4slice_free(explanation);
+    CHECK(explain.find("covered by index") == string::npos);
+
+    // Closing the database finishes a bulk load, so it can be reopened:
+    REQUIRE(c4db_beginBulkLoad(db, &err));
+    {
+        TransactionHelper t(db);
+        C4SliceResult body = c4db_encodeJSON(db, C4STR("{\"name\":{\"first\":\"Aardvark\"}}"), &err);
+        REQUIRE(body.buf);
+        createRev(C4STR("bulk"), kRevID, {body.buf, body.size});
+        c4slice_free(body);
+    }
+    c4query_free(query);
+    query = nullptr;
+    reopenDB();
+    compile(json5("['=', ['.name.first'], 'Aardvark']"));
+    CHECK(run(0, UINT64_MAX) == (vector<string>{"bulk"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query reader pool", "[Query][C]") {
+    if (!isRevTrees()) return;      // Version-vector docs aren't read through the pool
+    C4Error error;
+    C4DatabaseConfig config = *c4db_getConfig(db);
+    config.tuning.readerConnections = 2;
+    REQUIRE(c4db_close(db, &error));
+    c4db_free(db);
+    db = c4db_open(databasePath(), &config, &error);
+    REQUIRE(db);
+
+    const vector<string> expected = {"0000001", "0000015", "0000036", "0000043", "0000053", "0000064", "0000072", "0000073"};
+    vector<string> purged = expected;
+    purged.erase(purged.begin() + 1);
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+    CHECK(run() == expected);
+    CHECK(run(1, 4) == (vector<string>{"0000015", "0000036", "0000043", "0000053"}));
+
+    // Reads on another thread (which isn't in the transaction) use the readers, so they don't see
+    // uncommitted changes. (Catch isn't thread-safe, so check the results on this thread.)
+    bool otherFoundDoc = false;
+    vector<string> otherResults;
+    auto readOnOtherThread = [&]{
+        thread other([&]{
+            C4Error err;
+            C4Document *doc = c4doc_get(db, C4STR("0000015"), true, &err);
+            otherFoundDoc = (doc != nullptr);
+            c4doc_free(doc);
+            otherResults.clear();
+            auto e = c4query_run(query, &kC4DefaultQueryOptions, kC4SliceNull, &err);
+            if (e) {
+                while (c4queryenum_next(e, &err))
+                    otherResults.emplace_back((const char*)e->docID.buf, e->docID.size);
+                c4queryenum_free(e);
+            }
+        });
+        other.join();
+    };
+
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, C4STR("0000015"), &error));
+        // This thread is in the transaction, so it sees its own change:
+        CHECK(c4doc_get(db, C4STR("0000015"), true, &error) == nullptr);
+        CHECK(run() == purged);
+
+        readOnOtherThread();
+        CHECK(otherFoundDoc);
+        CHECK(otherResults == expected);
+    }
+
+    // After the commit, everyone sees it:
+    CHECK(c4doc_get(db, C4STR("0000015"), true, &error) == nullptr);
+    CHECK(run() == purged);
+    readOnOtherThread();
+    CHECK(!otherFoundDoc);
+    CHECK(otherResults == purged);
+
+    C4Slice docIDs[2] = {C4STR("0000001"), C4STR("0000015")};
+    C4Document* docs[2];
+    REQUIRE(c4doc_getMany(db, docIDs, 2, docs, &error));
+    CHECK((docs[0]->flags & kExists) != 0);
+    CHECK((docs[1]->flags & kExists) == 0);
+    c4doc_free(docs[0]);
+    c4doc_free(docs[1]);
+}
+
+
 static string getColumn(C4SliceResult customColumns, unsigned i) {
     REQUIRE(customColumns.buf);
     Array colsArray = Value::fromData((FLSlice)customColumns).asArray();
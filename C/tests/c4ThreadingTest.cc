@@ -9,7 +9,9 @@
 #include "c4Test.hh"
 #include "c4Observer.h"
 #include "c4DocEnumerator.h"
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <iostream>
@@ -151,7 +153,48 @@ public:
         c4dbobs_free(observer);
         closeDB(database);
     }
-    
+
+
+    // Has `numThreads` threads save docs on `database`, each in its own transaction; every
+    // `abortEvery`th transaction of each thread is aborted. Returns the latencies (in seconds)
+    // of the committed transactions.
+    vector<double> writeConcurrently(C4Database *database, int numThreads, int docsPerThread,
+                                     int abortEvery =0, const char *prefix ="doc")
+    {
+        vector<vector<double>> latencies(numThreads);
+        vector<thread> threads;
+        for (int t = 0; t < numThreads; ++t) {
+            threads.emplace_back([=, &latencies]{
+                for (int i = 0; i < docsPerThread; ++i) {
+                    bool abort = (abortEvery > 0 && i % abortEvery == abortEvery - 1);
+                    char docID[30];
+                    sprintf(docID, "%s%s-%02d-%05d", (abort ? "aborted-" : ""), prefix, t, i);
+                    auto start = chrono::steady_clock::now();
+                    C4Error error;
+                    REQUIRE(c4db_beginTransaction(database, &error));
+                    C4DocPutRequest rq = {};
+                    rq.docID = c4str(docID);
+                    rq.body = kBody;
+                    rq.save = true;
+                    C4Document *doc = c4doc_put(database, &rq, nullptr, &error);
+                    REQUIRE(doc);
+                    c4doc_free(doc);
+                    REQUIRE(c4db_endTransaction(database, !abort, &error));
+                    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+                    if (!abort)
+                        latencies[t].push_back(elapsed.count());
+                }
+            });
+        }
+        for (auto &t : threads)
+            t.join();
+
+        vector<double> all;
+        for (auto &l : latencies)
+            all.insert(all.end(), l.begin(), l.end());
+        return all;
+    }
+
 };
 
 
@@ -165,3 +208,236 @@ N_WAY_TEST_CASE_METHOD(C4ThreadingTest, "Threading CreateVsEnumerate", "[Threadi
     thread4.join();
     std::cerr << "Threading test done!\n";
 }
+
+
+N_WAY_TEST_CASE_METHOD(C4ThreadingTest, "Threading group commit", "[Threading][C]") {
+    static const int kThreads = 8, kDocsPerThread = 100, kAbortEvery = 5;
+    C4DatabaseConfig config = *c4db_getConfig(db);
+    config.flags |= kC4DB_GroupCommit;
+    C4Database *database = c4db_open(databasePath(), &config, nullptr);
+    REQUIRE(database);
+
+    // Another connection observes the committed changes:
+    C4Database *otherDB = openDB();
+    auto observer = c4dbobs_create(otherDB, [](C4DatabaseObserver*, void*) { }, nullptr);
+
+    auto latencies = writeConcurrently(database, kThreads, kDocsPerThread, kAbortEvery);
+    const int kCommitted = kThreads * (kDocsPerThread - kDocsPerThread / kAbortEvery);
+    CHECK((int)latencies.size() == kCommitted);
+    CHECK(c4db_getDocumentCount(database) == kCommitted);
+    CHECK(c4db_getDocumentCount(otherDB) == kCommitted);
+
+    // The observer sees every committed doc, and none of the aborted ones:
+    int observed = 0;
+    C4DatabaseChange changes[100];
+    uint32_t n;
+    bool external;
+    while (0 < (n = c4dbobs_getChanges(observer, changes, 100, &external))) {
+        CHECK(external);
+        for (uint32_t i = 0; i < n; ++i)
+            CHECK(memcmp(changes[i].docID.buf, "doc-", 4) == 0);
+        observed += n;
+    }
+    CHECK(observed == kCommitted);
+
+    c4dbobs_free(observer);
+    closeDB(otherDB);
+    closeDB(database);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4ThreadingTest, "Threading group commit isolation", "[Threading][C]") {
+    if (!isRevTrees())
+        return;     // version-vector docs are always read on the main connection
+    C4DatabaseConfig config = *c4db_getConfig(db);
+    config.flags |= kC4DB_GroupCommit;
+    C4Database *database = c4db_open(databasePath(), &config, nullptr);
+    REQUIRE(database);
+
+    // Each writer thread saves a doc, then waits for the main thread before ending its
+    // transaction. The main thread advances `stage`; the writers report back through `done`.
+    mutex m;
+    condition_variable cond;
+    int stage = 0, done = 0;
+    auto waitFor = [&](int &var, int value) {
+        unique_lock<mutex> lock(m);
+        cond.wait(lock, [&]{return var >= value;});
+    };
+    auto setValue = [&](int &var, int value) {
+        { lock_guard<mutex> lock(m); var = value; }
+        cond.notify_all();
+    };
+    auto isVisible = [&](const char *docID) {
+        C4Error error;
+        C4Document *doc = c4doc_get(database, c4str(docID), true, &error);
+        c4doc_free(doc);
+        return doc != nullptr;
+    };
+    auto writer = [&](const char *docID, int n) {
+        C4Error error;
+        REQUIRE(c4db_beginTransaction(database, &error));
+        C4DocPutRequest rq = {};
+        rq.docID = c4str(docID);
+        rq.body = kBody;
+        rq.save = true;
+        C4Document *doc = c4doc_put(database, &rq, nullptr, &error);
+        REQUIRE(doc);
+        c4doc_free(doc);
+        setValue(done, n);
+        waitFor(stage, n);
+        REQUIRE(c4db_endTransaction(database, true, &error));
+    };
+
+    thread t1(writer, "a", 1);
+    waitFor(done, 1);
+    thread t2(writer, "b", 2);
+    this_thread::sleep_for(chrono::milliseconds(200));     // let t2 block in beginTransaction
+    CHECK(!isVisible("a"));
+
+    // t1's commit is deferred so t2 can join it; neither doc is committed yet:
+    setValue(stage, 1);
+    waitFor(done, 2);
+    CHECK(!isVisible("a"));
+    CHECK(!isVisible("b"));
+
+    // t2 ends the group, committing both:
+    setValue(stage, 2);
+    t1.join();
+    t2.join();
+    CHECK(isVisible("a"));
+    CHECK(isVisible("b"));
+    closeDB(database);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4ThreadingTest, "Threading group commit benchmark", "[Threading][Perf][C][.slow]") {
+    static const int kTransactions = 2000;
+    for (int grouped = 0; grouped <= 1; ++grouped) {
+        for (int numThreads : {1, 2, 4, 8, 16, 32}) {
+            C4DatabaseConfig config = *c4db_getConfig(db);
+            if (grouped)
+                config.flags |= kC4DB_GroupCommit;
+            C4Database *database = c4db_open(databasePath(), &config, nullptr);
+            REQUIRE(database);
+
+            auto start = chrono::steady_clock::now();
+            char prefix[20];
+            sprintf(prefix, "%s%02d", (grouped ? "group" : "normal"), numThreads);
+            auto latencies = writeConcurrently(database, numThreads, kTransactions / numThreads,
+                                               0, prefix);
+            chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+            closeDB(database);
+
+            sort(latencies.begin(), latencies.end());
+            double p99 = latencies[min(latencies.size() - 1, latencies.size() * 99 / 100)];
+            fprintf(stderr, "%s, %2d threads: %8.0f commits/sec, p99 latency %7.3f ms\n",
+                    (grouped ? "Group commit" : "Normal      "), numThreads,
+                    latencies.size() / elapsed.count(), p99 * 1000.0);
+        }
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4ThreadingTest, "Threading compaction writer latency", "[Threading][Perf][C][.slow]") {
+    static const unsigned kDocs = 100000;
+    static const int kTransactions = 2000;
+    for (int compacting = 0; compacting <= 1; ++compacting) {
+        // Create a lot of docs and purge most of them, so compaction has real work to do:
+        C4Error error;
+        {
+            TransactionHelper t(db);
+            char docID[30];
+            for (unsigned i = 0; i < kDocs; ++i) {
+                sprintf(docID, "junk%d-%06u", compacting, i);
+                C4DocPutRequest rq = {};
+                rq.docID = c4str(docID);
+                rq.body = kBody;
+                rq.save = true;
+                C4Document *doc = c4doc_put(db, &rq, nullptr, &error);
+                REQUIRE(doc);
+                c4doc_free(doc);
+            }
+            for (unsigned i = 0; i < kDocs; ++i) {
+                if (i % 10 != 0) {
+                    sprintf(docID, "junk%d-%06u", compacting, i);
+                    REQUIRE(c4db_purgeDoc(db, c4str(docID), &error));
+                }
+            }
+        }
+
+        // Compact on another connection while writing:
+        C4Database *compactDB = openDB();
+        thread compactor;
+        chrono::duration<double> compactTime {0};
+        if (compacting) {
+            compactor = thread([&]{
+                auto start = chrono::steady_clock::now();
+                C4Error err;
+                REQUIRE(c4db_compact(compactDB, &err));
+                compactTime = chrono::steady_clock::now() - start;
+            });
+        }
+        auto latencies = writeConcurrently(db, 1, kTransactions, 0,
+                                           (compacting ? "compacting" : "idle"));
+        if (compacting)
+            compactor.join();
+        closeDB(compactDB);
+
+        sort(latencies.begin(), latencies.end());
+        auto percentile = [&](int p) {
+            return latencies[min(latencies.size() - 1, latencies.size() * p / 100)] * 1000.0;
+        };
+        fprintf(stderr, "%s: write latency p50 %7.3f ms, p99 %7.3f ms, max %7.3f ms",
+                (compacting ? "During compaction" : "No compaction    "),
+                percentile(50), percentile(99), latencies.back() * 1000.0);
+        if (compacting)
+            fprintf(stderr, " (compaction took %.3f sec)", compactTime.count());
+        fprintf(stderr, "\n");
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4ThreadingTest, "Threading concurrent reads", "[Threading][Perf][C][.slow]") {
+    static const int kDocs = 10000, kReads = 200000;
+    {
+        TransactionHelper t(db);
+        char docID[20];
+        for (int i = 0; i < kDocs; ++i) {
+            sprintf(docID, "doc-%05d", i);
+            createRev(c4str(docID), kRevID, kBody);
+        }
+    }
+
+    for (uint32_t readers : {0u, 8u}) {
+        C4DatabaseConfig config = *c4db_getConfig(db);
+        config.tuning.readerConnections = readers;
+        C4Database *database = c4db_open(databasePath(), &config, nullptr);
+        REQUIRE(database);
+        for (int numThreads : {1, 2, 4, 8, 16}) {
+            atomic<int> failures {0};
+            auto start = chrono::steady_clock::now();
+            vector<thread> threads;
+            for (int t = 0; t < numThreads; ++t) {
+                threads.emplace_back([&, t]{
+                    char docID[20];
+                    unsigned n = t;
+                    for (int i = 0; i < kReads / numThreads; ++i) {
+                        n = n * 1103515245 + 12345;
+                        sprintf(docID, "doc-%05u", (n >> 8) % kDocs);
+                        C4Document *doc = c4doc_get(database, c4str(docID), true, nullptr);
+                        if (!doc)
+                            ++failures;
+                        c4doc_free(doc);
+                    }
+                });
+            }
+            for (auto &th : threads)
+                th.join();
+            chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+            CHECK(failures == 0);
+            fprintf(stderr, "%u readers, %2d threads: %9.0f reads/sec\n",
+                    readers, numThreads, kReads / elapsed.count());
+        }
+        closeDB(database);
+    }
+}
@@ -140,4 +140,20 @@ namespace LiteCore.Interop
     public
 #endif
          unsafe delegate void C4OnCompactCallback(void* context, [MarshalAs(UnmanagedType.U1)]bool compacting);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+         unsafe delegate void C4OnCompactProgressCallback(void* context, [MarshalAs(UnmanagedType.U1)]bool compacting, C4CompactProgress progress);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+         unsafe delegate void C4OnDictionaryTrainingCallback(void* context);
 }
@@ -41,6 +41,7 @@ namespace LiteCore.Interop
         AutoCompact   = 4,
         Bundled       = 8,
         SharedKeys    = 0x10,
+        GroupCommit   = 0x20,
     }
 
 #if LITECORE_PACKAGED
@@ -65,6 +66,63 @@ namespace LiteCore.Interop
         VersionVectors,
     }
 
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    enum C4TuningPreset : uint
+    {
+        Default,
+        Mobile,
+        Server,
+        BulkLoad,
+    }
+
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    enum C4TempStore : uint
+    {
+        Default,
+        File,
+        Memory,
+    }
+
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    enum C4Compression : uint
+    {
+        None,
+        Snappy,
+        Dictionary,
+    }
+
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    struct C4DatabaseTuning
+    {
+        public C4TuningPreset preset;
+        public long mmapSize;
+        public long cacheSize;
+        public uint pageSize;
+        public uint walAutoCheckpoint;
+        public long journalSizeLimit;
+        public int workerThreads;
+        public C4TempStore tempStore;
+        public uint readerConnections;
+        public uint maxTrackedChanges;
+        public C4Compression compression;
+    }
+
 #if LITECORE_PACKAGED
     internal
 #else
@@ -76,6 +134,7 @@ namespace LiteCore.Interop
         private IntPtr _storageEngine;
         public C4DocumentVersioning versioning;
         public C4EncryptionKey encryptionKey;
+        public C4DatabaseTuning tuning;
 
         public string storageEngine
         {
@@ -99,6 +158,18 @@ namespace LiteCore.Interop
         public fixed byte bytes[32];
     }
 
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    unsafe struct C4CompactProgress
+    {
+        public ulong docsScanned;
+        public ulong blobsDeleted;
+        public ulong bytesReclaimed;
+    }
+
 #if LITECORE_PACKAGED
     internal
 #else
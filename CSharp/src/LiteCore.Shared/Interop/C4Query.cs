@@ -38,6 +38,11 @@ namespace LiteCore.Interop
             if(old != IntPtr.Zero) {
                 Marshal.FreeHGlobal(old);
             }
+
+            old = Interlocked.Exchange(ref _includedPropertiesJSON, IntPtr.Zero);
+            if(old != IntPtr.Zero) {
+                Marshal.FreeHGlobal(old);
+            }
         }
     }
 
@@ -59,6 +59,7 @@ namespace LiteCore.Interop
         public ulong skip;
         public ulong limit;
         private byte _rankFullText;
+        private byte _streaming;
 
         public bool rankFullText
         {
@@ -69,6 +70,16 @@ namespace LiteCore.Interop
                 _rankFullText = Convert.ToByte(value);
             }
         }
+
+        public bool streaming
+        {
+            get {
+                return Convert.ToBoolean(_streaming);
+            }
+            set {
+                _streaming = Convert.ToByte(value);
+            }
+        }
     }
 
 #if LITECORE_PACKAGED
@@ -80,6 +91,7 @@ namespace LiteCore.Interop
     {
         private IntPtr _language;
         private byte _ignoreDiacritics;
+        private IntPtr _includedPropertiesJSON;
 
         public string language
         {
@@ -101,6 +113,17 @@ namespace LiteCore.Interop
                 _ignoreDiacritics = Convert.ToByte(value);
             }
         }
+
+        public string includedPropertiesJSON
+        {
+            get {
+                return Marshal.PtrToStringAnsi(_includedPropertiesJSON);
+            }
+            set {
+                var old = Interlocked.Exchange(ref _includedPropertiesJSON, Marshal.StringToHGlobalAnsi(value));
+                Marshal.FreeHGlobal(old);
+            }
+        }
     }
 
 #if LITECORE_PACKAGED
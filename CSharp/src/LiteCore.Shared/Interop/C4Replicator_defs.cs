@@ -66,6 +66,21 @@ namespace LiteCore.Interop
         public ulong total;
     }
 
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    unsafe struct C4FlowControl
+    {
+        public uint changesBatchSize;
+        public uint maxRevsInFlight;
+        public ulong maxRevBytesAwaitingReply;
+        public uint latencyMS;
+        public uint minLatencyMS;
+        public ulong bytesPerSec;
+    }
+
 #if LITECORE_PACKAGED
     internal
 #else
@@ -85,5 +100,6 @@ namespace LiteCore.Interop
         public C4ReplicatorActivityLevel level;
         public C4Progress progress;
         public C4Error error;
+        public C4FlowControl flowControl;
     }
 }
\ No newline at end of file
@@ -30,6 +30,7 @@ public interface Constants {
         int kC4DB_AutoCompact = 4;   ///< Enable auto-compaction
         int kC4DB_Bundled = 8;       ///< Store db & attachments inside a directory
         int kC4DB_SharedKeys = 0x10; ///< Enable shared-keys optimization at creation time
+        int kC4DB_GroupCommit = 0x20; ///< Commit concurrent transactions on this handle together
     }
 
     // Document versioning system (also determines database storage schema)
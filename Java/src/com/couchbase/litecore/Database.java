@@ -27,6 +27,7 @@ public class Database {
     public static final int AutoCompact = 4;
     public static final int Bundle = 8;
     public static final int SharedKeys = 0x10;
+    public static final int GroupCommit = 0x20;
     public static final int ForestDBStorage = 0x000;
     public static final int SQLiteStorage = 0x100;
 
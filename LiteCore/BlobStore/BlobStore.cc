@@ -17,6 +17,7 @@
 #include "FilePath.hh"
 #include "Error.hh"
 #include "EncryptedStream.hh"
+#include "CompressedStream.hh"
 #include "Logging.hh"
 #include <stdint.h>
 #include <stdio.h>
@@ -41,7 +42,12 @@ namespace litecore {
     }
 
     blobKey::blobKey(const string &str) {
-        slice data = slice(str);
+        if (!readFromBase64(slice(str)))
+            error::_throw(error::WrongFormat);
+    }
+
+
+    bool blobKey::readFromBase64(slice data) {
         if (data.size == kBlobKeyStringLength && 0 == memcmp(data.buf, "sha1-", 5)) {
             data.moveStart(5);
             // Decoder always writes a multiple of 3 bytes, so round up:
@@ -49,10 +55,26 @@ namespace litecore {
             slice result = data.readBase64Into(slice(buf, sizeof(buf)));
             if (result.size == 20) {
                 memcpy(bytes, result.buf, result.size);
-                return;
+                return true;
             }
         }
-        error::_throw(error::WrongFormat);
+        return false;
+    }
+
+
+    bool blobKey::readFromFilename(string filename, bool *outCompressed) {
+        static const size_t kExtLength = 5;     // ".blob"
+        bool compressed = (filename.size() > 0 && filename.back() == 'z');  // ".blobz"
+        if (compressed)
+            filename.pop_back();
+        if (filename.size() != kBlobKeyStringLength - 5 + kExtLength
+                || filename.compare(filename.size() - kExtLength, kExtLength, ".blob") != 0)
+            return false;
+        if (outCompressed)
+            *outCompressed = compressed;
+        filename.resize(filename.size() - kExtLength);
+        replace(filename.begin(), filename.end(), '_', '/');
+        return readFromBase64(slice("sha1-" + filename));
     }
 
 
@@ -61,10 +83,12 @@ namespace litecore {
     }
 
 
-    string blobKey::filename() const {
+    // Compressed blobs are stored as ".blobz" files, since their contents can't be told apart
+    // from regular blobs.
+    string blobKey::filename(bool compressed) const {
         string str = slice(bytes, sizeof(bytes)).base64String();
         replace(str.begin(), str.end(), '/', '_');
-        return str + ".blob";
+        return str + (compressed ? ".blobz" : ".blob");
     }
 
 
@@ -85,14 +109,31 @@ namespace litecore {
 #pragma mark - BLOB READING:
     
     
-    Blob::Blob(const BlobStore &store, const blobKey &key)
-    :_path(store.dir(), key.filename()),
+    Blob::Blob(const BlobStore &store, const blobKey &key, bool compressed)
+    :_path(store.dir(), key.filename(compressed)),
      _key(key),
+     _compressed(compressed),
      _store(store)
     { }
 
 
+    // Looks for the blob in either form; the regular form is the result if neither exists.
+    Blob::Blob(const BlobStore &store, const blobKey &key)
+    :Blob(store, key, false)
+    {
+        if (!_path.exists()) {
+            FilePath compressedPath(store.dir(), key.filename(true));
+            if (compressedPath.exists()) {
+                _path = compressedPath;
+                _compressed = true;
+            }
+        }
+    }
+
+
     int64_t Blob::contentLength() const {
+        if (_compressed)
+            return read()->getLength();
         int64_t length = path().dataSize();
         if (length >= 0 && _store.options().encryptionAlgorithm != kNoEncryption)
             length -= EncryptedReadStream::kFileSizeOverhead;
@@ -109,6 +150,8 @@ namespace litecore {
                                              options.encryptionAlgorithm,
                                              options.encryptionKey);
         }
+        if (_compressed)
+            reader = new CompressedReadStream(shared_ptr<SeekableReadStream>(reader));
         return unique_ptr<SeekableReadStream>{reader};
     }
 
@@ -128,6 +171,12 @@ namespace litecore {
                                                                     options.encryptionAlgorithm,
                                                                     options.encryptionKey)};
         }
+        if (options.compression != kNoCompression) {
+            _compressor = make_shared<CompressedWriteStream>(_writer,
+                                                             options.compression,
+                                                             options.compressionThreshold);
+            _writer = _compressor;
+        }
         sha1_begin(&_sha1ctx);
     }
 
@@ -169,7 +218,12 @@ namespace litecore {
 
     Blob BlobWriteStream::install() {
         close();
-        Blob blob(_store, computeKey());
+        bool compressed = _compressor && _compressor->isCompressed();
+        blobKey key = computeKey();
+        Blob existing(_store, key);
+        if (existing.exists() && existing.isCompressed() != compressed)
+            return existing;        // Already stored in the other form; keep that one
+        Blob blob(_store, key, compressed);
         _tmpPath.setReadOnly(true);
         _tmpPath.moveTo(blob.path());
         _installed = true;
@@ -180,7 +234,8 @@ namespace litecore {
 #pragma mark - BLOBSTORE:
 
 
-    const BlobStore::Options BlobStore::Options::defaults = {true, true};
+    const BlobStore::Options BlobStore::Options::defaults = {true, true, kNoEncryption, {},
+                                                             kNoCompression, 0};
 
 
     BlobStore::BlobStore(const FilePath &dir, const Options *options)
@@ -203,4 +258,27 @@ namespace litecore {
         return stream.install();
     }
 
+
+    uint64_t BlobStore::deleteAllExcept(const vector<blobKey> &keep,
+                                        time_t notBefore,
+                                        function_ref<void(int64_t size)> onDeleted)
+    {
+        uint64_t count = 0;
+        _dir.forEachFile([&](const FilePath &path) {
+            blobKey key;
+            if (!key.readFromFilename(path.fileName()))
+                return;             // not a blob, e.g. an incoming_ temporary file
+            if (binary_search(keep.begin(), keep.end(), key))
+                return;
+            if (path.lastModified() >= notBefore)
+                return;
+            int64_t size = path.dataSize();
+            if (path.del()) {
+                ++count;
+                onDeleted(size);
+            }
+        });
+        return count;
+    }
+
 }
@@ -11,6 +11,10 @@
 #include "FilePath.hh"
 #include "Stream.hh"
 #include "SecureDigest.hh"
+#include "function_ref.hh"
+#include <cstring>
+#include <ctime>
+#include <vector>
 
 #if !SECURE_DIGEST_AVAILABLE
 #error No SHA digest API configured (See SecureDigest.hh)
@@ -18,6 +22,7 @@
 
 namespace litecore {
     class BlobStore;
+    class CompressedWriteStream;
     class FilePath;
 
 
@@ -32,9 +37,18 @@ namespace litecore {
         operator slice() const          {return slice(bytes, sizeof(bytes));}
         std::string hexString() const   {return operator slice().hexString();}
         std::string base64String() const;
-        std::string filename() const;
+        std::string filename(bool compressed =false) const;
 
         static blobKey computeFrom(slice data);
+
+        /** Parses a "sha1-" base64 digest string; returns false if it's invalid. */
+        bool readFromBase64(slice);
+
+        /** Parses a blob's filename (as returned by filename()); returns false if invalid. */
+        bool readFromFilename(std::string filename, bool *outCompressed =nullptr);
+
+        bool operator== (const blobKey &k) const {return memcmp(bytes, k.bytes, sizeof(bytes)) == 0;}
+        bool operator< (const blobKey &k) const  {return memcmp(bytes, k.bytes, sizeof(bytes)) < 0;}
     };
 
 
@@ -46,6 +60,7 @@ namespace litecore {
         blobKey key() const             {return _key;}
         FilePath path() const           {return _path;}
         int64_t contentLength() const;      // An overestimate, if blob is encrypted
+        bool isCompressed() const       {return _compressed;}
 
         alloc_slice contents() const    {return read()->readAll();}
 
@@ -58,9 +73,11 @@ namespace litecore {
         friend class BlobWriteStream;
         
         Blob(const BlobStore&, const blobKey&);
+        Blob(const BlobStore&, const blobKey&, bool compressed);
 
         FilePath _path;
         const blobKey _key;
+        bool _compressed;
         const BlobStore &_store;
     };
 
@@ -86,6 +103,7 @@ namespace litecore {
         BlobStore &_store;
         FilePath _tmpPath;
         std::shared_ptr<WriteStream> _writer;
+        std::shared_ptr<CompressedWriteStream> _compressor;
         sha1Context _sha1ctx;
         blobKey _key;
         bool _computedKey {false};
@@ -101,7 +119,9 @@ namespace litecore {
             bool writeable      :1;     ///< If false, opened read-only
             EncryptionAlgorithm encryptionAlgorithm;
             alloc_slice encryptionKey;
-            
+            Compression compression;    ///< How to compress new blobs
+            uint64_t compressionThreshold; ///< Smaller blobs are stored uncompressed
+
             static const Options defaults;
         };
 
@@ -123,6 +143,13 @@ namespace litecore {
 
         Blob put(slice data);
 
+        /** Deletes every blob whose key is not in `keep`, which must be sorted, unless the blob
+            was modified at or after `notBefore` (it may be newly added and not yet referenced.)
+            Calls `onDeleted` with the size of each blob deleted. Returns the number deleted. */
+        uint64_t deleteAllExcept(const std::vector<blobKey> &keep,
+                                 time_t notBefore,
+                                 function_ref<void(int64_t size)> onDeleted);
+
     private:
         FilePath const          _dir;                           // Location
         Options                 _options;                       // Option/capability flags
@@ -23,8 +23,11 @@
 #include "SequenceTracker.hh"
 #include "Fleece.hh"
 #include "BlobStore.hh"
+#include "RecordEnumerator.hh"
+#include "Compression.hh"
 #include "forestdb_endian.h"
 #include "SecureRandomize.hh"
+#include <condition_variable>
 
 
 namespace c4Internal {
@@ -88,6 +91,50 @@ namespace c4Internal {
     }
 
 
+    static const int64_t MB = 1024 * 1024;
+
+    // Storage tuning presets, indexed by C4TuningPreset. Zero means the storage engine's default.
+    static const C4DatabaseTuning kTuningPresets[] = {
+        // preset           mmapSize  cacheSize page  walCkpt journalLimit workers tempStore            readers tracked compression
+        {kC4TuningDefault,  0,        0,        0,    0,      0,           0,      kC4TempStoreDefault, 0,      0,      kC4CompressionNone},
+        {kC4TuningMobile,   16*MB,    1*MB,     4096, 500,    1*MB,        -1,     kC4TempStoreFile,    0,      0,      kC4CompressionNone},
+        {kC4TuningServer,   1024*MB,  64*MB,    4096, 4000,   64*MB,       4,      kC4TempStoreMemory,  8,      0,      kC4CompressionNone},
+        {kC4TuningBulkLoad, 256*MB,   128*MB,   4096, 20000,  256*MB,      4,      kC4TempStoreMemory,  0,      0,      kC4CompressionNone},
+    };
+
+
+    // Blobs smaller than this are stored uncompressed even when compression is enabled
+    static const uint64_t kBlobCompressionThreshold = 8 * 1024;
+
+
+    // Upper limit of C4DatabaseTuning.readerConnections
+    static const uint32_t kMaxReaderConnections = 64;
+
+
+    // Applies a C4DatabaseTuning's overrides to its preset, after validating them.
+    static DataFile::Tuning resolveTuning(const C4DatabaseTuning &t) {
+        if (t.preset > kC4TuningBulkLoad || t.tempStore > kC4TempStoreMemory
+                || t.compression > kC4CompressionDictionary
+                || t.cacheSize < 0 || t.journalSizeLimit < 0
+                || t.readerConnections > kMaxReaderConnections
+                || (t.pageSize != 0 && (t.pageSize < 512 || t.pageSize > 65536
+                                        || (t.pageSize & (t.pageSize - 1)) != 0)))
+            error::_throw(error::InvalidParameter);
+        const C4DatabaseTuning &p = kTuningPresets[t.preset];
+        DataFile::Tuning tuning;
+        tuning.mmapSize          = t.mmapSize ? t.mmapSize : p.mmapSize;
+        tuning.cacheSize         = t.cacheSize ? t.cacheSize : p.cacheSize;
+        tuning.pageSize          = t.pageSize ? t.pageSize : p.pageSize;
+        tuning.walAutoCheckpoint = t.walAutoCheckpoint ? t.walAutoCheckpoint : p.walAutoCheckpoint;
+        tuning.journalSizeLimit  = t.journalSizeLimit ? t.journalSizeLimit : p.journalSizeLimit;
+        tuning.workerThreads     = t.workerThreads ? t.workerThreads : p.workerThreads;
+        tuning.tempStore         = t.tempStore ? t.tempStore : p.tempStore;
+        tuning.readerConnections = t.readerConnections ? t.readerConnections : p.readerConnections;
+        tuning.compression       = (Compression)(t.compression ? t.compression : p.compression);
+        return tuning;
+    }
+
+
     // subroutine of Database constructor that creates its _db
     /*static*/ DataFile* Database::newDataFile(const FilePath &path,
                                                const C4DatabaseConfig &config,
@@ -99,6 +146,11 @@ namespace c4Internal {
         }
         options.create = (config.flags & kC4DB_Create) != 0;
         options.writeable = (config.flags & kC4DB_ReadOnly) == 0;
+        options.tuning = resolveTuning(config.tuning);
+        // A commit group's changes are on the main connection until the group commits; reads
+        // from threads outside it have to go to a reader, so they don't see them:
+        if ((config.flags & kC4DB_GroupCommit) && options.tuning.readerConnections == 0)
+            options.tuning.readerConnections = 1;
 
         options.encryptionAlgorithm = (EncryptionAlgorithm)config.encryptionKey.algorithm;
         if (options.encryptionAlgorithm != kNoEncryption) {
@@ -114,7 +166,10 @@ namespace c4Internal {
         DataFile::Factory *storage = DataFile::factoryNamed((string)(storageEngine));
         if (!storage)
             error::_throw(error::Unimplemented);
-        return storage->openFile(path, &options);
+        DataFile *df = storage->openFile(path, &options);
+        if (config.flags & kC4DB_AutoCompact)
+            df->setAutoCompact(true);
+        return df;
     }
 
 
@@ -125,6 +180,12 @@ namespace c4Internal {
      _encoder(new fleece::Encoder()),
      _sequenceTracker(new SequenceTracker())
     {
+        // (newDataFile has already validated the tuning preset.)
+        auto maxTrackedChanges = config.tuning.maxTrackedChanges;
+        if (maxTrackedChanges == 0)
+            maxTrackedChanges = kTuningPresets[config.tuning.preset].maxTrackedChanges;
+        _sequenceTracker->setMaxChanges(maxTrackedChanges);
+
         if (config.flags & kC4DB_SharedKeys) {
             _db->useDocumentKeys();
             _encoder->setSharedKeys(documentKeys());
@@ -224,10 +285,157 @@ namespace c4Internal {
     }
 
 
+    void Database::beginBulkLoad() {
+        mustNotBeInTransaction();
+        WITH_LOCK(this);
+        dataFile()->beginBulkLoad();
+    }
+
+
+    void Database::endBulkLoad() {
+        mustNotBeInTransaction();
+        WITH_LOCK(this);
+        dataFile()->endBulkLoad();
+    }
+
+
+    // Max time Database::compact holds the lock at once
+    static const chrono::milliseconds kCompactTimeSlice {50};
+
+
+    bool Database::compactIncrementally(chrono::milliseconds timeSlice) {
+        mustNotBeInTransaction();
+        WITH_LOCK(this);
+        return dataFile()->compactIncrementally(timeSlice);
+    }
+
+
+    bool Database::compactionNeeded() {
+        WITH_LOCK(this);
+        return dataFile()->compactionNeeded();
+    }
+
+
     void Database::compact() {
         mustNotBeInTransaction();
+        DataFile::CompactProgress progress;
+        {
+            WITH_LOCK(this);
+            dataFile()->beganCompacting();
+        }
+        try {
+            // Take the lock one slice at a time, so other threads using this handle can write
+            // in between:
+            bool more;
+            do {
+                WITH_LOCK(this);
+                more = dataFile()->compactIncrementally(kCompactTimeSlice);
+            } while (more);
+            if (config.flags & kC4DB_Bundled)
+                collectBlobGarbage(progress);
+        } catch (...) {
+            WITH_LOCK(this);
+            dataFile()->finishedCompacting(progress);
+            throw;
+        }
         WITH_LOCK(this);
-        dataFile()->compact();
+        dataFile()->finishedCompacting(progress);
+    }
+
+
+    // Adds the digests of a revision's attachments to `keys`.
+    static void findBlobReferences(slice body, SharedKeys *sk, vector<blobKey> &keys) {
+        const Value *root = Value::fromTrustedData(body);
+        const Dict *doc = root ? root->asDict() : nullptr;
+        const Value *attachments = doc ? doc->get("_attachments"_sl, sk) : nullptr;
+        if (!attachments || !attachments->asDict())
+            return;
+        for (Dict::iterator i(attachments->asDict()); i; ++i) {
+            const Dict *attachment = i.value()->asDict();
+            const Value *digest = attachment ? attachment->get("digest"_sl, sk) : nullptr;
+            blobKey key;
+            if (digest && key.readFromBase64(digest->asString()))
+                keys.push_back(key);
+        }
+    }
+
+
+    // Mark-and-sweep of the blob store: deletes blobs not referenced by any revision that still
+    // has a body. The documents are read a page at a time in sequence order, without holding the
+    // lock in between, so other threads can keep using the database; a document saved during the
+    // scan gets a new, higher sequence and is scanned when the enumeration gets there. The last
+    // of those, and the sweep itself, run inside a transaction, so no document referencing a
+    // blob can be committed in between. Blobs created since the scan began are kept, since their
+    // documents may not be saved yet.
+    void Database::collectBlobGarbage(DataFile::CompactProgress &progress) {
+        static const unsigned kPageSize = 1000;
+        time_t startTime = time(nullptr);
+        BlobStore *store;
+        {
+            WITH_LOCK(this);
+            store = blobStore();
+        }
+        SharedKeys *sk = documentKeys();
+
+        vector<blobKey> referenced;
+        sequence_t lastSeq = 0;
+
+        // Scans up to `limit` records after lastSeq; returns false if there were none.
+        auto scanPage = [&](unsigned limit) -> bool {
+            vector<Record> page;
+            {
+                WITH_LOCK(this);
+                RecordEnumerator::Options options;
+                options.limit = limit;
+                options.includeDeleted = true;
+                RecordEnumerator e(defaultKeyStore(), lastSeq + 1, UINT64_MAX, options);
+                while (e.next())
+                    page.push_back(e.record());
+            }
+            if (page.empty())
+                return false;
+
+            for (auto &record : page) {
+                lastSeq = max(lastSeq, record.sequence());
+                unique_ptr<Document> doc(documentFactory().newDocumentInstance(record));
+                doc->selectCurrentRevision();
+                do {
+                    if (doc->loadSelectedRevBodyIfAvailable())
+                        findBlobReferences(doc->selectedRev.body, sk, referenced);
+                } while (doc->selectNextRevision());
+            }
+            sort(referenced.begin(), referenced.end());
+            referenced.erase(unique(referenced.begin(), referenced.end()), referenced.end());
+
+            progress.docsScanned += page.size();
+            WITH_LOCK(this);
+            dataFile()->compactProgress(progress);
+            return true;
+        };
+
+        while (scanPage(kPageSize))
+            ;
+
+        beginTransaction();
+        uint64_t deleted;
+        try {
+            scanPage(UINT_MAX);     // whatever was saved since the last page
+            deleted = store->deleteAllExcept(referenced, startTime, [&](int64_t size) {
+                ++progress.blobsDeleted;
+                progress.bytesReclaimed += max(size, (int64_t)0);
+                if (progress.blobsDeleted % 100 == 0) {
+                    WITH_LOCK(this);
+                    dataFile()->compactProgress(progress);
+                }
+            });
+        } catch (...) {
+            endTransaction(false);
+            throw;
+        }
+        endTransaction(false);      // nothing was written
+        LogTo(DBLog, "Compaction deleted %llu unreferenced blobs (%llu bytes); %zu are in use",
+              (unsigned long long)deleted, (unsigned long long)progress.bytesReclaimed,
+              referenced.size());
     }
 
 
@@ -237,6 +445,85 @@ namespace c4Internal {
     }
 
 
+#pragma mark - COMPRESSION DICTIONARY:
+
+
+    // Number of recent bodies a compression dictionary is trained on
+    static const unsigned kDictionarySampleSize = 1000;
+    // Documents saved before a dictionary is first trained, and between later retrainings
+    static const uint64_t kFirstTrainingInterval = 1000;
+    static const uint64_t kRetrainingInterval = 20000;
+
+
+    bool Database::usesCompressionDictionary() const {
+        return _db->options().tuning.compression == kDictionaryCompression;
+    }
+
+
+    bool Database::trainCompressionDictionary() {
+        mustNotBeInTransaction();
+        if (!usesCompressionDictionary())
+            error::_throw(error::UnsupportedOperation);
+        // Sample the newest bodies (which are what the default KeyStore compresses; big ones
+        // are compressed without the dictionary, so leave them out):
+        vector<alloc_slice> samples;
+        {
+            WITH_LOCK(this);
+            RecordEnumerator::Options options;
+            options.descending = true;
+            options.limit = kDictionarySampleSize;
+            RecordEnumerator e(defaultKeyStore(), UINT64_MAX, 0, options);
+            while (e.next()) {
+                if (e->body().size <= BodyCompressor::kMaxDictionaryBodySize)
+                    samples.push_back(e->body());
+            }
+            _savedSinceTraining = 0;
+            _trainingNotified = false;
+        }
+
+        alloc_slice dictionary = CompressionDictionary::train(samples);
+        if (!dictionary) {
+            LogTo(DBLog, "Not enough data in %zu bodies to train a compression dictionary",
+                  samples.size());
+            return false;
+        }
+
+        beginTransaction();
+        try {
+            WITH_LOCK(this);
+            if (!dataFile()->saveCompressionDictionary(dictionary, transaction()))
+                error::_throw(error::UnsupportedOperation);
+        } catch (...) {
+            endTransaction(false);
+            throw;
+        }
+        endTransaction(true);
+        return true;
+    }
+
+
+    bool Database::dictionaryTrainingNeeded() {
+        WITH_LOCK(this);
+        return _dictionaryTrainingNeeded();
+    }
+
+
+    bool Database::_dictionaryTrainingNeeded() {
+        if (!usesCompressionDictionary())
+            return false;
+        auto interval = _db->compressionDictionaryVersion() ? kRetrainingInterval
+                                                            : kFirstTrainingInterval;
+        return _savedSinceTraining >= interval;
+    }
+
+
+    void Database::setOnDictionaryTrainingNeeded(function<void()> callback) noexcept {
+        WITH_LOCK(this);
+        _onTrainingNeeded = callback;
+        _trainingNotified = false;
+    }
+
+
     void Database::rekey(const C4EncryptionKey *newKey) {
         mustNotBeInTransaction();
         WITH_LOCK(this);
@@ -322,6 +609,11 @@ namespace c4Internal {
                 options.encryptionKey = alloc_slice(config.encryptionKey.bytes,
                                                     sizeof(config.encryptionKey.bytes));
             }
+            // Blobs are too big for a dictionary to help, so they use Snappy in that mode:
+            auto compression = resolveTuning(config.tuning).compression;
+            options.compression = (compression == kDictionaryCompression) ? kSnappyCompression
+                                                                          : compression;
+            options.compressionThreshold = kBlobCompressionThreshold;
             _blobStore.reset(new BlobStore(blobStorePath, &options));
         }
         return _blobStore.get();
@@ -363,67 +655,202 @@ namespace c4Internal {
     // so do not call them if _mutex is already locked (after WITH_LOCK) or deadlock may occur!
 
 
+    // Group commit (kC4DB_GroupCommit): if other threads are waiting to begin transactions when
+    // a transaction commits, the DataFile transaction is left open for them. Each one joins it
+    // inside a savepoint, so it can still abort on its own. The last transaction in the group
+    // commits it for all of them, and the others wait in endTransaction for the outcome.
+
+    static const size_t kMaxCommitGroupSize = 64;
+
+    struct Database::CommitGroup {
+        size_t size {1};                // Number of committed transactions in the group
+
+        void finished(exception_ptr e) {
+            {
+                lock_guard<mutex> lock(_mutex);
+                _done = true;
+                _error = e;
+            }
+            _cond.notify_all();
+        }
+
+        void wait() {
+            unique_lock<mutex> lock(_mutex);
+            _cond.wait(lock, [&]{return _done;});
+            if (_error)
+                rethrow_exception(_error);
+        }
+
+    private:
+        mutex _mutex;
+        condition_variable _cond;
+        bool _done {false};
+        exception_ptr _error;
+    };
+
+
     void Database::beginTransaction() {
     #if C4DB_THREADSAFE
+        ++_transactionWaiters;
         _transactionMutex.lock(); // this is a recursive mutex
+        --_transactionWaiters;
     #endif
-        if (++_transactionLevel == 1) {
-            WITH_LOCK(this);
-            _transaction = new Transaction(_db.get());
-            lock_guard<mutex> lock(_sequenceTracker->mutex());
-            _sequenceTracker->beginTransaction();
+        if (_transactionLevel == 0) {
+            try {
+                WITH_LOCK(this);
+                if (_commitGroup) {
+                    try {
+                        _transaction->beginSavepoint();
+                    } catch (...) {
+                        finishCommitGroup();    // commit for the members that already joined
+                        throw;
+                    }
+                    _inGroup = true;
+                } else {
+                    _transaction = new Transaction(_db.get());
+                    lock_guard<mutex> lock(_sequenceTracker->mutex());
+                    _sequenceTracker->beginTransaction();
+                }
+            } catch (...) {
+            #if C4DB_THREADSAFE
+                _transactionMutex.unlock();
+            #endif
+                throw;
+            }
         }
+        ++_transactionLevel;
     }
 
     bool Database::inTransaction() noexcept {
     #if C4DB_THREADSAFE
         lock_guard<recursive_mutex> lock(_transactionMutex);
     #endif
+        if (_transactionLevel == 0 && _commitGroup) {
+            // Nothing else can use the database until the waiting group is committed:
+            WITH_LOCK(this);
+            finishCommitGroup();
+        }
         return _transactionLevel > 0;
     }
 
 
     void Database::endTransaction(bool commit) {
     #if C4DB_THREADSAFE
-        lock_guard<recursive_mutex> lock(_transactionMutex);
+        unique_lock<recursive_mutex> lock(_transactionMutex);
     #endif
         if (_transactionLevel == 0)
             error::_throw(error::NotInTransaction);
+    #if C4DB_THREADSAFE
+        _transactionMutex.unlock(); // undoes lock in beginTransaction(); `lock` still holds it
+    #endif
         if (--_transactionLevel == 0) {
-            WITH_LOCK(this);
-            auto t = _transaction;
+            shared_ptr<CommitGroup> group;
+            {
+                WITH_LOCK(this);
+                group = finishTransaction(commit);
+            }
+            if (group) {
+                // The commit is up to the last transaction in the group; wait for it:
+            #if C4DB_THREADSAFE
+                lock.unlock();
+            #endif
+                group->wait();
+            }
+        }
+    }
+
+
+    // Ends the outermost transaction. Returns the CommitGroup to wait for if the commit was
+    // deferred (or was made on behalf of a group.)
+    shared_ptr<Database::CommitGroup> Database::finishTransaction(bool commit) {
+        bool othersWaiting = (_transactionWaiters > 0);
+        if (_inGroup) {
+            _inGroup = false;
+            auto changes = move(_groupedChanges);
+            _groupedChanges.clear();
             try {
-                if (commit)
-                    t->commit();
-                else
-                    t->abort();
+                _transaction->endSavepoint(commit);
             } catch (...) {
-                delete t;
-                _transaction = nullptr;
-                {
-                    lock_guard<mutex> lock(_sequenceTracker->mutex());
-                    _sequenceTracker->endTransaction(false);
-                }
+                finishCommitGroup(current_exception());     // the group can't go on
                 throw;
             }
+            if (commit) {
+                lock_guard<mutex> lock(_sequenceTracker->mutex());
+                for (auto &change : changes)
+                    _sequenceTracker->documentChanged(change.docID, change.revID, change.sequence);
+                ++_commitGroup->size;
+            }
+            auto group = _commitGroup;
+            if (!othersWaiting || group->size >= kMaxCommitGroupSize)
+                finishCommitGroup();
+            return commit ? group : nullptr;
+
+        } else if (commit && othersWaiting && (config.flags & kC4DB_GroupCommit)
+                          && _db->supportsSavepoints()) {
+            // Leave the transaction open for the waiting threads to join:
+            _commitGroup = make_shared<CommitGroup>();
+            return _commitGroup;
+
+        } else {
+            endDataFileTransaction(commit);
+            return nullptr;
+        }
+    }
+
+
+    // Commits the group's transaction, or aborts it if there's already an error, and tells the
+    // waiting members the outcome.
+    void Database::finishCommitGroup(exception_ptr error) noexcept {
+        auto group = move(_commitGroup);
+        _commitGroup = nullptr;
+        try {
+            endDataFileTransaction(!error);
+        } catch (...) {
+            if (!error)
+                error = current_exception();
+        }
+        LogTo(DBLog, "Database: %s group of %zu transactions",
+              (error ? "failed to commit" : "committed"), group->size);
+        group->finished(error);
+    }
+
+
+    // Commits or aborts the DataFile transaction, and notifies observers.
+    void Database::endDataFileTransaction(bool commit) {
+        auto t = _transaction;
+        try {
+            if (commit)
+                t->commit();
+            else
+                t->abort();
+        } catch (...) {
             delete t;
             _transaction = nullptr;
-
-            lock_guard<mutex> lock(_sequenceTracker->mutex());
-            if (commit) {
-                // Notify other Database instances on this file:
-                _db->forOtherDataFiles([&](DataFile *other) {
-                    auto otherDatabase = (Database*)other->owner();
-                    if (otherDatabase)
-                        otherDatabase->externalTransactionCommitted(*_sequenceTracker);
-                });
+            {
+                lock_guard<mutex> lock(_sequenceTracker->mutex());
+                _sequenceTracker->endTransaction(false);
             }
+            throw;
+        }
+        delete t;
+        _transaction = nullptr;
 
-            _sequenceTracker->endTransaction(commit);
+        lock_guard<mutex> lock(_sequenceTracker->mutex());
+        if (commit) {
+            // Notify other Database instances on this file:
+            _db->forOtherDataFiles([&](DataFile *other) {
+                auto otherDatabase = (Database*)other->owner();
+                if (otherDatabase)
+                    otherDatabase->externalTransactionCommitted(*_sequenceTracker);
+            });
+        }
+
+        _sequenceTracker->endTransaction(commit);
+
+        if (commit && _onTrainingNeeded && !_trainingNotified && _dictionaryTrainingNeeded()) {
+            _trainingNotified = true;
+            _onTrainingNeeded();
         }
-    #if C4DB_THREADSAFE
-        _transactionMutex.unlock(); // undoes lock in beginTransaction()
-    #endif
     }
 
 
@@ -460,6 +887,34 @@ namespace c4Internal {
     }
 
 
+    bool Database::withReader(function_ref<void(DataFile&)> fn) {
+        {
+            // A thread in a transaction has to see its own uncommitted changes, so it has to use
+            // the main DataFile. (If another thread owns _transactionMutex, this one isn't in a
+            // transaction, and the readers will see what was committed before it.)
+            // A commit group waiting for more members is committed first, in case the caller
+            // falls back to reading from the main DataFile, which would see its changes.
+        #if C4DB_THREADSAFE
+            unique_lock<recursive_mutex> lock(_transactionMutex, try_to_lock);
+            if (lock.owns_lock()) {
+        #endif
+                if (_transactionLevel > 0)
+                    return false;
+                if (_commitGroup) {
+                    WITH_LOCK(this);
+                    finishCommitGroup();
+                }
+        #if C4DB_THREADSAFE
+            }
+        #endif
+        }
+        // Version-vector documents are read through the RevisionStore, not the default KeyStore:
+        if (config.versioning != kC4RevisionTrees)
+            return false;
+        return _db->withReader(fn);
+    }
+
+
     Record Database::getRawDocument(const string &storeName, slice key) {
         WITH_LOCK(this);
         return getKeyStore(storeName).get(key);
@@ -477,6 +932,14 @@ namespace c4Internal {
     }
 
 
+    void Database::putRawDocuments(const string &storeName,
+                                   const KeyStore::SetEntry entries[], size_t count)
+    {
+        WITH_LOCK(this);
+        getKeyStore(storeName).setMany(entries, count, nullptr, transaction());
+    }
+
+
     fleece::Encoder& Database::sharedEncoder() {
         WITH_LOCK(this);
         _encoder->reset();
@@ -486,6 +949,13 @@ namespace c4Internal {
 
     void Database::saved(Document* doc) {
         WITH_LOCK(this);
+        ++_savedSinceTraining;
+        if (_inGroup) {
+            // This transaction could still be rolled back on its own, which the tracker can't
+            // do, so it only hears of the changes when the transaction commits:
+            _groupedChanges.push_back({doc->_docIDBuf, doc->_revIDBuf, doc->sequence});
+            return;
+        }
         lock_guard<mutex> lock(_sequenceTracker->mutex());
         _sequenceTracker->documentChanged(doc->_docIDBuf, doc->_revIDBuf, doc->sequence);
         //NOTE: This assumes the doc's current revID is the new revision's
@@ -14,6 +14,8 @@
 #include "DataFile.hh"
 #include "FilePath.hh"
 #include "c4Private.h"
+#include <exception>
+#include <memory>
 
 
 #if C4DB_THREADSAFE
@@ -68,8 +70,20 @@ namespace c4Internal {
         void rekey(const C4EncryptionKey *newKey);
 
         void compact();
+        bool compactIncrementally(std::chrono::milliseconds timeSlice);
+        bool compactionNeeded();
+
+        void beginBulkLoad();
+        void endBulkLoad();
         void setOnCompact(DataFile::OnCompactCallback callback) noexcept;
 
+        /** Trains a compression dictionary on recent document bodies and saves it. Only sampling
+            and saving hold the lock, so it can run on a background thread. Returns false if
+            there's too little data to train on. Requires kC4CompressionDictionary. */
+        bool trainCompressionDictionary();
+        bool dictionaryTrainingNeeded();
+        void setOnDictionaryTrainingNeeded(std::function<void()> callback) noexcept;
+
         const C4DatabaseConfig config;
 
         Transaction& transaction() const;
@@ -84,10 +98,17 @@ namespace c4Internal {
         KeyStore& defaultKeyStore();
         KeyStore& getKeyStore(const string &name) const;
 
+        /** If the DataFile has a reader pool (C4DatabaseTuning.readerConnections) and the calling
+            thread isn't in a transaction, calls `fn` with a pooled read-only DataFile and returns
+            true; else returns false. Doesn't lock _mutex, so call it before WITH_LOCK. */
+        bool withReader(function_ref<void(DataFile&)> fn);
+
         bool purgeDocument(slice docID);
 
         Record getRawDocument(const std::string &storeName, slice key);
         void putRawDocument(const string &storeName, slice key, slice meta, slice body);
+        void putRawDocuments(const string &storeName,
+                             const KeyStore::SetEntry entries[], size_t count);
 
         DocumentFactory& documentFactory()                  {return *_documentFactory;}
 
@@ -122,7 +143,21 @@ namespace c4Internal {
         void externalTransactionCommitted(const SequenceTracker&);
 
     private:
+        struct CommitGroup;
+
+        // A change made by a transaction that joined a commit group; not yet sent to the tracker
+        struct GroupedChange {
+            alloc_slice docID, revID;
+            sequence_t  sequence;
+        };
+
         static FilePath findOrCreateBundle(const string &path, C4DatabaseConfig &config);
+        shared_ptr<CommitGroup> finishTransaction(bool commit);
+        void endDataFileTransaction(bool commit);
+        void finishCommitGroup(exception_ptr error =nullptr) noexcept;
+        void collectBlobGarbage(DataFile::CompactProgress&);
+        bool usesCompressionDictionary() const;
+        bool _dictionaryTrainingNeeded();
 
         unique_ptr<DataFile>        _db;                    // Underlying DataFile
         Transaction*                _transaction {nullptr}; // Current Transaction, or null
@@ -133,10 +168,17 @@ namespace c4Internal {
         // Must be acquired BEFORE _mutex, or deadlock may occur!
         recursive_mutex             _transactionMutex;
     #endif
+        shared_ptr<CommitGroup>     _commitGroup;           // Group awaiting commit, or null
+        bool                        _inGroup {false};       // Has current transaction joined it?
+        vector<GroupedChange>       _groupedChanges;        // Current transaction's changes
+        atomic<int>                 _transactionWaiters {0};// Threads in beginTransaction
         unique_ptr<fleece::Encoder> _encoder;
         unique_ptr<SequenceTracker> _sequenceTracker;       // Doc change tracker/notifier
         unique_ptr<BlobStore>       _blobStore;
         uint32_t                    _maxRevTreeDepth {0};
+        uint64_t                    _savedSinceTraining {0};// Docs saved since dictionary trained
+        bool                        _trainingNotified {false};  // Called _onTrainingNeeded yet?
+        std::function<void()>       _onTrainingNeeded;      // Dictionary training callback
     };
 
 
@@ -30,6 +30,17 @@ Transactions:
  When a transaction begins, a placeholder is added at the end of the list.
  On commit: Generate a list of all changes since that placeholder, and broadcast to all other databases open on this file. They add those changes to their SequenceTrackers.
  On abort: Iterate over all changes since that placeholder and call documentChanged, with the old committed sequence number. This will notify all observers that the doc has reverted back.
+
+Indexing:
+ _bySequence maps sequences to the changes in the list, so _since() is a map lookup.
+ Every change added to the end of the list gets a new, higher `position`; a placeholder takes the
+ position of the entry before it. So there are changes after a placeholder iff its position is
+ less than the latest change's, and hasChangesAfterPlaceholder() doesn't have to walk the list.
+
+Memory limit:
+ If _maxChanges is set, removeObsoleteEntries also discards the oldest changes once there are
+ more than that, skipping over the placeholders in front of them and marking their notifiers as
+ having missed changes.
 */
 
 
@@ -105,21 +116,31 @@ namespace litecore {
             if (entry->isIdle() && !hasDBChangeNotifiers()) {
                 listChanged = false;
             } else {
-                if (entry->isIdle())
+                removeFromIndex(i->second);
+                if (entry->isIdle()) {
                     _changes.splice(_changes.end(), _idle, i->second);
-                else if (next(i->second) != _changes.end())
+                    entry->idle = false;
+                } else if (next(i->second) != _changes.end()) {
                     _changes.splice(_changes.end(), _changes, i->second);
-                else
+                } else {
                     listChanged = false;
+                }
             }
             // Update its revID & sequence:
             entry->revID = revID;
             entry->sequence = sequence;
+            if (!entry->isIdle()) {
+                if (listChanged)
+                    entry->position = ++_lastPosition;
+                addToIndex(i->second);
+            }
         } else {
             // or create a new entry at the end:
             _changes.emplace_back(docID, revID, sequence);
             iterator change = prev(_changes.end());
             _byDocID[change->docID] = change;
+            change->position = ++_lastPosition;
+            addToIndex(change);
             entry = &*change;
         }
 
@@ -164,20 +185,37 @@ namespace litecore {
             _lastSequence = e->sequence;
             _documentChanged(e->docID, e->revID, e->sequence);
         }
+        removeObsoleteEntries();
     }
 
 
     SequenceTracker::const_iterator
     SequenceTracker::_since(sequence_t sinceSeq) const {
-        if (sinceSeq >= _lastSequence) {
+        if (sinceSeq >= _lastSequence)
             return _changes.cend();
-        } else {
-            return lower_bound(_changes.cbegin(), _changes.cend(),
-                               sinceSeq + 1,
-                               [](const Entry &c, sequence_t s) {return c.sequence < s;} );
-            //OPT: This is O(n) since _changes is a linked list. I don't expect it to be called often enough for this to be a problem, but I could be wrong.
-            //OPT: Might be more efficient to search backwards, if sinceSeq is usually recent?
-        }
+        auto i = _bySequence.upper_bound(sinceSeq);
+        if (i == _bySequence.end())
+            return _changes.cend();
+        return i->second;
+    }
+
+
+    void SequenceTracker::addToIndex(iterator entry) {
+        if (entry->sequence > 0)
+            _bySequence[entry->sequence] = entry;
+    }
+
+
+    void SequenceTracker::removeFromIndex(const_iterator entry) {
+        auto i = _bySequence.find(entry->sequence);
+        if (i != _bySequence.end() && const_iterator(i->second) == entry)
+            _bySequence.erase(i);
+    }
+
+
+    void SequenceTracker::setPlaceholderPosition(const_iterator placeholder) {
+        auto &ph = const_cast<Entry&>(*placeholder);
+        ph.position = (placeholder == _changes.cbegin()) ? 0 : prev(placeholder)->position;
     }
 
 
@@ -185,7 +223,12 @@ namespace litecore {
     SequenceTracker::addPlaceholderAfter(DatabaseChangeNotifier *obs, sequence_t seq) {
         Assert(obs);
         ++_numPlaceholders;
-        return _changes.emplace(_since(seq), obs);
+        auto placeholder = _changes.emplace(_since(seq), obs);
+        setPlaceholderPosition(placeholder);
+        // Changes after `seq` that have already been removed can't be seen:
+        if (seq < _maxRemovedSequence)
+            obs->_missedChanges = true;
+        return placeholder;
     }
 
     void SequenceTracker::removePlaceholder(const_iterator placeholder) {
@@ -196,11 +239,8 @@ namespace litecore {
 
 
     bool SequenceTracker::hasChangesAfterPlaceholder(const_iterator placeholder) const {
-        for (auto i = next(placeholder); i != _changes.end(); ++i) {
-            if (!i->isPlaceholder())
-                return true;
-        }
-        return false;
+        // The latest change is never removed from the list, so _lastPosition is its position:
+        return placeholder->position < _lastPosition;
     }
 
 
@@ -234,6 +274,7 @@ namespace litecore {
         }
         if (n > 0) {
             _changes.splice(i, _changes, placeholder);
+            setPlaceholderPosition(placeholder);
             // (It would be nice to call removeObsoleteEntries now, but it could free the entries
             // that own the docID slices I'm about to return.)
         }
@@ -243,6 +284,13 @@ namespace litecore {
 
     void SequenceTracker::catchUpPlaceholder(const_iterator placeholder) {
         _changes.splice(_changes.end(), _changes, placeholder);
+        setPlaceholderPosition(placeholder);
+        removeObsoleteEntries();
+    }
+
+
+    void SequenceTracker::setMaxChanges(size_t maxChanges) {
+        _maxChanges = maxChanges;
         removeObsoleteEntries();
     }
 
@@ -253,10 +301,41 @@ namespace litecore {
         // Any changes before the first placeholder aren't going to be seen, so remove them:
         while (_changes.size() - _numPlaceholders > kMinChangesToKeep
                     && !_changes.front().isPlaceholder()) {
-            _byDocID.erase(_changes.front().docID);
-            _changes.erase(_changes.begin());
-            //FIX: Shouldn't erase it if its documentObservers is non-empty
+            removeEntry(_changes.begin());
+        }
+
+        // If there are still too many, remove the oldest even though some notifiers haven't
+        // seen them yet:
+        if (_maxChanges > 0 && _changes.size() - _numPlaceholders > _maxChanges) {
+            auto i = _changes.begin(), missedEnd = i;
+            while (_changes.size() - _numPlaceholders > _maxChanges) {
+                if (i->isPlaceholder()) {
+                    ++i;
+                } else {
+                    i = removeEntry(i);
+                    missedEnd = i;
+                }
+            }
+            // Everything before missedEnd is now a placeholder whose notifier missed a change:
+            for (auto ph = _changes.begin(); ph != missedEnd; ++ph)
+                ph->databaseObserver->_missedChanges = true;
+        }
+    }
+
+
+    // Removes a change from the list. If it has document observers it's moved to _idle instead.
+    SequenceTracker::iterator SequenceTracker::removeEntry(iterator entry) {
+        removeFromIndex(entry);
+        _maxRemovedSequence = max(_maxRemovedSequence, entry->sequence);
+        auto nextEntry = next(entry);
+        if (entry->documentObservers.empty()) {
+            _byDocID.erase(entry->docID);
+            _changes.erase(entry);
+        } else {
+            entry->idle = true;
+            _idle.splice(_idle.end(), _changes, entry);
         }
+        return nextEntry;
     }
 
 
@@ -16,6 +16,7 @@
 #pragma once
 #include "Base.hh"
 #include <list>
+#include <map>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
@@ -51,6 +52,13 @@ namespace litecore {
 
         void documentsChanged(const std::vector<const Entry*>&);
 
+        /** Limits the number of document changes kept for DatabaseChangeNotifiers. When there
+            are more, the oldest are discarded even if some notifiers haven't read them yet;
+            those notifiers' `missedChanges` will return true. Zero (the default) means no limit. */
+        void setMaxChanges(size_t maxChanges);
+
+        size_t maxChanges() const               {return _maxChanges;}
+
         /** Copy the other tracker's transaction's changes into myself as committed & external */
         void addExternalTransaction(const SequenceTracker &from);
 
@@ -59,6 +67,7 @@ namespace litecore {
         /** Tracks a document's current sequence. */
         struct Entry {
             sequence_t                      sequence {0};
+            uint64_t                        position {0};   // Increases along the list
 
             // Document entry (when sequence != 0):
             sequence_t                      committedSequence {0};
@@ -126,18 +135,26 @@ namespace litecore {
         friend class DocChangeNotifier;
         friend class SequenceTrackerTest;
 
+        typedef std::list<Entry>::iterator iterator;
+
         void _documentChanged(const alloc_slice &docID,
                               const alloc_slice &revID,
                               sequence_t sequence);
         const_iterator _since(sequence_t s) const;
-
-        typedef std::list<Entry>::iterator iterator;
+        void addToIndex(iterator);
+        void removeFromIndex(const_iterator);
+        void setPlaceholderPosition(const_iterator);
+        iterator removeEntry(iterator);
 
         std::list<Entry>                        _changes;
         std::list<Entry>                        _idle;
         std::unordered_map<slice, iterator, fleece::sliceHash> _byDocID;
+        std::map<sequence_t, iterator>          _bySequence;    // Changes in _changes, by sequence
         sequence_t                              _lastSequence {0};
+        sequence_t                              _maxRemovedSequence {0}; // Latest change dropped
+        uint64_t                                _lastPosition {0};
         size_t                                  _numPlaceholders {0};
+        size_t                                  _maxChanges {0};
         std::unique_ptr<DatabaseChangeNotifier> _transaction;
         sequence_t                              _preTransactionLastSequence;
         std::mutex                              _mutex;
@@ -203,6 +220,15 @@ namespace litecore {
             return tracker.readChanges(_placeholder, changes, maxChanges, external);
         }
 
+        /** Returns true if changes were discarded before this notifier read them, because the
+            tracker's `maxChanges` limit was reached, or because they were already gone when it
+            was created to start after an older sequence. Resets the flag. */
+        bool missedChanges() {
+            bool missed = _missedChanges;
+            _missedChanges = false;
+            return missed;
+        }
+
     protected:
         void notify() {if (callback) callback(*this);}
 
@@ -210,6 +236,7 @@ namespace litecore {
         friend class SequenceTracker;
 
         SequenceTracker::const_iterator const _placeholder;
+        bool _missedChanges {false};
     };
 
 }
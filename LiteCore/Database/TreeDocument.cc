@@ -102,9 +102,24 @@ namespace c4Internal {
 
         bool loadSelectedRevBodyIfAvailable() override {
             loadRevisions();
+            if (_selectedRev && !_selectedRev->isBodyLoaded())
+                loadBodies();
             return selectedRev.body.buf != nullptr;
         }
 
+        // Reads the bodies of a doc whose tree was read without them, keeping the selection.
+        void loadBodies() {
+            WITH_LOCK(_db);
+            if (_versionedDoc.loadBodies()) {
+                selectRevision(_selectedRev);
+            } else {
+                // The doc has changed since it was read, so read it again:
+                alloc_slice revID = _selectedRevIDBuf;
+                _versionedDoc.read();
+                selectRevision(_versionedDoc[revidBuffer(revID)]);
+            }
+        }
+
         bool selectRevision(const Rev *rev) noexcept {   // doesn't throw
             _selectedRev = rev;
             _loadedBody = nullslice;
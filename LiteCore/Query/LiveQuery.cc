@@ -0,0 +1,261 @@
+//
+//  LiveQuery.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "LiveQuery.hh"
+#include "Query.hh"
+#include "RecordEnumerator.hh"
+#include "SequenceTracker.hh"
+#include "Error.hh"
+#include "Logging.hh"
+#include "Fleece.hh"
+#include <algorithm>
+#include <unordered_set>
+
+using namespace std;
+using namespace fleece;
+
+namespace litecore {
+
+    extern LogDomain DBLog;
+
+    // Name of the query parameter the delta query uses to select recently changed documents.
+    static const slice kSinceParam = "_liveQuerySince"_sl;
+
+
+    // Returns true if the expression contains a nested SELECT.
+    static bool containsSelect(const Value *node) {
+        Array::iterator i(node->asArray());
+        if (i && i.value()->asString().caseEquivalent("SELECT"_sl))
+            return true;
+        for (; i; ++i) {
+            if (containsSelect(i.value()))
+                return true;
+        }
+        return false;
+    }
+
+
+    // Returns the JSON of a query like the given one, but which only returns rows of documents
+    // whose sequence is greater than the kSinceParam parameter. Returns a null slice if the
+    // query's rows don't correspond to single documents, or if it has a LIMIT or OFFSET (a
+    // changed doc can move other rows into or out of the window), so it can't be updated
+    // incrementally.
+    static alloc_slice deltaExpression(slice expressionJSON) {
+        alloc_slice fleeceData = JSONConverter::convertJSON(expressionJSON);
+        const Value *root = Value::fromTrustedData(fleeceData);
+        const Dict *operands = root->asDict();
+        const Value *where = nullptr;
+        if (!operands) {
+            const Array *array = root->asArray();
+            if (array && array->count() == 2 && array->get(0)->asString().caseEquivalent("SELECT"_sl))
+                operands = array->get(1)->asDict();     // an entire SELECT statement
+            else
+                where = root;                           // just a WHERE clause
+            if (!operands && !where)
+                return alloc_slice();
+        }
+
+        Encoder enc;
+        enc.beginDictionary();
+        for (Dict::iterator i(operands ? operands : Dict::kEmpty); i; ++i) {
+            slice key = i.key()->asString();
+            if (key.caseEquivalent("WHERE"_sl)) {
+                where = i.value();
+            } else if (key.caseEquivalent("FROM"_sl) || key.caseEquivalent("GROUP_BY"_sl)
+                                                     || key.caseEquivalent("HAVING"_sl)
+                                                     || key.caseEquivalent("LIMIT"_sl)
+                                                     || key.caseEquivalent("OFFSET"_sl)) {
+                return alloc_slice();
+            } else if (!key.caseEquivalent("ORDER_BY"_sl)) {   // order of changes is irrelevant
+                if (containsSelect(i.value()))
+                    return alloc_slice();
+                enc.writeKey(key);
+                enc.writeValue(i.value());
+            }
+        }
+        if (where && containsSelect(where))
+            return alloc_slice();
+
+        // WHERE ['AND', ['>', ['._sequence'], ['$since']], where]
+        enc.writeKey("WHERE"_sl);
+        if (where) {
+            enc.beginArray();
+            enc.writeString("AND"_sl);
+        }
+        enc.beginArray();
+        enc.writeString(">"_sl);
+        enc.beginArray();
+        enc.writeString("._sequence"_sl);
+        enc.endArray();
+        enc.beginArray();
+        enc.writeString(string("$") + kSinceParam.asString());
+        enc.endArray();
+        enc.endArray();
+        if (where) {
+            enc.writeValue(where);
+            enc.endArray();
+        }
+        enc.endDictionary();
+        alloc_slice delta = enc.extractOutput();
+        return Value::fromTrustedData(delta)->toJSON();
+    }
+
+
+    LiveQuery::LiveQuery(KeyStore &keyStore, SequenceTracker &tracker,
+                         slice expressionJSON, slice paramBindingsJSON)
+    :_tracker(tracker)
+    ,_query(keyStore.compileQuery(expressionJSON))
+    ,_paramBindings(paramBindingsJSON)
+    {
+        if (!_query->isAggregate() && keyStore.capabilities().sequences) {
+            alloc_slice delta = deltaExpression(expressionJSON);
+            if (delta) {
+                _deltaQuery.reset(keyStore.compileQuery(delta));
+                // Enumerating by sequence makes the KeyStore create its by-sequence index, which
+                // the delta query uses to find the changed documents:
+                RecordEnumerator e(keyStore, keyStore.lastSequence() + 1);
+            }
+        }
+        if (!_deltaQuery)
+            LogTo(DBLog, "LiveQuery: query will be re-run after every change");
+
+        lock_guard<mutex> lock(_tracker.mutex());
+        _notifier.reset(new DatabaseChangeNotifier(_tracker, nullptr));
+    }
+
+
+    LiveQuery::~LiveQuery() {
+        lock_guard<mutex> lock(_tracker.mutex());
+        _notifier.reset();
+    }
+
+
+    size_t LiveQuery::update(const Callback &callback) {
+        vector<alloc_slice> docIDs;
+        sequence_t minSequence;
+        bool changed = readChanges(docIDs, minSequence);
+        if (!_hasRun || (changed && !_deltaQuery))
+            return runAll(callback);
+        else if (changed)
+            return runDelta(docIDs, minSequence - 1, callback);
+        else
+            return 0;
+    }
+
+
+    // Reads the IDs of the documents changed since the last call, and their lowest sequence.
+    bool LiveQuery::readChanges(vector<alloc_slice> &docIDs, sequence_t &minSequence) {
+        static const size_t kBatchSize = 100;
+        SequenceTracker::Change changes[kBatchSize];
+        bool external;
+        size_t n;
+        minSequence = UINT64_MAX;
+        lock_guard<mutex> lock(_tracker.mutex());
+        do {
+            n = _notifier->readChanges(changes, kBatchSize, external);
+            for (size_t i = 0; i < n; ++i) {
+                docIDs.emplace_back(changes[i].docID);
+                minSequence = min(minSequence, changes[i].sequence);
+            }
+        } while (n == kBatchSize);
+        // If the tracker dropped changes before they were read, a delta would be incomplete:
+        if (_notifier->missedChanges())
+            _hasRun = false;
+        return !docIDs.empty();
+    }
+
+
+    // Runs the entire query, and reports all its rows as a reset.
+    size_t LiveQuery::runAll(const Callback &callback) {
+        _hasRun = true;
+        vector<Row> rows;
+        QueryEnumerator::Options options;
+        options.paramBindings = _paramBindings;
+        QueryEnumerator e(_query.get(), &options);
+        while (e.next())
+            rows.push_back({alloc_slice(e.recordID()), e.sequence(), e.getCustomColumns()});
+
+        vector<Change> changes;
+        changes.reserve(rows.size());
+        for (auto &row : rows)
+            changes.push_back({kAdded, row.docID, row.sequence, row.customColumns});
+        callback(changes, true);
+
+        _rowCount = rows.size();
+        _rows.clear();
+        if (_deltaQuery) {
+            for (auto &row : rows) {
+                slice docID = row.docID;
+                _rows.emplace(docID, move(row));
+            }
+        }
+        return changes.size();
+    }
+
+
+    // Queries only the documents changed after sequence `since`, and reports how their rows
+    // differ from the current results. (The query may also return documents changed after the
+    // tracker was read; that's harmless, since their rows will be the same next time.)
+    size_t LiveQuery::runDelta(const vector<alloc_slice> &docIDs, sequence_t since,
+                               const Callback &callback)
+    {
+        Encoder enc;
+        enc.beginDictionary();
+        if (_paramBindings) {
+            alloc_slice bindings = JSONConverter::convertJSON(_paramBindings);
+            const Dict *dict = Value::fromTrustedData(bindings)->asDict();
+            if (!dict)
+                error::_throw(error::InvalidParameter);
+            for (Dict::iterator i(dict); i; ++i) {
+                enc.writeKey(i.key()->asString());
+                enc.writeValue(i.value());
+            }
+        }
+        enc.writeKey(kSinceParam);
+        enc.writeInt(since);
+        enc.endDictionary();
+        alloc_slice bindings = enc.extractOutput();
+        alloc_slice bindingsJSON = Value::fromTrustedData(bindings)->toJSON();
+
+        vector<Row> found;
+        QueryEnumerator::Options options;
+        options.paramBindings = bindingsJSON;
+        QueryEnumerator e(_deltaQuery.get(), &options);
+        while (e.next())
+            found.push_back({alloc_slice(e.recordID()), e.sequence(), e.getCustomColumns()});
+
+        vector<Change> changes;
+        unordered_set<slice, sliceHash> foundIDs;
+        for (auto &row : found) {
+            foundIDs.insert(row.docID);
+            auto i = _rows.find(row.docID);
+            if (i == _rows.end()) {
+                changes.push_back({kAdded, row.docID, row.sequence, row.customColumns});
+                _rows.emplace(row.docID, row);
+            } else if (i->second.sequence != row.sequence) {
+                changes.push_back({kUpdated, row.docID, row.sequence, row.customColumns});
+                i->second.sequence = row.sequence;
+                i->second.customColumns = row.customColumns;
+            }
+        }
+        // Changed documents that no longer match must have been removed:
+        for (auto &docID : docIDs) {
+            if (foundIDs.find(docID) == foundIDs.end()) {
+                auto i = _rows.find(docID);
+                if (i != _rows.end()) {
+                    changes.push_back({kRemoved, docID, 0, nullslice});
+                    _rows.erase(i);
+                }
+            }
+        }
+
+        if (!changes.empty())
+            callback(changes, false);
+        return changes.size();
+    }
+
+}
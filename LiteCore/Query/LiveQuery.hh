@@ -0,0 +1,85 @@
+//
+//  LiveQuery.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "Base.hh"
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace litecore {
+    class KeyStore;
+    class Query;
+    class SequenceTracker;
+    class DatabaseChangeNotifier;
+
+
+    /** Keeps the results of a query up to date as the database changes. Each update() asks the
+        SequenceTracker which documents changed, re-runs the query on just those documents, and
+        reports the rows that were added, removed or updated.
+        Queries whose rows don't correspond to single documents (aggregates, GROUP_BY, joins,
+        nested SELECTs) can't be updated incrementally; they're re-run in full, and reported as
+        a reset. */
+    class LiveQuery {
+    public:
+        enum ChangeType {
+            kAdded,
+            kRemoved,
+            kUpdated,
+        };
+
+        struct Change {
+            ChangeType  type;
+            slice       docID;
+            sequence_t  sequence;           ///< Document's current sequence (0 if removed)
+            slice       customColumns;      ///< Fleece array of WHAT columns (null if removed)
+        };
+
+        /** Receives the changes found by update(). If `reset` is true, the previous results
+            should be discarded, and `changes` is the entire new result set. */
+        typedef std::function<void(const std::vector<Change> &changes, bool reset)> Callback;
+
+        /** Compiles the query; it won't be run until the first update(). */
+        LiveQuery(KeyStore&, SequenceTracker&, slice expressionJSON,
+                  slice paramBindingsJSON =nullslice);
+        ~LiveQuery();
+
+        /** Brings the results up to date and reports any changes to the callback. The first call
+            runs the entire query and reports a reset. Returns the number of changes reported.
+            The caller must hold the database lock, but not the SequenceTracker's mutex. */
+        size_t update(const Callback&);
+
+        /** True if changes can be processed incrementally; false if the query is re-run. */
+        bool isIncremental() const                      {return _deltaQuery != nullptr;}
+
+        /** The number of rows in the current results. */
+        size_t rowCount() const         {return isIncremental() ? _rows.size() : _rowCount;}
+
+    private:
+        struct Row {
+            alloc_slice docID;
+            sequence_t  sequence;
+            alloc_slice customColumns;
+        };
+
+        bool readChanges(std::vector<alloc_slice> &docIDs, sequence_t &minSequence);
+        size_t runAll(const Callback&);
+        size_t runDelta(const std::vector<alloc_slice> &docIDs, sequence_t since,
+                        const Callback&);
+
+        SequenceTracker &_tracker;
+        std::unique_ptr<Query> _query;
+        std::unique_ptr<Query> _deltaQuery;     // Rows of documents changed after a sequence
+        alloc_slice _paramBindings;
+        std::unique_ptr<DatabaseChangeNotifier> _notifier;
+        std::unordered_map<slice, Row, fleece::sliceHash> _rows;   // keys point to Row::docID
+        size_t _rowCount {0};                   // Row count of a non-incremental query
+        bool _hasRun {false};
+    };
+
+}
@@ -25,6 +25,13 @@ namespace litecore {
     { }
 
 
+    QueryEnumerator::QueryEnumerator(Query *query,
+                                     Query *runOn,
+                                     const Options *options)
+    :_impl(query->createEnumerator(options, runOn))
+    { }
+
+
     bool QueryEnumerator::next() {
         if (_impl) {
             if (_impl->next(_recordID, _sequence))
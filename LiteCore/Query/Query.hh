@@ -16,14 +16,25 @@ namespace litecore {
     class QueryEnumerator {
     public:
         struct Options {
-            Options()           :skip(0), limit(UINT64_MAX) { }
+            Options()           :skip(0), limit(UINT64_MAX), streaming(false) { }
             uint64_t skip;
             uint64_t limit;
             slice paramBindings;
+            /** If true, rows are read lazily from the database as next() is called, instead of
+                all being collected up front. The enumerator then holds a read snapshot of the
+                database (as of its creation) until it's closed or destructed; commits made via
+                other DataFile instances won't be visible to it. Changes made through the same
+                DataFile while it's open have undefined visibility, so avoid them. */
+            bool streaming;
         };
 
         QueryEnumerator(Query*, const Options* =nullptr);
 
+        /** Runs `runOn`, a Query compiled from the same expression on another DataFile open on the
+            same file (such as a pooled reader), but afterwards refers only to `query`; so `runOn`
+            and its DataFile can be reused as soon as this returns. Can't be streaming. */
+        QueryEnumerator(Query *query, Query *runOn, const Options* =nullptr);
+
         bool next();
         void close()                    {_impl.reset();}
 
@@ -80,12 +91,18 @@ namespace litecore {
 
         virtual std::string explain()   {return "";}
 
+        /** True if the query's rows don't correspond to individual records, as with aggregate
+            functions or GROUP_BY. */
+        virtual bool isAggregate() const    {return false;}
+
     protected:
         Query(KeyStore &keyStore) noexcept
         :_keyStore(keyStore)
         { }
 
         virtual QueryEnumerator::Impl* createEnumerator(const QueryEnumerator::Options*) =0;
+        virtual QueryEnumerator::Impl* createEnumerator(const QueryEnumerator::Options*,
+                                                        Query *runOn) =0;
 
     private:
         KeyStore &_keyStore;
@@ -122,15 +122,32 @@ namespace litecore {
         out << "'";
     }
 
+
+    // Writes an identifier with SQL quoting (inside double-quotes, doubling contained quotes.)
+    /*static*/ void QueryParser::writeSQLIdentifier(std::ostream &out, slice name) {
+        out << '"';
+        for (unsigned i = 0; i < name.size; i++) {
+            if (name[i] == '"')
+                out.write("\"\"", 2);
+            else
+                out.write((const char*)&name[i], 1);
+        }
+        out << '"';
+    }
+
     
     static string propertyFromOperands(Array::iterator &operands);
     static string propertyFromNode(const Value *node);
+    static bool variablePropertyFromNode(const Value *node, string &var, string &property);
 
 
 #pragma mark - QUERY PARSER TOP LEVEL:
 
 
     void QueryParser::reset() {
+        _sql.str(string());
+        _sql.clear();
+        _aliases.clear();
         _context.clear();
         _context.push_back(&kOuterOperation);
         _parameters.clear();
@@ -138,6 +155,7 @@ namespace litecore {
         _ftsTables.clear();
         _1stCustomResultCol = 0;
         _isAggregateQuery = _aggregatesOK = false;
+        _uncovered = _coveredColumnUsed = _coveringKeyUsed = _inWhere = false;
     }
 
 
@@ -148,6 +166,33 @@ namespace litecore {
     
     
     void QueryParser::parse(const Value *expression) {
+        // If a covering index has every property the query uses, read from it instead of the
+        // records. Prefer one whose key the WHERE clause uses, since SQLite can search on that.
+        const CoveringIndex *covering = nullptr;
+        for (auto &index : _coveringIndexes) {
+            if (parseCovered(expression, &index) && _coveredColumnUsed) {
+                if (!covering || _coveringKeyUsed)
+                    covering = &index;
+                if (_coveringKeyUsed)
+                    break;
+            }
+        }
+        parseCovered(expression, covering);
+        _coveringIndexUsed = covering ? covering->table : string();
+    }
+
+
+    // Parses the query, reading from the covering index if one is given. Returns false if the
+    // index lacks something the query needs (in which case the SQL is unusable.)
+    bool QueryParser::parseCovered(const Value *expression, const CoveringIndex *index) {
+        _covering = index;
+        parseSelect(expression);
+        _covering = nullptr;
+        return !_uncovered;
+    }
+
+
+    void QueryParser::parseSelect(const Value *expression) {
         reset();
         if (expression->asDict()) {
             // Given a dict; assume it's the operands of a SELECT:
@@ -219,7 +264,9 @@ namespace litecore {
         // WHERE clause:
         if (where) {
             _sql << " WHERE ";
+            _inWhere = true;
             parseNode(where);
+            _inWhere = false;
         }
 
         // GROUP_BY clause:
@@ -328,7 +375,15 @@ namespace litecore {
 
 
     void QueryParser::writeFromClause(const Value *from) {
-        _sql << " FROM " << _tableName;
+        if (_covering) {
+            // Joins and full-text matches need the records table:
+            if (from || !_ftsTables.empty())
+                _uncovered = true;
+            _sql << " FROM ";
+            writeSQLIdentifier(_sql, slice(_covering->table));
+        } else {
+            _sql << " FROM " << _tableName;
+        }
         if (from) {
             for (unsigned i = 0; i < _aliases.size(); ++i) {
                 auto entry = from->asArray()->get(i)->asDict();
@@ -479,7 +534,8 @@ namespace litecore {
     // Handles EXISTS
     void QueryParser::existsOp(slice op, Array::iterator& operands) {
         // "EXISTS propertyname" turns into a call to fl_exists()
-        if (writeNestedPropertyOpIfAny("fl_exists", operands))
+        if (writeNestedPropertyOpIfAny("fl_exists", operands)
+                || writeNestedVariableOpIfAny("fl_exists", operands))
             return;
 
         _sql << "EXISTS";
@@ -595,14 +651,10 @@ namespace litecore {
         require(isValidIdentifier(var), "Invalid variable name '%.*s'", SPLAT(op));
         require(_variables.count(var) > 0, "No such variable '%.*s'", SPLAT(op));
 
-        if (operands.count() == 0) {
+        if (operands.count() == 0)
             _sql << '_' << var << ".value";
-        } else {
-            auto property = propertyFromOperands(operands);
-            _sql << "fl_value(_" << var << ".pointer, ";
-            writeSQLString(_sql, slice(property));
-            _sql << ")";
-        }
+        else
+            writeVariableGetter("fl_value", var, propertyFromOperands(operands));
     }
 
 
@@ -679,6 +731,21 @@ namespace litecore {
     }
 
 
+    // Registered scalar functions (see SQLiteFleeceFunctions.cc) that read an array argument
+    // passed by fl_pointer as well as one re-encoded by fl_value. (The fl_* functions that
+    // array_count() and EXISTS turn into don't need this: they're given the document, or a
+    // variable's pointer, plus a path, and read the value in place.)
+    static const char* const kArrayPointerFunctions[] = {"array_sum", nullptr};
+
+    static bool takesArrayPointer(slice fnName) {
+        for (auto name = kArrayPointerFunctions; *name; ++name) {
+            if (fnName.caseEquivalent(slice(*name)))
+                return true;
+        }
+        return false;
+    }
+
+
     // Handles function calls, where the op ends with "()"
     void QueryParser::functionOp(slice op, Array::iterator& operands) {
         // Look up the function name:
@@ -706,8 +773,11 @@ namespace litecore {
         else
             op = spec->name; // canonical case
 
-        // Special case: "array_count(propertyname)" turns into a call to fl_count:
-        if (op.caseEquivalent("array_count"_sl) && writeNestedPropertyOpIfAny("fl_count", operands))
+        // Special case: "array_count(propertyname)" turns into a call to fl_count (which reads a
+        // variable's property through its pointer, too):
+        if (op.caseEquivalent("array_count"_sl)
+                && (writeNestedPropertyOpIfAny("fl_count", operands)
+                    || writeNestedVariableOpIfAny("fl_count", operands)))
             return;
         else if (op.caseEquivalent("rank"_sl)) {
             if (writeNestedPropertyOpIfAny("rank", operands))
@@ -716,6 +786,24 @@ namespace litecore {
                 fail("rank() can only be called on FTS-indexed properties");
         }
 
+        // Special case: an array function whose only argument is a property (of the document or
+        // of an ANY/EVERY variable) gets a pointer to the property value, instead of a
+        // re-encoded copy. (With more than one argument, SQLite might reload the body column
+        // between them, invalidating earlier pointers.) Only scalar functions qualify: an
+        // aggregate would hold the pointer across rows.
+        if (arity == 1 && !spec->aggregate && !spec->sqlite_name && takesArrayPointer(op)) {
+            string var, property = propertyFromNode(operands[0]);
+            if (!property.empty() || variablePropertyFromNode(operands[0], var, property)) {
+                _sql << op << '(';
+                if (var.empty())
+                    writePropertyGetter("fl_pointer", property);
+                else
+                    writeVariableGetter("fl_pointer", var, property);
+                _sql << ')';
+                return;
+            }
+        }
+
         _sql << op;
         writeArgList(operands);
     }
@@ -779,6 +867,30 @@ namespace litecore {
     }
 
 
+    // If a node is a property of an ANY/EVERY variable, like ["?X", "name"], stores the variable
+    // and the property path and returns true; else returns false.
+    static bool variablePropertyFromNode(const Value *node, string &var, string &property) {
+        Array::iterator i(node->asArray());
+        if (i.count() < 2)
+            return false;
+        auto op = i[0]->asString();
+        if (!op || op[0] != '?')
+            return false;
+        ++i;
+        if (op.size == 1) {
+            var = (string)i.value()->asString();
+            ++i;
+        } else {
+            op.moveStart(1);
+            var = op.asString();
+        }
+        if (i.count() == 0)
+            return false;       // the variable itself, not a property of it
+        property = propertyFromOperands(i);
+        return true;
+    }
+
+
     // If the first operand is a property operation, writes it using the given SQL function name
     // and returns true; else returns false.
     bool QueryParser::writeNestedPropertyOpIfAny(const char *fnName, Array::iterator &operands) {
@@ -792,6 +904,32 @@ namespace litecore {
     }
 
 
+    // If the first operand is a property of an ANY/EVERY variable, writes it using the given SQL
+    // function and returns true; else returns false.
+    bool QueryParser::writeNestedVariableOpIfAny(const char *fnName, Array::iterator &operands) {
+        if (operands.count() == 0)
+            return false;
+        string var, property;
+        if (!variablePropertyFromNode(operands[0], var, property))
+            return false;
+        writeVariableGetter(fnName, var, property);
+        return true;
+    }
+
+
+    // Writes a call to a Fleece SQL function on a property of an ANY/EVERY variable. The
+    // function reads the variable's value in place, through fl_each's pointer column.
+    void QueryParser::writeVariableGetter(const char *fn, const string &var,
+                                          const string &property)
+    {
+        require(isValidIdentifier(var), "Invalid variable name '%s'", var.c_str());
+        require(_variables.count(var) > 0, "No such variable '%s'", var.c_str());
+        _sql << fn << "(_" << var << ".pointer, ";
+        writeSQLString(_sql, slice(property));
+        _sql << ")";
+    }
+
+
     // Writes a call to a Fleece SQL function, including the closing ")".
     void QueryParser::writePropertyGetter(const string &fn, string property) {
         string tableName;
@@ -808,11 +946,26 @@ namespace litecore {
             property = property.substr(dot+1);
         }
 
+        if (_covering && property != "_id" && property != "_sequence") {
+            // A covering index has a column for each of its properties' values:
+            auto &props = _covering->properties;
+            if (fn == "fl_value" && tableName.empty()
+                                 && find(props.begin(), props.end(), property) != props.end()) {
+                _coveredColumnUsed = true;
+                if (_inWhere && property == props[0])
+                    _coveringKeyUsed = true;
+                writeSQLIdentifier(_sql, slice(coveredColumnName(property)));
+                return;
+            }
+            _uncovered = true;
+        }
+
         if (property == "_id") {
-            require(fn == "fl_value", "can't use '_id' in this context");
+            require(fn == "fl_value" || fn == "fl_pointer", "can't use '_id' in this context");
             _sql << tableName << "key";
         } else if (property == "_sequence") {
-            require(fn == "fl_value", "can't use '_sequence' in this context");
+            require(fn == "fl_value" || fn == "fl_pointer",
+                    "can't use '_sequence' in this context");
             _sql << tableName << "sequence";
         } else if (fn == "rank") {
             // FTS rank() needs special treatment
@@ -881,6 +1034,35 @@ namespace litecore {
     }
 
 
+    string QueryParser::coveringIndexName(const Array *keys) const {
+        return indexName(keys) + "::covering";
+    }
+
+
+    /*static*/ vector<string> QueryParser::coveredProperties(const Array *keys,
+                                                            const Array *included)
+    {
+        vector<string> properties;
+        for (auto exprs : {keys, included}) {
+            for (Array::iterator i(exprs); i; ++i) {
+                string property;
+                slice str = i.value()->asString();
+                if (str.size > 1 && str[0] == '.')
+                    property = string((const char*)str.buf + 1, str.size - 1);
+                else
+                    property = propertyFromNode(i.value());
+                require(!property.empty(),
+                        "Covering index expressions must be document properties");
+                require(property != "_id" && property != "_sequence",
+                        "Covering index can't include '%s'", property.c_str());
+                if (find(properties.begin(), properties.end(), property) == properties.end())
+                    properties.push_back(property);
+            }
+        }
+        return properties;
+    }
+
+
     size_t QueryParser::FTSPropertyIndex(const Value *matchLHS, bool canAdd) {
         string key = FTSIndexName(matchLHS);
         auto i = find(_ftsTables.begin(), _ftsTables.end(), key);
@@ -35,6 +35,17 @@ namespace litecore {
         void setDefaultOffset(const std::string &o)                 {_defaultOffset = o;}
         void setDefaultLimit(const std::string &l)                  {_defaultLimit = l;}
 
+        /** A covering index: a table that mirrors every record's key, sequence and meta,
+            plus the values of some properties (each in a column named by coveredColumnName.) */
+        struct CoveringIndex {
+            std::string table;
+            std::vector<std::string> properties;    // The first one is the index's primary key
+        };
+
+        /** Tells the parser what covering indexes exist. If all the properties a query uses are
+            in one of them, the query will read that table instead of the records. */
+        void setCoveringIndexes(const std::vector<CoveringIndex> &c){_coveringIndexes = c;}
+
         void parse(const fleece::Value*);
         void parseJSON(slice);
 
@@ -43,6 +54,7 @@ namespace litecore {
         void writeCreateIndex(const fleece::Array *expressions);
 
         static void writeSQLString(std::ostream &out, slice str);
+        static void writeSQLIdentifier(std::ostream &out, slice name);
 
         std::string SQL()  const                                    {return _sql.str();}
 
@@ -51,10 +63,23 @@ namespace litecore {
 
         bool isAggregateQuery() const                               {return _isAggregateQuery;}
 
+        /** The table of the covering index the query uses, or an empty string if none. */
+        const std::string& coveringIndexUsed() const                {return _coveringIndexUsed;}
+
         static std::string expressionSQL(const fleece::Value*, const char *bodyColumnName = "body");
         std::string indexName(const fleece::Array *keys) const;
         std::string FTSIndexName(const fleece::Value *key) const;
         std::string FTSIndexName(const std::string &property) const;
+        std::string coveringIndexName(const fleece::Array *keys) const;
+
+        /** Returns the property paths of a covering index's keys followed by its included
+            expressions; throws InvalidQuery if any of them isn't a plain document property. */
+        static std::vector<std::string> coveredProperties(const fleece::Array *keys,
+                                                          const fleece::Array *included);
+
+        /** The name of the covering-index column holding a property's value: the property path
+            with a leading '.', so it can't collide with the key, sequence or meta columns. */
+        static std::string coveredColumnName(const std::string &property)  {return "." + property;}
 
     private:
         struct Operation;
@@ -68,6 +93,8 @@ namespace litecore {
         QueryParser& operator=(const QueryParser&) =delete;
 
         void reset();
+        void parseSelect(const fleece::Value*);
+        bool parseCovered(const fleece::Value*, const CoveringIndex*);
         void parseNode(const fleece::Value*);
         void parseOpNode(const fleece::Array*);
         void handleOperation(const Operation*, slice actualOperator, fleece::Array::iterator& operands);
@@ -99,7 +126,10 @@ namespace litecore {
         void functionOp(slice, fleece::Array::iterator&);
 
         bool writeNestedPropertyOpIfAny(const char *fnName, fleece::Array::iterator &operands);
+        bool writeNestedVariableOpIfAny(const char *fnName, fleece::Array::iterator &operands);
         void writePropertyGetter(const std::string &fn, std::string property);
+        void writeVariableGetter(const char *fn, const std::string &var,
+                                 const std::string &property);
         void writeSQLString(slice str)              {writeSQLString(_sql, str);}
         void writeArgList(fleece::Array::iterator& operands);
         void writeColumnList(fleece::Array::iterator& operands);
@@ -124,6 +154,13 @@ namespace litecore {
         unsigned _1stCustomResultCol {0};
         bool _aggregatesOK {false};
         bool _isAggregateQuery {false};
+        std::vector<CoveringIndex> _coveringIndexes;
+        const CoveringIndex* _covering {nullptr};   // Covering index being tried, if any
+        bool _uncovered {false};                    // Has the query used anything not covered?
+        bool _coveredColumnUsed {false};            // Has the query used any index column?
+        bool _coveringKeyUsed {false};              // Has the WHERE clause used the index key?
+        bool _inWhere {false};
+        std::string _coveringIndexUsed;
     };
 
 }
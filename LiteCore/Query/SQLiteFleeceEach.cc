@@ -24,6 +24,7 @@
 
 #include "SQLite_Internal.hh"
 #include "SQLiteFleeceUtil.hh"
+#include "Compression.hh"
 #include "Path.hh"
 
 #include <sqlite3.h>
@@ -201,6 +202,16 @@ private:
 
         // Parse the Fleece data:
         _fleeceData = valueAsSlice(argv[0]);
+        if (_vtab->context.compressor && BodyCompressor::isCompressed(_fleeceData)) {
+            // Keep the decompressed body in the cursor, not the shared context's cache, since
+            // other cursors on this table may be in use at the same time:
+            try {
+                _fleeceData = _vtab->context.compressor->decompress(_fleeceData);
+            } catch (const std::exception &x) {
+                Warn("Invalid compressed document body in SQLite table");
+                return SQLITE_CORRUPT;
+            }
+        }
         slice data = _fleeceData;
         if (_vtab->context.accessor)
             data = _vtab->context.accessor(data);
@@ -261,12 +272,9 @@ private:
             case kDataColumn:
                 setResultBlobFromEncodedValue(ctx, currentValue());
                 break;
-            case kPointerColumn: {
-                auto value = currentValue();
-                sqlite3_result_blob(ctx, &value, sizeof(value), SQLITE_TRANSIENT);
-                sqlite3_result_subtype(ctx, kFleecePointerSubtype);
+            case kPointerColumn:
+                setResultPointerFromValue(ctx, currentValue());
                 break;
-            }
             case kRootFleeceDataColumn:
                 setResultBlobFromSlice(ctx, _fleeceData);
                 break;
@@ -377,12 +385,13 @@ constexpr sqlite3_module FleeceCursor::kEachModule;
 
 int RegisterFleeceEachFunctions(sqlite3 *db,
                                 DataFile::FleeceAccessor accessor,
+                                const BodyCompressor *compressor,
                                 SharedKeys *sharedKeys)
 {
     return sqlite3_create_module_v2(db,
                                     "fl_each",
                                     &FleeceCursor::kEachModule,
-                                    new fleeceFuncContext{accessor, sharedKeys},
+                                    new fleeceFuncContext{accessor, compressor, sharedKeys},
                                     [](void *param){delete (fleeceFuncContext*)param;});
 }
 
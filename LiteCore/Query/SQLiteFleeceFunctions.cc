@@ -15,10 +15,12 @@
 
 #include "SQLite_Internal.hh"
 #include "SQLiteFleeceUtil.hh"
+#include "Compression.hh"
 #include "Path.hh"
 #include "Error.hh"
 #include "Logging.hh"
 #include <sqlite3.h>
+#include <memory>
 #include <regex>
 
 using namespace fleece;
@@ -27,6 +29,18 @@ using namespace std;
 namespace litecore {
 
 
+    slice fleeceFuncContext::fleeceData(slice recordBody) {
+        if (compressor && BodyCompressor::isCompressed(recordBody)) {
+            if (recordBody != lastCompressedBody) {
+                lastBody = compressor->decompress(recordBody);
+                lastCompressedBody = recordBody;
+            }
+            recordBody = lastBody;
+        }
+        return accessor ? accessor(recordBody) : recordBody;
+    }
+
+
     const Value* fleeceParam(sqlite3_context* ctx, sqlite3_value *arg) noexcept {
         slice fleece = valueAsSlice(arg);
         if (sqlite3_value_subtype(arg) == kFleecePointerSubtype) {
@@ -42,8 +56,14 @@ namespace litecore {
             if (sqlite3_value_subtype(arg) != kFleeceDataSubtype) {
                 // Pull the Fleece data out of a raw document body:
                 auto funcCtx = (fleeceFuncContext*)sqlite3_user_data(ctx);
-                if (funcCtx->accessor)
-                    fleece = funcCtx->accessor(fleece);
+                try {
+                    fleece = funcCtx->fleeceData(fleece);
+                } catch (const std::exception &x) {
+                    Warn("Invalid compressed document body in SQLite table");
+                    sqlite3_result_error(ctx, "invalid compressed data", -1);
+                    sqlite3_result_error_code(ctx, SQLITE_CORRUPT);
+                    return nullptr;
+                }
             }
             if (!fleece)
                 return Dict::kEmpty;             // No body; may be deleted rev
@@ -76,11 +96,40 @@ namespace litecore {
     }
 
 
-    static const Value* evaluatePath(sqlite3_context *ctx, slice path, const Value *val) noexcept {
-        auto sharedKeys = ((fleeceFuncContext*)sqlite3_user_data(ctx))->sharedKeys;
-        int rc = evaluatePath(path, sharedKeys, &val);
-        if (rc == SQLITE_OK)
-            return val;
+    // Evaluates the property path in argument `argNo` against a Fleece value. The parsed Path is
+    // attached to the argument as SQLite auxdata, which SQLite keeps as long as the argument
+    // doesn't change; so a constant path (the usual case) is only parsed, and its keys looked up
+    // in the SharedKeys, once per statement instead of once per row.
+    static const Value* evaluatePath(sqlite3_context *ctx, sqlite3_value **argv, int argNo,
+                                     const Value *val) noexcept
+    {
+        auto path = (const Path*)sqlite3_get_auxdata(ctx, argNo);
+        if (path)
+            return path->eval(val);
+
+        slice pathStr = valueAsSlice(argv[argNo]);
+        int rc;
+        if (!pathStr.buf) {
+            rc = SQLITE_FORMAT;
+        } else {
+            try {
+                auto sharedKeys = ((fleeceFuncContext*)sqlite3_user_data(ctx))->sharedKeys;
+                unique_ptr<Path> newPath(new Path((string)pathStr, sharedKeys));   // can throw!
+                val = newPath->eval(val);
+                // (SQLite may delete the Path immediately, so don't use it after this call)
+                sqlite3_set_auxdata(ctx, argNo, newPath.release(),
+                                    [](void *p) {delete (Path*)p;});
+                return val;
+            } catch (const error &error) {
+                WarnError("Invalid property path `%.*s` in query (err %d)",
+                          (int)pathStr.size, (char*)pathStr.buf, error.code);
+                rc = SQLITE_ERROR;
+            } catch (const bad_alloc&) {
+                rc = SQLITE_NOMEM;
+            } catch (...) {
+                rc = SQLITE_ERROR;
+            }
+        }
         sqlite3_result_error_code(ctx, rc);
         return nullptr;
     }
@@ -156,6 +205,12 @@ namespace litecore {
     }
 
 
+    void setResultPointerFromValue(sqlite3_context *ctx, const Value *val) noexcept {
+        sqlite3_result_blob(ctx, &val, sizeof(val), SQLITE_TRANSIENT);
+        sqlite3_result_subtype(ctx, kFleecePointerSubtype);
+    }
+
+
 #pragma mark - REGULAR FUNCTIONS:
 
 
@@ -165,19 +220,41 @@ namespace litecore {
             const Value *root = fleeceParam(ctx, argv[0]);
             if (!root)
                 return;
-            setResultFromValue(ctx, evaluatePath(ctx, valueAsSlice(argv[1]), root));
+            setResultFromValue(ctx, evaluatePath(ctx, argv, 1, root));
         } catch (const std::exception &x) {
             sqlite3_result_error(ctx, "fl_value: exception!", -1);
         }
     }
 
 
+    // fl_pointer(fleeceData, propertyPath) -> propertyValue
+    // Like fl_value, except that an array or dict is returned as a Value* pointing into the
+    // document, instead of being copied and re-encoded. The pointer is only valid while the
+    // current row is being evaluated, so QueryParser only uses this for the single argument of
+    // a function that takes a Fleece array (like array_sum), never for a value that could be
+    // stored, sorted or returned as a result column.
+    static void fl_pointer(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        try {
+            const Value *root = fleeceParam(ctx, argv[0]);
+            if (!root)
+                return;
+            const Value *val = evaluatePath(ctx, argv, 1, root);
+            if (val && (val->type() == kArray || val->type() == kDict))
+                setResultPointerFromValue(ctx, val);
+            else
+                setResultFromValue(ctx, val);
+        } catch (const std::exception &x) {
+            sqlite3_result_error(ctx, "fl_pointer: exception!", -1);
+        }
+    }
+
+
     // fl_exists(fleeceData, propertyPath) -> 0/1
     static void fl_exists(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
         const Value *root = fleeceParam(ctx, argv[0]);
         if (!root)
             return;
-        const Value *val = evaluatePath(ctx, valueAsSlice(argv[1]), root);
+        const Value *val = evaluatePath(ctx, argv, 1, root);
         sqlite3_result_int(ctx, (val ? 1 : 0));
     }
 
@@ -187,7 +264,7 @@ namespace litecore {
         const Value *root = fleeceParam(ctx, argv[0]);
         if (!root)
             return;
-        setResultFromValueType(ctx, evaluatePath(ctx, valueAsSlice(argv[1]), root));
+        setResultFromValueType(ctx, evaluatePath(ctx, argv, 1, root));
     }
 
     
@@ -196,7 +273,11 @@ namespace litecore {
         const Value *root = fleeceParam(ctx, argv[0]);
         if (!root)
             return;
-        const Value *val = evaluatePath(ctx, valueAsSlice(argv[1]), root);
+        const Value *val = evaluatePath(ctx, argv, 1, root);
+        if (!val) {
+            sqlite3_result_null(ctx);
+            return;
+        }
         switch (val->type()) {
             case kArray:
                 sqlite3_result_int(ctx, val->asArray()->count());
@@ -220,7 +301,7 @@ namespace litecore {
         const Value *root = fleeceParam(ctx, argv[0]);
         if (!root)
             return;
-        root = evaluatePath(ctx, valueAsSlice(argv[1]), root);
+        root = evaluatePath(ctx, argv, 1, root);
         if (!root)
             return;
         const Array *array = root->asArray();
@@ -307,6 +388,7 @@ namespace litecore {
                         return;
                     for (Array::iterator item(root->asArray()); item; ++item)
                         sum += item->asDouble();
+                    break;
                 }
                 case SQLITE_INTEGER:
                 case SQLITE_FLOAT:
@@ -346,6 +428,7 @@ namespace litecore {
 
     int RegisterFleeceFunctions(sqlite3 *db,
                                 DataFile::FleeceAccessor accessor,
+                                const BodyCompressor *compressor,
                                 fleece::SharedKeys *sharedKeys)
     {
         // Adapted from json1.c in SQLite source code
@@ -357,6 +440,7 @@ namespace litecore {
             void (*xFunc)(sqlite3_context*,int,sqlite3_value**);
         } aFunc[] = {
             { "fl_value",          2, fl_value  },
+            { "fl_pointer",        2, fl_pointer },
             { "fl_exists",         2, fl_exists },
             { "fl_type",           2, fl_type },
             { "fl_count",          2, fl_count },
@@ -381,7 +465,7 @@ namespace litecore {
                                             aFunc[i].zName,
                                             aFunc[i].nArg,
                                             SQLITE_UTF8 | SQLITE_DETERMINISTIC,
-                                            new fleeceFuncContext{accessor, sharedKeys},
+                                            new fleeceFuncContext{accessor, compressor, sharedKeys},
                                             aFunc[i].xFunc, nullptr, nullptr,
                                             [](void *param) {delete (fleeceFuncContext*)param;});
         }
@@ -13,6 +13,7 @@
 
 
 namespace litecore {
+    class BodyCompressor;
 
     // SQLite value subtypes for tagging blobs as Fleece
     static const int kFleeceDataSubtype     = 0x66;   // Blob contains encoded Fleece data
@@ -22,7 +23,16 @@ namespace litecore {
     // What the user_data of a registered function points to
     struct fleeceFuncContext {
         DataFile::FleeceAccessor accessor;
+        const BodyCompressor *compressor;
         fleece::SharedKeys *sharedKeys;
+
+        // Returns the Fleece data of a record body, decompressing it first if necessary.
+        // The result stays valid until it's called with a different body. Throws on bad data.
+        slice fleeceData(slice recordBody);
+
+        // One-entry cache of the last body decompressed, since a query usually calls several
+        // functions on the same row:
+        alloc_slice lastCompressedBody, lastBody;
     };
 
 
@@ -48,4 +58,9 @@ namespace litecore {
     void setResultTextFromSlice(sqlite3_context*, slice) noexcept;
     void setResultBlobFromSlice(sqlite3_context*, slice) noexcept;
     bool setResultBlobFromEncodedValue(sqlite3_context*, const fleece::Value*);
+
+    // Returns a Value* itself, as a blob tagged with kFleecePointerSubtype. Only safe if the
+    // result is passed directly to a function that calls fleeceParam() on it, while the data
+    // the Value points into (usually the current row's body) is still valid.
+    void setResultPointerFromValue(sqlite3_context*, const fleece::Value*) noexcept;
 }
@@ -18,6 +18,8 @@
 #include "Benchmark.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include <sqlite3.h>
+#include <algorithm>
+#include <mutex>
 #include <sstream>
 #include <iostream>
 
@@ -36,28 +38,115 @@ namespace litecore {
     };
 
 
-    class SQLiteQuery : public Query {
-    public:
-        SQLiteQuery(SQLiteKeyStore &keyStore, slice selectorExpression)
-        :Query(keyStore)
-        {
+    // The parts of a SQLiteQuery that depend only on its expression. These are cached by the
+    // SQLiteDataFile, so compiling the same expression again doesn't have to re-parse it.
+    // The prepared statement isn't shared, since each query binds and steps its own: a query
+    // takes the spare statement left by a freed one if there is one, else prepares a new one.
+    struct SQLiteCompiledQuery {
+        SQLiteCompiledQuery(SQLiteKeyStore &keyStore, slice selectorExpression) {
             QueryParser qp(keyStore.tableName());
             qp.setBaseResultColumns({"sequence", "key", "meta"});
             qp.setDefaultOffset("$offset");
             qp.setDefaultLimit("$limit");
+            qp.setCoveringIndexes(coveringIndexes(keyStore));
             qp.parseJSON(selectorExpression);
 
-            string sql = qp.SQL();
+            sql = qp.SQL();
             LogTo(SQL, "Compiled Query: %s", sql.c_str());
-            _statement.reset(keyStore.compile(sql));
-            
-            _ftsTables = qp.ftsTablesUsed();
-            for (auto ftsTable : _ftsTables) {
+            _spareStatement.reset(keyStore.compile(sql));
+
+            ftsTables = qp.ftsTablesUsed();
+            for (auto ftsTable : ftsTables) {
                 if (!keyStore.db().tableExists(ftsTable))
                     error::_throw(error::LiteCore, error::NoSuchIndex);
             }
-            _1stCustomResultColumn = qp.firstCustomResultColumn();
-            _isAggregate = qp.isAggregateQuery();
+            firstCustomResultColumn = qp.firstCustomResultColumn();
+            isAggregate = qp.isAggregateQuery();
+            coveringIndex = qp.coveringIndexUsed();
+        }
+
+        // Finds the covering-index tables of the key-store (see SQLiteKeyStore::createIndex),
+        // and the properties stored in each one's columns.
+        static vector<QueryParser::CoveringIndex> coveringIndexes(SQLiteKeyStore &keyStore) {
+            vector<QueryParser::CoveringIndex> indexes;
+            string prefix = keyStore.tableName() + "::";
+            SQLite::Statement tables(keyStore.db(), "SELECT name FROM sqlite_master "
+                                                    "WHERE type='table' AND name LIKE '%::covering'");
+            while (tables.executeStep()) {
+                string table = tables.getColumn(0).getString();
+                if (table.compare(0, prefix.size(), prefix) == 0)
+                    indexes.push_back({table, {}});
+            }
+            for (auto &index : indexes) {
+                SQLite::Statement columns(keyStore.db(), "PRAGMA table_info(\"" + index.table + "\")");
+                for (int col = 0; columns.executeStep(); ++col) {
+                    if (col < 3)        // skip key, sequence, meta
+                        continue;
+                    string column = columns.getColumn(1).getString();
+                    if (column.empty() || column[0] != '.') {
+                        index.properties.clear();       // not a layout we know; don't use it
+                        break;
+                    }
+                    index.properties.push_back(column.substr(1));
+                }
+            }
+            indexes.erase(remove_if(indexes.begin(), indexes.end(),
+                                    [](const QueryParser::CoveringIndex &index) {
+                                        return index.properties.empty();
+                                    }),
+                          indexes.end());
+            return indexes;
+        }
+
+        // Returns a prepared statement for a new query to use by itself.
+        shared_ptr<SQLite::Statement> takeStatement(SQLiteKeyStore &keyStore) {
+            {
+                lock_guard<mutex> lock(_mutex);
+                if (_spareStatement)
+                    return move(_spareStatement);
+            }
+            return shared_ptr<SQLite::Statement>(keyStore.compile(sql));
+        }
+
+        // Called when a query is freed, to keep its statement for the next one.
+        void returnStatement(shared_ptr<SQLite::Statement> statement) {
+            lock_guard<mutex> lock(_mutex);
+            if (!_spareStatement)
+                _spareStatement = move(statement);
+        }
+
+        string sql;
+        vector<string> ftsTables;
+        unsigned firstCustomResultColumn;
+        bool isAggregate;
+        string coveringIndex;           // Table of the covering index used, if any
+
+    private:
+        mutex _mutex;
+        shared_ptr<SQLite::Statement> _spareStatement;  // Prepared, and not in use by any query
+    };
+
+
+    class SQLiteQuery : public Query {
+    public:
+        SQLiteQuery(SQLiteKeyStore &keyStore, shared_ptr<SQLiteCompiledQuery> compiled)
+        :Query(keyStore)
+        ,_ftsTables(compiled->ftsTables)
+        ,_1stCustomResultColumn(compiled->firstCustomResultColumn)
+        ,_isAggregate(compiled->isAggregate)
+        ,_compiled(compiled)
+        ,_statement(compiled->takeStatement(keyStore))
+        { }
+
+        ~SQLiteQuery() {
+            // Hand the statement back unless an enumerator is still using it:
+            if (_statement.use_count() == 1) {
+                try {
+                    _statement->reset();
+                    _statement->clearBindings();
+                    _compiled->returnStatement(move(_statement));
+                } catch (...) { }
+            }
         }
 
 
@@ -113,20 +202,34 @@ namespace litecore {
                     result << x.getColumn(i).getInt() << "|";
                 result << " " << x.getColumn(3).getText() << "\n";
             }
+            if (!_compiled->coveringIndex.empty())
+                result << "(covered by index " << _compiled->coveringIndex << ")\n";
             return result.str();
         }
 
-        vector<string> _ftsTables;
-        unsigned _1stCustomResultColumn;
-        bool _isAggregate;
+        bool isAggregate() const override   {return _isAggregate;}
+
+        const vector<string> &_ftsTables;
+        const unsigned _1stCustomResultColumn;
+        const bool _isAggregate;
 
         shared_ptr<SQLite::Statement> statement() {return _statement;}
 
+        // Compiles a private copy of the statement, so a long-lived (streaming) enumerator
+        // doesn't tie up the query's own.
+        shared_ptr<SQLite::Statement> newStatement() {
+            auto &store = (SQLiteKeyStore&)keyStore();
+            return shared_ptr<SQLite::Statement>(store.compile(_compiled->sql));
+        }
+
     protected:
         QueryEnumerator::Impl* createEnumerator(const QueryEnumerator::Options *options) override;
+        QueryEnumerator::Impl* createEnumerator(const QueryEnumerator::Options *options,
+                                                Query *runOn) override;
 
     private:
-        shared_ptr<SQLite::Statement> _statement;
+        shared_ptr<SQLiteCompiledQuery> _compiled;      // May be shared with other SQLiteQuerys
+        shared_ptr<SQLite::Statement> _statement;       // Used only by this query
     };
 
 
@@ -245,11 +348,14 @@ namespace litecore {
 
 
     // Query enumerator that reads from the 'live' SQLite statement.
+    // In streaming mode it uses its own statement, and steps to the first row immediately; an
+    // active statement keeps its (WAL) read transaction open until it's reset, so this pins the
+    // snapshot the rows will come from to the time the enumerator was created.
     class SQLiteQueryEnumImpl : public SQLiteBaseQueryEnumImpl {
     public:
         SQLiteQueryEnumImpl(SQLiteQuery &query, const QueryEnumerator::Options *options)
         :SQLiteBaseQueryEnumImpl(query)
-        ,_statement(query.statement())
+        ,_statement(options && options->streaming ? query.newStatement() : query.statement())
         {
             _statement->clearBindings();
             long long offset = 0, limit = -1;
@@ -263,6 +369,10 @@ namespace litecore {
             _statement->bind("$offset", offset);
             _statement->bind("$limit", limit );
             LogStatement(*_statement);
+            if (options && options->streaming) {
+                _hasPendingRow = _statement->executeStep();
+                _isPending = true;
+            }
         }
 
         ~SQLiteQueryEnumImpl() {
@@ -313,8 +423,13 @@ namespace litecore {
         }
 
         bool next(slice &outRecordID, sequence_t &outSequence) override {
-            if (!_statement->executeStep())
+            if (_isPending) {
+                _isPending = false;
+                if (!_hasPendingRow)
+                    return false;
+            } else if (!_statement->executeStep()) {
                 return false;
+            }
             outSequence = sequence();
             outRecordID = recordID();
             return true;
@@ -363,8 +478,8 @@ namespace litecore {
         }
 
         // Collects all the (remaining) rows into a Fleece array of arrays,
-        // and returns an enumerator impl that will replay them.
-        SQLitePrerecordedQueryEnumImpl* fastForward() {
+        // and returns an enumerator impl that will replay them on behalf of `owner`.
+        SQLitePrerecordedQueryEnumImpl* fastForward(SQLiteQuery &owner) {
             Stopwatch st;
             int nCols = _statement->getColumnCount();
             uint64_t rowCount = 0;
@@ -378,32 +493,66 @@ namespace litecore {
             alloc_slice recording = enc.extractOutput();
             LogTo(SQL, "Created prerecorded query enum with %llu rows (%zu bytes) in %.3fms",
                   (unsigned long long)rowCount, recording.size, st.elapsed()*1000);
-            return new SQLitePrerecordedQueryEnumImpl(_query, recording);
+            return new SQLitePrerecordedQueryEnumImpl(owner, recording);
         }
 
     private:
         shared_ptr<SQLite::Statement> _statement;
+        bool _isPending {false};        // Streaming: has the 1st row been stepped to already?
+        bool _hasPendingRow {false};    // Streaming: did that step produce a row?
     };
 
 
 
     // The factory method that creates a SQLite QueryEnumerator::Impl.
     QueryEnumerator::Impl* SQLiteQuery::createEnumerator(const QueryEnumerator::Options *options) {
-        auto impl = new SQLiteQueryEnumImpl(*this, options);
-        if (false) {
-            return impl;
-        } else {
-            auto recording = impl->fastForward();
-            delete impl;
-            return recording;
+        unique_ptr<SQLiteQueryEnumImpl> impl(new SQLiteQueryEnumImpl(*this, options));
+        if (options && options->streaming)
+            return impl.release();
+        else
+            return impl->fastForward(*this);
+    }
+
+
+    // Runs the statement of `runOn` (on its own connection) to completion; the recorded rows
+    // are then replayed on behalf of this query, which was compiled from the same expression.
+    QueryEnumerator::Impl* SQLiteQuery::createEnumerator(const QueryEnumerator::Options *options,
+                                                         Query *runOn)
+    {
+        Assert(!(options && options->streaming));
+        SQLiteQueryEnumImpl impl(*(SQLiteQuery*)runOn, options);
+        return impl.fastForward(*this);
+    }
+
+
+    // Returns a canonical form of a query expression (table name plus minified JSON with sorted
+    // keys) to use as a query-cache key, or an empty string if it's not valid JSON.
+    static string queryCacheKey(const string &tableName, slice selectorExpression) {
+        try {
+            alloc_slice fleeceData = JSONConverter::convertJSON(selectorExpression);
+            const Value *root = Value::fromTrustedData(fleeceData);
+            if (!root)
+                return "";
+            return tableName + " " + root->toJSON().asString();
+        } catch (const FleeceException&) {
+            return "";      // Let QueryParser report the error
         }
     }
 
 
     // The factory method that creates a SQLite Query.
     Query* SQLiteKeyStore::compileQuery(slice selectorExpression) {
-        ((SQLiteDataFile&)dataFile()).registerFleeceFunctions();
-        return new SQLiteQuery(*this, selectorExpression);
+        db().registerFleeceFunctions();
+        string key = queryCacheKey(tableName(), selectorExpression);
+        shared_ptr<SQLiteCompiledQuery> compiled;
+        if (!key.empty())
+            compiled = db().cachedQuery(key);
+        if (!compiled) {
+            compiled = make_shared<SQLiteCompiledQuery>(*this, selectorExpression);
+            if (!key.empty())
+                db().cacheQuery(key, compiled);
+        }
+        return new SQLiteQuery(*this, compiled);
     }
 
 }
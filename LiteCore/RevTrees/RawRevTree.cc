@@ -28,7 +28,9 @@ using namespace fleece;
 
 namespace litecore {
 
-    std::vector<Rev> RawRevision::decodeTree(slice raw_tree, RevTree* owner, sequence curSeq) {
+    std::vector<Rev> RawRevision::decodeTree(slice raw_tree, slice bodies,
+                                             RevTree* owner, sequence curSeq)
+    {
         const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
         unsigned count = rawRev->count();
         if (count > UINT16_MAX)
@@ -36,7 +38,7 @@ namespace litecore {
         std::vector<Rev> revs(count);
         auto rev = revs.begin();
         for (; rawRev->isValid(); rawRev = rawRev->next()) {
-            rawRev->copyTo(*rev);
+            rawRev->copyTo(*rev, bodies);
             if (rev->sequence == 0)
                 rev->sequence = curSeq;
             rev->owner = owner;
@@ -49,24 +51,103 @@ namespace litecore {
     }
 
 
-    slice RawRevision::getCurrentRevBody(slice raw_tree) noexcept {
-        const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
+    // An inline tree ends with a zero 32-bit size, while a bodies blob ends with the current
+    // rev's body -- Fleece data, whose trailing root value is never a zero word.
+    static bool isInlineTree(slice recordBody) noexcept {
+        static const uint32_t kZero = 0;
+        return recordBody.size >= sizeof(kZero)
+            && memcmp(offsetby(recordBody.end(), -(ptrdiff_t)sizeof(kZero)),
+                      &kZero, sizeof(kZero)) == 0;
+    }
+
+
+    slice RawRevision::getCurrentRevBody(slice recordBody) noexcept {
+        if (!isInlineTree(recordBody))
+            return recordBody;
+        const RawRevision *rawRev = (const RawRevision*)recordBody.buf;
         return rawRev->body();
     }
 
 
+    bool RawRevision::findRevision(slice raw_tree, revid revID, unsigned maxAncestors,
+                                   std::vector<revid> &ancestors)
+    {
+        ancestors.clear();
+        unsigned generation = revID.generation();
+        const void *end = raw_tree.end();
+        auto rawRev = (const RawRevision*)raw_tree.buf;
+        while (raw_tree.size >= sizeof(uint32_t)) {
+            // The tree comes straight from storage, so check each rev's bounds before using it:
+            if (offsetby(rawRev, sizeof(uint32_t)) > end)
+                error::_throw(error::CorruptRevisionData);
+            if (!rawRev->isValid())
+                break;
+            size_t size = _dec32(rawRev->size);
+            if (size < offsetof(RawRevision, revID) + rawRev->revIDLen
+                    || offsetby(rawRev, size) > end)
+                error::_throw(error::CorruptRevisionData);
+            revid rawID(rawRev->revID, rawRev->revIDLen);
+            if (rawID == revID)
+                return true;
+            if (ancestors.size() < maxAncestors && rawID.generation() < generation)
+                ancestors.push_back(rawID);
+            rawRev = rawRev->next();
+        }
+        return false;
+    }
+
+
     alloc_slice RawRevision::encodeTree(const std::vector<Rev> &revs) {
+        return encodeRevs(revs, std::vector<int64_t>());
+    }
+
+
+    alloc_slice RawRevision::encodeTree(const std::vector<Rev> &revs, alloc_slice &outBodies) {
+        // The current rev's body goes last, so a Fleece parser will find its root at the end of
+        // the blob. Without a current body the blob would be ambiguous, so keep the others inline.
+        outBodies = nullslice;
+        if (revs.empty() || revs[0]._body.size == 0)
+            return encodeTree(revs);
+
+        std::vector<int64_t> bodyOffsets(revs.size(), -1);
+        size_t bodiesSize = 0;
+        for (size_t i = 1; i < revs.size(); ++i) {
+            if (revs[i]._body.size > 0) {
+                bodyOffsets[i] = bodiesSize;
+                bodiesSize += revs[i]._body.size;
+            }
+        }
+        bodyOffsets[0] = bodiesSize;
+        bodiesSize += revs[0]._body.size;
+
+        outBodies = alloc_slice(bodiesSize);
+        for (size_t i = 0; i < revs.size(); ++i) {
+            if (bodyOffsets[i] >= 0)
+                memcpy((uint8_t*)outBodies.buf + bodyOffsets[i], revs[i]._body.buf,
+                       revs[i]._body.size);
+        }
+        return encodeRevs(revs, bodyOffsets);
+    }
+
+
+    // `bodyOffsets` gives each rev's position in `bodies`, or -1 to write its body inline;
+    // if it's empty, all the bodies are inline.
+    alloc_slice RawRevision::encodeRevs(const std::vector<Rev> &revs,
+                                        const std::vector<int64_t> &bodyOffsets)
+    {
+        auto offsetOf = [&](size_t i) {return bodyOffsets.empty() ? -1 : bodyOffsets[i];};
+
         // Allocate output buffer:
         size_t totalSize = sizeof(uint32_t);  // start with space for trailing 0 size
-        for (auto rev = revs.begin(); rev != revs.end(); ++rev)
-            totalSize += sizeToWrite(*rev);
+        for (size_t i = 0; i < revs.size(); ++i)
+            totalSize += sizeToWrite(revs[i], offsetOf(i));
 
         alloc_slice result(totalSize);
 
         // Write the raw revs:
         RawRevision *dst = (RawRevision*)result.buf;
-        for (auto src = revs.begin(); src != revs.end(); ++src) {
-            dst = dst->copyFrom(*src);
+        for (size_t i = 0; i < revs.size(); ++i) {
+            dst = dst->copyFrom(revs[i], offsetOf(i));
         }
         dst->size = _enc32(0);   // write trailing 0 size marker
         Assert((&dst->size + 1) == result.end());
@@ -74,15 +155,19 @@ namespace litecore {
     }
 
 
-    size_t RawRevision::sizeToWrite(const Rev &rev) {
-        return offsetof(RawRevision, revID)
-             + rev.revID.size
-             + SizeOfVarInt(rev.sequence)
-             + rev._body.size;
+    size_t RawRevision::sizeToWrite(const Rev &rev, int64_t bodyOffset) {
+        size_t size = offsetof(RawRevision, revID)
+                    + rev.revID.size
+                    + SizeOfVarInt(rev.sequence);
+        if (bodyOffset >= 0)
+            size += SizeOfVarInt(bodyOffset) + SizeOfVarInt(rev._body.size);
+        else
+            size += rev._body.size;
+        return size;
     }
 
-    RawRevision* RawRevision::copyFrom(const Rev &rev) {
-        size_t revSize = sizeToWrite(rev);
+    RawRevision* RawRevision::copyFrom(const Rev &rev, int64_t bodyOffset) {
+        size_t revSize = sizeToWrite(rev, bodyOffset);
         this->size = _enc32((uint32_t)revSize);
         this->revIDLen = (uint8_t)rev.revID.size;
         memcpy(this->revID, rev.revID.buf, rev.revID.size);
@@ -90,17 +175,22 @@ namespace litecore {
 
         uint8_t dstFlags = rev.flags & RawRevision::kPublicPersistentFlags;
         if (rev._body.size > 0)
-            dstFlags |= RawRevision::kHasData;
+            dstFlags |= (bodyOffset >= 0) ? RawRevision::kHasBodyRef : RawRevision::kHasData;
         this->flags = (Rev::Flags)dstFlags;
 
         void *dstData = offsetby(&this->revID[0], rev.revID.size);
         dstData = offsetby(dstData, PutUVarInt(dstData, rev.sequence));
-        memcpy(dstData, rev._body.buf, rev._body.size);
+        if (bodyOffset >= 0) {
+            dstData = offsetby(dstData, PutUVarInt(dstData, bodyOffset));
+            PutUVarInt(dstData, rev._body.size);
+        } else {
+            memcpy(dstData, rev._body.buf, rev._body.size);
+        }
 
         return (RawRevision*)offsetby(this, revSize);
     }
 
-    void RawRevision::copyTo(Rev &dst) const {
+    void RawRevision::copyTo(Rev &dst, slice bodies) const {
         const void* end = this->next();
         dst.revID = {this->revID, this->revIDLen};
         dst.flags = (Rev::Flags)(this->flags & RawRevision::kPublicPersistentFlags);
@@ -108,10 +198,24 @@ namespace litecore {
         const void *data = offsetby(&this->revID, this->revIDLen);
         ptrdiff_t len = (uint8_t*)end-(uint8_t*)data;
         data = offsetby(data, GetUVarInt(slice(data, len), &dst.sequence));
-        if (this->flags & RawRevision::kHasData)
+        if (this->flags & RawRevision::kHasData) {
             dst._body = slice(data, end);
-        else
+        } else if (this->flags & RawRevision::kHasBodyRef) {
+            slice ref(data, end);
+            uint64_t offset, size;
+            if (!ReadUVarInt(&ref, &offset) || !ReadUVarInt(&ref, &size))
+                error::_throw(error::CorruptRevisionData);
+            if (!bodies.buf) {
+                dst._body = nullslice;          // bodies weren't read
+                dst._bodyNotLoaded = true;
+            } else if (offset > bodies.size || size > bodies.size - offset) {
+                error::_throw(error::CorruptRevisionData);
+            } else {
+                dst._body = slice(offsetby(bodies.buf, (size_t)offset), (size_t)size);
+            }
+        } else {
             dst._body = nullslice;
+        }
     }
 
 
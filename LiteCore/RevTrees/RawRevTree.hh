@@ -18,15 +18,32 @@ namespace litecore {
     // Layout of a single revision in encoded form. Rev tree is stored as a sequence of these
     // followed by a 32-bit zero.
     // Revs are stored in decending priority, with the current leaf rev(s) coming first.
+    // A tree can be encoded with the revision bodies inline, or split: the tree holds only each
+    // body's position in a separate bodies blob, whose last item is the current rev's body.
     class RawRevision {
     public:
+        /** Decodes a tree. If it was encoded split, `bodies` must be the bodies blob, or null if
+            it wasn't read; then the revs whose bodies are in it are marked as not loaded. */
         static std::vector<Rev> decodeTree(slice raw_tree,
-                                                RevTree *owner,
-                                                sequence curSeq);
+                                           slice bodies,
+                                           RevTree *owner,
+                                           sequence curSeq);
 
+        /** Encodes a tree with the bodies inline. */
         static alloc_slice encodeTree(const std::vector<Rev> &revs);
 
-        static slice getCurrentRevBody(slice raw_tree) noexcept;
+        /** Encodes a tree split from its bodies, which are stored in `outBodies`. If the current
+            rev has no body, the other bodies (if any) stay inline, and `outBodies` is null. */
+        static alloc_slice encodeTree(const std::vector<Rev> &revs, alloc_slice &outBodies);
+
+        /** Returns the current revision's body, given either an inline tree or a bodies blob. */
+        static slice getCurrentRevBody(slice recordBody) noexcept;
+
+        /** Looks up a revision in an encoded tree without decoding it. Returns true if it's
+            present; otherwise fills `ancestors` with up to `maxAncestors` revIDs of lower
+            generation, in tree order, i.e. the revisions that could be its ancestors. */
+        static bool findRevision(slice raw_tree, revid revID, unsigned maxAncestors,
+                                 std::vector<revid> &ancestors);
 
     private:
         // Private RevisionFlags bits used in encoded form:
@@ -34,6 +51,7 @@ namespace litecore {
             kPublicPersistentFlags = (Rev::kLeaf | Rev::kDeleted | Rev::kHasAttachments
                                                  | Rev::kKeepBody),
             kHasData = 0x80,  /**< Does this raw rev contain JSON/Fleece data? */
+            kHasBodyRef = 0x40, /**< Does this raw rev point to its data in the bodies blob? */
         };
 
         uint32_t        size;           // Total size of this tree rev
@@ -45,6 +63,9 @@ namespace litecore {
         // varint       sequence
         // if HasData flag:
         //    char      data[];       // Contains the revision body (JSON)
+        // if HasBodyRef flag:
+        //    varint    bodyOffset;   // Position of the revision body in the bodies blob
+        //    varint    bodySize;
 
         bool isValid() const {
             return size != 0;
@@ -63,9 +84,11 @@ namespace litecore {
             return count;
         }
 
-        static size_t sizeToWrite(const Rev&);
-        void copyTo(Rev &dst) const;
-        RawRevision* copyFrom(const Rev &rev);
+        static alloc_slice encodeRevs(const std::vector<Rev>&,
+                                      const std::vector<int64_t> &bodyOffsets);
+        static size_t sizeToWrite(const Rev&, int64_t bodyOffset);
+        void copyTo(Rev &dst, slice bodies) const;
+        RawRevision* copyFrom(const Rev &rev, int64_t bodyOffset);
     };
     
 }
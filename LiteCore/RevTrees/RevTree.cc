@@ -32,12 +32,40 @@ namespace litecore {
     using namespace fleece;
 
     RevTree::RevTree(slice raw_tree, sequence seq)
-    :_revs(RawRevision::decodeTree(raw_tree, this, seq))
+    :_revs(RawRevision::decodeTree(raw_tree, nullslice, this, seq))
     {
     }
 
     void RevTree::decode(litecore::slice raw_tree, sequence seq) {
-        _revs = RawRevision::decodeTree(raw_tree, this, seq);
+        _revs = RawRevision::decodeTree(raw_tree, nullslice, this, seq);
+    }
+
+    void RevTree::decode(slice raw_tree, slice bodies, sequence seq) {
+        _revs = RawRevision::decodeTree(raw_tree, bodies, this, seq);
+    }
+
+    void RevTree::loadBodies(slice raw_tree, slice bodies) {
+        Assert(bodies.buf);
+        auto loaded = RawRevision::decodeTree(raw_tree, bodies, this, 0);
+        for (auto &rev : _revs) {
+            if (!rev._bodyNotLoaded)
+                continue;
+            for (auto &loadedRev : loaded) {
+                if (loadedRev.revID == rev.revID) {
+                    rev._body = loadedRev._body;
+                    break;
+                }
+            }
+            rev._bodyNotLoaded = false;
+        }
+    }
+
+    bool RevTree::bodiesLoaded() const {
+        for (auto &rev : _revs) {
+            if (rev._bodyNotLoaded)
+                return false;
+        }
+        return true;
     }
 
     alloc_slice RevTree::encode() {
@@ -45,6 +73,11 @@ namespace litecore {
         return RawRevision::encodeTree(_revs);
     }
 
+    alloc_slice RevTree::encode(alloc_slice &outBodies) {
+        sort();
+        return RawRevision::encodeTree(_revs, outBodies);
+    }
+
 #if DEBUG
     void Rev::dump(std::ostream& out) {
         out << "(" << sequence << ") " << (std::string)revID.expanded() << "  ";
@@ -308,8 +341,11 @@ namespace litecore {
     // Remove bodies of already-saved revs that are no longer leaves:
     void RevTree::removeNonLeafBodies() {
         for (auto &rev : _revs) {
-            if (rev._body.size > 0 && !(rev.flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody)))
+            if ((rev._body.size > 0 || rev._bodyNotLoaded)
+                    && !(rev.flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody))) {
                 rev._body = nullslice;
+                rev._bodyNotLoaded = false;
+            }
         }
     }
 
@@ -31,8 +31,12 @@ namespace litecore {
         revid           revID;      /**< Revision ID (compressed) */
         sequence_t      sequence;   /**< DB sequence number that this revision has/had */
 
+        /** The body, or a null slice if it's not stored, or wasn't read along with the tree. */
         slice body() const          {return _body;}
-        bool isBodyAvailable() const{return _body.buf != nullptr;}
+        /** Is a body stored, whether or not it's been read? */
+        bool isBodyAvailable() const{return _body.buf != nullptr || _bodyNotLoaded;}
+        /** False if the body is stored but wasn't read along with the tree. */
+        bool isBodyLoaded() const   {return !_bodyNotLoaded;}
 
         bool isLeaf() const         {return (flags & kLeaf) != 0;}
         bool isDeleted() const      {return (flags & kDeleted) != 0;}
@@ -61,10 +65,12 @@ namespace litecore {
         
         slice       _body;          /**< Revision body (JSON), or empty if not stored in this tree*/
         uint16_t    _parentIndex;   /**< Index in tree's rev[] array of parent revision, if any */
+        bool        _bodyNotLoaded {false}; /**< Body is stored, but wasn't read with the tree */
 
         void addFlag(Flags f)       {flags = (Flags)(flags | f);}
         void clearFlag(Flags f)     {flags = (Flags)(flags & ~f);}
-        void removeBody()           {clearFlag(kKeepBody); _body = nullslice;}
+        void removeBody()           {clearFlag(kKeepBody); _body = nullslice;
+                                     _bodyNotLoaded = false;}
 #if DEBUG
         void dump(std::ostream&);
 #endif
@@ -81,8 +87,13 @@ namespace litecore {
         virtual ~RevTree() { }
 
         void decode(slice raw_tree, sequence seq);
+        /** Decodes a tree that was encoded apart from its revision bodies. If `bodies` is null
+            (they weren't read), revs that have bodies are marked as not loaded. */
+        void decode(slice raw_tree, slice bodies, sequence seq);
 
         alloc_slice encode();
+        /** Encodes the tree without the revision bodies, which are stored in `outBodies`. */
+        alloc_slice encode(alloc_slice &outBodies);
 
         size_t size() const                             {return _revs.size();}
         const Rev* get(unsigned index) const;
@@ -126,11 +137,18 @@ namespace litecore {
 
         void saved();
 
+        /** False if any revision's body is stored but wasn't read along with the tree. */
+        bool bodiesLoaded() const;
+
 #if DEBUG
         std::string dump();
 #endif
 
     protected:
+        /** Fills in the bodies of revs that were decoded without them, given the tree as it was
+            decoded and its bodies blob. */
+        void loadBodies(slice raw_tree, slice bodies);
+
         virtual bool isBodyOfRevisionAvailable(const Rev*) const;
         virtual alloc_slice readBodyOfRevision(const Rev*) const;
 #if DEBUG
@@ -47,12 +47,19 @@ namespace litecore {
         decode();
     }
 
+    // If the KeyStore supports it, the tree is stored in the record's extra, apart from the
+    // revision bodies in its body (see save()); records saved without an extra, including
+    // those written before it existed, have the tree and bodies together in the body.
+    // A meta-only read still gets the extra, so the tree is known, minus the bodies.
     void VersionedDocument::decode() {
         _unknown = false;
-        if (_rec.body().buf)
+        if (_rec.extra().buf) {
+            RevTree::decode(_rec.extra(), _rec.body(), _rec.sequence());
+        } else if (_rec.body().buf) {
             RevTree::decode(_rec.body(), _rec.sequence());
-        else if (_rec.bodySize() > 0)
+        } else if (_rec.bodySize() > 0) {
             _unknown = true;        // i.e. rec was read as meta-only
+        }
 
         if (_rec.exists()) {
             _meta.decode(_rec.meta());
@@ -61,6 +68,20 @@ namespace litecore {
         }
     }
 
+    // Reads the bodies of a tree that was decoded without them (from a meta-only read.)
+    bool VersionedDocument::loadBodies() {
+        if (bodiesLoaded())
+            return true;
+        Record rec(_rec.key());
+        _db.read(rec);
+        if (rec.sequence() != _rec.sequence() || rec.extra() != _rec.extra())
+            return false;
+        // The Revs point into _rec's extra, so keep that and just add the body:
+        _rec.setBody(rec.body());
+        RevTree::loadBodies(_rec.extra(), _rec.body());
+        return true;
+    }
+
     void VersionedDocument::updateMeta() {
         _meta.flags = kNone;
         const Rev* curRevision = currentRevision();
@@ -93,9 +114,19 @@ namespace litecore {
         updateMeta();
         if (currentRevision()) {
             removeNonLeafBodies();
+            // The bodies that weren't read have to be rewritten along with the tree:
+            if (!loadBodies())
+                error::_throw(error::Conflict);
             // Don't call _rec.setBody() because it'll invalidate all the pointers from Revisions
             // into the existing body buffer.
-            auto result = _db.set(_rec.key(), _rec.meta(), encode(), transaction);
+            KeyStore::setResult result;
+            if (_db.supportsExtra()) {
+                alloc_slice bodies;
+                alloc_slice tree = encode(bodies);
+                result = _db.set(_rec.key(), _rec.meta(), bodies, tree, transaction);
+            } else {
+                result = _db.set(_rec.key(), _rec.meta(), encode(), transaction);
+            }
             _rec.updateSequence(result.seq);
         } else {
             _db.del(_rec.key(), transaction);
@@ -30,9 +30,16 @@ namespace litecore {
         /** Reads and parses the body of the record. Useful if doc was read as meta-only. */
         void read();
 
-        /** Returns false if the record was loaded metadata-only. Revision accessors will fail. */
+        /** Returns false if the record was loaded metadata-only and its tree is stored with the
+            bodies. Revision accessors will fail. (If the tree is stored apart, a meta-only read
+            decodes it, but revisions' bodies aren't loaded until loadBodies is called.) */
         bool revsAvailable() const {return !_unknown;}
 
+        /** Reads the revision bodies that weren't loaded along with the tree, without disturbing
+            the Revs. Returns false, changing nothing, if the record has been updated since it
+            was read; then call read() to start over. */
+        bool loadBodies();
+
         const alloc_slice& docID() const {return _rec.key();}
         revid revID() const         {return revid(_meta.version);}
         DocumentFlags flags() const {return _meta.flags;}
@@ -26,5 +26,12 @@ namespace litecore {
         kAES256                 /**< AES with 256-bit key */
     };
 
+    enum Compression : uint8_t {
+        kNoCompression = 0,     /**< Data is stored as-is (default) */
+        kSnappyCompression,     /**< Google's Snappy: fast, with moderate compression */
+        kDictionaryCompression  /**< LZ77 with a dictionary trained from the database's own
+                                     bodies; compresses small bodies Snappy can't shrink */
+    };
+
 }
 
@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <mutex>              // std::mutex, std::unique_lock
 #include <condition_variable> // std::condition_variable
+#include <thread>
 #include <unordered_map>
 #include <dirent.h>
 #include <algorithm>
@@ -35,6 +36,7 @@
 #endif
 
 #include "SQLiteDataFile.hh"
+#include "LogDataFile.hh"
 
 using namespace std;
 
@@ -67,7 +69,7 @@ namespace litecore {
 
 
     std::vector<DataFile::Factory*> DataFile::factories() {
-        return {&SQLiteDataFile::factory()};
+        return {&SQLiteDataFile::factory(), &LogDataFile::factory()};
     }
 
 
@@ -177,8 +179,13 @@ namespace litecore {
         void setTransaction(Transaction* t) {
             Assert(t);
             unique_lock<mutex> lock(_transactionMutex);
-            while (_transaction != nullptr)
-                _transactionCond.wait(lock);
+            if (_transaction != nullptr) {
+                ++_transactionsWaiting;
+                do {
+                    _transactionCond.wait(lock);
+                } while (_transaction != nullptr);
+                --_transactionsWaiting;
+            }
             _transaction = t;
         }
 
@@ -191,6 +198,11 @@ namespace litecore {
         }
 
 
+        bool transactionWaiting() const {
+            return _transactionsWaiting > 0;
+        }
+
+
     protected:
         Shared(const FilePath &p)
         :path(p)
@@ -200,6 +212,7 @@ namespace litecore {
         mutex              _transactionMutex;       // Mutex for transactions
         condition_variable _transactionCond;        // For waiting on the mutex
         Transaction*       _transaction {nullptr};  // Currently active Transaction object
+        atomic<unsigned>   _transactionsWaiting {0};// Number of threads blocked in setTransaction
         vector<DataFile*>  _dataFiles;              // Open DataFiles on this File
         mutex              _dataFilesMutex;         // Mutex protecting _dataFiles
 
@@ -333,6 +346,11 @@ namespace litecore {
             _documentKeys = make_unique<DocumentKeys>(*this);
     }
 
+    void DataFile::refreshDocumentKeys() {
+        if (_documentKeys)
+            _documentKeys->refresh();
+    }
+
 
 
 #pragma mark PURGE/DELETION COUNT:
@@ -363,6 +381,15 @@ namespace litecore {
             infoStore.set(slice(kPurgeCountKey), purgeCount.body(), t);
     }
 
+    uint64_t DataFile::deletionCount() const {
+        return getKeyStore(kInfoKeyStoreName).get(slice(kDeletionCountKey)).bodyAsUInt();
+    }
+
+    void DataFile::setPurgeCount(uint64_t count, Transaction &t) {
+        uint64_t newBody = _endian_encode(count);
+        getKeyStore(kInfoKeyStoreName).set(slice(kPurgeCountKey), slice(&newBody, sizeof(newBody)), t);
+    }
+
 
 #pragma mark - TRANSACTION:
 
@@ -395,6 +422,15 @@ namespace litecore {
     }
 
 
+    void DataFile::_beginSavepoint(Transaction*) {
+        error::_throw(error::Unimplemented);
+    }
+
+    void DataFile::_endSavepoint(Transaction*, bool commit) {
+        error::_throw(error::Unimplemented);
+    }
+
+
     Transaction& DataFile::transaction() {
         Assert(_inTransaction);
         return *_shared->transaction();
@@ -411,6 +447,18 @@ namespace litecore {
     }
 
 
+    bool DataFile::transactionWaiting() const {
+        return _shared->transactionWaiting();
+    }
+
+
+    void DataFile::yieldToWaitingTransactions() const {
+        // Bounded, so a steady stream of writers can't stall the caller forever:
+        for (int i = 0; i < 100 && _shared->transactionWaiting(); ++i)
+            this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+
     Transaction::Transaction(DataFile* db)
     :Transaction(db, true)
     { }
@@ -431,6 +479,7 @@ namespace litecore {
 
     void Transaction::commit() {
         Assert(_active, "Transaction is not active");
+        Assert(!_inSavepoint, "Savepoint is still open");
         _db.transactionEnding(this, true);
         _active = false;
         LogTo(DBLog, "DataFile: commit transaction");
@@ -440,6 +489,7 @@ namespace litecore {
 
     void Transaction::abort() {
         Assert(_active, "Transaction is not active");
+        _inSavepoint = false;               // rolling back the transaction ends the savepoint
         _db.transactionEnding(this, false);
         _active = false;
         LogTo(DBLog, "DataFile: abort transaction");
@@ -447,6 +497,21 @@ namespace litecore {
     }
 
 
+    void Transaction::beginSavepoint() {
+        Assert(_active, "Transaction is not active");
+        Assert(!_inSavepoint, "Savepoints don't nest");
+        _db._beginSavepoint(this);
+        _inSavepoint = true;
+    }
+
+
+    void Transaction::endSavepoint(bool commit) {
+        Assert(_inSavepoint, "No savepoint");
+        _inSavepoint = false;
+        _db._endSavepoint(this, commit);
+    }
+
+
     Transaction::~Transaction() {
         if (_active) {
             LogTo(DBLog, "DataFile: Transaction exiting scope without explicit commit; aborting");
@@ -463,14 +528,21 @@ namespace litecore {
 
 
     void DataFile::beganCompacting() {
+        if (_compactDepth++ > 0)
+            return;
         ++sCompactCount;
         _shared->isCompacting = true;
-        if (_onCompactCallback) _onCompactCallback(true);
+        if (_onCompactCallback) _onCompactCallback(true, CompactProgress());
+    }
+    void DataFile::compactProgress(const CompactProgress &progress) {
+        if (_onCompactCallback) _onCompactCallback(true, progress);
     }
-    void DataFile::finishedCompacting() {
+    void DataFile::finishedCompacting(const CompactProgress &progress) {
+        if (--_compactDepth > 0)
+            return;
         --sCompactCount;
         _shared->isCompacting = false;
-        if (_onCompactCallback) _onCompactCallback(false);
+        if (_onCompactCallback) _onCompactCallback(false, progress);
     }
 
     bool DataFile::isCompacting() const noexcept {
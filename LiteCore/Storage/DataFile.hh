@@ -22,6 +22,7 @@
 #include <unordered_map>
 #include <atomic> // for std::atomic_uint
 #include <functional> // for std::function
+#include <chrono>
 #ifdef check
 #undef check
 #endif
@@ -43,12 +44,26 @@ namespace litecore {
     class DataFile {
     public:
 
+        /** Performance settings. Zero values mean the storage engine's default. */
+        struct Tuning {
+            int64_t  mmapSize;          ///< Bytes of the file to memory-map; negative to disable
+            int64_t  cacheSize;         ///< Bytes of page cache
+            unsigned pageSize;          ///< Page size, if the file is being created
+            unsigned walAutoCheckpoint; ///< Checkpoint when the WAL reaches this many pages
+            int64_t  journalSizeLimit;  ///< Bytes the WAL is truncated to after a checkpoint
+            int      workerThreads;     ///< Extra threads to use for sorting; negative for none
+            int      tempStore;         ///< Temporary storage: 1 = files, 2 = memory
+            unsigned readerConnections; ///< Size of the pool of read-only connections
+            Compression compression;    ///< How to compress bodies in the default KeyStore
+        };
+
         struct Options {
             KeyStore::Capabilities keyStores;
             bool create         :1;     ///< Should the db be created if it doesn't exist?
             bool writeable      :1;     ///< If false, db is opened read-only
             EncryptionAlgorithm encryptionAlgorithm;
             alloc_slice encryptionKey;
+            Tuning tuning;
 
             static const Options defaults;
         };
@@ -81,14 +96,84 @@ namespace litecore {
         bool isCompacting() const noexcept;
         static bool isAnyCompacting() noexcept;
 
-        typedef std::function<void(bool compacting)> OnCompactCallback;
+        /** Progress of a compaction, as passed to the OnCompactCallback. */
+        struct CompactProgress {
+            uint64_t docsScanned    {0};        ///< Docs checked for blob references
+            uint64_t blobsDeleted   {0};        ///< Unreferenced blobs deleted
+            uint64_t bytesReclaimed {0};        ///< Total file size of the deleted blobs
+        };
+
+        /** Called with `compacting` true when compaction begins and as it progresses, and
+            with false, and the final progress, when it ends. */
+        typedef std::function<void(bool compacting, const CompactProgress&)> OnCompactCallback;
 
         void setOnCompact(OnCompactCallback callback) noexcept  {_onCompactCallback = callback;}
 
         virtual bool setAutoCompact(bool autoCompact)   {return false;}
 
+        /** Does roughly `timeSlice` worth of compaction as a series of short transactions, so
+            other writers are never blocked for long, then returns. Starts a compaction if none is
+            in progress. Returns true if there's more work left, i.e. it should be called again.
+            The default implementation just calls compact(). */
+        virtual bool compactIncrementally(std::chrono::milliseconds timeSlice) {
+            compact();
+            return false;
+        }
+
+        /** True if a compaction is in progress or would reclaim a useful amount of space. */
+        virtual bool compactionNeeded()                 {return false;}
+
+        /** Brackets a compaction, notifying the OnCompactCallback. These can be nested, as when a
+            higher level adds its own work around compact(); only the outermost calls notify. */
+        void beganCompacting();
+        void compactProgress(const CompactProgress&);
+        void finishedCompacting(const CompactProgress& = CompactProgress());
+
         virtual void rekey(EncryptionAlgorithm, slice newKey);
 
+        /** Starts a bulk-load session, which speeds up inserting lots of records by deferring
+            index maintenance until endBulkLoad and, where the engine supports it, skipping
+            the on-disk journal. No other DataFile may have the file open.
+            Implementations define what happens if the process crashes during a session. */
+        virtual void beginBulkLoad()                        { }
+
+        /** Ends a bulk-load session, rebuilding the indexes. Closing the DataFile also ends
+            the session. */
+        virtual void endBulkLoad()                          { }
+
+        virtual bool isBulkLoading() const                  {return false;}
+
+        /** Calls `fn` with a read-only DataFile on the same file, taken from a pool of them, and
+            returns true; it sees the file as of the latest commit. Returns false without calling
+            `fn` if there's no pool. Thread-safe; blocks while all the pooled DataFiles are in
+            use. `fn` must not keep references to the DataFile or its KeyStores. */
+        virtual bool withReader(function_ref<void(DataFile&)> fn)  {return false;}
+
+        /** True if Transaction::beginSavepoint is supported. */
+        virtual bool supportsSavepoints() const             {return false;}
+
+        /** Statistics of the cache of compiled queries, if the implementation has one. */
+        struct QueryCacheStats {
+            uint64_t hits       {0};
+            uint64_t misses     {0};
+            size_t   count      {0};        ///< Number of queries currently cached
+        };
+
+        virtual QueryCacheStats queryCacheStats()           {return QueryCacheStats();}
+
+        /** Discards all cached compiled queries. (Queries already created aren't affected.) */
+        virtual void clearQueryCache()                      { }
+
+        /** Saves a dictionary trained from sample bodies (see CompressionDictionary::train) as
+            the next version in the info KeyStore, and returns that version. Once the transaction
+            commits, the default KeyStore uses it to compress small bodies if its compression
+            mode is kDictionaryCompression. Bodies compressed with earlier versions stay readable.
+            Returns 0 if the implementation doesn't compress bodies. */
+        virtual unsigned saveCompressionDictionary(slice dictionary, Transaction&) {return 0;}
+
+        /** The version of the dictionary bodies are being compressed with, or 0 if none. */
+        virtual unsigned compressionDictionaryVersion() const  {return 0;}
+
         /** The number of soft deletions that have been purged via compaction. 
             (Used by the indexer) */
         uint64_t purgeCount() const;
@@ -167,6 +252,13 @@ namespace litecore {
         /** Override to commit or abort a database transaction. */
         virtual void _endTransaction(Transaction*, bool commit) =0;
 
+        /** Override to support savepoints: marks a point in the current transaction that
+            _endSavepoint can roll back to. */
+        virtual void _beginSavepoint(Transaction*);
+
+        /** Override to keep or roll back the changes made since _beginSavepoint. */
+        virtual void _endSavepoint(Transaction*, bool commit);
+
         /** Is this DataFile object currently in a transaction? */
         bool inTransaction() const                      {return _inTransaction;}
 
@@ -177,11 +269,22 @@ namespace litecore {
 
         void updatePurgeCount(Transaction&);
 
-        void beganCompacting();
-        void finishedCompacting();
+        /** The number of soft deletions so far, for later use with setPurgeCount. */
+        uint64_t deletionCount() const;
+        void setPurgeCount(uint64_t, Transaction&);
+
+        /** True if another thread is blocked waiting to begin a transaction on this file. */
+        bool transactionWaiting() const;
+
+        /** Briefly sleeps while other threads are waiting to begin a transaction on this file,
+            so that long-running work split into many transactions doesn't starve them. */
+        void yieldToWaitingTransactions() const;
 
         void setOptions(const Options &o)               {_options = o;}
 
+        /** Reloads the document shared keys, to pick up keys added by other connections. */
+        void refreshDocumentKeys();
+
         void forOpenKeyStores(function_ref<void(KeyStore&)> fn);
 
     private:
@@ -207,6 +310,7 @@ namespace litecore {
         KeyStore*               _defaultKeyStore {nullptr};     // The default KeyStore
         std::unordered_map<std::string, std::unique_ptr<KeyStore>> _keyStores;// Opened KeyStores
         OnCompactCallback       _onCompactCallback {nullptr};   // Client callback for compacts
+        unsigned                _compactDepth {0};              // Nesting of beganCompacting
         std::unique_ptr<fleece::PersistentSharedKeys> _documentKeys;
         bool                    _inTransaction {false};         // Am I in a Transaction?
         std::atomic<void*>      _owner {nullptr};               // App-defined object that owns me
@@ -229,6 +333,12 @@ namespace litecore {
         void commit();
         void abort();
 
+        /** Starts a nested savepoint; changes made after this can be rolled back by
+            endSavepoint(false) without aborting the transaction. Savepoints don't nest.
+            Only available if the DataFile's supportsSavepoints() is true. */
+        void beginSavepoint();
+        void endSavepoint(bool commit);
+
     private:
         friend class DataFile;
         friend class KeyStore;
@@ -240,6 +350,7 @@ namespace litecore {
 
         DataFile&   _db;        // The DataFile
         bool _active;           // Is there an open transaction at the db level?
+        bool _inSavepoint {false};  // Is there an open savepoint?
     };
 
 }
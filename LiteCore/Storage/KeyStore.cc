@@ -41,6 +41,14 @@ namespace litecore {
         fn(rec);
     }
 
+    vector<Record> KeyStore::getMany(const vector<slice> &keys, ContentOptions options) const {
+        vector<Record> records;
+        records.reserve(keys.size());
+        for (slice key : keys)
+            records.push_back(get(key, options));
+        return records;
+    }
+
     void KeyStore::get(sequence seq, ContentOptions options, function_ref<void(const Record&)> fn) {
         fn(get(seq, options));
     }
@@ -61,11 +69,23 @@ namespace litecore {
         if (rec.deleted()) {
             del(rec, t);
         } else {
-            auto result = set(rec.key(), rec.meta(), rec.body(), t);
+            auto result = set(rec.key(), rec.meta(), rec.body(), rec.extra(), t);
             updateDoc(rec, result.seq, result.off);
         }
     }
 
+    void KeyStore::setMany(const SetEntry entries[], size_t count,
+                           setResult results[], Transaction &t)
+    {
+        // Subclasses can override this to avoid per-record overhead.
+        for (size_t i = 0; i < count; ++i) {
+            auto result = set(entries[i].key, entries[i].meta, entries[i].body,
+                              entries[i].extra, t);
+            if (results)
+                results[i] = result;
+        }
+    }
+
     bool KeyStore::del(slice key, Transaction &t) {
         LogTo(DBLog, "KeyStore(%s) del %s", _name.c_str(), logSlice(key));
         bool ok = _del(key, t);
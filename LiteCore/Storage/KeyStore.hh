@@ -23,8 +23,8 @@ namespace litecore {
     typedef uint64_t docOffset;
 
     /** A container of key/value mappings. Keys and values are opaque blobs.
-        The value is divided into 'meta' and 'body'; the body can optionally be omitted when
-        reading, to save time/space. There is also a 'sequence' number that's assigned every time
+        The value is divided into 'meta' and 'body' (and optionally 'extra', which is read along
+        with the meta); the body can optionally be omitted when reading, to save time/space. There is also a 'sequence' number that's assigned every time
         a value is saved, from an incrementing counter.
         A key, meta and body together are called a Record.
         This is an abstract class; the DataFile instance acts as its factory and will instantiate
@@ -60,6 +60,12 @@ namespace litecore {
         virtual void get(slice key, ContentOptions, function_ref<void(const Record&)>);
         virtual void get(sequence, ContentOptions, function_ref<void(const Record&)>);
 
+        /** Reads multiple records at once, returning them in the same order as the keys.
+            A key that doesn't exist produces a Record with that key whose exists() is false.
+            Subclasses can override this to look the keys up in batches. */
+        virtual std::vector<Record> getMany(const std::vector<slice> &keys,
+                                            ContentOptions = kDefaultContent) const;
+
         /** Reads a record whose key() is already set. */
         virtual bool read(Record &rec, ContentOptions options = kDefaultContent) const =0;
 
@@ -77,11 +83,27 @@ namespace litecore {
 
         struct setResult {sequence seq; docOffset off;};
 
-        virtual setResult set(slice key, slice meta, slice value, Transaction&) =0;
+        /** Writes a record. A non-null `extra` requires supportsExtra(). */
+        virtual setResult set(slice key, slice meta, slice value, slice extra, Transaction&) =0;
+        setResult set(slice key, slice meta, slice value, Transaction &t)
+                                                        {return set(key, meta, value, nullslice, t);}
         setResult set(slice key, slice value, Transaction &t)
                                                         {return set(key, nullslice, value, t);}
         void write(Record&, Transaction&);
 
+        /** True if records can have an 'extra' blob; see Record::extra. */
+        virtual bool supportsExtra() const              {return false;}
+
+        /** One record to be written by setMany(). */
+        struct SetEntry {slice key; slice meta; slice body; slice extra;};
+
+        /** Writes a batch of records; equivalent to calling set() on each in order, but faster.
+            Sequences are assigned consecutively, starting at lastSequence()+1.
+            If `results` is non-null it must have `count` items; each receives the result of
+            writing the corresponding entry. */
+        virtual void setMany(const SetEntry entries[], size_t count,
+                             setResult results[], Transaction&);
+
         bool del(slice key, Transaction&);
         bool del(sequence s, Transaction&);
         bool del(const Record&, Transaction&);
@@ -97,6 +119,7 @@ namespace litecore {
         struct IndexOptions {
             const char *stemmer;
             bool ignoreDiacritics;
+            const char *includedPropertiesJSON; ///< Value index: JSON array of extra properties to cover
         };
 
         virtual bool supportsIndexes(IndexType) const                   {return false;}
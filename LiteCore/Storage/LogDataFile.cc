@@ -0,0 +1,159 @@
+//
+//  LogDataFile.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "LogDataFile.hh"
+#include "LogKeyStore.hh"
+#include "LogFile.hh"
+#include "Error.hh"
+#include "FilePath.hh"
+#include "Logging.hh"
+
+using namespace std;
+
+namespace litecore {
+
+    LogDataFile::Factory& LogDataFile::factory() {
+        static LogDataFile::Factory s;
+        return s;
+    }
+
+
+    LogDataFile* LogDataFile::Factory::openFile(const FilePath &path, const Options *options) {
+        return new LogDataFile(path, options);
+    }
+
+
+    bool LogDataFile::Factory::deleteFile(const FilePath &path, const Options*) {
+        auto count = (unsigned) openCount(path);
+        if (count > 0)
+            error::_throw(error::Busy, "Still %u open connection(s) to %s",
+                          count, path.path().c_str());
+        return path.del() | LogFile::compactionPath(path).del();
+        // Note the non-short-circuiting 'or'! Both paths will be deleted.
+    }
+
+
+    LogDataFile::LogDataFile(const FilePath &path, const Options *options)
+    :DataFile(path, options)
+    {
+        reopen();
+    }
+
+
+    LogDataFile::~LogDataFile() {
+        close();
+    }
+
+
+    void LogDataFile::reopen() {
+        DataFile::reopen();
+        if (options().encryptionAlgorithm != kNoEncryption)
+            error::_throw(error::UnsupportedEncryption);
+        _log = LogFile::open(filePath(), options());
+        (void)defaultKeyStore();
+    }
+
+
+    bool LogDataFile::isOpen() const noexcept {
+        return _log != nullptr;
+    }
+
+
+    void LogDataFile::close() {
+        DataFile::close(); // closes all the KeyStores
+        _transaction.reset();
+        _log = nullptr;
+    }
+
+
+    LogFile& LogDataFile::logFile() const {
+        checkOpen();
+        return *_log;
+    }
+
+
+    KeyStore* LogDataFile::newKeyStore(const string &name, KeyStore::Capabilities options) {
+        logFile().addStore(name);
+        return new LogKeyStore(*this, name, options);
+    }
+
+
+    vector<string> LogDataFile::allKeyStoreNames() {
+        return logFile().storeNames(currentTransaction());
+    }
+
+
+    void LogDataFile::deleteKeyStore(const string &name) {
+        if (_transaction) {
+            logFile().drop(*_transaction, name);
+        } else {
+            Transaction t(this);
+            logFile().drop(*_transaction, name);
+            t.commit();
+        }
+    }
+
+
+    void LogDataFile::_beginTransaction(Transaction*) {
+        Assert(!_transaction);
+        _transaction = logFile().beginTransaction();
+    }
+
+
+    void LogDataFile::_endTransaction(Transaction*, bool commit) {
+        auto t = move(_transaction);
+        if (!commit || !t)
+            return;
+        logFile().commit(*t);
+
+        if (_autoCompact && _log->shouldCompact()) {
+            // Still holding the file lock, so no other transaction can be open:
+            beganCompacting();
+            try {
+                _log->compact(false);
+            } catch (const exception &x) {
+                Warn("LogDataFile: auto-compaction failed: %s", x.what());
+            }
+            finishedCompacting();
+        }
+    }
+
+
+    void LogDataFile::deleteDataFile() {
+        if (factory().openCount(filePath()) > 1)
+            error::_throw(error::Busy);
+        close();
+        factory().deleteFile(filePath());
+    }
+
+
+    bool LogDataFile::setAutoCompact(bool autoCompact) {
+        _autoCompact = autoCompact;
+        return true;
+    }
+
+
+    void LogDataFile::compact() {
+        checkOpen();
+        beganCompacting();
+        try {
+            {
+                Transaction t(this);
+                updatePurgeCount(t);
+                t.commit();
+            }
+            withFileLock([this]{
+                _log->compact(true);
+            });
+        } catch (...) {
+            finishedCompacting();
+            throw;
+        }
+        finishedCompacting();
+    }
+
+}
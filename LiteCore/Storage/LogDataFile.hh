@@ -0,0 +1,68 @@
+//
+//  LogDataFile.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "DataFile.hh"
+#include <memory>
+
+namespace litecore {
+
+    class LogFile;
+    struct LogTransaction;
+
+
+    /** Log-structured implementation of DataFile. Every write is appended to a single file,
+        and an in-memory index maps each key (and sequence) to the offset of its latest version.
+        Commits are a single sequential write, and compaction rewrites the file with only the
+        current records.
+        Limitations: the file can only be shared between DataFiles in the same process, and
+        queries, indexes and encryption are not supported. */
+    class LogDataFile : public DataFile {
+    public:
+
+        LogDataFile(const FilePath &path, const Options*);
+        ~LogDataFile();
+
+        bool isOpen() const noexcept override;
+        void close() override;
+        void deleteDataFile() override;
+        void compact() override;
+        bool setAutoCompact(bool autoCompact) override;
+
+        std::vector<std::string> allKeyStoreNames() override;
+
+        class Factory : public DataFile::Factory {
+        public:
+            virtual const char* cname() override {return "Log";}
+            virtual std::string filenameExtension() override {return ".cblog";}
+            virtual bool encryptionEnabled(EncryptionAlgorithm alg) override
+                                                            {return alg == kNoEncryption;}
+            virtual LogDataFile* openFile(const FilePath &, const Options* =nullptr) override;
+            virtual bool deleteFile(const FilePath &path, const Options* =nullptr) override;
+        };
+
+        static Factory& factory();
+
+    protected:
+        void reopen() override;
+        void _beginTransaction(Transaction*) override;
+        void _endTransaction(Transaction*, bool commit) override;
+        KeyStore* newKeyStore(const std::string &name, KeyStore::Capabilities) override;
+        void deleteKeyStore(const std::string &name) override;
+
+    private:
+        friend class LogKeyStore;
+
+        LogFile& logFile() const;
+        LogTransaction* currentTransaction() const          {return _transaction.get();}
+
+        Retained<LogFile>               _log;               // The shared log file
+        std::unique_ptr<LogTransaction> _transaction;       // Current transaction, if any
+        bool                            _autoCompact {false};
+    };
+
+}
@@ -0,0 +1,1022 @@
+//
+//  LogFile.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "LogFile.hh"
+#include "Record.hh"
+#include "Error.hh"
+#include "FilePath.hh"
+#include "Logging.hh"
+#include "PlatformIO.hh"
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <fcntl.h>
+#endif
+
+using namespace std;
+
+namespace litecore {
+
+    // The file starts with a magic string followed by a 32-bit format version.
+    static const char kFileMagic[12] = "LiteCoreLog";
+    static const uint32_t kFileVersion = 1;
+
+    // The rest of the file is a sequence of entries. Each consists of a type byte, a 32-bit
+    // payload length, and the payload. All integers are little-endian; store names are
+    // prefixed with a 16-bit length. A transaction is a series of entries followed by a commit
+    // entry containing a checksum of them; anything after the last valid commit is discarded
+    // when the file is opened.
+    enum EntryType : uint8_t {
+        kPutEntry = 1,      // name, seq(8), flags(1), keyLen(4), metaLen(4), bodyLen(4), key, meta, body
+        kRemoveEntry,       // name, keyLen(4), key
+        kEraseEntry,        // name
+        kDropEntry,         // name
+        kLastSeqEntry,      // name, seq(8)
+        kCommitEntry,       // checksum(4)
+    };
+
+    static const size_t kEntryHeaderSize = 5;
+    static const size_t kPutFixedSize = 21;     // Size of a put entry's fields after the name
+    static const uint8_t kDeletedFlag = 0x01;
+
+    // When reading only a record's meta, this much of its entry is read at first:
+    static const size_t kMetaOnlyReadSize = 512;
+
+    // Auto-compaction happens when the file is at least this big...
+    static const uint64_t kAutoCompactMinSize = 1024 * 1024;
+    // ...and less than this fraction of it is current records:
+    static const double kAutoCompactLiveFraction = 0.5;
+
+    static const uint32_t kChecksumSeed = 2166136261u;
+
+
+    static mutex sFilesMutex;
+    static unordered_map<string, LogFile*> sFiles;
+
+
+#pragma mark - ENCODING:
+
+
+    template <class INT>
+    static void writeInt(string &out, INT n) {
+        for (size_t i = 0; i < sizeof(INT); ++i)
+            out.push_back((char)((n >> (8 * i)) & 0xFF));
+    }
+
+    static void writeBytes(string &out, slice bytes) {
+        out.append((const char*)bytes.buf, bytes.size);
+    }
+
+    static void writeName(string &out, const string &name) {
+        if (name.size() > UINT16_MAX)
+            error::_throw(error::InvalidParameter);
+        writeInt<uint16_t>(out, (uint16_t)name.size());
+        out.append(name);
+    }
+
+    static void writeEntryHeader(string &out, EntryType type, uint64_t payloadSize) {
+        if (payloadSize > UINT32_MAX)
+            error::_throw(error::InvalidParameter);
+        writeInt<uint8_t>(out, type);
+        writeInt<uint32_t>(out, (uint32_t)payloadSize);
+    }
+
+    static string fileHeader() {
+        string header(kFileMagic, sizeof(kFileMagic));
+        writeInt<uint32_t>(header, kFileVersion);
+        return header;
+    }
+
+    // FNV-1a
+    static uint32_t checksum(slice bytes, uint32_t hash =kChecksumSeed) {
+        auto b = (const uint8_t*)bytes.buf;
+        for (size_t i = 0; i < bytes.size; ++i) {
+            hash ^= b[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+
+    // Reads little-endian values from a slice. Clears `ok` if it runs out of data.
+    struct EntryReader {
+        slice in;
+        bool ok {true};
+
+        explicit EntryReader(slice s)   :in(s) { }
+
+        template <class INT>
+        INT readInt() {
+            if (in.size < sizeof(INT)) {
+                ok = false;
+                return 0;
+            }
+            auto b = (const uint8_t*)in.buf;
+            INT n = 0;
+            for (size_t i = 0; i < sizeof(INT); ++i)
+                n |= (INT)((INT)b[i] << (8 * i));
+            in = slice(b + sizeof(INT), in.size - sizeof(INT));
+            return n;
+        }
+
+        slice readBytes(size_t n) {
+            if (in.size < n) {
+                ok = false;
+                return nullslice;
+            }
+            slice result = n ? slice(in.buf, n) : nullslice;
+            in = slice((const uint8_t*)in.buf + n, in.size - n);
+            return result;
+        }
+
+        slice readName()                {return readBytes(readInt<uint16_t>());}
+    };
+
+
+    struct PutEntry {
+        slice store, key, meta, body;
+        uint32_t bodySize;
+        sequence seq;
+        bool deleted;
+    };
+
+    // Parses a put entry, including its header. If `partial` is true the entry may be cut off
+    // anywhere after the meta, and the body isn't returned.
+    static bool parsePut(slice entry, PutEntry &put, bool partial =false) {
+        EntryReader r(entry);
+        if (r.readInt<uint8_t>() != kPutEntry)
+            return false;
+        uint64_t payloadSize = r.readInt<uint32_t>();
+        if (!r.ok || (!partial && payloadSize + kEntryHeaderSize != entry.size))
+            return false;
+        put.store = r.readName();
+        put.seq = r.readInt<uint64_t>();
+        put.deleted = (r.readInt<uint8_t>() & kDeletedFlag) != 0;
+        auto keySize = r.readInt<uint32_t>();
+        auto metaSize = r.readInt<uint32_t>();
+        put.bodySize = r.readInt<uint32_t>();
+        put.key = r.readBytes(keySize);
+        put.meta = r.readBytes(metaSize);
+        if (partial) {
+            put.body = nullslice;
+            return r.ok;
+        }
+        put.body = r.readBytes(put.bodySize);
+        return r.ok && r.in.size == 0;
+    }
+
+
+#pragma mark - INDEX:
+
+
+    const LogIndexEntry* LogStoreIndex::find(slice key) const {
+        auto i = byKey.find(key);
+        return (i != byKey.end()) ? &i->second : nullptr;
+    }
+
+
+    const LogIndexEntry* LogStoreIndex::findBySeq(sequence seq) const {
+        auto i = bySeq.find(seq);
+        return (i != bySeq.end()) ? find(i->second) : nullptr;
+    }
+
+
+    void LogStoreIndex::put(LogIndexEntry &&entry, bool keepRemoved) {
+        auto i = byKey.find(entry.key);
+        if (i != byKey.end()) {
+            auto &old = i->second;
+            if (!old.removed()) {
+                bytes -= old.size;
+                if (!old.deleted)
+                    --count;
+                if (old.seq)
+                    bySeq.erase(old.seq);
+            }
+            byKey.erase(i);
+        }
+        if (entry.removed()) {
+            if (!keepRemoved)
+                return;
+        } else {
+            bytes += entry.size;
+            if (!entry.deleted)
+                ++count;
+            if (entry.seq)
+                bySeq[entry.seq] = entry.key;
+        }
+        slice key = entry.key;
+        byKey.emplace(key, move(entry));
+    }
+
+
+    void LogStoreIndex::clear() {
+        bySeq.clear();
+        byKey.clear();
+        lastSeq = count = bytes = 0;
+    }
+
+
+#pragma mark - OPENING:
+
+
+    Retained<LogFile> LogFile::open(const FilePath &path, const DataFile::Options &options) {
+        lock_guard<mutex> lock(sFilesMutex);
+        LogFile* &file = sFiles[path.path()];
+        if (file && file->refCount() > 0) {
+            if (file->_readOnly && options.writeable) {
+                // Another DataFile opened the file read-only; reopen it for writing:
+                lock_guard<mutex> fileLock(file->_mutex);
+                FILE *fd = fopen_u8(path.path().c_str(), "r+b");
+                if (!fd)
+                    error::_throw(error::CantOpenFile, "%s", strerror(errno));
+                fclose(file->_fd);
+                file->_fd = fd;
+                file->_readOnly = false;
+            }
+            return file;
+        }
+        try {
+            file = new LogFile(path, options);
+        } catch (...) {
+            sFiles.erase(path.path());
+            throw;
+        }
+        return file;
+    }
+
+
+    LogFile::LogFile(const FilePath &path, const DataFile::Options &options)
+    :_path(path),
+     _readOnly(!options.writeable)
+    {
+        auto pathStr = path.path();
+        _fd = fopen_u8(pathStr.c_str(), _readOnly ? "rb" : "r+b");
+        if (!_fd && errno == ENOENT && options.create && !_readOnly)
+            _fd = fopen_u8(pathStr.c_str(), "w+b");
+        if (!_fd)
+            error::_throw(error::CantOpenFile, "%s: %s", pathStr.c_str(), strerror(errno));
+        try {
+            load();
+        } catch (...) {
+            closeFile();
+            throw;
+        }
+    }
+
+
+    LogFile::~LogFile() {
+        closeFile();
+        lock_guard<mutex> lock(sFilesMutex);
+        auto i = sFiles.find(_path.path());
+        if (i != sFiles.end() && i->second == this)
+            sFiles.erase(i);
+    }
+
+
+    void LogFile::openFile(const char *mode) {
+        _fd = fopen_u8(_path.path().c_str(), mode);
+        if (!_fd)
+            error::_throw(error::CantOpenFile, "%s: %s", _path.path().c_str(), strerror(errno));
+    }
+
+
+    void LogFile::closeFile() {
+        if (_fd) {
+            fclose(_fd);
+            _fd = nullptr;
+        }
+    }
+
+
+    FilePath LogFile::compactionPath(const FilePath &path) {
+        return path.appendingToName("-compact");
+    }
+
+
+    // Reads the entire file, rebuilding the index from committed transactions.
+    void LogFile::load() {
+        _stores.clear();
+        _liveBytes = 0;
+
+        if (fseeko(_fd, 0, SEEK_END) != 0)
+            error::_throwErrno();
+        auto fileSize = (uint64_t)ftello(_fd);
+        string header = fileHeader();
+        if (fileSize == 0 && !_readOnly) {
+            // New file; write the header:
+            if (fwrite(header.data(), 1, header.size(), _fd) != header.size() || fflush(_fd) != 0)
+                error::_throwErrno();
+            _end = header.size();
+            return;
+        }
+
+        string entry(header.size(), '\0');
+        if (fseeko(_fd, 0, SEEK_SET) != 0
+                || fread(&entry[0], 1, entry.size(), _fd) != entry.size()
+                || memcmp(entry.data(), header.data(), sizeof(kFileMagic)) != 0)
+            error::_throw(error::NotADatabaseFile);
+        EntryReader versionReader(slice(&entry[sizeof(kFileMagic)], 4));
+        if (versionReader.readInt<uint32_t>() != kFileVersion)
+            error::_throw(error::NotADatabaseFile);
+
+        uint64_t pos = header.size();
+        _end = pos;
+        map<string, LogStoreIndex> pending;
+        uint32_t sum = kChecksumSeed;
+        while (pos + kEntryHeaderSize <= fileSize) {
+            entry.resize(kEntryHeaderSize);
+            if (fread(&entry[0], 1, kEntryHeaderSize, _fd) != kEntryHeaderSize)
+                break;
+            EntryReader r(entry);
+            auto type = r.readInt<uint8_t>();
+            uint64_t payloadSize = r.readInt<uint32_t>();
+            if (pos + kEntryHeaderSize + payloadSize > fileSize)
+                break;
+            entry.resize(kEntryHeaderSize + payloadSize);
+            if (payloadSize > 0 && fread(&entry[kEntryHeaderSize], 1, payloadSize, _fd) != payloadSize)
+                break;
+
+            if (type == kCommitEntry) {
+                EntryReader c(slice(&entry[kEntryHeaderSize], entry.size() - kEntryHeaderSize));
+                if (c.readInt<uint32_t>() != sum || !c.ok)
+                    break;
+                apply(pending);
+                pending.clear();
+                sum = kChecksumSeed;
+                pos += entry.size();
+                _end = pos;
+            } else {
+                if (!replay(entry, pos, pending))
+                    break;
+                sum = checksum(entry, sum);
+                pos += entry.size();
+            }
+        }
+
+        if (_end < fileSize) {
+            Warn("LogFile: Ignoring %llu bytes of uncommitted or corrupt data at end of %s",
+                 (unsigned long long)(fileSize - _end), _path.path().c_str());
+            if (!_readOnly)
+                truncate(_end);
+        }
+        LogTo(DBLog, "LogFile: Loaded %s: %llu bytes, %llu live",
+              _path.path().c_str(), (unsigned long long)_end, (unsigned long long)_liveBytes);
+    }
+
+
+    // Applies an entry (which starts at file offset `offset`) to a set of store indexes.
+    bool LogFile::replay(slice entry, uint64_t offset, map<string, LogStoreIndex> &stores) {
+        EntryReader r(entry);
+        auto type = r.readInt<uint8_t>();
+        r.readInt<uint32_t>();
+        slice name = r.readName();
+        if (!r.ok)
+            return false;
+        LogStoreIndex &index = overlay(stores, string(name));
+
+        LogIndexEntry e;
+        switch (type) {
+            case kPutEntry: {
+                PutEntry put;
+                if (!parsePut(entry, put))
+                    return false;
+                e.key = put.key;
+                e.offset = offset;
+                e.size = (uint32_t)entry.size;
+                e.seq = put.seq;
+                e.deleted = put.deleted;
+                index.lastSeq = max(index.lastSeq, put.seq);
+                index.dropped = false;
+                index.put(move(e), true);
+                break;
+            }
+            case kRemoveEntry:
+                e.key = r.readBytes(r.readInt<uint32_t>());
+                if (!r.ok)
+                    return false;
+                index.put(move(e), true);
+                break;
+            case kEraseEntry:
+            case kDropEntry:
+                index.clear();
+                index.erased = true;
+                index.dropped = (type == kDropEntry);
+                break;
+            case kLastSeqEntry:
+                index.lastSeq = r.readInt<uint64_t>();
+                break;
+            default:
+                return false;
+        }
+        return r.ok;
+    }
+
+
+    // Merges a transaction's index changes into the committed index.
+    void LogFile::apply(map<string, LogStoreIndex> &changes) {
+        for (auto &i : changes) {
+            LogStoreIndex &changed = i.second;
+            if (changed.dropped) {
+                auto s = _stores.find(i.first);
+                if (s != _stores.end()) {
+                    _liveBytes -= s->second.bytes;
+                    _stores.erase(s);
+                }
+                continue;
+            }
+            LogStoreIndex &store = _stores[i.first];
+            _liveBytes -= store.bytes;
+            if (changed.erased)
+                store.clear();
+            for (auto &e : changed.byKey)
+                store.put(move(e.second), false);
+            store.lastSeq = changed.lastSeq;
+            _liveBytes += store.bytes;
+        }
+    }
+
+
+    void LogFile::truncate(uint64_t size) {
+        fflush(_fd);
+#ifdef _MSC_VER
+        int result = _chsize_s(_fileno(_fd), size);
+#else
+        int result = ftruncate(fileno(_fd), (off_t)size);
+#endif
+        if (result != 0)
+            error::_throwErrno();
+    }
+
+
+#pragma mark - READING:
+
+
+    void LogFile::readFromFile(uint64_t offset, size_t size, string &out) {
+        out.resize(size);
+        if (fseeko(_fd, (off_t)offset, SEEK_SET) != 0
+                || (size > 0 && fread(&out[0], 1, size, _fd) != size))
+            error::_throw(error::IOError);
+    }
+
+
+    // Returns the bytes at an offset, from the transaction's buffer if they're not committed
+    // yet. Returns nullslice if the range isn't part of the file or the transaction.
+    slice LogFile::readEntryBytes(uint64_t offset, size_t size, const LogTransaction *t,
+                                  string &storage)
+    {
+        if (t && offset >= t->startOffset) {
+            uint64_t pos = offset - t->startOffset;
+            if (pos + size > t->buffer.size())
+                return nullslice;
+            return slice(&t->buffer[(size_t)pos], size);
+        }
+        if (offset < sizeof(kFileMagic) + 4 || offset + size > _end)
+            return nullslice;
+        readFromFile(offset, size, storage);
+        return slice(storage);
+    }
+
+
+    // Reads the put entry described by `e` into `rec`. If e.key is null, it's filled in.
+    // Returns false if the entry isn't what the index says it should be.
+    bool LogFile::readRecord(const string &store, LogIndexEntry &e, const LogTransaction *t,
+                             ContentOptions options, Record &rec)
+    {
+        bool metaOnly = (options & kMetaOnly) != 0;
+        string storage;
+        PutEntry put;
+        bool parsed = false;
+        if (metaOnly && e.size > kMetaOnlyReadSize) {
+            slice bytes = readEntryBytes(e.offset, kMetaOnlyReadSize, t, storage);
+            parsed = bytes && parsePut(bytes, put, true);
+        }
+        if (!parsed) {
+            slice bytes = readEntryBytes(e.offset, e.size, t, storage);
+            if (!bytes || !parsePut(bytes, put))
+                return false;
+        }
+        if (put.store != slice(store) || put.seq != e.seq || (e.key && put.key != e.key))
+            return false;
+
+        if (!e.key)
+            e.key = put.key;
+        e.deleted = put.deleted;
+        rec.setKey(e.key);
+        rec.setMeta(put.meta);
+        if (metaOnly)
+            rec.setUnloadedBodySize(put.bodySize);
+        else
+            rec.setBody(put.body);
+        return true;
+    }
+
+
+    LogStoreIndex* LogFile::committedStore(const string &store) {
+        auto i = _stores.find(store);
+        return (i != _stores.end()) ? &i->second : nullptr;
+    }
+
+
+    static const LogStoreIndex* overlayFor(const LogTransaction *t, const string &store) {
+        if (!t)
+            return nullptr;
+        auto i = t->stores.find(store);
+        return (i != t->stores.end()) ? &i->second : nullptr;
+    }
+
+
+    // Returns the index a transaction is building for a store, creating it if necessary.
+    LogStoreIndex& LogFile::overlay(map<string, LogStoreIndex> &stores, const string &store) {
+        auto i = stores.find(store);
+        if (i == stores.end()) {
+            i = stores.emplace(store, LogStoreIndex()).first;
+            auto committed = committedStore(store);
+            if (committed)
+                i->second.lastSeq = committed->lastSeq;
+        }
+        return i->second;
+    }
+
+
+    const LogIndexEntry* LogFile::find(const string &store, slice key, const LogTransaction *t) {
+        auto changed = overlayFor(t, store);
+        if (changed) {
+            auto e = changed->find(key);
+            if (e)
+                return e->removed() ? nullptr : e;
+            if (changed->erased)
+                return nullptr;
+        }
+        auto committed = committedStore(store);
+        return committed ? committed->find(key) : nullptr;
+    }
+
+
+    const LogIndexEntry* LogFile::find(const string &store, sequence seq, const LogTransaction *t) {
+        auto changed = overlayFor(t, store);
+        if (changed) {
+            auto e = changed->findBySeq(seq);
+            if (e)
+                return e;
+        }
+        auto committed = committedStore(store);
+        auto e = committed ? committed->findBySeq(seq) : nullptr;
+        if (e && changed && (changed->erased || changed->find(e->key)))
+            return nullptr;     // superseded by the transaction
+        return e;
+    }
+
+
+    vector<string> LogFile::storeNames(const LogTransaction *t) {
+        lock_guard<mutex> lock(_mutex);
+        set<string> names;
+        for (auto &i : _stores)
+            names.insert(i.first);
+        if (t) {
+            for (auto &i : t->stores) {
+                if (i.second.dropped)
+                    names.erase(i.first);
+                else
+                    names.insert(i.first);
+            }
+        }
+        return vector<string>(names.begin(), names.end());
+    }
+
+
+    void LogFile::addStore(const string &store) {
+        lock_guard<mutex> lock(_mutex);
+        (void)_stores[store];
+    }
+
+
+    sequence LogFile::lastSequence(const string &store, const LogTransaction *t) {
+        lock_guard<mutex> lock(_mutex);
+        auto changed = overlayFor(t, store);
+        if (changed)
+            return changed->lastSeq;
+        auto committed = committedStore(store);
+        return committed ? committed->lastSeq : 0;
+    }
+
+
+    uint64_t LogFile::recordCount(const string &store, const LogTransaction *t) {
+        lock_guard<mutex> lock(_mutex);
+        auto changed = overlayFor(t, store);
+        auto committed = committedStore(store);
+        if (changed && changed->erased)
+            committed = nullptr;
+        uint64_t count = committed ? committed->count : 0;
+        if (changed) {
+            for (auto &i : changed->byKey) {
+                auto old = committed ? committed->find(i.first) : nullptr;
+                if (old && !old->deleted)
+                    --count;
+                if (!i.second.removed() && !i.second.deleted)
+                    ++count;
+            }
+        }
+        return count;
+    }
+
+
+    bool LogFile::lookup(const string &store, slice key, const LogTransaction *t,
+                         LogIndexEntry &outEntry)
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto e = find(store, key, t);
+        if (e)
+            outEntry = *e;
+        return e != nullptr;
+    }
+
+
+    bool LogFile::lookup(const string &store, sequence seq, const LogTransaction *t,
+                         LogIndexEntry &outEntry)
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto e = find(store, seq, t);
+        if (e)
+            outEntry = *e;
+        return e != nullptr;
+    }
+
+
+    bool LogFile::read(const string &store, slice key, const LogTransaction *t,
+                       ContentOptions options, Record &rec, LogIndexEntry &outEntry)
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto e = find(store, key, t);
+        if (!e)
+            return false;
+        outEntry = *e;
+        if (!readRecord(store, outEntry, t, options, rec))
+            error::_throw(error::CorruptData);
+        return true;
+    }
+
+
+    bool LogFile::read(const string &store, sequence seq, const LogTransaction *t,
+                       ContentOptions options, Record &rec, LogIndexEntry &outEntry)
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto e = find(store, seq, t);
+        if (!e)
+            return false;
+        outEntry = *e;
+        if (!readRecord(store, outEntry, t, options, rec))
+            error::_throw(error::CorruptData);
+        return true;
+    }
+
+
+    bool LogFile::readAt(const string &store, uint64_t offset, sequence seq,
+                         const LogTransaction *t, Record &rec, LogIndexEntry &outEntry)
+    {
+        lock_guard<mutex> lock(_mutex);
+        string storage;
+        EntryReader r(readEntryBytes(offset, kEntryHeaderSize, t, storage));
+        if (r.readInt<uint8_t>() != kPutEntry)
+            return false;
+        uint64_t size = kEntryHeaderSize + (uint64_t)r.readInt<uint32_t>();
+        if (!r.ok || size > UINT32_MAX)
+            return false;
+        outEntry = LogIndexEntry();
+        outEntry.offset = offset;
+        outEntry.size = (uint32_t)size;
+        outEntry.seq = seq;
+        return readRecord(store, outEntry, t, kDefaultContent, rec);
+    }
+
+
+    bool LogFile::readSnapshot(const string &store, LogIndexEntry &entry, uint64_t generation,
+                               const LogTransaction *t, ContentOptions options, Record &rec)
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (generation != _generation) {
+            // Compaction has moved the records since the snapshot was made:
+            auto e = find(store, entry.key, t);
+            if (!e)
+                return false;
+            entry = *e;
+        }
+        return readRecord(store, entry, t, options, rec);
+    }
+
+
+    vector<LogIndexEntry> LogFile::snapshotByKey(const string &store, const LogTransaction *t,
+                                                 slice minKey, bool inclusiveMin,
+                                                 slice maxKey, bool inclusiveMax,
+                                                 bool includeDeleted,
+                                                 uint64_t &outGeneration)
+    {
+        typedef map<slice, LogIndexEntry> KeyMap;
+        static const KeyMap kEmpty;
+
+        lock_guard<mutex> lock(_mutex);
+        outGeneration = _generation;
+        auto changed = overlayFor(t, store);
+        auto committed = committedStore(store);
+        if (changed && changed->erased)
+            committed = nullptr;
+        const KeyMap &cMap = committed ? committed->byKey : kEmpty;
+        const KeyMap &tMap = changed ? changed->byKey : kEmpty;
+
+        auto first = [&](const KeyMap &m) -> KeyMap::const_iterator {
+            if (!minKey.buf)
+                return m.begin();
+            return inclusiveMin ? m.lower_bound(minKey) : m.upper_bound(minKey);
+        };
+        auto inRange = [&](const KeyMap &m, KeyMap::const_iterator i) -> bool {
+            if (i == m.end())
+                return false;
+            if (!maxKey.buf)
+                return true;
+            int cmp = i->first.compare(maxKey);
+            return inclusiveMax ? (cmp <= 0) : (cmp < 0);
+        };
+
+        // Merge the two key-ordered maps; the transaction's entries take precedence:
+        vector<LogIndexEntry> result;
+        auto ci = first(cMap), ti = first(tMap);
+        while (true) {
+            bool cValid = inRange(cMap, ci), tValid = inRange(tMap, ti);
+            if (!cValid && !tValid)
+                break;
+            const LogIndexEntry *e;
+            if (tValid && (!cValid || ti->first.compare(ci->first) <= 0)) {
+                if (cValid && ti->first == ci->first)
+                    ++ci;
+                e = &(ti++)->second;
+            } else {
+                e = &(ci++)->second;
+            }
+            if (!e->removed() && (includeDeleted || !e->deleted))
+                result.push_back(*e);
+        }
+        return result;
+    }
+
+
+    vector<LogIndexEntry> LogFile::snapshotBySeq(const string &store, const LogTransaction *t,
+                                                 sequence minSeq, bool inclusiveMin,
+                                                 sequence maxSeq, bool inclusiveMax,
+                                                 bool includeDeleted,
+                                                 uint64_t &outGeneration)
+    {
+        lock_guard<mutex> lock(_mutex);
+        outGeneration = _generation;
+        auto changed = overlayFor(t, store);
+        auto committed = committedStore(store);
+        if (changed && changed->erased)
+            committed = nullptr;
+
+        vector<LogIndexEntry> result;
+        auto collect = [&](const LogStoreIndex &index, const LogStoreIndex *shadow) {
+            auto i = inclusiveMin ? index.bySeq.lower_bound(minSeq)
+                                  : index.bySeq.upper_bound(minSeq);
+            for (; i != index.bySeq.end(); ++i) {
+                if (i->first > maxSeq || (i->first == maxSeq && !inclusiveMax))
+                    break;
+                if (shadow && shadow->find(i->second))
+                    continue;
+                auto e = index.find(i->second);
+                if (includeDeleted || !e->deleted)
+                    result.push_back(*e);
+            }
+        };
+        // A transaction's sequences are all higher than the committed ones (unless it erased
+        // the store, in which case there are no committed ones), so this is in order:
+        if (committed)
+            collect(*committed, changed);
+        if (changed)
+            collect(*changed, nullptr);
+        return result;
+    }
+
+
+#pragma mark - WRITING:
+
+
+    unique_ptr<LogTransaction> LogFile::beginTransaction() {
+        lock_guard<mutex> lock(_mutex);
+        unique_ptr<LogTransaction> t(new LogTransaction);
+        t->startOffset = _end;
+        return t;
+    }
+
+
+    // Applies the entry just appended to the transaction's buffer to its index.
+    void LogFile::addEntry(LogTransaction &t, size_t bufferPos) {
+        lock_guard<mutex> lock(_mutex);
+        slice entry(&t.buffer[bufferPos], t.buffer.size() - bufferPos);
+        if (!replay(entry, t.startOffset + bufferPos, t.stores))
+            error::_throw(error::AssertionFailed);
+    }
+
+
+    uint64_t LogFile::put(LogTransaction &t, const string &store,
+                          slice key, slice meta, slice body, sequence seq, bool deleted)
+    {
+        size_t pos = t.buffer.size();
+        uint64_t payloadSize = 2 + store.size() + kPutFixedSize + key.size + meta.size + body.size;
+        try {
+            writeEntryHeader(t.buffer, kPutEntry, payloadSize);
+            writeName(t.buffer, store);
+            writeInt<uint64_t>(t.buffer, seq);
+            writeInt<uint8_t>(t.buffer, deleted ? kDeletedFlag : 0);
+            writeInt<uint32_t>(t.buffer, (uint32_t)key.size);
+            writeInt<uint32_t>(t.buffer, (uint32_t)meta.size);
+            writeInt<uint32_t>(t.buffer, (uint32_t)body.size);
+            writeBytes(t.buffer, key);
+            writeBytes(t.buffer, meta);
+            writeBytes(t.buffer, body);
+            addEntry(t, pos);
+        } catch (...) {
+            t.buffer.resize(pos);
+            throw;
+        }
+        return t.startOffset + pos;
+    }
+
+
+    void LogFile::remove(LogTransaction &t, const string &store, slice key) {
+        size_t pos = t.buffer.size();
+        try {
+            writeEntryHeader(t.buffer, kRemoveEntry, 2 + store.size() + 4 + key.size);
+            writeName(t.buffer, store);
+            writeInt<uint32_t>(t.buffer, (uint32_t)key.size);
+            writeBytes(t.buffer, key);
+            addEntry(t, pos);
+        } catch (...) {
+            t.buffer.resize(pos);
+            throw;
+        }
+    }
+
+
+    void LogFile::erase(LogTransaction &t, const string &store) {
+        size_t pos = t.buffer.size();
+        writeEntryHeader(t.buffer, kEraseEntry, 2 + store.size());
+        writeName(t.buffer, store);
+        addEntry(t, pos);
+    }
+
+
+    void LogFile::drop(LogTransaction &t, const string &store) {
+        size_t pos = t.buffer.size();
+        writeEntryHeader(t.buffer, kDropEntry, 2 + store.size());
+        writeName(t.buffer, store);
+        addEntry(t, pos);
+    }
+
+
+    // Flushes the file's data to storage. Returns 0 on success, like fsync.
+    static int syncFile(FILE *fd) {
+#ifdef _MSC_VER
+        return _commit(_fileno(fd));
+#else
+        return fsync(fileno(fd));
+#endif
+    }
+
+
+    // Flushes a directory's entries to storage, so that a rename in it survives a crash.
+    // (Windows can't open a directory as a file, and NTFS journals renames anyway.)
+    static void syncDir(const FilePath &dir) {
+#ifndef _MSC_VER
+        int fd = ::open(dir.path().c_str(), O_RDONLY);
+        if (fd < 0)
+            error::_throwErrno();
+        int result = fsync(fd);
+        ::close(fd);
+        if (result != 0)
+            error::_throwErrno();
+#endif
+    }
+
+
+    void LogFile::commit(LogTransaction &t) {
+        if (t.buffer.empty())
+            return;
+        writeEntryHeader(t.buffer, kCommitEntry, 4);
+        writeInt<uint32_t>(t.buffer, checksum(slice(t.buffer.data(),
+                                                    t.buffer.size() - kEntryHeaderSize)));
+
+        lock_guard<mutex> lock(_mutex);
+        if (_readOnly)
+            error::_throw(error::NotWriteable);
+        Assert(t.startOffset == _end);
+        if (fseeko(_fd, (off_t)_end, SEEK_SET) != 0
+                || fwrite(t.buffer.data(), 1, t.buffer.size(), _fd) != t.buffer.size()
+                || fflush(_fd) != 0
+                || syncFile(_fd) != 0) {
+            int err = errno;
+            try {
+                truncate(_end);
+            } catch (...) { }
+            error::_throw(error::POSIX, err);
+        }
+        _end += t.buffer.size();
+        apply(t.stores);
+        t.buffer.clear();
+        t.stores.clear();
+    }
+
+
+#pragma mark - COMPACTION:
+
+
+    bool LogFile::shouldCompact() {
+        lock_guard<mutex> lock(_mutex);
+        return _end >= kAutoCompactMinSize && _liveBytes < _end * kAutoCompactLiveFraction;
+    }
+
+
+    uint64_t LogFile::compact(bool purgeDeleted) {
+        lock_guard<mutex> lock(_mutex);
+        if (_readOnly)
+            error::_throw(error::NotWriteable);
+        uint64_t oldSize = _end, purged = 0;
+        FilePath tempPath = compactionPath(_path);
+        FILE *out = fopen_u8(tempPath.path().c_str(), "wb");
+        if (!out)
+            error::_throwErrno();
+        try {
+            uint32_t sum = kChecksumSeed;
+            auto write = [&](slice bytes, bool checksummed) {
+                if (fwrite(bytes.buf, 1, bytes.size, out) != bytes.size)
+                    error::_throwErrno();
+                if (checksummed)
+                    sum = checksum(bytes, sum);
+            };
+
+            // Copy each current record's put entry, then record the store's last sequence
+            // (the record that had it may be gone) and commit the lot as one transaction:
+            write(slice(fileHeader()), false);
+            string storage, entry;
+            for (auto &s : _stores) {
+                for (auto &i : s.second.byKey) {
+                    const LogIndexEntry &e = i.second;
+                    if (purgeDeleted && e.deleted) {
+                        ++purged;
+                        continue;
+                    }
+                    slice bytes = readEntryBytes(e.offset, e.size, nullptr, storage);
+                    if (!bytes)
+                        error::_throw(error::CorruptData);
+                    write(bytes, true);
+                }
+                entry.clear();
+                writeEntryHeader(entry, kLastSeqEntry, 2 + s.first.size() + 8);
+                writeName(entry, s.first);
+                writeInt<uint64_t>(entry, s.second.lastSeq);
+                write(slice(entry), true);
+            }
+            entry.clear();
+            writeEntryHeader(entry, kCommitEntry, 4);
+            writeInt<uint32_t>(entry, sum);
+            write(slice(entry), false);
+
+            if (fflush(out) != 0 || syncFile(out) != 0)
+                error::_throwErrno();
+            int result = fclose(out);
+            out = nullptr;
+            if (result != 0)
+                error::_throwErrno();
+
+            closeFile();
+            tempPath.moveTo(_path);
+        } catch (...) {
+            if (out)
+                fclose(out);
+            try {
+                tempPath.del();
+            } catch (...) { }
+            if (!_fd) {
+                openFile("r+b");
+                load();
+            }
+            throw;
+        }
+
+        openFile("r+b");
+        load();
+        ++_generation;
+        syncDir(_path.dir());
+        LogTo(DBLog, "LogFile: Compacted %s from %llu to %llu bytes; purged %llu tombstones",
+              _path.path().c_str(), (unsigned long long)oldSize, (unsigned long long)_end,
+              (unsigned long long)purged);
+        return purged;
+    }
+
+}
@@ -0,0 +1,175 @@
+//
+//  LogFile.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "DataFile.hh"
+#include "RefCounted.hh"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+namespace litecore {
+
+    /** Location of the current version of a record in a LogFile. */
+    struct LogIndexEntry {
+        alloc_slice key;
+        uint64_t    offset  {0};        // File offset of the put entry; 0 if the key was removed
+        uint32_t    size    {0};        // Total size of the put entry in bytes
+        sequence    seq     {0};
+        bool        deleted {false};    // Is this a soft-deleted tombstone?
+
+        bool removed() const            {return offset == 0;}
+    };
+
+
+    /** In-memory index of one KeyStore's records in a LogFile. A LogTransaction has one of these
+        per KeyStore it's modified, as an overlay on top of the committed index. */
+    struct LogStoreIndex {
+        std::map<slice, LogIndexEntry> byKey;   // Map keys point into the entries' `key`
+        std::map<sequence, slice>      bySeq;   // Sequence -> key, for entries with sequences
+        sequence lastSeq    {0};
+        uint64_t count      {0};                // Number of non-deleted records
+        uint64_t bytes      {0};                // Total size of records' put entries
+        bool     erased     {false};            // (Overlay only) Earlier records were all erased
+        bool     dropped    {false};            // (Overlay only) The store was deleted
+
+        const LogIndexEntry* find(slice key) const;
+        const LogIndexEntry* findBySeq(sequence) const;
+
+        /** Adds or replaces an entry. A removed entry is kept only if `keepRemoved` is true. */
+        void put(LogIndexEntry&&, bool keepRemoved);
+        void clear();
+    };
+
+
+    /** State of an uncommitted transaction: the encoded entries not yet written to the file,
+        and the index changes they make. The entries' offsets are the ones they'll have once
+        the buffer is appended to the file at `startOffset`. */
+    struct LogTransaction {
+        uint64_t startOffset {0};
+        std::string buffer;
+        std::map<std::string, LogStoreIndex> stores;
+    };
+
+
+    /** An append-only log file containing the records of any number of KeyStores, plus an
+        in-memory index of where each record's current version lives in it. Used by
+        LogDataFile; shared by all LogDataFiles open on the same path, in the same process.
+        Every method is thread-safe. */
+    class LogFile : public RefCounted {
+    public:
+        /** Returns the LogFile for a path, opening or creating it if necessary. */
+        static Retained<LogFile> open(const FilePath&, const DataFile::Options&);
+
+        const FilePath& path() const                    {return _path;}
+
+        /** Incremented every time compaction moves records to new offsets. */
+        uint64_t generation() const                     {return _generation;}
+
+        //////// Reading:
+        // The LogTransaction parameters are the caller's transaction, or null if it's not in
+        // one; uncommitted changes are visible only to their own transaction.
+
+        std::vector<std::string> storeNames(const LogTransaction*);
+        void addStore(const std::string &store);
+
+        sequence lastSequence(const std::string &store, const LogTransaction*);
+        uint64_t recordCount(const std::string &store, const LogTransaction*);
+
+        bool lookup(const std::string &store, slice key, const LogTransaction*,
+                    LogIndexEntry &outEntry);
+        bool lookup(const std::string &store, sequence, const LogTransaction*,
+                    LogIndexEntry &outEntry);
+
+        /** Looks up a record by key and reads its meta and body into `rec`. */
+        bool read(const std::string &store, slice key, const LogTransaction*, ContentOptions,
+                  Record &rec, LogIndexEntry &outEntry);
+        /** Looks up a record by sequence and reads its key, meta and body into `rec`. */
+        bool read(const std::string &store, sequence, const LogTransaction*, ContentOptions,
+                  Record &rec, LogIndexEntry &outEntry);
+        /** Reads the version of a record written at an offset, if it's still in the file. */
+        bool readAt(const std::string &store, uint64_t offset, sequence, const LogTransaction*,
+                    Record &rec, LogIndexEntry &outEntry);
+        /** Reads a record found by one of the snapshot methods below. If the file has been
+            compacted since `generation`, the entry is first looked up again by key. */
+        bool readSnapshot(const std::string &store, LogIndexEntry &entry, uint64_t generation,
+                          const LogTransaction*, ContentOptions, Record &rec);
+
+        /** Returns the entries in a key range, in key order. Null keys are unbounded. */
+        std::vector<LogIndexEntry> snapshotByKey(const std::string &store, const LogTransaction*,
+                                                 slice minKey, bool inclusiveMin,
+                                                 slice maxKey, bool inclusiveMax,
+                                                 bool includeDeleted, uint64_t &outGeneration);
+        /** Returns the entries in a sequence range, in sequence order. */
+        std::vector<LogIndexEntry> snapshotBySeq(const std::string &store, const LogTransaction*,
+                                                 sequence minSeq, bool inclusiveMin,
+                                                 sequence maxSeq, bool inclusiveMax,
+                                                 bool includeDeleted, uint64_t &outGeneration);
+
+        //////// Writing:
+
+        std::unique_ptr<LogTransaction> beginTransaction();
+
+        /** Adds a new version of a record, returning its file offset. */
+        uint64_t put(LogTransaction&, const std::string &store,
+                     slice key, slice meta, slice body, sequence, bool deleted);
+        void remove(LogTransaction&, const std::string &store, slice key);
+        void erase(LogTransaction&, const std::string &store);
+        void drop(LogTransaction&, const std::string &store);
+
+        /** Appends the transaction's entries, and a commit marker, to the file, and syncs it
+            to storage so the commit is durable. */
+        void commit(LogTransaction&);
+
+        /** True if enough of the file is garbage (overwritten records) to make compaction
+            worthwhile. */
+        bool shouldCompact();
+
+        /** Rewrites the file with only the current version of every record, dropping
+            tombstones too if `purgeDeleted` is true. Returns the number of tombstones purged.
+            Caller must ensure no transaction is open on the file. */
+        uint64_t compact(bool purgeDeleted);
+
+        /** The path compaction writes the new file to before replacing the old one. */
+        static FilePath compactionPath(const FilePath &path);
+
+    protected:
+        LogFile(const FilePath&, const DataFile::Options&);
+        ~LogFile();
+
+    private:
+        void openFile(const char *mode);
+        void closeFile();
+        void load();
+        void readFromFile(uint64_t offset, size_t size, std::string &out);
+        slice readEntryBytes(uint64_t offset, size_t size, const LogTransaction*,
+                             std::string &storage);
+        bool readRecord(const std::string &store, LogIndexEntry&, const LogTransaction*,
+                        ContentOptions, Record&);
+        LogStoreIndex* committedStore(const std::string &store);
+        LogStoreIndex& overlay(std::map<std::string, LogStoreIndex>&, const std::string &store);
+        bool replay(slice entry, uint64_t offset, std::map<std::string, LogStoreIndex>&);
+        void addEntry(LogTransaction&, size_t bufferPos);
+        const LogIndexEntry* find(const std::string &store, slice key, const LogTransaction*);
+        const LogIndexEntry* find(const std::string &store, sequence, const LogTransaction*);
+        void apply(std::map<std::string, LogStoreIndex> &changes);
+        void truncate(uint64_t size);
+
+        const FilePath      _path;
+        std::mutex          _mutex;
+        FILE*               _fd {nullptr};
+        bool                _readOnly;
+        uint64_t            _end {0};                       // End of the last committed entry
+        uint64_t            _liveBytes {0};                 // Size of all current records
+        uint64_t            _generation {0};                // Incremented by compact()
+        std::map<std::string, LogStoreIndex> _stores;       // Committed index of each store
+    };
+
+}
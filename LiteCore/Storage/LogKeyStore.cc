@@ -0,0 +1,232 @@
+//
+//  LogKeyStore.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "LogKeyStore.hh"
+#include "LogDataFile.hh"
+#include "LogFile.hh"
+#include "Record.hh"
+#include "RecordEnumerator.hh"
+#include "Error.hh"
+#include "Logging.hh"
+#include <algorithm>
+#include <limits.h>
+
+using namespace std;
+
+namespace litecore {
+
+    LogKeyStore::LogKeyStore(LogDataFile &db, const string &name, KeyStore::Capabilities capabilities)
+    :KeyStore(db, name, capabilities)
+    { }
+
+
+    LogFile& LogKeyStore::logFile() const {
+        return db().logFile();
+    }
+
+
+    LogTransaction* LogKeyStore::transaction() const {
+        return db().currentTransaction();
+    }
+
+
+    LogTransaction& LogKeyStore::writeTransaction() const {
+        db().checkOpen();
+        if (!db().options().writeable)
+            error::_throw(error::NotWriteable);
+        auto t = transaction();
+        if (!t)
+            error::_throw(error::NotInTransaction);
+        return *t;
+    }
+
+
+    void LogKeyStore::updateRecord(Record &rec, const LogIndexEntry &e) const {
+        updateDoc(rec, e.seq, (_capabilities.getByOffset ? e.offset : 0), e.deleted);
+    }
+
+
+    uint64_t LogKeyStore::recordCount() const {
+        return logFile().recordCount(name(), transaction());
+    }
+
+
+    sequence LogKeyStore::lastSequence() const {
+        return logFile().lastSequence(name(), transaction());
+    }
+
+
+    bool LogKeyStore::read(Record &rec, ContentOptions options) const {
+        LogIndexEntry e;
+        if (!logFile().read(name(), rec.key(), transaction(), options, rec, e))
+            return false;
+        updateRecord(rec, e);
+        return !rec.deleted();
+    }
+
+
+    Record LogKeyStore::get(sequence seq, ContentOptions options) const {
+        Record rec;
+        LogIndexEntry e;
+        if (logFile().read(name(), seq, transaction(), options, rec, e))
+            updateRecord(rec, e);
+        return rec;
+    }
+
+
+    Record LogKeyStore::getByOffsetNoErrors(docOffset offset, sequence seq) const {
+        Record rec;
+        if (!_capabilities.getByOffset)
+            return rec;
+        LogIndexEntry e;
+        try {
+            if (logFile().readAt(name(), offset, seq, transaction(), rec, e)) {
+                updateRecord(rec, e);
+                return rec;
+            }
+            // The file may have been compacted; maybe the sequence is still current...
+            return get(seq, kDefaultContent);
+        } catch (const error&) {
+            return Record();
+        }
+    }
+
+
+    // The log's put entries have no room for an extra, so supportsExtra() is false.
+    KeyStore::setResult LogKeyStore::set(slice key, slice meta, slice body, slice extra,
+                                         Transaction&)
+    {
+        LogTo(DBLog, "KeyStore(%s) set %s", name().c_str(), logSlice(key));
+        if (extra.buf)
+            error::_throw(error::Unimplemented);
+        auto &t = writeTransaction();
+        sequence seq = _capabilities.sequences ? lastSequence() + 1 : 0;
+        uint64_t offset = logFile().put(t, name(), key, meta, body, seq, false);
+        return {seq, (_capabilities.getByOffset ? offset : 0)};
+    }
+
+
+    bool LogKeyStore::_del(slice key, Transaction&) {
+        auto &t = writeTransaction();
+        LogIndexEntry e;
+        return logFile().lookup(name(), key, &t, e) && delEntry(e, t);
+    }
+
+
+    bool LogKeyStore::_del(sequence seq, Transaction&) {
+        auto &t = writeTransaction();
+        LogIndexEntry e;
+        return logFile().lookup(name(), seq, &t, e) && delEntry(e, t);
+    }
+
+
+    // Soft deletion writes a tombstone with a new sequence; otherwise the key is removed.
+    bool LogKeyStore::delEntry(const LogIndexEntry &e, LogTransaction &t) {
+        if (e.deleted)
+            return false;
+        if (_capabilities.softDeletes) {
+            sequence seq = _capabilities.sequences ? lastSequence() + 1 : 0;
+            logFile().put(t, name(), e.key, nullslice, nullslice, seq, true);
+        } else {
+            logFile().remove(t, name(), e.key);
+        }
+        return true;
+    }
+
+
+    void LogKeyStore::erase() {
+        Transaction t(db());
+        logFile().erase(writeTransaction(), name());
+        t.commit();
+    }
+
+
+#pragma mark - ENUMERATION:
+
+
+    /** Enumerates a snapshot of the index entries taken when it's created; records are read
+        from the file as it advances. */
+    class LogEnumerator : public RecordEnumerator::Impl {
+    public:
+        LogEnumerator(LogKeyStore &store, vector<LogIndexEntry> &&entries, uint64_t generation,
+                      RecordEnumerator::Options &options)
+        :_store(store),
+         _entries(move(entries)),
+         _generation(generation),
+         _content(options.contentOptions)
+        {
+            if (options.descending)
+                reverse(_entries.begin(), _entries.end());
+            // Apply skip and limit here, so RecordEnumerator doesn't step through the records:
+            size_t skip = min((size_t)options.skip, _entries.size());
+            _entries.erase(_entries.begin(), _entries.begin() + skip);
+            if (options.limit < _entries.size())
+                _entries.resize(options.limit);
+            options.skip = 0;
+            options.limit = UINT_MAX;
+        }
+
+        virtual bool next() override {
+            while (_pos < _entries.size()) {
+                auto &e = _entries[_pos++];
+                _record.clear();
+                // Skip entries whose records no longer exist (the snapshot may be of an
+                // aborted transaction):
+                if (_store.logFile().readSnapshot(_store.name(), e, _generation,
+                                                  _store.transaction(), _content, _record)) {
+                    updateDoc(_record, e.seq,
+                              (_store.capabilities().getByOffset ? e.offset : 0), e.deleted);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        virtual bool read(Record &rec) override {
+            rec = move(_record);
+            return true;
+        }
+
+    private:
+        LogKeyStore &_store;
+        vector<LogIndexEntry> _entries;
+        size_t _pos {0};
+        uint64_t _generation;
+        ContentOptions _content;
+        Record _record;
+    };
+
+
+    // iterate by key:
+    RecordEnumerator::Impl* LogKeyStore::newEnumeratorImpl(slice minKey, slice maxKey,
+                                                           RecordEnumerator::Options &options)
+    {
+        bool includeDeleted = options.includeDeleted || !_capabilities.softDeletes;
+        uint64_t generation;
+        auto entries = logFile().snapshotByKey(name(), transaction(),
+                                               minKey, options.inclusiveMin(),
+                                               maxKey, options.inclusiveMax(),
+                                               includeDeleted, generation);
+        return new LogEnumerator(*this, move(entries), generation, options);
+    }
+
+    // iterate by sequence:
+    RecordEnumerator::Impl* LogKeyStore::newEnumeratorImpl(sequence min, sequence max,
+                                                           RecordEnumerator::Options &options)
+    {
+        if (!_capabilities.sequences)
+            error::_throw(error::NoSequences);
+        bool includeDeleted = options.includeDeleted || !_capabilities.softDeletes;
+        uint64_t generation;
+        auto entries = logFile().snapshotBySeq(name(), transaction(),
+                                               min, options.inclusiveMin(),
+                                               max, options.inclusiveMax(),
+                                               includeDeleted, generation);
+        return new LogEnumerator(*this, move(entries), generation, options);
+    }
+
+}
@@ -0,0 +1,56 @@
+//
+//  LogKeyStore.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "KeyStore.hh"
+
+namespace litecore {
+
+    class LogDataFile;
+    class LogFile;
+    struct LogIndexEntry;
+    struct LogTransaction;
+
+
+    /** LogDataFile implementation of KeyStore. Record offsets are file offsets, so with the
+        getByOffset capability old versions stay readable until the file is compacted. */
+    class LogKeyStore : public KeyStore {
+    public:
+        uint64_t recordCount() const override;
+        sequence lastSequence() const override;
+
+        Record get(sequence, ContentOptions) const override;
+        bool read(Record &rec, ContentOptions options) const override;
+        Record getByOffsetNoErrors(docOffset, sequence) const override;
+
+        setResult set(slice key, slice meta, slice value, slice extra, Transaction&) override;
+
+        void erase() override;
+
+    protected:
+        bool _del(slice key, Transaction&) override;
+        bool _del(sequence s, Transaction&) override;
+
+        RecordEnumerator::Impl* newEnumeratorImpl(slice minKey, slice maxKey,
+                                                  RecordEnumerator::Options&) override;
+        RecordEnumerator::Impl* newEnumeratorImpl(sequence min, sequence max,
+                                                  RecordEnumerator::Options&) override;
+
+    private:
+        friend class LogDataFile;
+        friend class LogEnumerator;
+
+        LogKeyStore(LogDataFile&, const std::string &name, KeyStore::Capabilities options);
+        LogDataFile& db() const                    {return (LogDataFile&)dataFile();}
+        LogFile& logFile() const;
+        LogTransaction* transaction() const;
+        LogTransaction& writeTransaction() const;
+        bool delEntry(const LogIndexEntry&, LogTransaction&);
+        void updateRecord(Record&, const LogIndexEntry&) const;
+    };
+
+}
@@ -30,6 +30,7 @@ namespace litecore {
     :_key(d._key),
      _meta(d._meta),
      _body(d._body),
+     _extra(d._extra),
      _bodySize(d._bodySize),
      _sequence(d._sequence),
      _offset(d._offset),
@@ -41,6 +42,7 @@ namespace litecore {
     :_key(move(d._key)),
      _meta(move(d._meta)),
      _body(move(d._body)),
+     _extra(move(d._extra)),
      _bodySize(d._bodySize),
      _sequence(d._sequence),
      _offset(d._offset),
@@ -48,9 +50,23 @@ namespace litecore {
      _exists(d._exists)
     { }
 
+    Record& Record::operator=(Record &&d) noexcept {
+        _key = move(d._key);
+        _meta = move(d._meta);
+        _body = move(d._body);
+        _extra = move(d._extra);
+        _bodySize = d._bodySize;
+        _sequence = d._sequence;
+        _offset = d._offset;
+        _deleted = d._deleted;
+        _exists = d._exists;
+        return *this;
+    }
+
     void Record::clearMetaAndBody() noexcept {
         setMeta(nullslice);
         setBody(nullslice);
+        setExtra(nullslice);
         _bodySize = _sequence = _offset = 0;
         _exists = _deleted = false;
     }
@@ -18,7 +18,7 @@
 
 namespace litecore {
 
-    /** The unit of storage in a DataFile: a key, metadata and body (all opaque blobs);
+    /** The unit of storage in a DataFile: a key, metadata, body and 'extra' (all opaque blobs);
         and some extra metadata like a deletion flag and a sequence number. */
     class Record {
     public:
@@ -26,11 +26,16 @@ namespace litecore {
         explicit Record(slice key);
         Record(const Record&);
         Record(Record&&) noexcept;
+        Record& operator=(Record&&) noexcept;
 
         const alloc_slice& key() const          {return _key;}
         const alloc_slice& meta() const         {return _meta;}
         const alloc_slice& body() const         {return _body;}
 
+        /** Secondary metadata, stored apart from the body but read along with the meta, even
+            with kMetaOnly. Only some storage engines support it (see KeyStore::supportsExtra.) */
+        const alloc_slice& extra() const        {return _extra;}
+
         size_t bodySize() const                 {return _bodySize;}
 
         sequence_t sequence() const             {return _sequence;}
@@ -48,6 +53,8 @@ namespace litecore {
             void setMeta(const T &meta)         {_meta = meta;}
         template <typename T>
             void setBody(const T &body)         {_body = body; _bodySize = _body.size;}
+        template <typename T>
+            void setExtra(const T &extra)       {_extra = extra;}
 
         void setDeleted(bool deleted)           {_deleted = deleted; if (deleted) _exists = false;}
 
@@ -77,6 +84,7 @@ namespace litecore {
         }
 
         alloc_slice _key, _meta, _body;     // The key, metadata and body of the record
+        alloc_slice _extra;                 // Secondary metadata, read even with kMetaOnly
         size_t      _bodySize {0};          // Size of body, if body wasn't loaded
         sequence_t  _sequence {0};          // Sequence number (if KeyStore supports sequences)
         uint64_t    _offset {0};            // File offset in db, if KeyStore supports that
@@ -27,6 +27,9 @@ namespace litecore {
 
     LogDomain EnumLog("Enum");
 
+    // Number of records read at once (with KeyStore::getMany) when enumerating a key array.
+    static const size_t kPrefetchCount = 100;
+
 #pragma mark - ENUMERATION:
 
 
@@ -110,6 +113,7 @@ namespace litecore {
         _impl = move(e._impl);
         _recordIDs = e._recordIDs;
         _curDocIndex = e._curDocIndex;
+        _prefetched = move(e._prefetched);
         _options = e._options;
         _skipStep = e._skipStep;
         return *this;
@@ -118,6 +122,7 @@ namespace litecore {
 
     void RecordEnumerator::close() noexcept {
         _record.clear();
+        _prefetched.clear();
         _impl.reset();
     }
 
@@ -151,9 +156,14 @@ namespace litecore {
             close();
             return false;
         }
-        _record.clearMetaAndBody();
-        _record.setKey(_recordIDs[_curDocIndex++]);
-        _store->read(_record);
+        size_t prefetchIndex = _curDocIndex % kPrefetchCount;
+        if (prefetchIndex == 0) {
+            size_t end = min(_curDocIndex + kPrefetchCount, _recordIDs.size());
+            vector<slice> keys(_recordIDs.begin() + _curDocIndex, _recordIDs.begin() + end);
+            _prefetched = _store->getMany(keys);
+        }
+        _record = move(_prefetched[prefetchIndex]);
+        ++_curDocIndex;
         LogToAt(EnumLog, Debug, "enum:     --> [%s]", _record.key().hexCString());
         return true;
     }
@@ -126,6 +126,7 @@ namespace litecore {
         Options         _options;           // Enumeration options
         std::vector<std::string>  _recordIDs; // The set of recordIDs to enumerate (if any)
         int             _curDocIndex {0};   // Current index in _recordIDs, else -1
+        std::vector<Record> _prefetched;    // Records read ahead from _recordIDs
         Record          _record;            // Current record
         bool            _skipStep {false};  // Should next call to next() skip _impl->next()?
         std::unique_ptr<Impl> _impl;        // The storage-specific implementation
@@ -21,7 +21,10 @@
 #include "FilePath.hh"
 #include "SharedKeys.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <set>
 #include <sqlite3.h>
 #include <sstream>
 #include <mutex>
@@ -42,7 +45,7 @@ namespace litecore {
 
     static const int64_t MB = 1024 * 1024;
 
-    // SQLite page size
+    // SQLite page size (unless overridden by Options::tuning, as are the next two)
     static const int64_t kPageSize = 4096;
 
     // Maximum size WAL journal will be left at after a commit
@@ -55,12 +58,37 @@ namespace litecore {
     static const float kVacuumFractionThreshold = 0.25;
     // If the database has many bytes of free space, vacuum it
     static const int64_t kVacuumSizeThreshold = 50 * MB;
+    // Max number of rows compaction deletes in one transaction
+    static const int kCompactBatchSize = 1000;
+    // Max number of free pages compaction or auto-compaction releases in one step
+    static const int kVacuumPagesPerStep = 256;
+
+    // Table holding the SQL of the indexes & triggers dropped during a bulk load
+    static const char* const kBulkLoadTable = "kvbulkload";
+    // Page cache size during a bulk load, in KB
+    static const int64_t kBulkLoadCacheKB = 256 * 1024;
 
     // Database busy timeout; generally not needed since we have other arbitration that keeps
     // multiple threads from trying to start transactions at once, but another process might
     // open the database and grab the write lock.
     static const unsigned kBusyTimeoutSecs = 10;
 
+    // Maximum number of compiled queries to keep in the cache
+    static const size_t kQueryCacheSize = 50;
+
+    // Info-store record holding the version of the newest compression dictionary; each version's
+    // data is in a record whose key appends "-<version>".
+    static const char* const kDictionaryVersionKey = "compressionDictionary";
+
+    static string dictionaryKey(unsigned version) {
+        return string(kDictionaryVersionKey) + "-" + to_string(version);
+    }
+
+
+    // Numbers of commits begun and finished by SQLiteDataFiles in this process. A pooled reader
+    // reloads its shared keys when a commit may have added some to its snapshot (see withReader.)
+    static atomic<uint64_t> sCommitsBegun {0}, sCommitsDone {0};
+
 
     LogDomain SQL("SQL");
 
@@ -126,8 +154,13 @@ path.path().c_str());
 
 
     SQLiteDataFile::SQLiteDataFile(const FilePath &path, const Options *options)
-    :DataFile(path, options)
+    :DataFile(path, options),
+     _bodyCompressor(this->options().tuning.compression)
     {
+        // Bodies may be compressed with any dictionary version, whatever the current mode:
+        _bodyCompressor.setDictionaryLoader([this](unsigned version) {
+            return getKeyStore(kInfoKeyStoreName).get(slice(dictionaryKey(version))).body();
+        });
         reopen();
     }
 
@@ -147,22 +180,37 @@ path.path().c_str());
         if (!decrypt())
             error::_throw(error::UnsupportedEncryption);
 
-        withFileLock([this]{
+        auto configure = [this]{
             _sqlDb->setBusyTimeout(kBusyTimeoutSecs * 1000);
 
+            const Tuning &tuning = options().tuning;
+            int64_t mmapSize = tuning.mmapSize ? max(tuning.mmapSize, (int64_t)0) : kMMapSize;
+            int64_t pageSize = tuning.pageSize ? tuning.pageSize : kPageSize;
+            int64_t journalSize = tuning.journalSizeLimit ? tuning.journalSizeLimit : kJournalSize;
+
             // http://www.sqlite.org/pragma.html
             stringstream sql;
             sql <<
-            "PRAGMA mmap_size=" <<kMMapSize<< "; " // mmap improves performance
-            "PRAGMA page_size=" <<kPageSize<< "; " // in case SQLite is older than 3.12
+            "PRAGMA mmap_size=" <<mmapSize<< "; "  // mmap improves performance
+            "PRAGMA page_size=" <<pageSize<< "; "  // in case SQLite is older than 3.12
             "PRAGMA journal_mode=WAL; "            // faster writes, better concurrency
-            "PRAGMA journal_size_limit="<<kJournalSize<<"; "  // trim WAL file
+            "PRAGMA journal_size_limit="<<journalSize<<"; "  // trim WAL file
             "PRAGMA auto_vacuum=incremental; "     // incremental vacuum mode
-            "PRAGMA synchronous=normal; "          // faster commits
+            "PRAGMA synchronous=normal; ";         // faster commits
+            if (tuning.cacheSize)
+                sql << "PRAGMA cache_size=" << -(tuning.cacheSize / 1024) << "; "; // negative = KB
+            if (tuning.walAutoCheckpoint)
+                sql << "PRAGMA wal_autocheckpoint=" << tuning.walAutoCheckpoint << "; ";
+            if (tuning.tempStore)
+                sql << "PRAGMA temp_store=" << tuning.tempStore << "; ";  // 1=FILE, 2=MEMORY
+            sql <<
             "CREATE TABLE IF NOT EXISTS "          // Table of metadata about KeyStores
             "kvmeta (name TEXT PRIMARY KEY, lastSeq INTEGER DEFAULT 0) WITHOUT ROWID";
             exec(sql.str());
 
+            // An existing database keeps the page size it was created with:
+            _pageSize = intQuery("PRAGMA page_size");
+
 #if DEBUG
             if (arc4random() % 1)              // deliberately make unordered queries unpredictable
                 _sqlDb->exec("PRAGMA reverse_unordered_selects=1");
@@ -170,23 +218,57 @@ path.path().c_str());
 
             // Configure number of extra threads to be used by SQLite:
             int maxThreads = 0;
+            if (tuning.workerThreads != 0) {
+                maxThreads = max(tuning.workerThreads, 0);
+            } else {
 #if TARGET_OS_OSX
-            maxThreads = 2;
-            // TODO: Configure for other platforms
+                maxThreads = 2;
+                // TODO: Configure for other platforms
 #endif
+            }
             sqlite3_limit(_sqlDb->getHandle(), SQLITE_LIMIT_WORKER_THREADS, maxThreads);
 
+            // Tables created before records had an 'extra' column get one now. (A read-only
+            // file can't be changed; its KeyStores read 'extra' as NULL instead.)
+            if (options().writeable) {
+                for (auto &name : allKeyStoreNames()) {
+                    if (!columnExists("kv_" + name, "extra"))
+                        exec("ALTER TABLE \"kv_" + name + "\" ADD COLUMN extra BLOB");
+                    // So does the kvold_ shadow table, and the trigger that fills it:
+                    if (tableExists("kvold_" + name) && !columnExists("kvold_" + name, "extra")) {
+                        exec("ALTER TABLE \"kvold_" + name + "\" ADD COLUMN extra BLOB");
+                        exec("DROP TRIGGER IF EXISTS \"backup_" + name + "\"");
+                        exec(SQLiteKeyStore::backupTriggerSQL(name));
+                    }
+                }
+            }
+
             // Create the default KeyStore's table:
             (void)defaultKeyStore();
-        });
+        };
+        // A read-only connection doesn't change the file, so it needn't wait for a writer:
+        if (options().writeable)
+            withFileLock(configure);
+        else
+            configure();
+
+        if (tableExists(kBulkLoadTable)) {
+            // A bulk load was interrupted by a crash. It ran with the rollback journal in memory,
+            // so the file may hold part of a transaction, which no integrity check can rule out:
+            Warn("Database '%s' was left in the middle of a bulk load; it has to be deleted",
+                 filePath().path().c_str());
+            error::_throw(error::CorruptData);
+        }
+        loadCompressionDictionary();
+        enableReaders();
     }
 
 
     void SQLiteDataFile::registerFleeceFunctions() {
         if (!_registeredFleeceFunctions) {
             auto sqlite = _sqlDb->getHandle();
-            RegisterFleeceFunctions    (sqlite, fleeceAccessor(), documentKeys());
-            RegisterFleeceEachFunctions(sqlite, fleeceAccessor(), documentKeys());
+            RegisterFleeceFunctions    (sqlite, fleeceAccessor(), &_bodyCompressor, documentKeys());
+            RegisterFleeceEachFunctions(sqlite, fleeceAccessor(), &_bodyCompressor, documentKeys());
             RegisterFTSRankFunction(sqlite);
             register_unicodesn_tokenizer(sqlite);
             _registeredFleeceFunctions = true;
@@ -200,11 +282,24 @@ path.path().c_str());
 
 
     void SQLiteDataFile::close() {
+        if (_bulkLoading && _sqlDb && !inTransaction()) {
+            // Left unfinished, the bulk load would make the file unopenable:
+            try {
+                endBulkLoad();
+            } catch (const exception &x) {
+                Warn("Couldn't finish bulk load of '%s' while closing it: %s",
+                     filePath().path().c_str(), x.what());
+            }
+        }
+        closeReaders();
         DataFile::close(); // closes all the KeyStores
+        clearQueryCache();
         _getLastSeqStmt.reset();
         _setLastSeqStmt.reset();
+        _schemaVersionStmt.reset();
         if (_sqlDb) {
-            maybeVacuum();
+            if (options().writeable)
+                maybeVacuum();
             _sqlDb.reset();
         }
     }
@@ -326,6 +421,9 @@ path.path().c_str());
 
 
     void SQLiteDataFile::_endTransaction(Transaction *t, bool commit) {
+        auto pendingDictionary = move(_pendingDictionary);
+        _pendingDictionary = {};
+
         // Notify key-stores so they can save state:
         forOpenKeyStores([commit](KeyStore &ks) {
             ((SQLiteKeyStore&)ks).transactionWillEnd(commit);
@@ -334,11 +432,49 @@ path.path().c_str());
         // Now commit:
         if (commit) {
             LogTo(SQL, "COMMIT");
-            _transaction->commit();
+            ++sCommitsBegun;
+            try {
+                _transaction->commit();
+            } catch (...) {
+                ++sCommitsDone;
+                throw;
+            }
+            ++sCommitsDone;
         } else {
             LogTo(SQL, "ROLLBACK");
         }
         _transaction.reset(); // destruct SQLite::Transaction, which will rollback if not committed
+
+        if (commit && pendingDictionary.second)
+            _bodyCompressor.addDictionary(pendingDictionary.first, pendingDictionary.second);
+
+        if (commit && _autoCompact && !_compactState) {
+            // Still holding the file lock, so release a bounded number of free pages now rather
+            // than letting them pile up into one long vacuum:
+            try {
+                if (worthVacuuming())
+                    vacuumStep();
+            } catch (const SQLite::Exception &x) {
+                Warn("Caught SQLite exception while auto-compacting: %s", x.what());
+            }
+        }
+    }
+
+
+    void SQLiteDataFile::_beginSavepoint(Transaction*) {
+        exec("SAVEPOINT litecore");
+    }
+
+
+    void SQLiteDataFile::_endSavepoint(Transaction*, bool commit) {
+        if (!commit) {
+            exec("ROLLBACK TO litecore");
+            // Key-stores may have cached state that was rolled back:
+            forOpenKeyStores([](KeyStore &ks) {
+                ((SQLiteKeyStore&)ks).savepointRolledBack();
+            });
+        }
+        exec("RELEASE litecore");
     }
 
 
@@ -393,6 +529,18 @@ path.path().c_str());
         return exists;
     }
 
+
+    bool SQLiteDataFile::columnExists(const string &table, const string &column) const {
+        checkOpen();
+        SQLite::Statement st(*_sqlDb, string("PRAGMA table_info(\"") + table + "\")");
+        LogStatement(st);
+        while (st.executeStep()) {
+            if (st.getColumn(1).getString() == column)
+                return true;
+        }
+        return false;
+    }
+
     
     sequence SQLiteDataFile::lastSequence(const string& keyStoreName) const {
         sequence seq = 0;
@@ -414,7 +562,175 @@ path.path().c_str());
     }
 
 
+    int64_t SQLiteDataFile::schemaVersion() {
+        compile(_schemaVersionStmt, "PRAGMA schema_version");
+        UsingStatement u(_schemaVersionStmt);
+        return _schemaVersionStmt->executeStep() ? (int64_t)_schemaVersionStmt->getColumn(0) : 0;
+    }
+
+
+#pragma mark - READER POOL:
+
+
+    // The pool holds up to tuning.readerConnections read-only SQLiteDataFiles on the same file,
+    // opened as they're first needed. Each has its own SQLite connection, so in WAL mode they
+    // can all read at once, and at the same time as a writer; and its own compiled statements,
+    // query cache and Fleece functions, so nothing is shared with other threads while in use.
+
+
+    void SQLiteDataFile::enableReaders() {
+        lock_guard<mutex> lock(_readersMutex);
+        _readersEnabled = (options().tuning.readerConnections > 0 && !_bulkLoading);
+    }
+
+
+    // Waits for all readers to be released, then closes them and disables the pool.
+    void SQLiteDataFile::closeReaders() {
+        vector<unique_ptr<SQLiteDataFile>> readers;
+        {
+            unique_lock<mutex> lock(_readersMutex);
+            _readersEnabled = false;
+            _readersCond.notify_all();      // wake up acquireReader calls so they give up
+            while (_readersOpening > 0 || _idleReaders.size() < _readers.size())
+                _readersCond.wait(lock);
+            _idleReaders.clear();
+            swap(readers, _readers);
+        }
+        if (!readers.empty())
+            LogTo(DBLog, "Closing %zu reader connections", readers.size());
+    }
+
+
+    // Returns an idle reader, opening one if the pool isn't full, else waiting for one to be
+    // released. Returns null if the pool is disabled.
+    SQLiteDataFile* SQLiteDataFile::acquireReader() {
+        unique_lock<mutex> lock(_readersMutex);
+        while (true) {
+            if (!_readersEnabled)
+                return nullptr;
+            if (!_idleReaders.empty()) {
+                SQLiteDataFile *reader = _idleReaders.back();
+                _idleReaders.pop_back();
+                return reader;
+            }
+            if (_readers.size() + _readersOpening < options().tuning.readerConnections)
+                break;
+            _readersCond.wait(lock);
+        }
+
+        // Open a new reader, without holding the mutex:
+        ++_readersOpening;
+        lock.unlock();
+        unique_ptr<SQLiteDataFile> reader;
+        try {
+            Options readerOptions = options();
+            readerOptions.create = readerOptions.writeable = false;
+            readerOptions.tuning.readerConnections = 0;
+            reader.reset(factory().openFile(filePath(), &readerOptions));
+            reader->setRecordFleeceAccessor(fleeceAccessor());
+            if (documentKeys())
+                reader->useDocumentKeys();
+        } catch (...) {
+            lock.lock();
+            --_readersOpening;
+            _readersCond.notify_all();
+            throw;
+        }
+        LogTo(DBLog, "Opened reader connection %p", reader.get());
+        lock.lock();
+        --_readersOpening;
+        _readers.push_back(move(reader));
+        return _readers.back().get();
+    }
+
+
+    void SQLiteDataFile::releaseReader(SQLiteDataFile *reader) {
+        lock_guard<mutex> lock(_readersMutex);
+        _idleReaders.push_back(reader);
+        _readersCond.notify_all();
+    }
+
+
+    // Calls `fn` inside a read transaction on a pooled reader, after making sure the reader's
+    // shared keys include all those in the transaction's snapshot. Every commit visible in the
+    // snapshot had begun before it was pinned; and if no more commits had begun by then than
+    // had finished when the keys were last loaded, every one of them is already known.
+    bool SQLiteDataFile::withReader(function_ref<void(DataFile&)> fn) {
+        SQLiteDataFile *reader = acquireReader();
+        if (!reader)
+            return false;
+        try {
+            uint64_t done = sCommitsDone;
+            SQLite::Transaction snapshot(*reader->_sqlDb);      // (never committed; only read)
+            (void)reader->intQuery("SELECT count(*) FROM sqlite_master");  // pins the snapshot
+            if (reader->_keysCommitCount != sCommitsBegun) {
+                reader->refreshDocumentKeys();                  // reads the snapshot's keys
+                reader->_keysCommitCount = done;
+            }
+            fn(*reader);
+        } catch (...) {
+            releaseReader(reader);
+            throw;
+        }
+        releaseReader(reader);
+        return true;
+    }
+
+
+#pragma mark - QUERY CACHE:
+
+
+    shared_ptr<SQLiteCompiledQuery> SQLiteDataFile::cachedQuery(const string &key) {
+        // Any schema change (including by another connection) may invalidate compiled queries:
+        int64_t schema = schemaVersion();
+        lock_guard<mutex> lock(_queryCacheMutex);
+        if (schema != _queryCacheSchema) {
+            _queryCache.clear();
+            _queryCacheIndex.clear();
+            _queryCacheSchema = schema;
+        }
+        auto i = _queryCacheIndex.find(key);
+        if (i == _queryCacheIndex.end()) {
+            ++_queryCacheStats.misses;
+            return nullptr;
+        }
+        ++_queryCacheStats.hits;
+        _queryCache.splice(_queryCache.begin(), _queryCache, i->second);   // move to front
+        return i->second->second;
+    }
+
+
+    void SQLiteDataFile::cacheQuery(const string &key, shared_ptr<SQLiteCompiledQuery> query) {
+        lock_guard<mutex> lock(_queryCacheMutex);
+        if (_queryCacheIndex.find(key) != _queryCacheIndex.end())
+            return;
+        _queryCache.emplace_front(key, query);
+        _queryCacheIndex[key] = _queryCache.begin();
+        if (_queryCache.size() > kQueryCacheSize) {
+            _queryCacheIndex.erase(_queryCache.back().first);
+            _queryCache.pop_back();
+        }
+    }
+
+
+    void SQLiteDataFile::clearQueryCache() {
+        lock_guard<mutex> lock(_queryCacheMutex);
+        _queryCache.clear();
+        _queryCacheIndex.clear();
+        _queryCacheSchema = -1;
+    }
+
+
+    DataFile::QueryCacheStats SQLiteDataFile::queryCacheStats() {
+        lock_guard<mutex> lock(_queryCacheMutex);
+        QueryCacheStats stats = _queryCacheStats;
+        stats.count = _queryCache.size();
+        return stats;
+    }
+
+
     void SQLiteDataFile::deleteDataFile() {
+        closeReaders();
         if (factory().openCount(filePath()) > 1)
             error::_throw(error::Busy);
         close();
@@ -422,15 +738,21 @@ path.path().c_str());
     }
 
 
+    bool SQLiteDataFile::worthVacuuming() {
+        int64_t pageCount = intQuery("PRAGMA page_count");
+        int64_t freePages = intQuery("PRAGMA freelist_count");
+        LogVerbose(DBLog, "%lld of %lld pages free (%.0f%%)",
+                   (long long)freePages, (long long)pageCount,
+                   100.0 * freePages / max(pageCount, (int64_t)1));
+        return (pageCount > 0 && (float)freePages / pageCount >= kVacuumFractionThreshold)
+            || (freePages * _pageSize >= kVacuumSizeThreshold);
+    }
+
+
     void SQLiteDataFile::maybeVacuum() {
         // For info, see https://blogs.gnome.org/jnelson/2015/01/06/sqlite-vacuum-and-auto_vacuum/
         try {
-            int64_t pageCount = intQuery("PRAGMA page_count");
-            int64_t freePages = intQuery("PRAGMA freelist_count");
-            LogTo(DBLog, "%lld of %lld pages free (%.0f%%)",
-                  (long long)freePages, (long long)pageCount, (float)freePages / pageCount);
-            if ((pageCount > 0 && (float)freePages / pageCount >= kVacuumFractionThreshold)
-                    || (freePages * kPageSize >= kVacuumSizeThreshold)) {
+            if (worthVacuuming()) {
                 Log("Vacuuming database '%s'...", filePath().dirName().c_str());
                 exec("PRAGMA incremental_vacuum");
             }
@@ -440,23 +762,326 @@ path.path().c_str());
     }
 
 
+    // Releases up to kVacuumPagesPerStep free pages. Returns true if there are more left.
+    bool SQLiteDataFile::vacuumStep() {
+        int64_t freePages = intQuery("PRAGMA freelist_count");
+        if (freePages == 0)
+            return false;
+        execWithLock("PRAGMA incremental_vacuum(" + to_string(kVacuumPagesPerStep) + ")");
+        return freePages > kVacuumPagesPerStep;
+    }
+
+
+#pragma mark - COMPACTION:
+
+
+    // Compaction is done in steps, each in its own short transaction, so that other connections
+    // can write in between. The state below persists between steps, and between calls to
+    // compactIncrementally().
+    struct SQLiteDataFile::CompactState {
+        vector<string> keyStores;       // KeyStores left to purge; current one is last
+        bool oldRevs {false};           // Purging the kvold_ table instead of kv_?
+        int64_t cursor {-1};            // Last rowid processed, or -1 before the table starts
+        int64_t endRowid {0};           // Max rowid at start; newer rows are left alone
+        int removed {0};                // Rows deleted from the current KeyStore
+        uint64_t deletionCount;         // Soft deletions as of the start of compaction
+        bool vacuuming {false};         // Are the tables done and vacuuming started?
+    };
+
+
+    // Does one bounded step of compaction. Returns false when compaction is complete.
+    bool SQLiteDataFile::compactStep() {
+        if (!_compactState) {
+            _compactState.reset(new CompactState);
+            _compactState->keyStores = allKeyStoreNames();
+            _compactState->deletionCount = deletionCount();
+        }
+        auto &state = *_compactState;
+
+        if (!state.keyStores.empty()) {
+            const string &name = state.keyStores.back();
+            string table = (state.oldRevs ? "kvold_" : "kv_") + name;
+            const char *condition = state.oldRevs ? "" : " AND deleted=1";
+            bool tableDone;
+            {
+                Transaction t(this);
+                if (state.cursor < 0) {
+                    state.cursor = 0;
+                    state.endRowid = intQuery(("SELECT coalesce(max(rowid), 0) FROM " + table).c_str());
+                }
+                // Find the end of the next batch, then delete the matching rows up to it:
+                int64_t batchEnd = intQuery(("SELECT coalesce(max(rowid), 0) FROM (SELECT rowid FROM "
+                                             + table + " WHERE rowid > " + to_string(state.cursor)
+                                             + " AND rowid <= " + to_string(state.endRowid) + condition
+                                             + " ORDER BY rowid LIMIT " + to_string(kCompactBatchSize)
+                                             + ")").c_str());
+                tableDone = (batchEnd == 0);
+                if (!tableDone) {
+                    state.removed += exec("DELETE FROM " + table + " WHERE rowid > "
+                                          + to_string(state.cursor) + " AND rowid <= "
+                                          + to_string(batchEnd) + condition);
+                    state.cursor = batchEnd;
+                } else if (state.oldRevs || !options().keyStores.getByOffset) {
+                    LogTo(DBLog, "Removed %d deleted keys from kv_%s", state.removed, name.c_str());
+                    state.keyStores.pop_back();
+                    if (state.keyStores.empty())
+                        setPurgeCount(state.deletionCount, t);
+                }
+                t.commit();
+            }
+            if (tableDone) {
+                state.oldRevs = !state.oldRevs && options().keyStores.getByOffset;
+                state.cursor = -1;
+                if (!state.oldRevs)
+                    state.removed = 0;
+            }
+            return true;
+        }
+
+        if (!state.vacuuming) {
+            state.vacuuming = worthVacuuming();
+            if (state.vacuuming)
+                Log("Vacuuming database '%s'...", filePath().dirName().c_str());
+        }
+        if (state.vacuuming && vacuumStep())
+            return true;
+        _compactState.reset();
+        return false;
+    }
+
+
     void SQLiteDataFile::compact() {
         checkOpen();
         beganCompacting();
+        try {
+            while (compactStep())
+                yieldToWaitingTransactions();
+        } catch (...) {
+            _compactState.reset();
+            finishedCompacting();
+            throw;
+        }
+        finishedCompacting();
+    }
+
+
+    bool SQLiteDataFile::compactIncrementally(chrono::milliseconds timeSlice) {
+        checkOpen();
+        auto deadline = chrono::steady_clock::now() + timeSlice;
+        bool more;
+        beganCompacting();
+        try {
+            do {
+                more = compactStep();
+                if (more)
+                    yieldToWaitingTransactions();
+            } while (more && chrono::steady_clock::now() < deadline);
+        } catch (...) {
+            _compactState.reset();
+            finishedCompacting();
+            throw;
+        }
+        finishedCompacting();
+        return more;
+    }
+
+
+    bool SQLiteDataFile::compactionNeeded() {
+        checkOpen();
+        return _compactState || deletionCount() > purgeCount() || worthVacuuming();
+    }
+
+
+    bool SQLiteDataFile::setAutoCompact(bool autoCompact) {
+        _autoCompact = autoCompact;
+        return true;
+    }
+
+
+#pragma mark - BULK LOAD:
+
+
+    // During a bulk load, all secondary indexes are dropped, as are the triggers that keep FTS
+    // tables up to date; their SQL is saved in kBulkLoadTable, in the same transaction.
+    // Covering-index triggers are kept, since queries may be answered from those tables alone. The journal is kept in memory, so a crash during a bulk load can leave the
+    // file damaged; reopen() refuses to open a file whose kBulkLoadTable is still there.
+    void SQLiteDataFile::beginBulkLoad() {
+        checkOpen();
+        if (_bulkLoading)
+            return;
+        Assert(!inTransaction());
+        closeReaders();     // They'd count as other connections, and can't share the exclusive lock
+        if (factory().openCount(filePath()) > 1) {
+            enableReaders();
+            error::_throw(error::Busy);
+        }
         {
             Transaction t(this);
-            for (auto& name : allKeyStoreNames()) {
-                auto removed = exec(string("DELETE FROM kv_")+name+" WHERE deleted=1");
-                if (options().keyStores.getByOffset) {
-                    removed += exec(string("DELETE FROM kvold_")+name);
-                }
-                LogTo(DBLog, "Removed %d deleted keys from kv_%s", removed, name.c_str());
+            exec(string("CREATE TABLE ") + kBulkLoadTable
+                 + " (name TEXT PRIMARY KEY, type TEXT, tbl TEXT, sql TEXT)");
+            exec(string("INSERT INTO ") + kBulkLoadTable + " SELECT name, type, tbl_name, sql"
+                 " FROM sqlite_master WHERE sql NOT NULL"
+                 " AND (type='index' OR (type='trigger' AND name NOT GLOB 'backup_*'"
+                                         " AND name NOT GLOB '*::covering::*'))");
+            vector<pair<string,string>> dropped;
+            {
+                SQLite::Statement st(*_sqlDb, string("SELECT type, name FROM ") + kBulkLoadTable);
+                while (st.executeStep())
+                    dropped.emplace_back(st.getColumn(0).getString(),
+                                         st.getColumn(1).getString());
             }
-            updatePurgeCount(t);
+            for (auto &item : dropped)
+                exec("DROP " + item.first + " \"" + item.second + "\"");
+            LogTo(DBLog, "Bulk load: deferred %zu indexes and triggers", dropped.size());
             t.commit();
         }
-        maybeVacuum();
-        finishedCompacting();
+
+        // (Not journal_mode=OFF: then ROLLBACK is undefined, and aborting a transaction is legal.)
+        _savedCacheSize = intQuery("PRAGMA cache_size");
+        exec("PRAGMA locking_mode=EXCLUSIVE; "
+             "PRAGMA journal_mode=MEMORY; "
+             "PRAGMA synchronous=OFF");
+        if (_savedCacheSize >= 0 || -_savedCacheSize < kBulkLoadCacheKB)
+            exec("PRAGMA cache_size=" + to_string(-kBulkLoadCacheKB));
+        _bulkLoading = true;
+    }
+
+
+    void SQLiteDataFile::endBulkLoad() {
+        checkOpen();
+        if (!_bulkLoading)
+            return;
+        Assert(!inTransaction());
+        if (_savedCacheSize != 0)
+            exec("PRAGMA cache_size=" + to_string(_savedCacheSize));
+        // The exclusive lock isn't released until the next access, and has to be before going
+        // back to WAL mode:
+        exec("PRAGMA locking_mode=NORMAL");
+        (void)intQuery("SELECT count(*) FROM sqlite_master");
+        exec("PRAGMA journal_mode=WAL; "
+             "PRAGMA synchronous=normal");
+        rebuildDeferredIndexes();
+        _bulkLoading = false;
+        _savedCacheSize = 0;
+        enableReaders();
+    }
+
+
+    // Removes an index deleted during a bulk load from kBulkLoadTable, so it isn't restored.
+    // Returns false if the index wasn't deferred.
+    bool SQLiteDataFile::forgetDeferredIndex(const string &name) {
+        if (!_bulkLoading)
+            return false;
+        SQLite::Statement st(*_sqlDb, string("DELETE FROM ") + kBulkLoadTable + " WHERE name=?");
+        st.bind(1, name);
+        LogStatement(st);
+        return st.exec() > 0;
+    }
+
+
+    // Restores the indexes and triggers saved by beginBulkLoad, except those that were
+    // re-created during the session (the new ones win) or whose tables were deleted.
+    void SQLiteDataFile::rebuildDeferredIndexes() {
+        registerFleeceFunctions();      // Index expressions & FTS tokenizer need these
+        Transaction t(this);
+        struct Saved {string type, name, table, sql;};
+        vector<Saved> saved;
+        {
+            SQLite::Statement st(*_sqlDb, string("SELECT type, name, tbl, sql FROM ")
+                                          + kBulkLoadTable);
+            while (st.executeStep())
+                saved.push_back({st.getColumn(0).getString(), st.getColumn(1).getString(),
+                                 st.getColumn(2).getString(), st.getColumn(3).getString()});
+        }
+        set<string> existing;
+        {
+            SQLite::Statement st(*_sqlDb, "SELECT name FROM sqlite_master");
+            while (st.executeStep())
+                existing.insert(st.getColumn(0).getString());
+        }
+        auto obsolete = [&](const Saved &item) -> bool {
+            if (existing.find(item.name) != existing.end()
+                    || existing.find(item.table) == existing.end())
+                return true;
+            if (item.type == "trigger") {
+                // Triggers named "<table>::ins" etc. write to <table>, which may be gone:
+                auto colons = item.name.rfind("::");
+                if (colons != string::npos
+                        && existing.find(item.name.substr(0, colons)) == existing.end())
+                    return true;
+            }
+            return false;
+        };
+
+        // Restore the triggers, then repopulate the tables they maintain from scratch by
+        // "updating" every record, which runs their AFTER UPDATE triggers:
+        unsigned rebuilt = 0;
+        set<string> triggeredTables;
+        for (auto &item : saved) {
+            if (item.type != "trigger" || obsolete(item))
+                continue;
+            exec(item.sql);
+            ++rebuilt;
+            static const string kInsSuffix = "::ins";
+            if (item.name.size() > kInsSuffix.size()
+                    && item.name.compare(item.name.size() - kInsSuffix.size(),
+                                         kInsSuffix.size(), kInsSuffix) == 0) {
+                auto target = item.name.substr(0, item.name.size() - kInsSuffix.size());
+                exec("DELETE FROM \"" + target + "\"");
+            }
+            triggeredTables.insert(item.table);
+        }
+        for (auto &table : triggeredTables)
+            exec("UPDATE \"" + table + "\" SET deleted=deleted");
+
+        // Now create the indexes, which SQLite does by sorting the existing rows:
+        for (auto &item : saved) {
+            if (item.type != "index" || obsolete(item))
+                continue;
+            exec(item.sql);
+            ++rebuilt;
+        }
+
+        exec(string("DROP TABLE ") + kBulkLoadTable);
+        t.commit();
+        LogTo(DBLog, "Bulk load: rebuilt %u of %zu indexes and triggers", rebuilt, saved.size());
+    }
+
+
+#pragma mark - COMPRESSION DICTIONARY:
+
+
+    // Loads the newest dictionary to compress bodies with. (Older ones are loaded on demand, to
+    // decompress bodies compressed with them.)
+    void SQLiteDataFile::loadCompressionDictionary() {
+        if (_bodyCompressor.mode() != kDictionaryCompression || !keyStoreExists(kInfoKeyStoreName))
+            return;
+        auto &info = getKeyStore(kInfoKeyStoreName);
+        auto version = (unsigned)info.get(slice(kDictionaryVersionKey)).bodyAsUInt();
+        if (version > _bodyCompressor.dictionaryVersion())
+            _bodyCompressor.addDictionary(version, info.get(slice(dictionaryKey(version))).body());
+    }
+
+
+    unsigned SQLiteDataFile::saveCompressionDictionary(slice dictionary, Transaction &t) {
+        if (dictionary.size == 0 || dictionary.size > CompressionDictionary::kMaxSize)
+            error::_throw(error::InvalidParameter);
+        auto &info = getKeyStore(kInfoKeyStoreName);
+        Record rec = info.get(slice(kDictionaryVersionKey));
+        auto version = (unsigned)rec.bodyAsUInt() + 1;
+        info.set(slice(dictionaryKey(version)), nullslice, dictionary, t);
+        rec.setBodyAsUInt(version);
+        info.write(rec, t);
+        // Don't compress with it until it's committed, or a rollback would orphan the bodies:
+        _pendingDictionary = {version, alloc_slice(dictionary)};
+        LogTo(DBLog, "Saved compression dictionary version %u (%zu bytes)",
+              version, dictionary.size);
+        return version;
+    }
+
+
+    unsigned SQLiteDataFile::compressionDictionaryVersion() const {
+        return _bodyCompressor.dictionaryVersion();
     }
 
 }
@@ -9,6 +9,12 @@
 #pragma once
 
 #include "DataFile.hh"
+#include "Compression.hh"
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace SQLite {
     class Database;
@@ -20,6 +26,7 @@ namespace SQLite {
 namespace litecore {
 
     class SQLiteKeyStore;
+    struct SQLiteCompiledQuery;
 
 
     /** SQLite implementation of Database. */
@@ -33,14 +40,31 @@ namespace litecore {
         void close() override;
         void deleteDataFile() override;
         void compact() override;
+        bool compactIncrementally(std::chrono::milliseconds timeSlice) override;
+        bool compactionNeeded() override;
+        bool setAutoCompact(bool autoCompact) override;
+        void beginBulkLoad() override;
+        void endBulkLoad() override;
+        bool isBulkLoading() const override                 {return _bulkLoading;}
+        bool supportsSavepoints() const override         {return true;}
+        bool withReader(function_ref<void(DataFile&)> fn) override;
+
+        QueryCacheStats queryCacheStats() override;
+        void clearQueryCache() override;
+        unsigned saveCompressionDictionary(slice dictionary, Transaction&) override;
+        unsigned compressionDictionaryVersion() const override;
 
         static void shutdown() { }
 
         operator SQLite::Database&() {return *_sqlDb;}
 
+        /** Compresses & decompresses bodies of the default KeyStore. */
+        const BodyCompressor& bodyCompressor() const        {return _bodyCompressor;}
+
         std::vector<std::string> allKeyStoreNames() override;
         bool keyStoreExists(const std::string &name);
         bool tableExists(const std::string &name) const;
+        bool columnExists(const std::string &table, const std::string &column) const;
 
         class Factory : public DataFile::Factory {
         public:
@@ -58,6 +82,8 @@ namespace litecore {
         void rekey(EncryptionAlgorithm, slice newKey) override;
         void _beginTransaction(Transaction*) override;
         void _endTransaction(Transaction*, bool commit) override;
+        void _beginSavepoint(Transaction*) override;
+        void _endSavepoint(Transaction*, bool commit) override;
         KeyStore* newKeyStore(const std::string &name, KeyStore::Capabilities) override;
         void deleteKeyStore(const std::string &name) override;
 
@@ -70,17 +96,59 @@ namespace litecore {
         int execWithLock(const std::string &sql);
         int64_t intQuery(const char *query);
         void maybeVacuum();
+        bool worthVacuuming();
         void registerFleeceFunctions();
 
+        /** Returns the cached compiled query with this key, or null. The cache is flushed
+            whenever the schema changes (as when an index is created or deleted.) */
+        std::shared_ptr<SQLiteCompiledQuery> cachedQuery(const std::string &key);
+        void cacheQuery(const std::string &key, std::shared_ptr<SQLiteCompiledQuery>);
+
     private:
         friend class SQLiteKeyStore;
 
+        typedef std::pair<std::string, std::shared_ptr<SQLiteCompiledQuery>> QueryCacheEntry;
+
+        struct CompactState;
+
         bool decrypt();
+        int64_t schemaVersion();
+        bool compactStep();
+        bool vacuumStep();
+        bool forgetDeferredIndex(const std::string &name);
+        void rebuildDeferredIndexes();
+        void loadCompressionDictionary();
+        SQLiteDataFile* acquireReader();
+        void releaseReader(SQLiteDataFile*);
+        void enableReaders();
+        void closeReaders();
 
         std::unique_ptr<SQLite::Database>    _sqlDb;         // SQLite database object
         std::unique_ptr<SQLite::Transaction> _transaction;   // Current SQLite transaction
         std::unique_ptr<SQLite::Statement>   _getLastSeqStmt, _setLastSeqStmt;
+        std::unique_ptr<SQLite::Statement>   _schemaVersionStmt;
         bool _registeredFleeceFunctions {false};
+        bool _autoCompact {false};
+        int64_t _pageSize {0};                               // Actual page size of the file
+        bool _bulkLoading {false};
+        int64_t _savedCacheSize {0};                         // cache_size before bulk load
+        std::unique_ptr<CompactState>        _compactState;  // Progress of current compaction
+        BodyCompressor                       _bodyCompressor;
+        std::pair<unsigned, alloc_slice>     _pendingDictionary;  // Saved in current transaction
+
+        std::mutex                  _readersMutex;          // Protects the reader pool
+        std::condition_variable     _readersCond;           // Signaled when a reader is released
+        bool                        _readersEnabled {false};// May the pool be used?
+        std::vector<std::unique_ptr<SQLiteDataFile>> _readers;  // Read-only connections
+        std::vector<SQLiteDataFile*> _idleReaders;          // Readers not currently in use
+        unsigned                    _readersOpening {0};    // Readers being opened
+        uint64_t                    _keysCommitCount {0};   // (Reader) sCommitsDone at last key load
+
+        std::mutex                  _queryCacheMutex;
+        std::list<QueryCacheEntry>  _queryCache;            // Compiled queries, most recent 1st
+        std::unordered_map<std::string, std::list<QueryCacheEntry>::iterator> _queryCacheIndex;
+        int64_t                     _queryCacheSchema {-1}; // schema_version of cached queries
+        QueryCacheStats             _queryCacheStats;
     };
 
 }
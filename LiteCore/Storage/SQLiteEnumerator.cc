@@ -25,8 +25,10 @@ namespace litecore {
 
    class SQLiteEnumerator : public RecordEnumerator::Impl {
     public:
-        SQLiteEnumerator(SQLite::Statement *stmt, bool descending, ContentOptions content)
-        :_stmt(stmt),
+        SQLiteEnumerator(const SQLiteKeyStore &store, SQLite::Statement *stmt,
+                         bool descending, ContentOptions content)
+        :_store(store),
+         _stmt(stmt),
          _content(content)
         { }
 
@@ -37,11 +39,12 @@ namespace litecore {
         virtual bool read(Record &rec) override {
             updateDoc(rec, (int64_t)_stmt->getColumn(0), 0, (int)_stmt->getColumn(1));
             rec.setKey(SQLiteKeyStore::columnAsSlice(_stmt->getColumn(2)));
-            SQLiteKeyStore::setRecordMetaAndBody(rec, *_stmt.get(), _content);
+            _store.setRecordMetaAndBody(rec, *_stmt.get(), _content);
             return true;
         }
 
     private:
+        const SQLiteKeyStore &_store;
         unique_ptr<SQLite::Statement> _stmt;
         ContentOptions _content;
     };
@@ -53,7 +56,7 @@ namespace litecore {
             in << ", length(body)";
         else
             in << ", body";
-        in << " FROM kv_" << name();
+        in << ", " << extraColumn() << " FROM kv_" << name();
     }
 
     void SQLiteKeyStore::writeSQLOptions(stringstream &sql, RecordEnumerator::Options &options) {
@@ -103,7 +106,7 @@ namespace litecore {
             stmt->bind(param++, minKey.buf, (int)minKey.size);
         if (maxKey.buf)
             stmt->bind(param++, maxKey.buf, (int)maxKey.size);
-        return new SQLiteEnumerator(stmt, options.descending, options.contentOptions);
+        return new SQLiteEnumerator(*this, stmt, options.descending, options.contentOptions);
     }
 
     // iterate by sequence:
@@ -133,7 +136,7 @@ namespace litecore {
         st->bind(1, (long long)min);
         if (max < INT64_MAX)
             st->bind(2, (long long)max);
-        return new SQLiteEnumerator(st, options.descending, options.contentOptions);
+        return new SQLiteEnumerator(*this, st, options.descending, options.contentOptions);
     }
 
 }
@@ -17,6 +17,7 @@
 #include "Fleece.hh"
 #include <sstream>
 #include <iostream>
+#include <map>
 
 using namespace std;
 using namespace fleece;
@@ -45,26 +46,41 @@ namespace litecore {
 
 
     SQLiteKeyStore::SQLiteKeyStore(SQLiteDataFile &db, const string &name, KeyStore::Capabilities capabilities)
-    :KeyStore(db, name, capabilities)
+    :KeyStore(db, name, capabilities),
+     _compressible(name == DataFile::kDefaultKeyStoreName),
+     _compressBodies(_compressible && db.bodyCompressor().mode() != kNoCompression)
     {
         if (!db.keyStoreExists(name)) {
             // Create the sequence and deleted columns regardless of options, otherwise it's too
             // complicated to customize all the SQL queries to conditionally use them...
             db.exec(subst("CREATE TABLE IF NOT EXISTS kv_@ (key BLOB PRIMARY KEY, meta BLOB, "
-                          "body BLOB, sequence INTEGER, deleted INTEGER DEFAULT 0)"));
+                          "body BLOB, sequence INTEGER, deleted INTEGER DEFAULT 0, extra BLOB)"));
             if (capabilities.getByOffset) {
                 // shadow table for overwritten records
                 db.exec(subst("CREATE TABLE IF NOT EXISTS kvold_@ ("
-                                  "sequence INTEGER PRIMARY KEY, key BLOB, meta BLOB, body BLOB); "
-                              "PRAGMA recursive_triggers = 1; "
-                              "CREATE TRIGGER backup_@ BEFORE DELETE ON kv_@ BEGIN "
-                              "  INSERT INTO kvold_@ (sequence, key, meta, body) "
-                              "    VALUES (OLD.sequence, OLD.key, OLD.meta, OLD.body); END"));
+                                  "sequence INTEGER PRIMARY KEY, key BLOB, meta BLOB, body BLOB, "
+                                  "extra BLOB); "
+                              "PRAGMA recursive_triggers = 1; ")
+                        + backupTriggerSQL(name));
             }
+        } else {
+            // SQLiteDataFile::reopen adds the column to older tables, unless it's read-only:
+            if (!db.columnExists(tableName(), "extra"))
+                _hasExtraColumn = false;
+            if (capabilities.getByOffset && !db.columnExists("kvold_" + name, "extra"))
+                _hasOldExtraColumn = false;
         }
     }
 
 
+    // The trigger that copies a record to the kvold_ shadow table before it's overwritten.
+    string SQLiteKeyStore::backupTriggerSQL(const string &name) {
+        return "CREATE TRIGGER \"backup_" + name + "\" BEFORE DELETE ON \"kv_" + name + "\" BEGIN "
+               "  INSERT INTO \"kvold_" + name + "\" (sequence, key, meta, body, extra) "
+               "    VALUES (OLD.sequence, OLD.key, OLD.meta, OLD.body, OLD.extra); END";
+    }
+
+
     void SQLiteKeyStore::close() {
         _recCountStmt.reset();
         _getByKeyStmt.reset();
@@ -72,6 +88,8 @@ namespace litecore {
         _getBySeqStmt.reset();
         _getByOffStmt.reset();
         _getMetaBySeqStmt.reset();
+        _getManyStmt.reset();
+        _getMetaManyStmt.reset();
         _setStmt.reset();
         _delByKeyStmt.reset();
         _delBySeqStmt.reset();
@@ -80,11 +98,14 @@ namespace litecore {
     }
 
 
+    // Replaces '@' with the KeyStore's name, and '$' with the expression to read 'extra'.
     string SQLiteKeyStore::subst(const char *sqlTemplate) const {
         string sql(sqlTemplate);
         size_t pos;
         while(string::npos != (pos = sql.find('@')))
             sql.replace(pos, 1, name());
+        while(string::npos != (pos = sql.find('$')))
+            sql.replace(pos, 1, extraColumn());
         return sql;
     }
 
@@ -157,6 +178,13 @@ namespace litecore {
     }
 
 
+    // The by-sequence index may have been created after the savepoint. (The cached
+    // _lastSequence stays as it is; skipping the rolled-back sequences is harmless.)
+    void SQLiteKeyStore::savepointRolledBack() {
+        _createdSeqIndex = false;
+    }
+
+
     /*static*/ slice SQLiteKeyStore::columnAsSlice(const SQLite::Column &col) {
         return slice(col.getBlob(), col.getBytes());
     }
@@ -167,25 +195,45 @@ namespace litecore {
     // alloc_slice (not just slice).
 
 
-    // Gets meta from column 3, and body (or its length) from column 4
-    /*static*/ void SQLiteKeyStore::setRecordMetaAndBody(Record &rec,
-                                                         SQLite::Statement &stmt,
-                                                         ContentOptions options)
+    // Gets meta from column 3, body (or its length) from column 4, and extra from column 5.
+    // With kMetaOnly the body isn't read at all, so it's never decompressed, and its size is the
+    // size it takes up in the file.
+    void SQLiteKeyStore::setRecordMetaAndBody(Record &rec,
+                                              SQLite::Statement &stmt,
+                                              ContentOptions options) const
     {
         rec.setMeta(columnAsSlice(stmt.getColumn(3)));
+        rec.setExtra(columnAsSlice(stmt.getColumn(5)));
         if (options & kMetaOnly)
             rec.setUnloadedBodySize((ssize_t)stmt.getColumn(4));
         else
-            rec.setBody(columnAsSlice(stmt.getColumn(4)));
+            setBody(rec, columnAsSlice(stmt.getColumn(4)));
+    }
+
+
+    // Sets a Record's body from a column value, decompressing it if necessary.
+    void SQLiteKeyStore::setBody(Record &rec, slice body) const {
+        if (_compressible && BodyCompressor::isCompressed(body))
+            rec.setBody(db().bodyCompressor().decompress(body));
+        else
+            rec.setBody(body);
+    }
+
+
+    // Returns the form of a body to store, or null if it should be stored as-is.
+    alloc_slice SQLiteKeyStore::compressBody(slice body) const {
+        if (!_compressBodies)
+            return alloc_slice();
+        return db().bodyCompressor().compress(body);
     }
     
 
     bool SQLiteKeyStore::read(Record &rec, ContentOptions options) const {
         auto &stmt = (options & kMetaOnly)
             ? compile(_getMetaByKeyStmt,
-                      "SELECT sequence, deleted, 0, meta, length(body) FROM kv_@ WHERE key=?")
+                      "SELECT sequence, deleted, 0, meta, length(body), $ FROM kv_@ WHERE key=?")
             : compile(_getByKeyStmt,
-                      "SELECT sequence, deleted, 0, meta, body FROM kv_@ WHERE key=?");
+                      "SELECT sequence, deleted, 0, meta, body, $ FROM kv_@ WHERE key=?");
         stmt.bindNoCopy(1, rec.key().buf, (int)rec.key().size);
         UsingStatement u(stmt);
         if (!stmt.executeStep())
@@ -200,15 +248,81 @@ namespace litecore {
     }
 
 
+    // Number of keys looked up per execution of the getMany statement. Unused parameters in a
+    // partial batch are bound to NULL, which matches nothing.
+    static const int kGetManyBatchSize = 100;
+
+
+    vector<Record> SQLiteKeyStore::getMany(const vector<slice> &keys,
+                                           ContentOptions options) const
+    {
+        vector<Record> records;
+        records.reserve(keys.size());
+        map<slice, size_t> indexOf;         // Maps each key to its first index in `keys`
+        for (size_t i = 0; i < keys.size(); ++i) {
+            records.emplace_back(keys[i]);
+            indexOf.emplace(keys[i], i);
+        }
+        if (indexOf.empty())
+            return records;
+
+        auto &stmtRef = (options & kMetaOnly) ? _getMetaManyStmt : _getManyStmt;
+        if (!stmtRef) {
+            stringstream sql;
+            sql << "SELECT sequence, deleted, key, meta, "
+                << ((options & kMetaOnly) ? "length(body)" : "body")
+                << ", $ FROM kv_@ WHERE key IN (?";
+            for (int i = 1; i < kGetManyBatchSize; ++i)
+                sql << ",?";
+            sql << ")";
+            compile(stmtRef, sql.str().c_str());
+        }
+        auto &stmt = *stmtRef;
+
+        auto next = indexOf.begin();
+        while (next != indexOf.end()) {
+            stmt.reset();
+            for (int param = 1; param <= kGetManyBatchSize; ++param) {
+                if (next != indexOf.end()) {
+                    stmt.bindNoCopy(param, next->first.buf, (int)next->first.size);
+                    ++next;
+                } else {
+                    stmt.bind(param);
+                }
+            }
+            UsingStatement u(stmt);
+            while (stmt.executeStep()) {
+                auto found = indexOf.find(columnAsSlice(stmt.getColumn(2)));
+                if (found == indexOf.end())
+                    continue;
+                Record &rec = records[found->second];
+                sequence seq = (int64_t)stmt.getColumn(0);
+                uint64_t offset = _capabilities.getByOffset ? seq : 0;
+                bool deleted = (int)stmt.getColumn(1);
+                updateDoc(rec, seq, offset, deleted);
+                setRecordMetaAndBody(rec, stmt, options);
+            }
+        }
+
+        // Fill in any duplicate keys from their first occurrence:
+        for (size_t i = 0; i < keys.size(); ++i) {
+            size_t first = indexOf[keys[i]];
+            if (first != i)
+                records[i] = Record(records[first]);
+        }
+        return records;
+    }
+
+
     Record SQLiteKeyStore::get(sequence seq, ContentOptions options) const {
         if (!_capabilities.sequences)
             error::_throw(error::NoSequences);
         Record rec;
         auto &stmt = (options & kMetaOnly)
             ? compile(_getMetaBySeqStmt,
-                          "SELECT 0, deleted, key, meta, length(body) FROM kv_@ WHERE sequence=?")
+                          "SELECT 0, deleted, key, meta, length(body), $ FROM kv_@ WHERE sequence=?")
             : compile(_getBySeqStmt,
-                           "SELECT 0, deleted, key, meta, body FROM kv_@ WHERE sequence=?");
+                           "SELECT 0, deleted, key, meta, body, $ FROM kv_@ WHERE sequence=?");
         UsingStatement u(stmt);
         stmt.bind(1, (long long)seq);
         if (stmt.executeStep()) {
@@ -228,14 +342,18 @@ namespace litecore {
         if (!_capabilities.getByOffset)
             return rec;
 
-        auto &stmt = compile(_getByOffStmt, "SELECT key, meta, body FROM kvold_@ WHERE sequence=?");
+        auto &stmt = compile(_getByOffStmt,
+                             (string("SELECT key, meta, body, ")
+                              + (_hasOldExtraColumn ? "extra" : "NULL")
+                              + " FROM kvold_@ WHERE sequence=?").c_str());
         UsingStatement u(stmt);
         stmt.bind(1, (long long)seq);
         if (stmt.executeStep()) {
             updateDoc(rec, seq, seq);
             rec.setKey(columnAsSlice(stmt.getColumn(0)));
             rec.setMeta(columnAsSlice(stmt.getColumn(1)));
-            rec.setBody(columnAsSlice(stmt.getColumn(2)));
+            setBody(rec, columnAsSlice(stmt.getColumn(2)));
+            rec.setExtra(columnAsSlice(stmt.getColumn(3)));
             return rec;
         } else {
             // Maybe the sequence is still current...
@@ -244,20 +362,30 @@ namespace litecore {
     }
 
 
-    KeyStore::setResult SQLiteKeyStore::set(slice key, slice meta, slice body, Transaction&) {
+    static const char* const kSetSQL =
+        "INSERT OR REPLACE INTO kv_@ (key, meta, body, extra, sequence, deleted) "
+        "VALUES (?, ?, ?, ?, ?, 0)";
+
+
+    KeyStore::setResult SQLiteKeyStore::set(slice key, slice meta, slice body, slice extra,
+                                            Transaction&)
+    {
         LogTo(DBLog, "KeyStore(%s) set %s", name().c_str(), logSlice(key));
-        compile(_setStmt,
-                "INSERT OR REPLACE INTO kv_@ (key, meta, body, sequence, deleted) VALUES (?, ?, ?, ?, 0)");
+        compile(_setStmt, kSetSQL);
+        alloc_slice compressed = compressBody(body);
+        if (compressed)
+            body = compressed;
         _setStmt->bindNoCopy(1, key.buf, (int)key.size);
         _setStmt->bindNoCopy(2, meta.buf, (int)meta.size);
         _setStmt->bindNoCopy(3, body.buf, (int)body.size);
+        _setStmt->bindNoCopy(4, extra.buf, (int)extra.size);
 
         sequence seq = 0;
         if (_capabilities.sequences) {
             seq = lastSequence() + 1;
-            _setStmt->bind(4, (long long)seq);
+            _setStmt->bind(5, (long long)seq);
         } else {
-            _setStmt->bind(4);
+            _setStmt->bind(5);
         }
         UsingStatement u(_setStmt);
         _setStmt->exec();
@@ -266,12 +394,45 @@ namespace litecore {
     }
 
 
+    // Same as set(), but reuses the statement across all the records without re-preparing it,
+    // and logs once instead of per record.
+    void SQLiteKeyStore::setMany(const SetEntry entries[], size_t count,
+                                 setResult results[], Transaction&)
+    {
+        if (count == 0)
+            return;
+        LogTo(DBLog, "KeyStore(%s) setMany: %zu records", name().c_str(), count);
+        auto &stmt = compile(_setStmt, kSetSQL);
+        UsingStatement u(stmt);
+        sequence seq = _capabilities.sequences ? lastSequence() : 0;
+        for (size_t i = 0; i < count; ++i) {
+            const SetEntry &entry = entries[i];
+            if (i > 0)
+                stmt.reset();
+            stmt.bindNoCopy(1, entry.key.buf, (int)entry.key.size);
+            stmt.bindNoCopy(2, entry.meta.buf, (int)entry.meta.size);
+            alloc_slice compressed = compressBody(entry.body);
+            slice body = compressed ? slice(compressed) : entry.body;
+            stmt.bindNoCopy(3, body.buf, (int)body.size);
+            stmt.bindNoCopy(4, entry.extra.buf, (int)entry.extra.size);
+            if (_capabilities.sequences)
+                stmt.bind(5, (long long)++seq);
+            else
+                stmt.bind(5);
+            stmt.exec();
+            if (results)
+                results[i] = {seq, (_capabilities.getByOffset ? seq : 0)};
+        }
+        setLastSequence(seq);
+    }
+
+
     bool SQLiteKeyStore::_del(slice key, sequence delSeq, Transaction&) {
         auto& stmt = delSeq ? _delBySeqStmt : _delByKeyStmt;
         if (!stmt) {
             stringstream sql;
             if (_capabilities.softDeletes) {
-                sql << "UPDATE kv_@ SET deleted=1, meta=null, body=null";
+                sql << "UPDATE kv_@ SET deleted=1, meta=null, body=null, extra=null";
                 if (_capabilities.sequences)
                     sql << ", sequence=? ";
             } else {
@@ -367,6 +528,10 @@ namespace litecore {
                 QueryParser qp(tableName());
                 qp.writeCreateIndex(params);
                 db().exec(qp.SQL());
+                if (options && options->includedPropertiesJSON)
+                    createCoveringIndex(params, slice(options->includedPropertiesJSON));
+                else
+                    dropCoveringIndex(qp.coveringIndexName(params));    // from an earlier version
                 break;
             }
             case kFullTextIndex: {
@@ -411,7 +576,10 @@ namespace litecore {
         Transaction t(db());
         switch (type) {
             case  kValueIndex:
-                db().exec(string("DROP INDEX ") + indexName);
+                // (During a bulk load the index is already dropped, with its SQL saved for later)
+                if (!db().forgetDeferredIndex(SQLIndexName(params, type)))
+                    db().exec(string("DROP INDEX ") + indexName);
+                dropCoveringIndex(QueryParser(tableName()).coveringIndexName(params));
                 break;
             case kFullTextIndex: {
                 db().exec(string("DROP VIRTUAL TABLE ") + indexName);
@@ -425,6 +593,77 @@ namespace litecore {
     }
 
 
+    // A covering index is a table holding each record's key, sequence and meta, plus the values
+    // of the index's properties, so queries using only those needn't read the record bodies.
+    // Like an FTS index, it's kept up to date by triggers on the records table.
+    void SQLiteKeyStore::createCoveringIndex(const Array *keys, slice includedJSON) {
+        alloc_slice includedFleece;
+        const Array *included = nullptr;
+        try {
+            includedFleece = JSONConverter::convertJSON(includedJSON);
+            auto f = Value::fromTrustedData(includedFleece);
+            if (f)
+                included = f->asArray();
+        } catch (const FleeceException &x) { }
+        if (!included)
+            error::_throw(error::InvalidQuery);
+        auto properties = QueryParser::coveredProperties(keys, included);
+        auto nKeys = QueryParser::coveredProperties(keys, nullptr).size();
+
+        // Replace any existing table, since the included properties may have changed:
+        string table = QueryParser(tableName()).coveringIndexName(keys);
+        dropCoveringIndex(table);
+
+        stringstream columns, keyColumns, values, newValues;
+        for (size_t i = 0; i < properties.size(); ++i) {
+            slice property(properties[i]);
+            string column = QueryParser::coveredColumnName(properties[i]);
+            if (i > 0)
+                columns << ", ";
+            QueryParser::writeSQLIdentifier(columns, slice(column));
+            if (i < nKeys) {
+                if (i > 0)
+                    keyColumns << ", ";
+                QueryParser::writeSQLIdentifier(keyColumns, slice(column));
+            }
+            values << ", fl_value(body, ";
+            QueryParser::writeSQLString(values, property);
+            values << ")";
+            newValues << ", fl_value(new.body, ";
+            QueryParser::writeSQLString(newValues, property);
+            newValues << ")";
+        }
+        string quoted = "\"" + table + "\"";
+        string allColumns = "key, sequence, meta, " + columns.str();
+
+        db().exec("CREATE TABLE " + quoted + " (key BLOB PRIMARY KEY, sequence INTEGER, meta BLOB, "
+                  + columns.str() + ")");
+        db().exec("CREATE INDEX \"" + table + "::keys\" ON " + quoted + " (" + keyColumns.str() + ")");
+        // (Live queries look up changed records by sequence)
+        db().exec("CREATE INDEX \"" + table + "::seqs\" ON " + quoted + " (sequence)");
+
+        // Index existing records:
+        db().exec("INSERT INTO " + quoted + " (" + allColumns + ") SELECT key, sequence, meta"
+                  + values.str() + " FROM kv_" + name());
+
+        // Set up triggers to keep the table up to date:
+        string ins = "INSERT OR REPLACE INTO " + quoted + " (" + allColumns + ") VALUES (new.key, new.sequence, new.meta" + newValues.str() + "); ";
+        string del = "DELETE FROM " + quoted + " WHERE key = old.key; ";
+        db().exec("CREATE TRIGGER \"" + table + "::ins\" AFTER INSERT ON kv_" + name() + " BEGIN " + ins + " END");
+        db().exec("CREATE TRIGGER \"" + table + "::del\" AFTER DELETE ON kv_" + name() + " BEGIN " + del + " END");
+        db().exec("CREATE TRIGGER \"" + table + "::upd\" AFTER UPDATE ON kv_" + name() + " BEGIN " + del + ins + " END");
+    }
+
+
+    // Triggers aren't dropped along with the tables they write to, only with the ones they're on.
+    void SQLiteKeyStore::dropCoveringIndex(const string &table) {
+        db().exec("DROP TRIGGER IF EXISTS \"" + table + "::ins\"");
+        db().exec("DROP TRIGGER IF EXISTS \"" + table + "::del\"");
+        db().exec("DROP TRIGGER IF EXISTS \"" + table + "::upd\"");
+        db().exec("DROP TABLE IF EXISTS \"" + table + "\"");
+    }
+
+
     bool SQLiteKeyStore::hasIndex(slice expression, IndexType type) {
         alloc_slice expressionFleece;
         const Array *params;
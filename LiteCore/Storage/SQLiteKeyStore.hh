@@ -32,12 +32,18 @@ namespace litecore {
 
         Record get(sequence, ContentOptions) const override;
         bool read(Record &rec, ContentOptions options) const override;
+        std::vector<Record> getMany(const std::vector<slice> &keys,
+                                    ContentOptions) const override;
         Record getByOffsetNoErrors(uint64_t offset, sequence) const override;
 
-        setResult set(slice key, slice meta, slice value, Transaction&) override;
+        setResult set(slice key, slice meta, slice value, slice extra, Transaction&) override;
+        void setMany(const SetEntry entries[], size_t count,
+                     setResult results[], Transaction&) override;
 
         void erase() override;
 
+        bool supportsExtra() const override                             {return true;}
+
         bool supportsIndexes(IndexType t) const override               {return t == kValueIndex;}
         void createIndex(slice expressionJSON,
                          IndexType =kValueIndex,
@@ -60,33 +66,46 @@ namespace litecore {
                                    const char *sqlTemplate) const;
 
         void transactionWillEnd(bool commit);
+        void savepointRolledBack();
 
         void close() override;
 
         static slice columnAsSlice(const SQLite::Column &col);
-        static void setRecordMetaAndBody(Record &rec,
-                                         SQLite::Statement &stmt,
-                                         ContentOptions options);
+        void setRecordMetaAndBody(Record &rec,
+                                  SQLite::Statement &stmt,
+                                  ContentOptions options) const;
+        alloc_slice compressBody(slice body) const;
+        void setBody(Record &rec, slice body) const;
 
     private:
         friend class SQLiteDataFile;
         friend class SQLiteEnumerator;
         friend class SQLiteQuery;
+        friend struct SQLiteCompiledQuery;
         
         SQLiteKeyStore(SQLiteDataFile&, const std::string &name, KeyStore::Capabilities options);
         SQLiteDataFile& db() const                    {return (SQLiteDataFile&)dataFile();}
         std::string subst(const char *sqlTemplate) const;
+        const char* extraColumn() const         {return _hasExtraColumn ? "extra" : "NULL";}
+        static std::string backupTriggerSQL(const std::string &name);
         void selectFrom(std::stringstream& in, const RecordEnumerator::Options &options);
         void writeSQLOptions(std::stringstream &sql, RecordEnumerator::Options &options);
         void setLastSequence(sequence seq);
         std::string SQLIndexName(const fleece::Array*, IndexType, bool quoted =false);
+        void createCoveringIndex(const fleece::Array *keys, slice includedPropertiesJSON);
+        void dropCoveringIndex(const std::string &table);
 
         std::unique_ptr<SQLite::Statement> _recCountStmt;
         std::unique_ptr<SQLite::Statement> _getByKeyStmt, _getMetaByKeyStmt, _getByOffStmt;
         std::unique_ptr<SQLite::Statement> _getBySeqStmt, _getMetaBySeqStmt;
+        std::unique_ptr<SQLite::Statement> _getManyStmt, _getMetaManyStmt;
         std::unique_ptr<SQLite::Statement> _setStmt, _backupStmt, _delByKeyStmt, _delBySeqStmt;
         bool _createdSeqIndex {false};     // Created by-seq index yet?
+        bool _hasExtraColumn {true};       // False if read-only & table predates 'extra' column
+        bool _hasOldExtraColumn {true};    // Same, for the kvold_ shadow table
         bool _lastSequenceChanged {false};
+        bool _compressible;                // Bodies may be compressed (default KeyStore only)
+        bool _compressBodies;              // Compress bodies when writing them?
         int64_t _lastSequence {-1};
     };
 
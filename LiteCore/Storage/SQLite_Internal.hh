@@ -24,6 +24,7 @@ namespace fleece {
 
 
 namespace litecore {
+    class BodyCompressor;
 
     extern LogDomain SQL;
 
@@ -46,8 +47,10 @@ namespace litecore {
     };
 
 
-    int RegisterFleeceFunctions(sqlite3 *db, DataFile::FleeceAccessor, fleece::SharedKeys*);
-    int RegisterFleeceEachFunctions(sqlite3 *db, DataFile::FleeceAccessor, fleece::SharedKeys*);
+    int RegisterFleeceFunctions(sqlite3 *db, DataFile::FleeceAccessor,
+                                const BodyCompressor*, fleece::SharedKeys*);
+    int RegisterFleeceEachFunctions(sqlite3 *db, DataFile::FleeceAccessor,
+                                    const BodyCompressor*, fleece::SharedKeys*);
     int RegisterFTSRankFunction(sqlite3 *db);
 
 }
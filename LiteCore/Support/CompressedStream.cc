@@ -0,0 +1,202 @@
+//
+//  CompressedStream.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "CompressedStream.hh"
+#include "Error.hh"
+#include "Logging.hh"
+#include "snappy.h"
+#include <algorithm>
+
+/*
+    The data is divided into chunks of kChunkSize (64kbytes) of uncompressed data, each of which
+    is compressed separately, so any chunk can be read without reading the ones before it.
+
+    Each chunk is preceded by an 8-byte header: the size of the chunk as stored (32-bit
+    big-endian), then its uncompressed size (ditto.) If the sizes are equal, the chunk didn't
+    compress and is stored as-is. A header with both sizes zero marks the end of the stream.
+
+    The reader walks the chunk headers when it's opened, which gives it the stream's length and
+    the offset of every chunk for seeking.
+ */
+
+namespace litecore {
+    using namespace std;
+
+    extern LogDomain BlobLog;
+
+
+    static void encodeUInt32(uint32_t n, uint8_t *out) {
+        for (int i = 3; i >= 0; --i) {
+            out[i] = (uint8_t)n;
+            n >>= 8;
+        }
+    }
+
+    static uint32_t decodeUInt32(const uint8_t *in) {
+        uint32_t n = 0;
+        for (int i = 0; i < 4; ++i)
+            n = (n << 8) | in[i];
+        return n;
+    }
+
+
+#pragma mark - WRITER:
+
+
+    CompressedWriteStream::CompressedWriteStream(shared_ptr<WriteStream> output,
+                                                 Compression compression,
+                                                 uint64_t threshold)
+    :_output(output),
+     _threshold(threshold)
+    {
+        if (compression != kSnappyCompression)
+            error::_throw(error::UnsupportedOperation);
+    }
+
+
+    void CompressedWriteStream::write(slice data) {
+        Assert(_output, "Write after close");
+        _buffer.append((const char*)data.buf, data.size);
+        // Hold onto the start of the data until it's clear it's above the threshold:
+        if (_compressed || _buffer.size() >= max(_threshold, (uint64_t)kChunkSize))
+            writeChunks(false);
+    }
+
+
+    void CompressedWriteStream::close() {
+        if (!_output)
+            return;
+        if (!_compressed && _buffer.size() < _threshold) {
+            // Too small to be worth compressing:
+            _output->write(slice(_buffer));
+        } else {
+            writeChunks(true);
+            uint8_t trailer[kChunkHeaderSize] = { };
+            _output->write(slice(trailer, sizeof(trailer)));
+        }
+        _buffer.clear();
+        _output->close();
+        _output = nullptr;
+    }
+
+
+    // Writes all the complete chunks in the buffer, or all the data if `final` is true.
+    void CompressedWriteStream::writeChunks(bool final) {
+        _compressed = true;
+        size_t pos = 0;
+        while (_buffer.size() - pos >= kChunkSize || (final && pos < _buffer.size())) {
+            size_t size = min(kChunkSize, _buffer.size() - pos);
+            writeChunk(slice(&_buffer[pos], size));
+            pos += size;
+        }
+        _buffer.erase(0, pos);
+    }
+
+
+    void CompressedWriteStream::writeChunk(slice data) {
+        _scratch.resize(kChunkHeaderSize + snappy::MaxCompressedLength(data.size));
+        auto header = (uint8_t*)&_scratch[0];
+        size_t size;
+        snappy::RawCompress((const char*)data.buf, data.size,
+                            &_scratch[kChunkHeaderSize], &size);
+        if (size >= data.size) {
+            // Incompressible; store it as-is:
+            encodeUInt32((uint32_t)data.size, &header[0]);
+            encodeUInt32((uint32_t)data.size, &header[4]);
+            _output->write(slice(header, kChunkHeaderSize));
+            _output->write(data);
+        } else {
+            encodeUInt32((uint32_t)size, &header[0]);
+            encodeUInt32((uint32_t)data.size, &header[4]);
+            _output->write(slice(header, kChunkHeaderSize + size));
+        }
+    }
+
+
+#pragma mark - READER:
+
+
+    CompressedReadStream::CompressedReadStream(shared_ptr<SeekableReadStream> input)
+    :_input(input)
+    {
+        uint64_t inputLength = _input->getLength();
+        uint64_t inputPos = 0;
+        while (true) {
+            uint8_t header[kChunkHeaderSize];
+            if (inputPos + kChunkHeaderSize > inputLength)
+                error::_throw(error::CorruptData);
+            _input->seek(inputPos);
+            if (_input->read(header, sizeof(header)) < sizeof(header))
+                error::_throw(error::CorruptData);
+            inputPos += kChunkHeaderSize;
+            Chunk chunk {inputPos, _length, decodeUInt32(&header[0]), decodeUInt32(&header[4])};
+            if (chunk.size == 0)
+                break;                              // End of the stream
+            // Every chunk but the last must be full, for read() to find them by position:
+            if (chunk.storedSize > chunk.size || chunk.size > kChunkSize
+                    || (!_chunks.empty() && _chunks.back().size != kChunkSize))
+                error::_throw(error::CorruptData);
+            _chunks.push_back(chunk);
+            inputPos += chunk.storedSize;
+            _length += chunk.size;
+        }
+    }
+
+
+    void CompressedReadStream::seek(uint64_t pos) {
+        _pos = min(pos, _length);
+    }
+
+
+    size_t CompressedReadStream::read(void *dst, size_t count) {
+        size_t bytesRead = 0;
+        while (count > 0 && _pos < _length) {
+            // Find the chunk containing _pos; all but the last are kChunkSize long:
+            size_t index = (size_t)(_pos / kChunkSize);
+            if (index != _bufferChunk)
+                readChunk(index);
+            const Chunk &chunk = _chunks[index];
+            size_t offset = (size_t)(_pos - chunk.pos);
+            size_t n = min(count, chunk.size - offset);
+            memcpy((uint8_t*)dst + bytesRead, (const uint8_t*)_buffer.buf + offset, n);
+            bytesRead += n;
+            count -= n;
+            _pos += n;
+        }
+        return bytesRead;
+    }
+
+
+    void CompressedReadStream::readChunk(size_t index) {
+        const Chunk &chunk = _chunks[index];
+        if (!_buffer)
+            _buffer = alloc_slice(kChunkSize);
+        _bufferChunk = SIZE_MAX;
+        _input->seek(chunk.inputPos);
+        if (chunk.storedSize == chunk.size) {
+            if (_input->read((void*)_buffer.buf, chunk.size) < chunk.size)
+                error::_throw(error::CorruptData);
+        } else {
+            _scratch.resize(chunk.storedSize);
+            size_t size;
+            if (_input->read(&_scratch[0], chunk.storedSize) < chunk.storedSize
+                    || !snappy::GetUncompressedLength(_scratch.data(), chunk.storedSize, &size)
+                    || size != chunk.size
+                    || !snappy::RawUncompress(_scratch.data(), chunk.storedSize,
+                                              (char*)_buffer.buf))
+                error::_throw(error::CorruptData);
+        }
+        _bufferChunk = index;
+    }
+
+
+    void CompressedReadStream::close() {
+        if (_input)
+            _input->close();
+    }
+
+}
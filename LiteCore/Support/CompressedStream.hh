@@ -0,0 +1,82 @@
+//
+//  CompressedStream.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "Stream.hh"
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace litecore {
+
+    /** Abstract base class of CompressedReadStream and CompressedWriteStream. */
+    class CompressedStream {
+    public:
+        static const size_t kChunkSize = 64 * 1024;    // Uncompressed size of a chunk
+        static const size_t kChunkHeaderSize = 8;
+
+    protected:
+        CompressedStream() { }
+        virtual ~CompressedStream() = default;
+    };
+
+
+    /** Compresses data written to it, and writes it to a wrapped WriteStream.
+        If less than `threshold` bytes are written in all, they're written as-is instead;
+        `isCompressed` tells which happened, once the stream's closed. */
+    class CompressedWriteStream : public virtual CompressedStream, public virtual WriteStream {
+    public:
+        CompressedWriteStream(std::shared_ptr<WriteStream> output,
+                              Compression,
+                              uint64_t threshold);
+
+        void write(slice) override;
+        void close() override;
+
+        bool isCompressed() const                           {return _compressed;}
+
+    private:
+        void writeChunks(bool final);
+        void writeChunk(slice data);
+
+        std::shared_ptr<WriteStream> _output;   // Wrapped stream that will write the chunks
+        uint64_t _threshold;
+        std::string _buffer;                    // Data not yet written to the output
+        std::string _scratch;                   // Holds a compressed chunk
+        bool _compressed {false};               // Have any chunks been written?
+    };
+
+
+    /** Provides (random) access to a data stream compressed by CompressedWriteStream. */
+    class CompressedReadStream : public CompressedStream, public virtual SeekableReadStream {
+    public:
+        CompressedReadStream(std::shared_ptr<SeekableReadStream> input);
+        uint64_t getLength() const override                 {return _length;}
+        size_t read(void *dst, size_t count) override;
+        void seek(uint64_t pos) override;
+        void close() override;
+
+    private:
+        struct Chunk {
+            uint64_t inputPos;                  // Offset of the chunk's data in the input
+            uint64_t pos;                       // Offset of the chunk's data in the output
+            uint32_t storedSize, size;
+        };
+
+        void readChunk(size_t index);
+
+        std::shared_ptr<SeekableReadStream> _input;  // Wrapped stream the chunks are read from
+        std::vector<Chunk> _chunks;
+        uint64_t _length {0};
+        uint64_t _pos {0};
+        size_t _bufferChunk {SIZE_MAX};         // Index of the chunk in _buffer
+        alloc_slice _buffer;                    // Uncompressed data of the current chunk
+        std::string _scratch;                   // Holds a compressed chunk
+    };
+
+}
@@ -0,0 +1,450 @@
+//
+//  Compression.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "Compression.hh"
+#include "Error.hh"
+#include "varint.hh"
+#include "snappy.h"
+#include <algorithm>
+#include <queue>
+#include <string.h>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+using namespace fleece;
+
+namespace litecore {
+
+    // The dictionary codec is a byte-oriented LZ77 in the style of LZ4, whose match offsets may
+    // reach back past the start of the input into the end of the dictionary. The input is a
+    // series of sequences, each a token byte (high nibble: literal count; low nibble: match
+    // length minus 4), an optional extra literal count, the literals, then a 2-byte little-endian
+    // match offset and optional extra match length. A nibble of 15 is extended by the following
+    // bytes, up to and including the first one that isn't 255. The last sequence has no match.
+
+    static const size_t kMinMatch = 4;
+    static const size_t kMaxOffset = 0xFFFF;
+    static const unsigned kDictionaryHashBits = 15;
+    static const unsigned kInputHashBits = 12;
+    static const size_t kMaxVarIntSize = 10;
+
+
+    static inline uint32_t read32(const uint8_t *p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static inline uint32_t hash4(uint32_t v, unsigned bits) {
+        return (v * 2654435761u) >> (32 - bits);
+    }
+
+    // Returns the number of bytes at `a` and `b` that match, without reading past `bEnd`.
+    static inline size_t matchLength(const uint8_t *a, const uint8_t *b, const uint8_t *bEnd) {
+        auto start = b;
+        while (b < bEnd && *a == *b) {
+            ++a;
+            ++b;
+        }
+        return b - start;
+    }
+
+    static inline void writeLength(uint8_t* &out, size_t n) {
+        for (; n >= 255; n -= 255)
+            *out++ = 255;
+        *out++ = (uint8_t)n;
+    }
+
+    static inline bool readLength(const uint8_t* &in, const uint8_t *end, size_t &n) {
+        uint8_t b;
+        do {
+            if (in >= end)
+                return false;
+            b = *in++;
+            n += b;
+        } while (b == 255);
+        return true;
+    }
+
+    // Writes a sequence; a `matchLen` of 0 makes it the last one.
+    static void writeSequence(uint8_t* &out, const uint8_t *literals, size_t literalLen,
+                              size_t offset, size_t matchLen)
+    {
+        uint8_t *token = out++;
+        *token = (uint8_t)(min(literalLen, (size_t)15) << 4);
+        if (literalLen >= 15)
+            writeLength(out, literalLen - 15);
+        memcpy(out, literals, literalLen);
+        out += literalLen;
+        if (matchLen > 0) {
+            *out++ = (uint8_t)offset;
+            *out++ = (uint8_t)(offset >> 8);
+            matchLen -= kMinMatch;
+            *token |= (uint8_t)min(matchLen, (size_t)15);
+            if (matchLen >= 15)
+                writeLength(out, matchLen - 15);
+        }
+    }
+
+
+    CompressionDictionary::CompressionDictionary(unsigned version, alloc_slice data)
+    :_version(version),
+     _data(data),
+     _hashTable(1 << kDictionaryHashBits, 0)
+    {
+        if (data.size == 0 || data.size > kMaxSize)
+            error::_throw(error::CorruptData);
+        auto bytes = (const uint8_t*)data.buf;
+        for (size_t pos = 0; pos + kMinMatch <= data.size; ++pos)
+            _hashTable[hash4(read32(&bytes[pos]), kDictionaryHashBits)] = (uint16_t)(pos + 1);
+    }
+
+
+    size_t CompressionDictionary::maxCompressedSize(size_t inputSize) {
+        return inputSize + inputSize / 255 + 16;
+    }
+
+
+    // Greedy: at each position takes the longer of the matches found through the input's and the
+    // dictionary's hash tables. Inputs are no bigger than kMaxDictionaryBodySize, so every
+    // offset fits in 16 bits.
+    size_t CompressionDictionary::compress(slice input, uint8_t *output) const {
+        auto in = (const uint8_t*)input.buf, end = in + input.size;
+        auto dict = (const uint8_t*)_data.buf, dictEnd = dict + _data.size;
+        uint16_t table[1 << kInputHashBits] = { };     // hash -> last position in input, plus 1
+        auto ip = in, anchor = in;
+        auto op = output;
+        if (input.size >= kMinMatch) {
+            auto limit = end - kMinMatch;
+            while (ip <= limit) {
+                uint32_t seq = read32(ip);
+                size_t bestLen = 0, bestOffset = 0;
+
+                uint16_t &slot = table[hash4(seq, kInputHashBits)];
+                if (slot) {
+                    auto m = in + slot - 1;
+                    if (read32(m) == seq) {
+                        bestLen = matchLength(m, ip, end);
+                        bestOffset = ip - m;
+                    }
+                }
+                slot = (uint16_t)(ip - in + 1);
+
+                uint16_t dictPos = _hashTable[hash4(seq, kDictionaryHashBits)];
+                if (dictPos) {
+                    auto m = dict + dictPos - 1;
+                    size_t offset = (ip - in) + (dictEnd - m);
+                    if (offset <= kMaxOffset && read32(m) == seq) {
+                        // A match can't run past the end of the dictionary into the input:
+                        auto matchEnd = ip + min((size_t)(end - ip), (size_t)(dictEnd - m));
+                        size_t len = matchLength(m, ip, matchEnd);
+                        if (len > bestLen) {
+                            bestLen = len;
+                            bestOffset = offset;
+                        }
+                    }
+                }
+
+                if (bestLen >= kMinMatch) {
+                    writeSequence(op, anchor, ip - anchor, bestOffset, bestLen);
+                    ip += bestLen;
+                    anchor = ip;
+                } else {
+                    ++ip;
+                }
+            }
+        }
+        writeSequence(op, anchor, end - anchor, 0, 0);
+        return op - output;
+    }
+
+
+    bool CompressionDictionary::decompress(slice input, uint8_t *output, size_t outputSize) const {
+        auto ip = (const uint8_t*)input.buf, end = ip + input.size;
+        auto op = output, outEnd = output + outputSize;
+        auto dict = (const uint8_t*)_data.buf;
+        while (ip < end) {
+            uint8_t token = *ip++;
+            size_t literalLen = token >> 4;
+            if (literalLen == 15 && !readLength(ip, end, literalLen))
+                return false;
+            if (literalLen > (size_t)(end - ip) || literalLen > (size_t)(outEnd - op))
+                return false;
+            memcpy(op, ip, literalLen);
+            op += literalLen;
+            ip += literalLen;
+            if (ip == end)
+                return op == outEnd;                    // that was the last sequence
+
+            if (end - ip < 2)
+                return false;
+            size_t offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            size_t matchLen = token & 0x0F;
+            if (matchLen == 15 && !readLength(ip, end, matchLen))
+                return false;
+            matchLen += kMinMatch;
+            if (offset == 0 || matchLen > (size_t)(outEnd - op))
+                return false;
+
+            size_t produced = op - output;
+            if (offset <= produced) {
+                // Copy bytewise, since the match may overlap the bytes it's producing:
+                auto m = op - offset;
+                for (size_t i = 0; i < matchLen; ++i)
+                    op[i] = m[i];
+            } else {
+                size_t back = offset - produced;      // distance back from the dictionary's end
+                if (back > _data.size || matchLen > back)
+                    return false;
+                memcpy(op, dict + _data.size - back, matchLen);
+            }
+            op += matchLen;
+        }
+        return false;                                   // missing the last sequence
+    }
+
+
+#pragma mark - TRAINING:
+
+
+    // Training is a greedy cover of the substrings the samples share. Each 8-byte string is worth
+    // the number of other samples it also occurs in; each candidate segment of a sample is worth
+    // the total of its strings that aren't yet in the dictionary. The most valuable segment is
+    // added until the dictionary is full. (Adding a segment only lowers the others' worth, so
+    // stale priorities in the queue are upper bounds, and can be rechecked lazily.)
+
+    static const size_t kKmerSize = 8;
+    static const size_t kSegmentSize = 32;
+    static const size_t kMinTrainingSamples = 8;
+    static const size_t kMinDictionarySize = 256;
+    static const size_t kMaxTrainingBytes = 8 * 1024 * 1024;
+
+    static inline uint64_t kmerAt(const uint8_t *p) {
+        uint64_t k;
+        memcpy(&k, p, sizeof(k));
+        return k;
+    }
+
+
+    alloc_slice CompressionDictionary::train(const vector<alloc_slice> &samples, size_t maxSize) {
+        maxSize = min(maxSize, (size_t)kMaxSize);
+
+        // Count the samples each k-mer occurs in, and cut the samples into overlapping segments:
+        struct Segment {const uint8_t *start; size_t size;};
+        vector<Segment> segments;
+        unordered_map<uint64_t, uint32_t> counts;
+        unordered_set<uint64_t> seen;
+        size_t nSamples = 0, totalSize = 0;
+        for (auto &sample : samples) {
+            if (sample.size < kKmerSize)
+                continue;
+            if (totalSize + sample.size > kMaxTrainingBytes)
+                break;
+            totalSize += sample.size;
+            ++nSamples;
+            auto bytes = (const uint8_t*)sample.buf;
+            seen.clear();
+            for (size_t i = 0; i + kKmerSize <= sample.size; ++i) {
+                auto kmer = kmerAt(&bytes[i]);
+                if (seen.insert(kmer).second)
+                    ++counts[kmer];
+            }
+            for (size_t i = 0; i + kKmerSize <= sample.size; i += kSegmentSize / 2)
+                segments.push_back({&bytes[i], min(kSegmentSize, sample.size - i)});
+        }
+        if (nSamples < kMinTrainingSamples)
+            return alloc_slice();
+
+        auto worth = [&](const Segment &seg) {
+            uint64_t total = 0;
+            for (size_t i = 0; i + kKmerSize <= seg.size; ++i) {
+                uint32_t count = counts[kmerAt(&seg.start[i])];
+                if (count > 1)
+                    total += count - 1;
+            }
+            return total;
+        };
+
+        priority_queue<pair<uint64_t, size_t>> queue;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            auto w = worth(segments[i]);
+            if (w > 0)
+                queue.emplace(w, i);
+        }
+
+        vector<Segment> chosen;
+        size_t size = 0;
+        while (!queue.empty() && size < maxSize) {
+            auto top = queue.top();
+            queue.pop();
+            auto &seg = segments[top.second];
+            auto w = worth(seg);
+            if (w < top.first) {
+                if (w > 0)
+                    queue.emplace(w, top.second);
+                continue;
+            }
+            // Trim the ends that add nothing (often an overlap with a segment already chosen):
+            size_t first = SIZE_MAX, last = 0;
+            for (size_t i = 0; i + kKmerSize <= seg.size; ++i) {
+                auto &count = counts[kmerAt(&seg.start[i])];
+                if (count > 1) {
+                    first = min(first, i);
+                    last = i;
+                }
+                count = 0;
+            }
+            size_t n = min(last + kKmerSize - first, maxSize - size);
+            chosen.push_back({seg.start + first, n});
+            size += n;
+        }
+        if (size < kMinDictionarySize)
+            return alloc_slice();
+
+        // Put the most valuable segments last, so they win collisions in the hash table:
+        alloc_slice result(size);
+        auto out = (uint8_t*)result.buf + size;
+        for (auto &seg : chosen) {
+            out -= seg.size;
+            memcpy(out, seg.start, seg.size);
+        }
+        return result;
+    }
+
+
+#pragma mark - BODY COMPRESSOR:
+
+
+    void BodyCompressor::addDictionary(unsigned version, alloc_slice data) {
+        auto dict = make_shared<CompressionDictionary>(version, data);
+        lock_guard<mutex> lock(_mutex);
+        _dictionaries[version] = dict;
+        if (!_current || version > _current->version())
+            _current = dict;
+    }
+
+
+    unsigned BodyCompressor::dictionaryVersion() const {
+        lock_guard<mutex> lock(_mutex);
+        return _current ? _current->version() : 0;
+    }
+
+
+    BodyCompressor::DictionaryRef BodyCompressor::currentDictionary() const {
+        lock_guard<mutex> lock(_mutex);
+        return _current;
+    }
+
+
+    BodyCompressor::DictionaryRef BodyCompressor::dictionary(unsigned version) const {
+        lock_guard<mutex> lock(_mutex);
+        auto i = _dictionaries.find(version);
+        if (i != _dictionaries.end())
+            return i->second;
+        alloc_slice data;
+        if (_loader)
+            data = _loader(version);
+        if (!data)
+            error::_throw(error::CorruptData);         // dictionary is missing
+        auto dict = make_shared<CompressionDictionary>(version, data);
+        _dictionaries[version] = dict;
+        // Another connection must have saved a newer dictionary; start using it too:
+        if (!_current || version > _current->version())
+            _current = dict;
+        return dict;
+    }
+
+
+    alloc_slice BodyCompressor::compress(slice body) const {
+        if (_mode == kDictionaryCompression && body.size <= kMaxDictionaryBodySize
+                                            && body.size >= kMinDictionaryCompressibleSize) {
+            auto dict = currentDictionary();
+            if (dict)
+                return compressWithDictionary(body, *dict);
+        }
+        if (_mode == kNoCompression || body.size < kMinCompressibleSize)
+            return alloc_slice();
+        return compressWithSnappy(body);
+    }
+
+
+    alloc_slice BodyCompressor::compressWithSnappy(slice body) const {
+        alloc_slice result(kHeaderSize + snappy::MaxCompressedLength(body.size));
+        auto out = (char*)result.buf;
+        out[0] = (char)kMarker;
+        out[1] = (char)kSnappyCompression;
+        size_t size;
+        snappy::RawCompress((const char*)body.buf, body.size, &out[kHeaderSize], &size);
+        size += kHeaderSize;
+        // Only keep it if it saves at least 1/8 of the size:
+        if (size > body.size - body.size / 8)
+            return alloc_slice();
+        result.shorten(size);
+        return result;
+    }
+
+
+    // Format: header, version and uncompressed size as varints, then the LZ data.
+    alloc_slice BodyCompressor::compressWithDictionary(slice body,
+                                                       const CompressionDictionary &dict) const
+    {
+        alloc_slice result(kHeaderSize + 2 * kMaxVarIntSize
+                           + CompressionDictionary::maxCompressedSize(body.size));
+        auto out = (uint8_t*)result.buf;
+        out[0] = kMarker;
+        out[1] = kDictionaryCompression;
+        size_t size = kHeaderSize;
+        size += PutUVarInt(&out[size], dict.version());
+        size += PutUVarInt(&out[size], body.size);
+        size += dict.compress(body, &out[size]);
+        if (size > body.size - body.size / 8)
+            return alloc_slice();
+        result.shorten(size);
+        return result;
+    }
+
+
+    alloc_slice BodyCompressor::decompressWithDictionary(slice data) const {
+        uint64_t version, size;
+        if (!ReadUVarInt(&data, &version) || !ReadUVarInt(&data, &size)
+                || version == 0 || version > UINT32_MAX
+                || size > kMaxDictionaryBodySize)      // larger bodies are never compressed this way
+            error::_throw(error::CorruptData);
+        auto dict = dictionary((unsigned)version);
+        alloc_slice result(size);
+        if (!dict->decompress(data, (uint8_t*)result.buf, size))
+            error::_throw(error::CorruptData);
+        return result;
+    }
+
+
+    alloc_slice BodyCompressor::decompress(slice body) const {
+        if (!isCompressed(body))
+            error::_throw(error::CorruptData);
+        auto codec = ((const uint8_t*)body.buf)[1];
+        body.moveStart(kHeaderSize);
+        auto data = (const char*)body.buf;
+        switch (codec) {
+            case kSnappyCompression: {
+                size_t size;
+                if (!snappy::GetUncompressedLength(data, body.size, &size))
+                    error::_throw(error::CorruptData);
+                alloc_slice result(size);
+                if (!snappy::RawUncompress(data, body.size, (char*)result.buf))
+                    error::_throw(error::CorruptData);
+                return result;
+            }
+            case kDictionaryCompression:
+                return decompressWithDictionary(body);
+            default:
+                error::_throw(error::CorruptData);     // unknown codec
+        }
+    }
+
+}
@@ -0,0 +1,115 @@
+//
+//  Compression.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "Base.hh"
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace litecore {
+
+    /** A set of byte strings common to a database's bodies, trained from a sample of them. The
+        kDictionaryCompression codec uses it as history that matches can refer back to, so even
+        small bodies compress well. Each saved dictionary has a version, which is recorded in every
+        body compressed with it; old versions are kept so those bodies stay readable. */
+    class CompressionDictionary {
+    public:
+        CompressionDictionary(unsigned version, alloc_slice data);
+
+        unsigned version() const                        {return _version;}
+        slice data() const                              {return _data;}
+
+        /** Builds a dictionary of up to `maxSize` bytes from the substrings found in the most
+            samples. Returns a null slice if the samples don't have enough in common. */
+        static alloc_slice train(const std::vector<alloc_slice> &samples,
+                                 size_t maxSize =kDefaultSize);
+
+        static const size_t kDefaultSize = 16 * 1024;
+        static const size_t kMaxSize = 32 * 1024;
+
+    private:
+        friend class BodyCompressor;
+
+        static size_t maxCompressedSize(size_t inputSize);
+        size_t compress(slice input, uint8_t *output) const;
+        bool decompress(slice input, uint8_t *output, size_t outputSize) const;
+
+        unsigned _version;
+        alloc_slice _data;
+        std::vector<uint16_t> _hashTable;   // hash of 4 bytes -> last position in _data, plus 1
+    };
+
+
+    /** Compresses and decompresses record bodies.
+        A compressed body starts with a 0xFF marker byte, then a byte identifying the codec, then
+        the compressed data. No uncompressed document body starts with 0xFF: it's either a rev
+        tree, whose first four bytes are a big-endian revision size, or Fleece data, whose first
+        value can't be a pointer. So compressed and uncompressed bodies can share a table. */
+    class BodyCompressor {
+    public:
+        using DictionaryLoader = std::function<alloc_slice(unsigned version)>;
+
+        explicit BodyCompressor(Compression mode =kNoCompression)   :_mode(mode) { }
+
+        Compression mode() const                        {return _mode;}
+
+        /** Adds a trained dictionary. In kDictionaryCompression mode the one with the highest
+            version is used to compress small bodies; until there is one, Snappy is used. */
+        void addDictionary(unsigned version, alloc_slice data);
+
+        /** The version of the dictionary used for compression, or 0 if there's none. */
+        unsigned dictionaryVersion() const;
+
+        /** Sets a function that fetches a dictionary by version. It's called when decompressing
+            a body compressed with a dictionary that hasn't been added. */
+        void setDictionaryLoader(DictionaryLoader loader)   {_loader = loader;}
+
+        /** Returns the compressed form of a body, or a null slice if compression is off, or
+            wouldn't save enough space to be worth the cost of decompressing. */
+        alloc_slice compress(slice body) const;
+
+        /** Returns true if the data is a compressed body. */
+        static bool isCompressed(slice body) {
+            return body.size >= kHeaderSize && ((const uint8_t*)body.buf)[0] == kMarker;
+        }
+
+        /** Decompresses a body returned by `compress`. (It needn't have been compressed with the
+            current mode.) Throws CorruptData if the data is invalid. */
+        alloc_slice decompress(slice body) const;
+
+        /** Returns the body's decompressed form if it's compressed, else the body itself. */
+        alloc_slice decompressIfNeeded(slice body) const {
+            return isCompressed(body) ? decompress(body) : alloc_slice(body);
+        }
+
+        static const uint8_t kMarker = 0xFF;
+        static const size_t kHeaderSize = 2;
+        static const size_t kMinCompressibleSize = 64;
+        static const size_t kMinDictionaryCompressibleSize = 32;
+        static const size_t kMaxDictionaryBodySize = 8 * 1024;
+
+    private:
+        using DictionaryRef = std::shared_ptr<const CompressionDictionary>;
+
+        DictionaryRef currentDictionary() const;
+        DictionaryRef dictionary(unsigned version) const;
+        alloc_slice compressWithSnappy(slice body) const;
+        alloc_slice compressWithDictionary(slice body, const CompressionDictionary&) const;
+        alloc_slice decompressWithDictionary(slice data) const;
+
+        Compression _mode;
+        DictionaryLoader _loader;
+        mutable std::mutex _mutex;                              // guards the two below
+        mutable std::map<unsigned, DictionaryRef> _dictionaries;
+        mutable DictionaryRef _current;
+    };
+
+}
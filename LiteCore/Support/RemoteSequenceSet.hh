@@ -9,93 +9,80 @@
 #pragma once
 #include "slice.hh"
 #include <assert.h>
-#include <map>
+#include <deque>
+#include <unordered_map>
 
 namespace litecore { namespace repl {
 
     /** A set of opaque remote sequence IDs, representing server-side database sequences.
-        This is used by the replicator to keep track of which revisions are being pulled. */
+        This is used by the replicator to keep track of which revisions are being pulled.
+        Sequences are kept in the order they were added; removing one leaves a tombstone in
+        its place, and tombstones are trimmed off the front, so all operations are O(1)
+        (amortized) no matter what order the sequences are removed in. */
     class RemoteSequenceSet {
     public:
         typedef fleece::alloc_slice sequence;
-        class reference;
 
         RemoteSequenceSet()                     { }
 
         /** Empties the set. */
         void clear(sequence since) {
-            _sequences.clear();
-            _nextOrder = 0;
-            _lastAdded = since;
-            _first = _sequences.end();
+            _entries.clear();
+            _index.clear();
+            _firstOrder = 0;
+            _beforeFirst = since;
         }
 
         bool empty() const {
-            return _sequences.empty();
+            return _index.empty();
         }
 
         size_t size() const {
-            return _sequences.size();
+            return _index.size();
         }
 
         /** Returns the sequence before the earliest one still in the set. */
-        sequence since() {
-            return (_first != _sequences.end()) ? _first->second.prevSequence : _lastAdded;
+        sequence since() const {
+            return _beforeFirst;
         }
 
         /** Adds a sequence to the set. */
         void add(sequence s) {
-            bool wasEmpty = empty();
-            auto p = _sequences.insert({s, {_nextOrder++, _lastAdded}});
-            _lastAdded = s;
-            if (wasEmpty)
-                _first = p.first;
+            // The _index key points into `s`, whose buffer the new entry keeps alive.
+            // (If `s` is already in the set, the new entry is just a tombstone.)
+            bool added = _index.emplace(s, _firstOrder + _entries.size()).second;
+            _entries.push_back({s, added});
         }
 
         /** Removes the sequence if it's in the set. Returns true if it was the earliest. */
         bool remove(sequence s) {
-            auto i = _sequences.find(s);
-            if (i == _sequences.end()) {
+            auto i = _index.find(s);
+            if (i == _index.end())
                 return false;
-            } else if (i == _first) {
-                size_t minOrder = i->second.order;
-                _sequences.erase(i);
-                findFirst(minOrder + 1);
-                return true;
-            } else {
-                _sequences.erase(i);
+            size_t order = i->second;
+            _index.erase(i);
+            _entries[order - _firstOrder].present = false;
+            if (order != _firstOrder)
                 return false;
+            // Trim tombstones off the front; the last one trimmed precedes the earliest sequence:
+            while (!_entries.empty() && !_entries.front().present) {
+                _beforeFirst = _entries.front().seq;
+                _entries.pop_front();
+                ++_firstOrder;
             }
+            return true;
         }
 
     private:
-
-        // Updates _first to point to the earliest entry in _sequences
-        void findFirst(size_t minOrderInSet) {
-            sequenceMap::iterator first = _sequences.end();
-            size_t minOrderSoFar = SIZE_MAX;
-            // OPT: Slow linear scan. Keep a secondary collection sorted by order?
-            for (auto i = _sequences.begin(); i != _sequences.end(); ++i) {
-                if (i->second.order < minOrderSoFar) {
-                    minOrderSoFar = i->second.order;
-                    first = i;
-                    if (minOrderSoFar == minOrderInSet)
-                        break;  // we know we've found the minimum
-                }
-            }
-            _first = first;
-        }
-
-        struct value {
-            size_t order;                   // Chronological order in which this sequence was added
-            sequence prevSequence;          // The previously-added sequence
+        struct entry {
+            sequence seq;
+            bool present;                   // False if removed (a tombstone)
         };
-        using sequenceMap = std::map<sequence, value>;
 
-        sequenceMap _sequences;             // Maps sequence to {order, previous seq}
-        size_t _nextOrder {0};              // Order to assign to the next insertion
-        sequence _lastAdded;                // The last sequence added
-        sequenceMap::iterator _first {};    // Points to the earliest sequence still in _sequences
+        std::deque<entry> _entries;         // Sequences in the order added, incl. tombstones
+        std::unordered_map<fleece::slice, size_t, fleece::sliceHash> _index; // seq -> its order
+        size_t _firstOrder {0};             // Order of _entries.front()
+        sequence _beforeFirst;              // The sequence added just before _entries.front()
     };
 
 } }
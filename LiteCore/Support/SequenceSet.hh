@@ -7,13 +7,19 @@
 //
 
 #pragma once
-#include <set>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <stdint.h>
 #include <assert.h>
 
 namespace litecore {
 
     /** A set of positive integers, generally representing database sequences.
-        This is used by the replicator to keep track of which revisions are being pushed. */
+        This is used by the replicator to keep track of which revisions are being pushed.
+        It's stored as a map of ranges of consecutive sequences, which keeps it small when the
+        sequences are mostly contiguous, and makes all operations O(log n) in the number of
+        ranges. */
     class SequenceSet {
     public:
         typedef uint64_t sequence;
@@ -23,21 +29,66 @@ namespace litecore {
 
         /** Empties the set.
             The optional `max` parameter sets the initial value of the `maxEver` property. */
-        void clear(sequence max =0)             {_sequences.clear(); _max = max;}
+        void clear(sequence max =0)             {_ranges.clear(); _size = 0; _max = max;}
 
-        bool empty() const                      {return _sequences.empty();}
-        size_t size() const                     {return _sequences.size();}
+        bool empty() const                      {return _size == 0;}
+        size_t size() const                     {return _size;}
 
         /** Returns the lowest sequence in the set. If the set is empty, returns 0. */
-        sequence first() const                  {return empty() ? 0 : *_sequences.begin();}
+        sequence first() const                  {return empty() ? 0 : _ranges.begin()->first;}
 
         /** The largest sequence ever stored in the set. (The clear() function resets this.) */
         sequence maxEver() const                {return _max;}
 
-        bool contains(sequence s) const         {return _sequences.find(s) != _sequences.end();}
+        bool contains(sequence s) const {
+            auto next = _ranges.upper_bound(s);
+            return next != _ranges.begin() && s < std::prev(next)->second;
+        }
+
+        void add(sequence s) {
+            _max = std::max(_max, s);
+            auto next = _ranges.upper_bound(s);             // first range starting after s
+            if (next != _ranges.begin()) {
+                auto prev = std::prev(next);
+                if (s < prev->second)
+                    return;                                 // already present
+                if (s == prev->second) {
+                    // Extend the preceding range, and merge it with the next if they now touch:
+                    ++prev->second;
+                    ++_size;
+                    if (next != _ranges.end() && next->first == prev->second) {
+                        prev->second = next->second;
+                        _ranges.erase(next);
+                    }
+                    return;
+                }
+            }
+            ++_size;
+            if (next != _ranges.end() && next->first == s + 1) {
+                // Extend the next range downwards (since its key changes, replace it):
+                sequence end = next->second;
+                _ranges.emplace_hint(_ranges.erase(next), s, end);
+            } else {
+                _ranges.emplace_hint(next, s, s + 1);
+            }
+        }
+
+        void remove(sequence s) {
+            auto next = _ranges.upper_bound(s);
+            if (next == _ranges.begin())
+                return;
+            auto range = std::prev(next);
+            if (s >= range->second)
+                return;                                     // not present
+            --_size;
+            if (s + 1 < range->second)
+                _ranges.emplace_hint(next, s + 1, range->second);   // the part after s
+            if (s > range->first)
+                range->second = s;                                  // the part before s
+            else
+                _ranges.erase(range);
+        }
 
-        void add(sequence s)                    {_sequences.insert(s); _max = std::max(_max, s);}
-        void remove(sequence s)                 {_sequences.erase(s);}
         void set(sequence s, bool present)      {present ? add(s) : remove(s);}
 
         reference operator[] (sequence s)               {return reference(*this, s);}
@@ -57,7 +108,8 @@ namespace litecore {
         };
 
     private:
-        std::set<sequence> _sequences;
+        std::map<sequence, sequence> _ranges;   // Maps start of each range to the end (exclusive)
+        size_t _size {0};                       // Number of sequences in the set
         sequence _max {0};
     };
 
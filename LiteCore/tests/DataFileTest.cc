@@ -7,12 +7,17 @@
 //
 
 #include "DataFile.hh"
+#include "LogDataFile.hh"
+#include "SQLiteDataFile.hh"
 #include "RecordEnumerator.hh"
 #include "Query.hh"
 #include "Error.hh"
 #include "FilePath.hh"
 #include "Fleece.hh"
 #include "Benchmark.hh"
+#include "SQLiteCpp/SQLiteCpp.h"
+#include <algorithm>
+#include <random>
 
 #include "LiteCoreTest.hh"
 
@@ -552,6 +557,400 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile KeyStoreWrite", "[DataFil
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile SetMany", "[DataFile]") {
+    {
+        Transaction t(db);
+        store->set("a"_sl, "A"_sl, t);
+        t.commit();
+    }
+    vector<string> keys;
+    for (int i = 1; i <= 100; i++)
+        keys.push_back(stringWithFormat("rec-%03d", i));
+    vector<KeyStore::SetEntry> entries;
+    for (auto &key : keys)
+        entries.push_back({slice(key), "meta"_sl, slice(key)});
+    vector<KeyStore::setResult> results(entries.size());
+    {
+        Transaction t(db);
+        store->setMany(entries.data(), entries.size(), results.data(), t);
+        t.commit();
+    }
+    REQUIRE(store->lastSequence() == 101);
+    for (int i = 0; i < 100; i++) {
+        REQUIRE(results[i].seq == (sequence)(i + 2));
+        Record rec = store->get(slice(keys[i]));
+        REQUIRE(rec.sequence() == (sequence)(i + 2));
+        REQUIRE(rec.meta() == "meta"_sl);
+        REQUIRE(rec.body() == slice(keys[i]));
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile GetMany", "[DataFile]") {
+    createNumberedDocs(store);
+
+    // Enough keys to need more than one batch, including duplicates and missing ones:
+    vector<string> keyStrs;
+    for (int i = 250; i >= 1; i -= 2)
+        keyStrs.push_back(stringWithFormat("rec-%03d", i));
+    keyStrs.push_back("rec-001");
+    vector<slice> keys(keyStrs.begin(), keyStrs.end());
+
+    for (int metaOnly = 0; metaOnly <= 1; ++metaOnly) {
+        INFO("metaOnly=" << metaOnly);
+        auto records = store->getMany(keys, metaOnly ? kMetaOnly : kDefaultContent);
+        REQUIRE(records.size() == keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            const Record &rec = records[i];
+            REQUIRE(rec.key() == keys[i]);
+            int n = stoi(keyStrs[i].substr(4));
+            if (n <= 100) {
+                REQUIRE(rec.exists());
+                REQUIRE(rec.sequence() == (sequence)n);
+                if (metaOnly)
+                    REQUIRE(rec.bodySize() == keys[i].size);
+                else
+                    REQUIRE(rec.body() == keys[i]);
+            } else {
+                REQUIRE_FALSE(rec.exists());
+            }
+        }
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Extra", "[DataFile]") {
+    if (!store->supportsExtra())
+        return;
+    {
+        Transaction t(db);
+        store->set("rec"_sl, "meta"_sl, "body"_sl, "extra"_sl, t);
+        store->set("plain"_sl, "meta"_sl, "body"_sl, t);
+        t.commit();
+    }
+    Record rec = store->get("rec"_sl);
+    CHECK(rec.body() == "body"_sl);
+    CHECK(rec.extra() == "extra"_sl);
+    CHECK_FALSE(store->get("plain"_sl).extra());
+
+    // The extra is read along with the meta:
+    rec = store->get("rec"_sl, kMetaOnly);
+    CHECK(rec.meta() == "meta"_sl);
+    CHECK(rec.extra() == "extra"_sl);
+    CHECK(rec.body().buf == nullptr);
+    CHECK(rec.bodySize() == 4);
+    CHECK(store->get(rec.sequence(), kMetaOnly).extra() == "extra"_sl);
+    CHECK(store->getMany({"rec"_sl}, kMetaOnly)[0].extra() == "extra"_sl);
+
+    RecordEnumerator::Options options;
+    options.contentOptions = kMetaOnly;
+    RecordEnumerator e(*store, "rec"_sl, "rec"_sl, options);
+    REQUIRE(e.next());
+    CHECK(e.record().extra() == "extra"_sl);
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "DataFile Extra Upgrade", "[DataFile]") {
+    // Make a KeyStore table the way it was before records had an extra:
+    {
+        SQLite::Database &sqlDb = *(SQLiteDataFile*)db;
+        sqlDb.exec("CREATE TABLE kv_old (key BLOB PRIMARY KEY, meta BLOB, body BLOB, "
+                   "sequence INTEGER, deleted INTEGER DEFAULT 0); "
+                   "INSERT INTO kv_old (key, meta, body, sequence) "
+                   "VALUES ('rec', 'meta', 'body', 1)");
+    }
+
+    // A read-only file can't be upgraded, but can still be read:
+    auto options = db->options();
+    options.writeable = false;
+    options.create = false;
+    reopenDatabase(&options);
+    Record rec = db->getKeyStore("old").get("rec"_sl);
+    CHECK(rec.body() == "body"_sl);
+    CHECK_FALSE(rec.extra());
+
+    // Opening it writeable adds the column:
+    options.writeable = true;
+    reopenDatabase(&options);
+    KeyStore &old = db->getKeyStore("old");
+    rec = old.get("rec"_sl, kMetaOnly);
+    CHECK(rec.meta() == "meta"_sl);
+    CHECK_FALSE(rec.extra());
+    {
+        Transaction t(db);
+        old.set("rec"_sl, "meta"_sl, "body"_sl, "extra"_sl, t);
+        t.commit();
+    }
+    CHECK(old.get("rec"_sl).extra() == "extra"_sl);
+}
+
+
+// Fleece body {"num": n, "tags": [...], "text": "..."}, big and repetitive enough to compress
+static alloc_slice compressibleBody(int num) {
+    fleece::Encoder enc;
+    enc.beginDictionary();
+    enc.writeKey("num");
+    enc.writeInt(num);
+    enc.writeKey("tags");
+    enc.beginArray();
+    enc.writeString(num % 2 ? "odd" : "even");
+    enc.endArray();
+    enc.writeKey("text");
+    string text;
+    for (int i = 0; i < 20; ++i)
+        text += stringWithFormat("the quick brown fox #%d ", num);
+    enc.writeString(text);
+    enc.endDictionary();
+    return enc.extractOutput();
+}
+
+
+static void addCompressibleDocs(KeyStore *store, int first, int last) {
+    Transaction t(store->dataFile());
+    for (int i = first; i <= last; i++) {
+        string docID = stringWithFormat("rec-%03d", i);
+        store->set(slice(docID), "meta"_sl, compressibleBody(i), t);
+    }
+    t.commit();
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "DataFile Compressed Bodies", "[DataFile][Query]") {
+    auto options = db->options();
+    options.tuning.compression = kSnappyCompression;
+    reopenDatabase(&options);
+    addCompressibleDocs(store, 1, 10);
+
+    // A compressed body takes up less room in the file, as a meta-only read shows:
+    alloc_slice body = compressibleBody(1);
+    CHECK(store->get("rec-001"_sl, kMetaOnly).bodySize() < (ssize_t)body.size);
+    CHECK(store->get("rec-001"_sl).body() == body);
+
+    // Other KeyStores are left alone:
+    {
+        Transaction t(db);
+        db->getKeyStore("other").set("rec"_sl, nullslice, body, t);
+        t.commit();
+    }
+    CHECK(db->getKeyStore("other").get("rec"_sl, kMetaOnly).bodySize() == (ssize_t)body.size);
+
+    // With compression off, new bodies are stored as-is, and old ones are still readable:
+    options.tuning.compression = kNoCompression;
+    reopenDatabase(&options);
+    addCompressibleDocs(store, 11, 20);
+    CHECK(store->get("rec-011"_sl, kMetaOnly).bodySize() == (ssize_t)compressibleBody(11).size);
+
+    int i = 0;
+    for (RecordEnumerator e(*store); e.next(); ) {
+        ++i;
+        CHECK(e->body() == compressibleBody(i));
+        CHECK(e->meta() == "meta"_sl);
+    }
+    CHECK(i == 20);
+    CHECK(store->get((sequence)5).body() == compressibleBody(5));
+    auto recs = store->getMany({"rec-002"_sl, "rec-012"_sl});
+    CHECK(recs[0].body() == compressibleBody(2));
+    CHECK(recs[1].body() == compressibleBody(12));
+
+    // Queries see both kinds of bodies:
+    unique_ptr<Query> query{ store->compileQuery(json5(
+        "{WHAT: ['.num'], WHERE: ['>=', ['.num'], 8]}")) };
+    int64_t count = 0, sum = 0;
+    for (QueryEnumerator e(query.get()); e.next(); ++count) {
+        auto cols = Value::fromData(e.getCustomColumns());
+        REQUIRE(cols);
+        sum += cols->asArray()->get(0)->asInt();
+    }
+    CHECK(count == 13);
+    CHECK(sum == 182);      // 8 + 9 + ... + 20
+
+    query.reset(store->compileQuery(json5(
+        "['ANY', 'X', ['.', 'tags'], ['=', ['?', 'X'], 'odd']]")));
+    count = 0;
+    for (QueryEnumerator e(query.get()); e.next(); ++count)
+        CHECK(e.recordID() != "rec-002"_sl);
+    CHECK(count == 10);
+}
+
+
+// Small Fleece body like {"num": n, "status": "...", "customer": "...", "notes": "..."}, which
+// has too little repetition to compress on its own, but a lot in common with the others
+static alloc_slice orderBody(int num) {
+    static const char* const kStatuses[] = {"pending", "shipped", "delivered"};
+    fleece::Encoder enc;
+    enc.beginDictionary();
+    enc.writeKey("num");
+    enc.writeInt(num);
+    enc.writeKey("status");
+    enc.writeString(kStatuses[num % 3]);
+    enc.writeKey("customer");
+    enc.writeString(stringWithFormat("customer-%d@example.com", num * 7919 % 1000));
+    enc.writeKey("notes");
+    enc.writeString("Leave the package at the front desk of the building, or with a neighbor "
+                    "if nobody answers. Signature required for deliveries over fifty dollars.");
+    enc.endDictionary();
+    return enc.extractOutput();
+}
+
+
+static void addOrderDocs(KeyStore *store, int first, int last) {
+    Transaction t(store->dataFile());
+    for (int i = first; i <= last; i++) {
+        string docID = stringWithFormat("rec-%03d", i);
+        store->set(slice(docID), "meta"_sl, orderBody(i), t);
+    }
+    t.commit();
+}
+
+
+static alloc_slice trainDictionary(KeyStore *store) {
+    vector<alloc_slice> samples;
+    for (RecordEnumerator e(*store); e.next(); )
+        samples.push_back(e->body());
+    return CompressionDictionary::train(samples);
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "DataFile Compression Dictionary", "[DataFile][Query]") {
+    auto options = db->options();
+    options.tuning.compression = kDictionaryCompression;
+    reopenDatabase(&options);
+
+    // Until there's a dictionary, these small bodies are stored as-is:
+    addOrderDocs(store, 1, 50);
+    CHECK(db->compressionDictionaryVersion() == 0);
+    CHECK(store->get("rec-001"_sl, kMetaOnly).bodySize() == (ssize_t)orderBody(1).size);
+
+    alloc_slice dictionary = trainDictionary(store);
+    REQUIRE(dictionary);
+    CHECK(dictionary.size <= (size_t)CompressionDictionary::kDefaultSize);
+    CHECK_FALSE(CompressionDictionary::train({orderBody(1), orderBody(2)}));   // too few
+
+    // A dictionary is used once it's committed, and not if it's aborted:
+    {
+        Transaction t(db);
+        CHECK(db->saveCompressionDictionary(dictionary, t) == 1);
+        CHECK(db->compressionDictionaryVersion() == 0);
+        t.commit();
+    }
+    CHECK(db->compressionDictionaryVersion() == 1);
+    {
+        Transaction t(db);
+        CHECK(db->saveCompressionDictionary(dictionary, t) == 2);
+        t.abort();
+    }
+    CHECK(db->compressionDictionaryVersion() == 1);
+
+    addOrderDocs(store, 51, 100);
+    CHECK(store->get("rec-051"_sl, kMetaOnly).bodySize() < (ssize_t)orderBody(51).size / 2);
+    CHECK(store->get("rec-051"_sl).body() == orderBody(51));
+
+    // Retrain; bodies compressed with either version stay readable:
+    {
+        Transaction t(db);
+        CHECK(db->saveCompressionDictionary(trainDictionary(store), t) == 2);
+        t.commit();
+    }
+    addOrderDocs(store, 101, 150);
+    reopenDatabase(&options);
+    CHECK(db->compressionDictionaryVersion() == 2);
+
+    // With compression off, the dictionaries are loaded as needed to decompress:
+    options.tuning.compression = kNoCompression;
+    reopenDatabase(&options);
+    CHECK(db->compressionDictionaryVersion() == 0);
+    int i = 0;
+    for (RecordEnumerator e(*store); e.next(); ) {
+        ++i;
+        CHECK(e->body() == orderBody(i));
+    }
+    CHECK(i == 150);
+    auto recs = store->getMany({"rec-010"_sl, "rec-060"_sl, "rec-110"_sl});
+    CHECK(recs[0].body() == orderBody(10));
+    CHECK(recs[1].body() == orderBody(60));
+    CHECK(recs[2].body() == orderBody(110));
+
+    unique_ptr<Query> query{ store->compileQuery(json5(
+        "{WHAT: ['.num'], WHERE: ['AND', ['=', ['.status'], 'shipped'], ['>', ['.num'], 40]]}")) };
+    int64_t count = 0, sum = 0;
+    for (QueryEnumerator e(query.get()); e.next(); ++count) {
+        auto cols = Value::fromData(e.getCustomColumns());
+        REQUIRE(cols);
+        sum += cols->asArray()->get(0)->asInt();
+    }
+    CHECK(count == 36);     // 43, 46, ... 148
+    CHECK(sum == 3438);
+}
+
+
+static void writeRecords(KeyStore *store, size_t count, bool batched) {
+    vector<string> keys(count);
+    for (size_t i = 0; i < count; i++)
+        keys[i] = stringWithFormat("rec-%09zu", i);
+    vector<KeyStore::SetEntry> entries;
+    entries.reserve(count);
+    for (auto &key : keys)
+        entries.push_back({slice(key), nullslice, "some body of a modest size"_sl});
+
+    Stopwatch st;
+    Transaction t(store->dataFile());
+    if (batched) {
+        store->setMany(entries.data(), count, nullptr, t);
+    } else {
+        for (auto &entry : entries)
+            store->set(entry.key, entry.meta, entry.body, t);
+    }
+    t.commit();
+    st.printReport((batched ? "setMany" : "set"), (unsigned)count, "record");
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile SetMany Performance", "[DataFile][Perf][.slow]") {
+    cerr << "Storage engine: " << factory().cname() << "\n";
+    for (size_t count : {1000, 100000, 1000000}) {
+        for (int batched = 0; batched <= 1; ++batched) {
+            writeRecords(store, count, batched);
+            store->erase();
+        }
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Read Performance", "[DataFile][Perf][.slow]") {
+    cerr << "Storage engine: " << factory().cname() << "\n";
+    const size_t kCount = 100000;
+    writeRecords(store, kCount, true);
+
+    vector<string> keys(kCount);
+    for (size_t i = 0; i < kCount; i++)
+        keys[i] = stringWithFormat("rec-%09zu", i);
+    shuffle(keys.begin(), keys.end(), default_random_engine(12345));
+
+    {
+        Stopwatch st;
+        size_t found = 0;
+        for (auto &key : keys)
+            found += store->get(slice(key)).exists();
+        st.printReport("get (random order)", (unsigned)kCount, "record");
+        CHECK(found == kCount);
+    }
+    {
+        Stopwatch st;
+        size_t found = 0;
+        for (RecordEnumerator e(*store); e.next(); )
+            ++found;
+        st.printReport("enumerate", (unsigned)kCount, "record");
+        CHECK(found == kCount);
+    }
+    {
+        Stopwatch st;
+        reopenDatabase();
+        st.printReport("reopen", 1, "database");
+        CHECK(store->recordCount() == kCount);
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile KeyStoreDelete", "[DataFile]") {
     KeyStore &s = db->getKeyStore("store");
     alloc_slice key("key");
@@ -669,7 +1068,7 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Compact", "[DataFile]") {
     }
 
     unsigned numCompactCalls = 0;
-    db->setOnCompact([&](bool compacting) {
+    db->setOnCompact([&](bool compacting, const DataFile::CompactProgress&) {
         ++numCompactCalls;
     });
 
@@ -740,3 +1139,39 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Rekey", "[DataFile]") {
     Record rec = store->get((slice)"rec-001");
     REQUIRE(rec.exists());
 }
+
+
+TEST_CASE("LogDataFile Recovery", "[DataFile]") {
+    auto &factory = LogDataFile::factory();
+    auto path = FilePath::tempDirectory()["log_recovery"].addingExtension(factory.filenameExtension());
+    factory.deleteFile(path);
+    {
+        unique_ptr<DataFile> db { factory.openFile(path) };
+        Transaction t(*db);
+        db->defaultKeyStore().set("a"_sl, "A"_sl, t);
+        t.commit();
+    }
+
+    // Simulate a crash partway through appending a transaction:
+    FILE *f = fopen(path.path().c_str(), "ab");
+    REQUIRE(f);
+    fwrite("\x01\x40\x00\x00\x00garbage", 1, 12, f);
+    fclose(f);
+
+    {
+        unique_ptr<DataFile> db { factory.openFile(path) };
+        KeyStore &store = db->defaultKeyStore();
+        CHECK(store.get("a"_sl).body() == "A"_sl);
+        Transaction t(*db);
+        store.set("b"_sl, "B"_sl, t);
+        t.commit();
+    }
+    {
+        unique_ptr<DataFile> db { factory.openFile(path) };
+        KeyStore &store = db->defaultKeyStore();
+        CHECK(store.get("a"_sl).body() == "A"_sl);
+        CHECK(store.get("b"_sl).body() == "B"_sl);
+        CHECK(store.lastSequence() == 2);
+    }
+    factory.deleteFile(path);
+}
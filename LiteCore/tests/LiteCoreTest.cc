@@ -8,6 +8,7 @@
 
 #include "LiteCoreTest.hh"
 #include "SQLiteDataFile.hh"
+#include "LogDataFile.hh"
 #include "FilePath.hh"
 #include <assert.h>
 #include <stdlib.h>
@@ -119,6 +120,8 @@ void ExpectException(litecore::error::Domain domain, int code, std::function<voi
 
 
 DataFile::Factory& DataFileTestFixture::factory() {
+    if (testOption == 1)
+        return LogDataFile::factory();
     return SQLiteDataFile::factory();
 }
 
@@ -153,7 +156,9 @@ void DataFileTestFixture::reopenDatabase(DataFile::Options *newOptions) {
 }
 
 
-DataFileTestFixture::DataFileTestFixture(int testOption) {
+DataFileTestFixture::DataFileTestFixture(int testOption)
+:testOption(testOption)
+{
     auto dbPath = databasePath("cbl_core_temp");
     deleteDatabase(dbPath);
     db = newDatabase(dbPath);
@@ -58,7 +58,7 @@ using namespace std;
 class DataFileTestFixture {
 public:
 
-    static const int numberOfOptions = 2;
+    static const int numberOfOptions = 2;       // 0 = SQLite, 1 = log-structured
 
     DataFileTestFixture()   :DataFileTestFixture(0) { }     // defaults to SQLite, rev-trees
     DataFileTestFixture(int testOption);
@@ -66,6 +66,7 @@ public:
 
     DataFile::Factory& factory();
     
+    int testOption {0};
     DataFile *db {nullptr};
     KeyStore *store {nullptr};
 
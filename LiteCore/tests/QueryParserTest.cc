@@ -104,6 +104,14 @@ TEST_CASE("QueryParser property contexts", "[Query]") {
           == "fl_count(body, 'addresses')");
     CHECK(parseWhere("['array_count()', ['.addresses']]")
           == "fl_count(body, 'addresses')");
+    CHECK(parseWhere("['array_sum()', ['.', 'prices']]")
+          == "array_sum(fl_pointer(body, 'prices'))");
+    CHECK(parseWhere("['array_sum()', ['$', 'X']]")
+          == "array_sum($_X)");
+    CHECK(parseWhere("['array_avg()', ['.', 'prices']]")
+          == "array_avg(fl_value(body, 'prices'))");
+    CHECK(parseWhere("['array_contains()', ['.', 'tags'], 'x']")
+          == "array_contains(fl_value(body, 'tags'), 'x')");
 }
 
 
@@ -120,6 +128,16 @@ TEST_CASE("QueryParser ANY", "[Query]") {
 TEST_CASE("QueryParser ANY complex", "[Query]") {
     CHECK(parseWhere("['ANY', 'X', ['.', 'names'], ['=', ['?', 'X', 'last'], 'Smith']]")
           == "EXISTS (SELECT 1 FROM fl_each(body, 'names') AS _X WHERE fl_value(_X.pointer, 'last') = 'Smith')");
+    // Functions of a variable's property read it through the variable's pointer:
+    CHECK(parseWhere("['ANY', 'X', ['.', 'orders'], ['>', ['array_count()', ['?', 'X', 'items']], 2]]")
+          == "EXISTS (SELECT 1 FROM fl_each(body, 'orders') AS _X WHERE fl_count(_X.pointer, 'items') > 2)");
+    CHECK(parseWhere("['ANY', 'X', ['.', 'orders'], ['>', ['array_sum()', ['?X', 'prices']], 100]]")
+          == "EXISTS (SELECT 1 FROM fl_each(body, 'orders') AS _X WHERE array_sum(fl_pointer(_X.pointer, 'prices')) > 100)");
+    CHECK(parseWhere("['ANY', 'X', ['.', 'orders'], ['EXISTS', ['?X', 'coupon']]]")
+          == "EXISTS (SELECT 1 FROM fl_each(body, 'orders') AS _X WHERE fl_exists(_X.pointer, 'coupon'))");
+    CHECK(parseWhere("['ANY', 'X', ['.', 'orders'], ['>', ['array_avg()', ['?X', 'prices']], 100]]")
+          == "EXISTS (SELECT 1 FROM fl_each(body, 'orders') AS _X WHERE array_avg(fl_value(_X.pointer, 'prices')) > 100)");
+    mustFail("['array_count()', ['?X', 'items']]");
 }
 
 
@@ -187,6 +205,44 @@ TEST_CASE("QueryParser Join", "[Query]") {
 }
 
 
+TEST_CASE("QueryParser covering index", "[Query]") {
+    QueryParser qp("kv_default");
+    qp.setCoveringIndexes({{"kv_default::[['.name']]::covering", {"name", "age"}},
+                           {"kv_default::[['.age']]::covering",  {"age", "name"}}});
+    auto parseCovered = [&](string json) {
+        alloc_slice fleece = JSONConverter::convertJSON(json5(json));
+        qp.parse(Value::fromTrustedData(fleece));
+        return qp.SQL();
+    };
+
+    // Prefers the index whose key is used in the WHERE clause:
+    CHECK(parseCovered("{WHAT: ['.name', '._id'], WHERE: ['>', ['.age'], 21]}")
+          == "SELECT \".name\", key FROM \"kv_default::[['.age']]::covering\" WHERE \".age\" > 21");
+    CHECK(qp.coveringIndexUsed() == "kv_default::[['.age']]::covering");
+    CHECK(parseCovered("{WHAT: ['.name'], ORDER_BY: [['.age']]}")
+          == "SELECT \".name\" FROM \"kv_default::[['.name']]::covering\" ORDER BY \".age\"");
+    CHECK(qp.coveringIndexUsed() == "kv_default::[['.name']]::covering");
+
+    // Property columns can't be confused with the key, sequence and meta columns:
+    qp.setCoveringIndexes({{"kv_default::[['.key']]::covering", {"key", "sequence"}}});
+    CHECK(parseCovered("{WHAT: ['.sequence', '._id'], WHERE: ['>', ['.key'], 1]}")
+          == "SELECT \".sequence\", key FROM \"kv_default::[['.key']]::covering\" WHERE \".key\" > 1");
+    qp.setCoveringIndexes({{"kv_default::[['.name']]::covering", {"name", "age"}},
+                           {"kv_default::[['.age']]::covering",  {"age", "name"}}});
+
+    // Queries that need anything else read the records:
+    CHECK(parseCovered("{WHAT: ['.name', '.email'], WHERE: ['>', ['.age'], 21]}")
+          == "SELECT fl_value(body, 'name'), fl_value(body, 'email') FROM kv_default WHERE fl_value(body, 'age') > 21");
+    CHECK(qp.coveringIndexUsed() == "");
+    CHECK(parseCovered("{WHAT: ['.name'], WHERE: ['EXISTS', ['.age']]}")
+          == "SELECT fl_value(body, 'name') FROM kv_default WHERE fl_exists(body, 'age')");
+    CHECK(qp.coveringIndexUsed() == "");
+    CHECK(parseCovered("{WHAT: ['._id'], WHERE: ['=', ['._id'], 'x']}")
+          == "SELECT key FROM kv_default WHERE key = 'x'");
+    CHECK(qp.coveringIndexUsed() == "");
+}
+
+
 TEST_CASE("QueryParser errors", "[Query][!throws]") {
     mustFail("['poop()', 1]");
     mustFail("['power()', 1]");
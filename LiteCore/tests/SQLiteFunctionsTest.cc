@@ -9,6 +9,7 @@
 #include "LiteCoreTest.hh"
 #include "SQLite_Internal.hh"
 #include "Fleece.hh"
+#include "Benchmark.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 
 using namespace litecore;
@@ -38,8 +39,8 @@ public:
         // Run test once with shared keys, once without:
         if (which & 1)
             sharedKeys = make_unique<SharedKeys>();
-        RegisterFleeceFunctions(db.getHandle(), flip, sharedKeys.get());
-        RegisterFleeceEachFunctions(db.getHandle(), flip, sharedKeys.get());
+        RegisterFleeceFunctions(db.getHandle(), flip, nullptr, sharedKeys.get());
+        RegisterFleeceEachFunctions(db.getHandle(), flip, nullptr, sharedKeys.get());
         db.exec("CREATE TABLE kv (key TEXT, body BLOB)");
         insertStmt = make_unique<SQLite::Statement>(db, "INSERT INTO kv (key, body) VALUES (?, ?)");
     }
@@ -96,6 +97,22 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite array_sum of fl_value", "[qu
 }
 
 
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite array_sum of fl_pointer", "[query]") {
+    insert("a",   "{\"hey\": [1, 2, 3, 4]}");
+    insert("b",   "{\"hey\": [2, 4, 6, 8]}");
+    insert("c",   "{\"hey\": []}");
+    insert("d",   "{\"hey\": [1, 2, true, \"foo\"]}");
+    insert("e",   "{\"xxx\": [1, 2, 3, 4]}");
+    insert("f",   "{\"hey\": 17}");
+
+    REQUIRE(query("SELECT ARRAY_SUM(fl_pointer(body, 'hey')) FROM kv")
+            == (vector<string>{"10.0", "20.0", "0.0", "4.0", "0.0", "17.0"}));
+    // A scalar value comes back as a regular SQL value:
+    REQUIRE(query("SELECT fl_pointer(body, 'hey') FROM kv WHERE key = 'f'")
+            == (vector<string>{"17"}));
+}
+
+
 N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_each array", "[query][fl_each]") {
     insert("one",   "[1, 2, 3, 4]");
     insert("two",   "[2, 4, 6, 8]");
@@ -140,3 +157,105 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_each with path", "[query]
     REQUIRE(query("SELECT DISTINCT kv.key FROM kv, fl_each(kv.body, 'hey') WHERE fl_each.value = 3")
             == (vector<string>{"one"}));
 }
+
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite functions of fl_each pointer", "[query][fl_each]") {
+    insert("one",   "{\"orders\": [{\"items\": [1, 2, 3]}, {\"items\": [4], \"coupon\": 1}]}");
+    insert("two",   "{\"orders\": [{\"items\": []}]}");
+
+    REQUIRE(query("SELECT fl_count(fl_each.pointer, 'items') FROM kv, fl_each(kv.body, 'orders') WHERE kv.key = 'one'")
+            == (vector<string>{"3", "1"}));
+    REQUIRE(query("SELECT array_sum(fl_pointer(fl_each.pointer, 'items')) FROM kv, fl_each(kv.body, 'orders') WHERE kv.key = 'one'")
+            == (vector<string>{"6.0", "4.0"}));
+    REQUIRE(query("SELECT fl_exists(fl_each.pointer, 'coupon') FROM kv, fl_each(kv.body, 'orders') WHERE kv.key = 'one'")
+            == (vector<string>{"0", "1"}));
+    REQUIRE(query("SELECT DISTINCT kv.key FROM kv, fl_each(kv.body, 'orders') WHERE fl_contains(fl_each.pointer, 'items', 0, 4)")
+            == (vector<string>{"one"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_value with varying path", "[query]") {
+    // The parsed path is cached per argument; make sure a path that changes per row works:
+    db.exec("ALTER TABLE kv ADD COLUMN path TEXT");
+    insert("a",   "{\"one\": 1, \"two\": 2, \"three\": {\"four\": 4}}");
+    insert("b",   "{\"one\": 2, \"two\": 4, \"three\": {\"four\": 8}}");
+    insert("c",   "{\"one\": 3, \"two\": 6, \"three\": {\"four\": 12}}");
+    db.exec("UPDATE kv SET path='one' WHERE key='a'");
+    db.exec("UPDATE kv SET path='two' WHERE key='b'");
+    db.exec("UPDATE kv SET path='three.four' WHERE key='c'");
+
+    REQUIRE(query("SELECT fl_value(body, path) FROM kv ORDER BY key")
+            == (vector<string>{"1", "4", "12"}));
+    REQUIRE(query("SELECT fl_value(body, 'three.four') FROM kv ORDER BY key")
+            == (vector<string>{"4", "8", "12"}));
+    REQUIRE(query("SELECT fl_exists(body, path) FROM kv ORDER BY key")
+            == (vector<string>{"1", "1", "1"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_value performance", "[query][Perf][.slow]") {
+    static const int kNumDocs = 1000000;
+    db.exec("ALTER TABLE kv ADD COLUMN path TEXT");
+    {
+        SQLite::Transaction t(db);
+        char key[20], json[100];
+        for (int i = 0; i < kNumDocs; ++i) {
+            sprintf(key, "%07d", i);
+            sprintf(json, "{\"name\": {\"first\": \"F%d\", \"last\": \"L%d\"}, \"n\": %d}",
+                    i, i, i);
+            insert(key, json);
+        }
+        db.exec("UPDATE kv SET path='name.first'");
+        t.commit();
+    }
+
+    // A path read from a column has to be parsed for every row, while a constant path is
+    // parsed once and cached:
+    const char* queries[2] = {"SELECT fl_value(body, path) FROM kv",
+                              "SELECT fl_value(body, 'name.first') FROM kv"};
+    for (auto sql : queries) {
+        SQLite::Statement stmt(db, sql);
+        Stopwatch st;
+        int n = 0;
+        while (stmt.executeStep())
+            ++n;
+        CHECK(n == kNumDocs);
+        st.printReport(sql, n, "row");
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite nested Fleece value performance", "[query][Perf][.slow]") {
+    static const int kNumDocs = 100000, kArraySize = 100;
+    {
+        SQLite::Transaction t(db);
+        char key[20];
+        for (int i = 0; i < kNumDocs; ++i) {
+            sprintf(key, "%07d", i);
+            string json = "{\"n\": " + to_string(i) + ", \"scores\": [";
+            for (int j = 0; j < kArraySize; ++j)
+                json += (j > 0 ? ", " : "") + to_string((i + j) % 1000);
+            json += "]}";
+            insert(key, json.c_str());
+        }
+        t.commit();
+    }
+
+    // fl_value re-encodes the array for array_sum to read; fl_pointer just passes a pointer:
+    const char* queries[2] = {"SELECT array_sum(fl_value(body, 'scores')) FROM kv",
+                              "SELECT array_sum(fl_pointer(body, 'scores')) FROM kv"};
+    double sums[2];
+    for (int q = 0; q < 2; ++q) {
+        SQLite::Statement stmt(db, queries[q]);
+        Stopwatch st;
+        int n = 0;
+        sums[q] = 0.0;
+        while (stmt.executeStep()) {
+            sums[q] += stmt.getColumn(0).getDouble();
+            ++n;
+        }
+        CHECK(n == kNumDocs);
+        st.printReport(queries[q], n, "row");
+    }
+    CHECK(sums[0] == sums[1]);
+}
@@ -0,0 +1,199 @@
+//
+//  SequenceSetTest.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "LiteCoreTest.hh"
+#include "SequenceSet.hh"
+#include "RemoteSequenceSet.hh"
+#include "Benchmark.hh"
+#include <algorithm>
+#include <random>
+#include <set>
+
+using namespace std;
+using namespace litecore;
+using namespace litecore::repl;
+
+
+TEST_CASE("SequenceSet", "[SequenceSet]") {
+    SequenceSet s;
+    CHECK(s.empty());
+    CHECK(s.first() == 0);
+    s.clear(5);
+    CHECK(s.maxEver() == 5);
+
+    for (SequenceSet::sequence seq : {10, 12, 11, 14, 9})
+        s.add(seq);
+    CHECK(s.size() == 5);
+    CHECK(s.first() == 9);
+    CHECK(s.maxEver() == 14);
+    CHECK(s.contains(11));
+    CHECK(!s.contains(13));
+    CHECK(!s.contains(8));
+    CHECK(!s.contains(15));
+
+    s.add(11);                          // already present
+    CHECK(s.size() == 5);
+    s.add(13);                          // joins two ranges
+    CHECK(s.size() == 6);
+    CHECK(s[13]);
+
+    s.remove(11);                       // splits a range
+    CHECK(s.size() == 5);
+    CHECK(!s[11]);
+    CHECK(s[10]);
+    CHECK(s[12]);
+    s.remove(11);                       // not present
+    CHECK(s.size() == 5);
+
+    s.remove(9);
+    s[10] = false;
+    CHECK(s.first() == 12);
+    s.remove(12);
+    s.remove(13);
+    s.remove(14);
+    CHECK(s.empty());
+    CHECK(s.first() == 0);
+    CHECK(s.maxEver() == 14);
+}
+
+
+TEST_CASE("SequenceSet random", "[SequenceSet]") {
+    // Compare against a std::set:
+    mt19937 random(1234);
+    SequenceSet s;
+    set<SequenceSet::sequence> model;
+    for (int i = 0; i < 20000; ++i) {
+        SequenceSet::sequence seq = 1 + random() % 200;
+        if (random() % 2) {
+            s.add(seq);
+            model.insert(seq);
+        } else {
+            s.remove(seq);
+            model.erase(seq);
+        }
+        REQUIRE(s.size() == model.size());
+        REQUIRE(s.first() == (model.empty() ? 0 : *model.begin()));
+        REQUIRE(s.contains(seq) == (model.count(seq) > 0));
+    }
+    for (SequenceSet::sequence seq = 0; seq <= 201; ++seq)
+        CHECK(s.contains(seq) == (model.count(seq) > 0));
+}
+
+
+TEST_CASE("RemoteSequenceSet", "[SequenceSet]") {
+    RemoteSequenceSet s;
+    s.clear(alloc_slice("0"_sl));
+    CHECK(s.empty());
+    CHECK(s.since() == "0"_sl);
+
+    for (const char *seq : {"1", "2", "3", "4"})
+        s.add(alloc_slice(slice(seq)));
+    CHECK(s.size() == 4);
+    CHECK(s.since() == "0"_sl);
+
+    CHECK(!s.remove(alloc_slice("3"_sl)));
+    CHECK(s.since() == "0"_sl);
+    CHECK(!s.remove(alloc_slice("3"_sl)));         // not present any more
+    CHECK(s.remove(alloc_slice("1"_sl)));
+    CHECK(s.since() == "1"_sl);
+    CHECK(s.remove(alloc_slice("2"_sl)));          // skips over 3, which was already removed
+    CHECK(s.since() == "3"_sl);
+    CHECK(s.size() == 1);
+    CHECK(s.remove(alloc_slice("4"_sl)));
+    CHECK(s.empty());
+    CHECK(s.since() == "4"_sl);
+    CHECK(!s.remove(alloc_slice("4"_sl)));
+}
+
+
+TEST_CASE("RemoteSequenceSet random", "[SequenceSet]") {
+    // Compare against a simple model: a list of sequences in the order they were added.
+    mt19937 random(1234);
+    RemoteSequenceSet s;
+    s.clear(alloc_slice("start"_sl));
+    vector<string> added;                       // every sequence added, in order
+    vector<bool> present;
+    string since = "start";
+    int next = 0;
+    for (int i = 0; i < 20000; ++i) {
+        if (random() % 2 || s.empty()) {
+            string seq = to_string(next++);
+            s.add(alloc_slice(slice(seq)));
+            added.push_back(seq);
+            present.push_back(true);
+        } else {
+            // Remove a random sequence that's in the set:
+            size_t pos;
+            do {
+                pos = random() % added.size();
+            } while (!present[pos]);
+            size_t firstPos = find(present.begin(), present.end(), true) - present.begin();
+            present[pos] = false;
+            bool wasFirst = s.remove(alloc_slice(slice(added[pos])));
+            REQUIRE(wasFirst == (pos == firstPos));
+            size_t newFirst = find(present.begin(), present.end(), true) - present.begin();
+            since = (newFirst > 0) ? added[newFirst - 1] : "start";
+        }
+        REQUIRE(s.since() == slice(since));
+        REQUIRE(s.size() == (size_t)count(present.begin(), present.end(), true));
+    }
+}
+
+
+TEST_CASE("SequenceSet out-of-order completion benchmark", "[SequenceSet][Perf][.slow]") {
+    // Simulates a replication of 1M revisions: sequences are added in order, up to 10,000 are
+    // in flight at once, and they complete in random order. (Each sequence is added a little
+    // before it can complete, so the sets hold about 10,000 sequences at a time.)
+    static const uint64_t kCount = 1000000, kInFlight = 10000;
+    mt19937 random(1234);
+    vector<uint64_t> inFlight;
+    vector<uint64_t> completionOrder;
+    completionOrder.reserve(kCount);
+    uint64_t next = 1;
+    while (completionOrder.size() < kCount) {
+        while (inFlight.size() < kInFlight && next <= kCount)
+            inFlight.push_back(next++);
+        size_t i = random() % inFlight.size();
+        completionOrder.push_back(inFlight[i]);
+        inFlight[i] = inFlight.back();
+        inFlight.pop_back();
+    }
+
+    {
+        Stopwatch st;
+        SequenceSet s;
+        uint64_t nextToAdd = 1;
+        for (uint64_t seq : completionOrder) {
+            while (nextToAdd <= min(seq + kInFlight, kCount))
+                s.add(nextToAdd++);
+            s.remove(seq);
+            (void)s.first();
+        }
+        CHECK(s.empty());
+        st.printReport("SequenceSet add/remove", kCount, "sequence");
+    }
+
+    {
+        vector<alloc_slice> seqs;
+        seqs.reserve(kCount + 1);
+        for (uint64_t seq = 0; seq <= kCount; ++seq)
+            seqs.emplace_back(slice(to_string(seq)));
+        Stopwatch st;
+        RemoteSequenceSet s;
+        s.clear(seqs[0]);
+        uint64_t nextToAdd = 1;
+        for (uint64_t seq : completionOrder) {
+            while (nextToAdd <= min(seq + kInFlight, kCount))
+                s.add(seqs[nextToAdd++]);
+            if (s.remove(seqs[seq]))
+                (void)s.since();
+        }
+        CHECK(s.empty());
+        CHECK(s.since() == seqs[kCount]);
+        st.printReport("RemoteSequenceSet add/remove", kCount, "sequence");
+    }
+}
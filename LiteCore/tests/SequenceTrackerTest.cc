@@ -331,3 +331,127 @@ TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker ExternalChanges
     CHECK(changes[0].docID == "B"_sl);
     CHECK(changes[1].docID == "Z"_sl);
 }
+
+
+TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker Since", "[notification]") {
+    // Change 10 docs 10 times each; only their latest sequences should be findable:
+    tracker.beginTransaction();
+    for (int i = 0; i < 100; ++i) {
+        char docID[10];
+        sprintf(docID, "doc-%d", i % 10);
+        tracker.documentChanged(alloc_slice(slice(docID)), "1-aa"_asl, ++seq);
+    }
+    tracker.endTransaction(true);
+
+    REQUIRE(since(0)->docID == "doc-0"_sl);
+    REQUIRE(since(0)->sequence == 91);
+    REQUIRE(since(90)->sequence == 91);
+    REQUIRE(since(91)->docID == "doc-1"_sl);
+    REQUIRE(since(95)->docID == "doc-5"_sl);
+    REQUIRE(since(99)->docID == "doc-9"_sl);
+    REQUIRE(since(100) == end());
+
+    DatabaseChangeNotifier cn(tracker, nullptr, 95);
+    SequenceTracker::Change changes[10];
+    bool external;
+    REQUIRE(cn.readChanges(changes, 10, external) == 5);
+    CHECK(changes[0].sequence == 96);
+    CHECK(changes[4].sequence == 100);
+}
+
+
+TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker HasChanges", "[notification]") {
+    DatabaseChangeNotifier cn1(tracker, nullptr);
+    DatabaseChangeNotifier cn2(tracker, nullptr);
+    CHECK(!cn1.hasChanges());
+    CHECK(!cn2.hasChanges());
+
+    SequenceTracker::Change changes[10];
+    bool external;
+    tracker.beginTransaction();
+    tracker.documentChanged("A"_asl, "1-aa"_asl, ++seq);
+    tracker.documentChanged("B"_asl, "1-bb"_asl, ++seq);
+    CHECK(cn1.hasChanges());
+    CHECK(cn2.hasChanges());
+
+    REQUIRE(cn1.readChanges(changes, 10, external) == 2);
+    REQUIRE_IF_DEBUG(dump() == "[*, (A@1, B@2, *)]");
+    CHECK(!cn1.hasChanges());
+    CHECK(cn2.hasChanges());
+
+    tracker.documentChanged("A"_asl, "2-aa"_asl, ++seq);
+    REQUIRE_IF_DEBUG(dump() == "[*, (B@2, *, A@3)]");
+    CHECK(cn1.hasChanges());
+    CHECK(cn2.hasChanges());
+
+    REQUIRE(cn1.readChanges(changes, 10, external) == 1);
+    REQUIRE(cn2.readChanges(changes, 10, external) == 2);
+    CHECK(!cn1.hasChanges());
+    CHECK(!cn2.hasChanges());
+    tracker.endTransaction(true);
+    CHECK(!cn1.hasChanges());
+}
+
+
+TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker MaxChanges", "[notification]") {
+    tracker.setMaxChanges(3);
+    DatabaseChangeNotifier cn1(tracker, nullptr);
+    DatabaseChangeNotifier cn2(tracker, nullptr);
+    SequenceTracker::Change changes[10];
+    bool external;
+
+    tracker.beginTransaction();
+    tracker.documentChanged("A"_asl, "1-aa"_asl, ++seq);
+    int countA = 0;
+    DocChangeNotifier cnA(tracker, "A"_sl, [&](DocChangeNotifier&,slice,sequence_t) {++countA;});
+    tracker.documentChanged("B"_asl, "1-bb"_asl, ++seq);
+    tracker.documentChanged("C"_asl, "1-cc"_asl, ++seq);
+    tracker.documentChanged("D"_asl, "1-dd"_asl, ++seq);
+    tracker.documentChanged("E"_asl, "1-ee"_asl, ++seq);
+    // Nothing is discarded until the transaction ends:
+    REQUIRE_IF_DEBUG(dump() == "[*, *, (A@1, B@2, C@3, D@4, E@5)]");
+    tracker.endTransaction(true);
+    REQUIRE_IF_DEBUG(dump() == "[*, *, C@3, D@4, E@5]");
+
+    CHECK(cn1.missedChanges());
+    CHECK(!cn1.missedChanges());    // flag was reset
+    REQUIRE(cn1.readChanges(changes, 10, external) == 3);
+    CHECK(changes[0].docID == "C"_sl);
+    CHECK(changes[2].docID == "E"_sl);
+    REQUIRE_IF_DEBUG(dump() == "[*, C@3, D@4, E@5, *]");
+
+    // A was discarded, but its DocChangeNotifier still works:
+    tracker.beginTransaction();
+    tracker.documentChanged("A"_asl, "2-aa"_asl, ++seq);
+    tracker.endTransaction(true);
+    CHECK(countA == 1);
+    REQUIRE_IF_DEBUG(dump() == "[*, D@4, E@5, *, A@6]");
+
+    CHECK(!cn1.missedChanges());
+    REQUIRE(cn1.readChanges(changes, 10, external) == 1);
+    CHECK(changes[0].docID == "A"_sl);
+
+    CHECK(cn2.missedChanges());
+    REQUIRE(cn2.readChanges(changes, 10, external) == 3);
+    CHECK(changes[0].docID == "D"_sl);
+    CHECK(changes[1].docID == "E"_sl);
+    CHECK(changes[2].docID == "A"_sl);
+    CHECK(changes[2].sequence == 6);
+
+    // Removing the limit keeps everything again:
+    tracker.setMaxChanges(0);
+    tracker.beginTransaction();
+    tracker.documentChanged("F"_asl, "1-ff"_asl, ++seq);
+    tracker.documentChanged("G"_asl, "1-gg"_asl, ++seq);
+    tracker.endTransaction(true);
+    REQUIRE_IF_DEBUG(dump() == "[D@4, E@5, A@6, *, *, F@7, G@8]");
+    CHECK(!cn2.missedChanges());
+
+    // A notifier starting before a discarded change has missed it:
+    DatabaseChangeNotifier cn3(tracker, nullptr, 2);
+    CHECK(cn3.missedChanges());
+    DatabaseChangeNotifier cn4(tracker, nullptr, 3);
+    CHECK(!cn4.missedChanges());
+    REQUIRE(cn4.readChanges(changes, 10, external) == 5);
+    CHECK(changes[0].docID == "D"_sl);
+}
@@ -7,6 +7,8 @@
 //
 
 #include "VersionedDocument.hh"
+#include "RawRevTree.hh"
+#include "DocumentMeta.hh"
 #include "LiteCoreTest.hh"
 
 
@@ -168,3 +170,73 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "VersionedDocument DocType", "[Vers
         REQUIRE(v.docType() == "moose"_sl);
     }
 }
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "VersionedDocument StorageLayout", "[VersionedDocument]") {
+    revidBuffer rev1ID("1-aaaa"_sl), rev2ID("2-bbbb"_sl), rev3ID("3-cccc"_sl);
+    litecore::slice rev1Data("body of revision 1"), rev2Data("body of revision 2"),
+                    rev3Data("body of revision 3");
+    int httpStatus;
+
+    // Write a record the old way, with the bodies inside the tree:
+    {
+        RevTree tree;
+        tree.insert(rev1ID, rev1Data, Rev::kKeepBody, revid(), false, httpStatus);
+        tree.insert(rev2ID, rev2Data, (Rev::Flags)0, rev1ID, false, httpStatus);
+        DocumentMeta meta(DocumentFlags::kNone, (revid)rev2ID, nullslice);
+        Transaction t(db);
+        store->set("foo"_sl, meta.encode(), tree.encode(), t);
+        t.commit();
+    }
+    Record rec = store->get("foo"_sl);
+    CHECK(RawRevision::getCurrentRevBody(rec.body()) == rev2Data);
+    {
+        VersionedDocument v(*store, "foo"_sl);
+        REQUIRE(v.revID() == (revid)rev2ID);
+        REQUIRE(v.currentRevision()->body() == rev2Data);
+        REQUIRE(v.get(rev1ID)->body() == rev1Data);
+        v.insert(rev3ID, rev3Data, (Rev::Flags)0, rev2ID, false, httpStatus);
+        REQUIRE(httpStatus == 201);
+        Transaction t(db);
+        v.save(t);
+        t.commit();
+    }
+
+    // Saving it again moves the tree into the record's extra, if the KeyStore supports it:
+    rec = store->get("foo"_sl);
+    if (store->supportsExtra()) {
+        REQUIRE(rec.extra());
+        // The body holds the retained bodies, ending with the current revision's:
+        CHECK(rec.body() == "body of revision 1body of revision 3"_sl);
+    } else {
+        CHECK_FALSE(rec.extra());
+        CHECK(RawRevision::getCurrentRevBody(rec.body()) == rev3Data);
+    }
+    Record metaRec = store->get("foo"_sl, kMetaOnly);
+    CHECK(metaRec.body().buf == nullptr);
+    CHECK(metaRec.extra() == rec.extra());
+
+    VersionedDocument v(*store, metaRec);
+    if (store->supportsExtra()) {
+        // A meta-only read decodes the tree, but leaves the bodies unloaded:
+        REQUIRE(v.revsAvailable());
+        REQUIRE(v.size() == 3);
+        CHECK(v.currentRevision()->revID == (revid)rev3ID);
+        CHECK(v.currentRevision()->isBodyAvailable());
+        CHECK_FALSE(v.currentRevision()->isBodyLoaded());
+        CHECK(v.currentRevision()->body().buf == nullptr);
+        CHECK_FALSE(v.get(rev2ID)->isBodyAvailable());
+        CHECK_FALSE(v.bodiesLoaded());
+        REQUIRE(v.loadBodies());
+        CHECK(v.bodiesLoaded());
+    } else {
+        REQUIRE_FALSE(v.revsAvailable());
+        v.read();
+    }
+    REQUIRE(v.revsAvailable());
+    REQUIRE(v.size() == 3);
+    CHECK(v.currentRevision()->revID == (revid)rev3ID);
+    CHECK(v.currentRevision()->body() == rev3Data);
+    CHECK_FALSE(v.get(rev2ID)->isBodyAvailable());
+    CHECK(v.get(rev1ID)->body() == rev1Data);
+}
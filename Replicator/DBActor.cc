@@ -8,6 +8,7 @@
 
 #include "DBActor.hh"
 #include "Pusher.hh"
+#include "JSONDelta.hh"
 #include "FleeceCpp.hh"
 #include "BLIPConnection.hh"
 #include "Message.hh"
@@ -31,6 +32,9 @@ namespace litecore { namespace repl {
     static constexpr auto kInsertionDelay = chrono::milliseconds(50);
 
     static constexpr size_t kMinBodySizeToCompress = 500;
+
+    // Revisions smaller than this are always sent whole, not as deltas:
+    static constexpr size_t kMinBodySizeForDelta = 200;
     
 
     static bool isNotFoundError(C4Error err) {
@@ -38,6 +42,44 @@ namespace litecore { namespace repl {
     }
 
 
+    static bool isUnderscored(slice key) {
+        return key.size > 0 && key[0] == '_';
+    }
+
+
+    // If any top-level property names of a Fleece-encoded body begin with an underscore,
+    // replaces the body with a copy without those properties, as the Puller does to JSON bodies.
+    static void stripUnderscoredProperties(C4SliceResult &body, C4Database *db) {
+        FLSharedKeys sk = c4db_getFLSharedKeys(db);
+        Dict root = Value::fromTrustedData({body.buf, body.size}).asDict();
+        bool any = false;
+        for (Dict::iterator i(root, sk); i; ++i) {
+            if (isUnderscored(i.keyString())) {
+                any = true;
+                break;
+            }
+        }
+        if (!any)
+            return;
+
+        FLEncoder enc = c4db_createFleeceEncoder(db);
+        FLEncoder_BeginDict(enc, root.count());
+        for (Dict::iterator i(root, sk); i; ++i) {
+            slice key = i.keyString();
+            if (!isUnderscored(key)) {
+                FLEncoder_WriteKey(enc, {key.buf, key.size});
+                FLEncoder_WriteValue(enc, i.value());
+            }
+        }
+        FLEncoder_EndDict(enc);
+        FLError flErr;
+        C4SliceResult stripped = FLEncoder_Finish(enc, &flErr);
+        FLEncoder_Free(enc);
+        c4slice_free(body);
+        body = stripped;
+    }
+
+
     DBActor::DBActor(Connection *connection,
                      Replicator *replicator,
                      C4Database *db,
@@ -50,6 +92,25 @@ namespace litecore { namespace repl {
     {
         registerHandler("getCheckpoint",    &DBActor::handleGetCheckpoint);
         registerHandler("setCheckpoint",    &DBActor::handleSetCheckpoint);
+
+        // Only a pusher sends revisions, so a pull-only replicator doesn't need loaders:
+        unsigned nLoaders = (options.push != kC4Disabled) ? options.revLoaders : 0;
+        for (unsigned i = 0; i < nLoaders; ++i) {
+            Retained<RevLoader> loader = RevLoader::create(connection, replicator, this, db,
+                                                           _insertDocumentMetadata, options);
+            if (!loader) {
+                warn("Couldn't open database connection for loading revisions");
+                break;
+            }
+            _revLoaders.push_back(loader);
+        }
+    }
+
+
+    void DBActor::_connectionClosed() {
+        for (auto &loader : _revLoaders)
+            loader->connectionClosed();
+        ReplActor::_connectionClosed();
     }
 
 
@@ -196,23 +257,11 @@ namespace litecore { namespace repl {
                               Retained<Pusher> pusher)
     {
         log("Reading %u local changes from %llu", limit, since);
-        vector<Rev> changes;
+        _lastSequenceSent = max(_lastSequenceSent, since);
         C4Error error = {};
-        C4EnumeratorOptions options = kC4DefaultEnumeratorOptions;
-        options.flags &= ~kC4IncludeBodies;
-        options.flags |= kC4IncludeDeleted;
-        c4::ref<C4DocEnumerator> e = c4db_enumerateChanges(_db, since, &options, &error);
-        if (e) {
-            changes.reserve(limit);
-            while (c4enum_next(e, &error) && limit > 0) {
-                C4DocumentInfo info;
-                c4enum_getDocumentInfo(e, &info);
-                changes.emplace_back(info);
-                --limit;
-            }
-        }
+        vector<Rev> changes = readChanges(since, limit, &error);
 
-        if (continuous && limit > 0 && !_changeObserver) {
+        if (continuous && changes.size() < limit && !_changeObserver) {
             // Reached the end of history; now start observing for future changes
             _pusher = pusher;
             _changeObserver = c4dbobs_create(_db,
@@ -227,6 +276,28 @@ namespace litecore { namespace repl {
     }
 
 
+    // Reads up to `limit` changes after sequence `since` from the database.
+    vector<Rev> DBActor::readChanges(C4SequenceNumber since, unsigned limit, C4Error *outError) {
+        vector<Rev> changes;
+        C4EnumeratorOptions options = kC4DefaultEnumeratorOptions;
+        options.flags &= ~kC4IncludeBodies;
+        options.flags |= kC4IncludeDeleted;
+        c4::ref<C4DocEnumerator> e = c4db_enumerateChanges(_db, since, &options, outError);
+        if (e) {
+            changes.reserve(limit);
+            while (limit > 0 && c4enum_next(e, outError)) {
+                C4DocumentInfo info;
+                c4enum_getDocumentInfo(e, &info);
+                changes.emplace_back(info);
+                --limit;
+            }
+        }
+        if (!changes.empty())
+            _lastSequenceSent = max(_lastSequenceSent, changes.back().sequence);
+        return changes;
+    }
+
+
     // Callback from the C4DatabaseObserver when the database has changed
     void DBActor::dbChanged() {
         static const uint32_t kMaxChanges = 100;
@@ -236,14 +307,35 @@ namespace litecore { namespace repl {
         vector<Rev> changes;
         while (true) {
             nChanges = c4dbobs_getChanges(_changeObserver, c4changes, kMaxChanges, &external);
+            if (c4dbobs_missedChanges(_changeObserver)) {
+                // The observer dropped some changes, so get them from the database instead;
+                // that covers everything the observer has queued up too.
+                warn("Database observer fell too far behind; reading changes since %llu",
+                     _lastSequenceSent);
+                while (c4dbobs_getChanges(_changeObserver, c4changes, kMaxChanges, &external) > 0)
+                    ;
+                C4Error error = {};
+                do {
+                    changes = readChanges(_lastSequenceSent, kMaxChanges, &error);
+                    if (!changes.empty() || error.code)
+                        _pusher->gotChanges(changes, error);
+                } while (changes.size() == kMaxChanges && !error.code);
+                continue;
+            }
             if (nChanges == 0)
                 break;
             log("Notified of %u db changes %llu ... %llu",
                 nChanges, c4changes[0].sequence, c4changes[nChanges-1].sequence);
+            changes.clear();
             C4DatabaseChange *c4change = c4changes;
             for (uint32_t i = 0; i < nChanges; ++i, ++c4change) {
-                changes.emplace_back(c4change->docID, c4change->revID, c4change->sequence);
+                // Skip changes already read from the database after a miss:
+                if (c4change->sequence > _lastSequenceSent)
+                    changes.emplace_back(c4change->docID, c4change->revID, c4change->sequence);
             }
+            if (changes.empty())
+                continue;
+            _lastSequenceSent = changes.back().sequence;
             C4Error error = {};
             _pusher->gotChanges(changes, error);
         }
@@ -253,7 +345,6 @@ namespace litecore { namespace repl {
     // Called by the Pusher; it passes on the "changes" message
     void DBActor::_findOrRequestRevs(Retained<MessageIn> req,
                                      function<void(vector<alloc_slice>)> callback) {
-        // Iterate over the array in the message, seeing whether I have each revision:
         auto changes = req->JSONBody().asArray();
         if (willLog() && !changes.empty()) {
             alloc_slice firstSeq(changes[0].asArray()[0].toString());
@@ -261,41 +352,55 @@ namespace litecore { namespace repl {
             log("Looking up %u revisions in the db (seq '%.*s'..'%.*s')",
                 changes.count(), SPLAT(firstSeq), SPLAT(lastSeq));
         }
+        // Look up all the revisions in the message in one batch, to see which ones I have:
+        unsigned count = changes.count();
+        vector<C4String> docIDs(count), revIDs(count);
+        for (unsigned i = 0; i < count; ++i) {
+            auto change = changes[i].asArray();
+            docIDs[i] = change[1].asString();
+            revIDs[i] = change[2].asString();
+            if (!docIDs[i].buf || !revIDs[i].buf) {
+                warn("Invalid entry in 'changes' message");
+                return;     // ???  Should this abort the replication?
+            }
+        }
+        vector<C4SliceResult> ancestors(count);
+        C4Error err;
+        if (!c4db_findDocAncestors(_db, count, kMaxPossibleAncestors,
+                                   docIDs.data(), revIDs.data(), ancestors.data(), &err)) {
+            gotError(err);
+            return;
+        }
+
         MessageBuilder response(req);
         response["maxHistory"_sl] = c4db_getMaxRevTreeDepth(_db);
+        if (_options.deltas)
+            response["deltas"_sl] = "true"_sl;
         vector<alloc_slice> requestedSequences;
-        unsigned i = 0, itemsWritten = 0, requested = 0;
-        vector<alloc_slice> ancestors;
+        unsigned itemsWritten = 0, requested = 0;
         auto &encoder = response.jsonBody();
         encoder.beginArray();
-        for (auto item : changes) {
-            auto change = item.asArray();
-            slice docID = change[1].asString();
-            slice revID = change[2].asString();
-            if (!docID || !revID) {
-                warn("Invalid entry in 'changes' message");
-                return;     // ???  Should this abort the replication?
-            }
-
-            if (!findAncestors(docID, revID, ancestors)) {
+        for (unsigned i = 0; i < count; ++i) {
+            if (ancestors[i].buf) {
                 // I don't have this revision, so request it:
                 ++requested;
                 while (++itemsWritten < i)
                     encoder.writeInt(0);
                 encoder.beginArray();
-                for (slice ancestor : ancestors)
-                    encoder.writeString(ancestor);
+                for (Array::iterator a(Value::fromData(slice(ancestors[i].buf, ancestors[i].size))
+                                            .asArray()); a; ++a)
+                    encoder.writeString(a.value().asString());
                 encoder.endArray();
+                c4slice_free(ancestors[i]);
 
                 if (callback) {
-                    alloc_slice sequence(change[0].toString()); //FIX: Should quote strings
+                    alloc_slice sequence(changes[i].asArray()[0].toString()); //FIX: Should quote strings
                     if (sequence)
                         requestedSequences.push_back(sequence);
                     else
                         warn("Empty/invalid sequence in 'changes' message");
                 }
             }
-            ++i;
         }
         encoder.endArray();
 
@@ -310,6 +415,18 @@ namespace litecore { namespace repl {
 #pragma mark - REVISIONS:
 
 
+    // Routes a "rev" request to a RevLoader, or handles it on this actor if there are none.
+    // The loader is picked by docID, so revisions of any one document are sent in order.
+    void DBActor::sendRevision(const RevRequest &request, MessageProgressCallback onProgress) {
+        if (_revLoaders.empty())
+            return enqueue(&DBActor::_sendRevision, request, onProgress);
+        size_t hash = 0;
+        for (size_t i = 0; i < request.docID.size; ++i)
+            hash = hash * 31 + request.docID[i];
+        _revLoaders[hash % _revLoaders.size()]->sendRevision(request, onProgress);
+    }
+
+
     // Sends a document revision in a "rev" request.
     void DBActor::_sendRevision(RevRequest request,
                                 MessageProgressCallback onProgress)
@@ -318,13 +435,66 @@ namespace litecore { namespace repl {
             return;
         logVerbose("Sending revision '%.*s' #%.*s",
                    SPLAT(request.docID), SPLAT(request.revID));
+        MessageBuilder msg("rev"_sl);
+        bool isDelta;
         C4Error c4err;
-        c4::ref<C4Document> doc = c4doc_get(_db, request.docID, true, &c4err);
-        if (!doc)
-            return gotError(c4err);
-        if (!c4doc_selectRevision(doc, request.revID, true, &c4err))
+        if (!encodeRevision(_db, request, _insertDocumentMetadata, msg, isDelta, &c4err))
             return gotError(c4err);
+        msg.noreply = !onProgress && !isDelta;
+        sendRequest(msg, isDelta ? deltaFallback(request, onProgress) : onProgress);
+    }
+
+
+    // Called when a RevLoader fails to read a revision. A revision that was saved in a commit
+    // group that hasn't been committed yet isn't visible on the loader's connection, so retry
+    // a missing revision on my own connection before reporting it.
+    void DBActor::_loaderFailed(RevRequest request, MessageProgressCallback onProgress,
+                                C4Error err)
+    {
+        if (isNotFoundError(err))
+            _sendRevision(request, onProgress);
+        else
+            gotError(err);
+    }
+
+
+    // Reads a revision from `db` and writes it into a "rev" message. This is static so that
+    // RevLoaders can call it on their own database connections.
+    bool DBActor::encodeRevision(C4Database *db,
+                                 const RevRequest &request,
+                                 bool insertDocumentMetadata,
+                                 MessageBuilder &msg,
+                                 bool &outIsDelta,
+                                 C4Error *outError)
+    {
+        outIsDelta = false;
+        c4::ref<C4Document> doc = c4doc_get(db, request.docID, true, outError);
+        if (!doc || !c4doc_selectRevision(doc, request.revID, true, outError))
+            return false;
         slice revisionBody = doc->selectedRev.body;
+        bool deleted = (doc->selectedRev.flags & kRevDeleted) != 0;
+        auto sk = c4db_getFLSharedKeys(db);
+        auto root = Value::fromTrustedData(revisionBody).asDict();
+        assert(root);
+
+        // If the peer accepts deltas, diff against the first known ancestor that has a body:
+        alloc_slice delta, deltaSrc;
+        if (request.deltaOK && !deleted && revisionBody.size >= kMinBodySizeForDelta) {
+            for (auto &ancestor : request.ancestorRevIDs) {
+                if (c4doc_selectRevision(doc, ancestor, true, nullptr) && doc->selectedRev.body.buf) {
+                    auto ancestorRoot = Value::fromTrustedData(doc->selectedRev.body).asDict();
+                    if (ancestorRoot) {
+                        delta = createJSONDelta(ancestorRoot, root, sk);
+                        if (delta.size < revisionBody.size / 2)
+                            deltaSrc = ancestor;
+                        else
+                            delta = nullslice;      // not worth it
+                    }
+                    break;
+                }
+            }
+            c4doc_selectRevision(doc, request.revID, false, nullptr);
+        }
 
         // Generate the revision history string:
         set<pure_slice> ancestors(request.ancestorRevIDs.begin(), request.ancestorRevIDs.end());
@@ -341,23 +511,23 @@ namespace litecore { namespace repl {
         }
         string history = historyStream.str();
 
-        // Now send the BLIP message:
-        MessageBuilder msg("rev"_sl);
-        msg.noreply = !onProgress;
+        // Now fill in the BLIP message:
         msg.compressed = (revisionBody.size >= kMinBodySizeToCompress);
         msg["id"_sl] = request.docID;
         msg["rev"_sl] = request.revID;
         msg["sequence"_sl] = request.sequence;
-        if (doc->selectedRev.flags & kRevDeleted)
+        if (deleted)
             msg["deleted"_sl] = "1"_sl;
         if (!history.empty())
             msg["history"_sl] = history;
 
-        auto root = Value::fromTrustedData(revisionBody).asDict();
-        assert(root);
-        if (_insertDocumentMetadata) {
+        if (deltaSrc) {
+            msg["deltaSrc"_sl] = deltaSrc;
+            msg.compressed = (delta.size >= kMinBodySizeToCompress);
+            msg.write(delta);
+            outIsDelta = true;
+        } else if (insertDocumentMetadata) {
             // SG currently requires the metatada properties in the document:
-            auto sk = c4db_getFLSharedKeys(_db);
             JSONEncoder enc;
             enc.setSharedKeys(sk);
             enc.beginDict();
@@ -365,7 +535,7 @@ namespace litecore { namespace repl {
             enc.writeString(request.docID);
             enc.writeKey("_rev"_sl);
             enc.writeString(request.revID);
-            if (doc->selectedRev.flags & kRevDeleted) {
+            if (deleted) {
                 enc.writeKey("deleted"_sl);
                 enc.writeBool(true);
             }
@@ -377,10 +547,39 @@ namespace litecore { namespace repl {
             alloc_slice json = enc.finish();
             msg.write(json);
         } else {
-            msg.jsonBody().setSharedKeys(c4db_getFLSharedKeys(_db));
+            msg.jsonBody().setSharedKeys(sk);
             msg.jsonBody().writeValue(root);        // encode as JSON
         }
-        sendRequest(msg, onProgress);
+        return true;
+    }
+
+
+    // The peer may no longer have a delta's source revision; if so, the whole revision is sent.
+    // Returns the progress callback for the delta message, which always needs the reply even if
+    // the caller (`onProgress`) doesn't.
+    MessageProgressCallback DBActor::deltaFallback(const RevRequest &request,
+                                                   MessageProgressCallback onProgress)
+    {
+        Retained<DBActor> self = this;
+        return [=](MessageProgress progress) {
+            if (progress.reply && progress.reply->isError()
+                    && isNotFoundError(blipToC4Error(progress.reply->getError()))) {
+                self->logVerbose("Peer lacks delta source of '%.*s' #%.*s; resending it whole",
+                                 SPLAT(request.docID), SPLAT(request.revID));
+                RevRequest fullRequest = request;
+                fullRequest.deltaOK = false;
+                // Report only the retry's reply, as though it were this message's:
+                auto bytesSent = progress.bytesSent;
+                self->sendRevision(fullRequest, [=](MessageProgress retryProgress) {
+                    if (retryProgress.reply && onProgress) {
+                        retryProgress.bytesSent = bytesSent;
+                        onProgress(retryProgress);
+                    }
+                });
+            } else if (onProgress) {
+                onProgress(progress);
+            }
+        };
     }
 
 
@@ -395,6 +594,35 @@ namespace litecore { namespace repl {
     }
 
 
+    // Reconstructs a revision body from a delta against an existing revision. If that revision
+    // or its body is gone, returns null and sets a NotFound error, which tells the peer to send
+    // the whole revision instead. Like a full body, the result has no top-level properties
+    // whose names begin with an underscore.
+    C4SliceResult DBActor::applyDelta(const RevToInsert &rev, C4Error *outError) {
+        c4::ref<C4Document> doc = c4doc_get(_db, rev.docID, true, outError);
+        if (!doc || !c4doc_selectRevision(doc, rev.deltaSrc, true, outError)
+                 || !doc->selectedRev.body.buf) {
+            *outError = {LiteCoreDomain, kC4ErrorNotFound};
+            return {};
+        }
+        FLError flErr;
+        alloc_slice deltaFleece = Encoder::convertJSON(rev.body, &flErr);
+        Dict deltaRoot = Value::fromTrustedData(deltaFleece).asDict();
+        Dict srcRoot = Value::fromTrustedData(doc->selectedRev.body).asDict();
+        FLEncoder enc = c4db_createFleeceEncoder(_db);
+        C4SliceResult body = {};
+        if (deltaRoot && srcRoot
+                && applyJSONDelta(srcRoot, deltaRoot, c4db_getFLSharedKeys(_db), enc))
+            body = FLEncoder_Finish(enc, &flErr);
+        FLEncoder_Free(enc);
+        if (body.buf)
+            stripUnderscoredProperties(body, _db);
+        if (!body.buf)
+            *outError = {LiteCoreDomain, kC4ErrorCorruptData};
+        return body;
+    }
+
+
     void DBActor::_insertRevisionsNow() {
         __typeof(_revsToInsert) revs;
         {
@@ -419,8 +647,23 @@ namespace litecore { namespace repl {
                     history.push_back(slice(pos, comma));
                     pos = comma + 1;
                 }
+                // Encode the body inside the transaction, so it can add to the shared keys:
+                C4Error docErr;
+                C4SliceResult body;
+                if (rev->deltaSrc)
+                    body = applyDelta(*rev, &docErr);
+                else
+                    body = c4db_encodeJSON(_db, rev->body, &docErr);
+                if (!body.buf) {
+                    warn("Couldn't decode body of '%.*s' #%.*s : error %d/%d",
+                         SPLAT(rev->docID), SPLAT(rev->revID), docErr.domain, docErr.code);
+                    if (rev->onInserted)
+                        rev->onInserted(docErr);
+                    continue;
+                }
+
                 C4DocPutRequest put = {};
-                put.body = rev->body;
+                put.body = {body.buf, body.size};
                 put.docID = rev->docID;
                 put.revFlags = rev->deleted ? kRevDeleted : 0;
                 put.existingRevision = true;
@@ -429,8 +672,8 @@ namespace litecore { namespace repl {
                 put.historyCount = history.size();
                 put.save = true;
 
-                C4Error docErr;
                 c4::ref<C4Document> doc = c4doc_put(_db, &put, nullptr, &docErr);
+                c4slice_free(body);
                 if (!doc)
                     warn("Failed to insert '%.*s' #%.*s : error %d/%d",
                          SPLAT(rev->docID), SPLAT(rev->revID), docErr.domain, docErr.code);
@@ -456,28 +699,5 @@ namespace litecore { namespace repl {
     }
 
 
-    // Returns true if revision exists; else returns false and sets ancestors to an array of
-    // ancestor revisions I do have (empty if doc doesn't exist at all)
-    bool DBActor::findAncestors(slice docID, slice revID, vector<alloc_slice> &ancestors) {
-        C4Error err;
-        c4::ref<C4Document> doc = c4doc_get(_db, docID, true, &err);
-        bool revExists = doc && c4doc_selectRevision(doc, revID, false, &err);
-        if (!revExists) {
-            ancestors.resize(0);
-            if (!isNotFoundError(err)) {
-                gotError(err);
-            } else if (doc) {
-                // Revision isn't found, but look for ancestors:
-                if (c4doc_selectFirstPossibleAncestorOf(doc, revID)) {
-                    do {
-                        ancestors.emplace_back(doc->selectedRev.revID);
-                    } while (c4doc_selectNextPossibleAncestorOf(doc, revID)
-                             && ancestors.size() < kMaxPossibleAncestors);
-                }
-            }
-        }
-        return revExists;
-    }
-
     
 } }
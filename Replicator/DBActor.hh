@@ -9,6 +9,7 @@
 #pragma once
 #include "ReplicatorTypes.hh"
 #include "ReplActor.hh"
+#include "RevLoader.hh"
 #include <string>
 #include <vector>
 
@@ -45,13 +46,16 @@ namespace litecore { namespace repl {
         }
 
         void sendRevision(const RevRequest &request,
-                          blip::MessageProgressCallback onProgress) {
-            enqueue(&DBActor::_sendRevision, request, onProgress);
-        }
+                          blip::MessageProgressCallback onProgress);
 
         void insertRevision(std::shared_ptr<RevToInsert> rev);
 
+    protected:
+        virtual void _connectionClosed() override;
+
     private:
+        friend class RevLoader;
+
         void handleGetCheckpoint(Retained<blip::MessageIn>);
         void handleSetCheckpoint(Retained<blip::MessageIn>);
         bool getPeerCheckpointDoc(blip::MessageIn* request, bool getting,
@@ -62,21 +66,31 @@ namespace litecore { namespace repl {
         void _setCheckpoint(alloc_slice data, std::function<void()> onComplete);
         void _getChanges(C4SequenceNumber since, unsigned limit, bool continuous,
                          Retained<Pusher>);
+        std::vector<Rev> readChanges(C4SequenceNumber since, unsigned limit, C4Error*);
         void _findOrRequestRevs(Retained<blip::MessageIn> req,
                                 std::function<void(std::vector<alloc_slice>)> callback);
         void _sendRevision(RevRequest request,
                            blip::MessageProgressCallback onProgress);
+        static bool encodeRevision(C4Database*,
+                                   const RevRequest&,
+                                   bool insertDocumentMetadata,
+                                   blip::MessageBuilder&,
+                                   bool &outIsDelta,
+                                   C4Error *outError);
+        blip::MessageProgressCallback deltaFallback(const RevRequest&,
+                                                    blip::MessageProgressCallback);
+        void _loaderFailed(RevRequest request,
+                           blip::MessageProgressCallback onProgress,
+                           C4Error err);
         void _insertRevision(std::shared_ptr<RevToInsert> rev);
 
 
         void insertRevisionsNow()   {enqueue(&DBActor::_insertRevisionsNow);}
         void _insertRevisionsNow();
+        C4SliceResult applyDelta(const RevToInsert&, C4Error *outError);
 
             void dbChanged();
 
-        bool findAncestors(slice docID, slice revID,
-                           std::vector<alloc_slice> &ancestors);
-
         static const size_t kMaxPossibleAncestors = 10;
 
         C4Database* const _db;
@@ -84,6 +98,8 @@ namespace litecore { namespace repl {
         std::string _remoteCheckpointDocID;
         c4::ref<C4DatabaseObserver> _changeObserver;
         Retained<Pusher> _pusher;
+        C4SequenceNumber _lastSequenceSent {0};         // Latest change given to the Pusher
+        std::vector<Retained<RevLoader>> _revLoaders;   // Read & encode revs to push (optional)
         std::unique_ptr<std::vector<std::shared_ptr<RevToInsert>>> _revsToInsert;
         std::mutex _revsToInsertMutex;
         Timer _insertTimer;
@@ -0,0 +1,136 @@
+//
+//  FlowController.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "FlowController.hh"
+#include <algorithm>
+
+using namespace std;
+
+namespace litecore { namespace repl {
+
+    // Initial values, which were the fixed limits before they became adaptive:
+    static const unsigned kInitialChangesBatchSize = 200;
+    static const unsigned kInitialRevsInFlight = 5;
+    static const size_t   kInitialRevBytes = 2*1024*1024;
+
+    // Weight of each new sample in the smoothed latency and throughput:
+    static constexpr double kSmoothing = 1.0 / 8;
+
+    // How often the throughput is sampled:
+    static constexpr auto kRateInterval = chrono::milliseconds(250);
+
+
+    template <class T>
+    static T clampTo(T value, T minValue, T maxValue) {
+        return max(minValue, min(value, maxValue));
+    }
+
+
+    // Makes every minimum at least 1 (a limit of 0 would stall the push) and every maximum
+    // at least its minimum.
+    static FlowController::Limits validated(FlowController::Limits limits) {
+        limits.minChangesBatchSize = max(limits.minChangesBatchSize, 1u);
+        limits.maxChangesBatchSize = max(limits.maxChangesBatchSize, limits.minChangesBatchSize);
+        limits.minRevsInFlight = max(limits.minRevsInFlight, 1u);
+        limits.maxRevsInFlight = max(limits.maxRevsInFlight, limits.minRevsInFlight);
+        limits.minRevBytesAwaitingReply = max(limits.minRevBytesAwaitingReply, (size_t)1);
+        limits.maxRevBytesAwaitingReply = max(limits.maxRevBytesAwaitingReply,
+                                              limits.minRevBytesAwaitingReply);
+        return limits;
+    }
+
+
+    FlowController::FlowController(const Limits &limits)
+    :_limits(validated(limits))
+    ,_changesBatchSize(clampTo(kInitialChangesBatchSize,
+                               _limits.minChangesBatchSize, _limits.maxChangesBatchSize))
+    ,_maxRevsInFlight(clampTo(kInitialRevsInFlight,
+                              _limits.minRevsInFlight, _limits.maxRevsInFlight))
+    ,_maxRevBytes(clampTo(kInitialRevBytes,
+                          _limits.minRevBytesAwaitingReply, _limits.maxRevBytesAwaitingReply))
+    ,_rateStart(clock::now())
+    { }
+
+
+    void FlowController::revAcknowledged(size_t bytes, clock::time_point sentAt) {
+        auto now = clock::now();
+        double latency = chrono::duration<double>(now - sentAt).count();
+
+        // Track the smoothed latency, and the minimum over the last full epoch:
+        _latency = _latency > 0 ? _latency + kSmoothing * (latency - _latency) : latency;
+        if (_epochSamples == 0 || latency < _epochMinLatency)
+            _epochMinLatency = latency;
+        if (_minLatency == 0 || latency < _minLatency)
+            _minLatency = latency;
+        if (++_epochSamples >= kMinLatencyEpoch) {
+            _minLatency = _epochMinLatency;     // forget minima from long ago
+            _epochSamples = 0;
+        }
+
+        // Sample the throughput:
+        _rateBytes += bytes;
+        auto elapsed = now - _rateStart;
+        if (elapsed >= kRateInterval) {
+            double rate = _rateBytes / chrono::duration<double>(elapsed).count();
+            _bytesPerSec = _bytesPerSec > 0 ? _bytesPerSec + kSmoothing * (rate - _bytesPerSec)
+                                            : rate;
+            _rateBytes = 0;
+            _rateStart = now;
+        }
+
+        if (_latency > kCongestionRatio * _minLatency) {
+            decrease(now);
+        } else {
+            // Additive increase: one more rev (and its share of bytes) per window of acks:
+            _increaseCredit += 1.0 / _maxRevsInFlight;
+            if (_increaseCredit >= 1.0) {
+                _increaseCredit = 0;
+                size_t bytesPerRev = _maxRevBytes / _maxRevsInFlight;
+                _maxRevsInFlight = min(_maxRevsInFlight + 1, _limits.maxRevsInFlight);
+                _maxRevBytes = min(_maxRevBytes + bytesPerRev, _limits.maxRevBytesAwaitingReply);
+            }
+        }
+    }
+
+
+    void FlowController::revFailed() {
+        decrease(clock::now());
+    }
+
+
+    // Multiplicative decrease; at most once per round trip, since the acks arriving during the
+    // next round trip were sent before the previous decrease could take effect.
+    void FlowController::decrease(clock::time_point now) {
+        if (now - _lastDecrease < chrono::duration<double>(_latency))
+            return;
+        _lastDecrease = now;
+        _increaseCredit = 0;
+        _maxRevsInFlight = max(_maxRevsInFlight / 2, _limits.minRevsInFlight);
+        _maxRevBytes = max(_maxRevBytes / 2, _limits.minRevBytesAwaitingReply);
+    }
+
+
+    void FlowController::changesAcknowledged(bool starved, size_t revsQueued) {
+        if (starved)
+            _changesBatchSize = min(2 * _changesBatchSize, _limits.maxChangesBatchSize);
+        else if (revsQueued > 2 * _changesBatchSize)
+            _changesBatchSize = max(_changesBatchSize * 3 / 4, _limits.minChangesBatchSize);
+    }
+
+
+    C4FlowControl FlowController::status() const {
+        C4FlowControl fc;
+        fc.changesBatchSize = _changesBatchSize;
+        fc.maxRevsInFlight = _maxRevsInFlight;
+        fc.maxRevBytesAwaitingReply = _maxRevBytes;
+        fc.latencyMS = (uint32_t)(_latency * 1000);
+        fc.minLatencyMS = (uint32_t)(_minLatency * 1000);
+        fc.bytesPerSec = (uint64_t)_bytesPerSec;
+        return fc;
+    }
+
+} }
@@ -0,0 +1,68 @@
+//
+//  FlowController.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "ReplActor.hh"
+#include <chrono>
+
+namespace litecore { namespace repl {
+
+    /** Adapts the Pusher's pipelining limits to the connection, AIMD-style. The number of
+        revisions in flight, and the bytes awaiting replies, grow by one revision's worth per
+        round trip while replies come back about as fast as the fastest recently seen; when the
+        latency rises well above that (a queue is building up), they're halved.
+        The changes batch size doubles when the Pusher runs out of revisions to send before the
+        next batch is answered, and shrinks when a backlog of revisions builds up.
+        Not thread-safe; it's owned by the Pusher and used on its thread. */
+    class FlowController {
+    public:
+        using Limits = ReplActor::Options::FlowLimits;
+        using clock = std::chrono::steady_clock;
+
+        /** Limits with a minimum of 0, or a maximum below the minimum, are adjusted so that
+            1 <= minimum <= maximum. */
+        explicit FlowController(const Limits&);
+
+        unsigned changesBatchSize() const           {return _changesBatchSize;}
+        unsigned maxRevsInFlight() const            {return _maxRevsInFlight;}
+        size_t maxRevBytesAwaitingReply() const     {return _maxRevBytes;}
+
+        /** Call when a 'rev' message is acknowledged. `sentAt` is when it was sent. */
+        void revAcknowledged(size_t bytes, clock::time_point sentAt);
+
+        /** Call when a 'rev' message fails; treats it as congestion. */
+        void revFailed();
+
+        /** Call when the reply to a 'changes' message arrives. `starved` means there were no
+            revisions waiting or being sent; `revsQueued` is the number waiting to be sent. */
+        void changesAcknowledged(bool starved, size_t revsQueued);
+
+        /** The current limits and measurements, for the replicator status. */
+        C4FlowControl status() const;
+
+    private:
+        void decrease(clock::time_point now);
+
+        static constexpr double kCongestionRatio = 2.0;     // latency/min latency = congested
+        static constexpr unsigned kMinLatencyEpoch = 256;   // # of samples per min-latency epoch
+
+        const Limits _limits;
+        unsigned _changesBatchSize;
+        unsigned _maxRevsInFlight;
+        size_t   _maxRevBytes;
+        double   _increaseCredit {0};               // Fractional progress to the next increase
+        double   _latency {0};                      // Smoothed ack latency (seconds)
+        double   _minLatency {0};                   // Lowest latency of the previous epoch
+        double   _epochMinLatency {0};              // Lowest latency of the current epoch
+        unsigned _epochSamples {0};
+        clock::time_point _lastDecrease;
+        clock::time_point _rateStart;               // Start of current throughput sample
+        size_t   _rateBytes {0};                    // Bytes acknowledged since _rateStart
+        double   _bytesPerSec {0};                  // Smoothed throughput
+    };
+
+} }
@@ -0,0 +1,173 @@
+//
+//  JSONDelta.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "JSONDelta.hh"
+#include <unordered_map>
+
+using namespace std;
+using namespace fleece;
+using namespace fleeceapi;
+
+namespace litecore { namespace repl {
+
+    typedef unordered_map<slice, Value, sliceHash> PropertyMap;
+
+
+    static PropertyMap properties(Dict dict, FLSharedKeys sk) {
+        PropertyMap props;
+        for (Dict::iterator i(dict, sk); i; ++i)
+            props[slice(i.keyString())] = i.value();
+        return props;
+    }
+
+
+    static bool isEqual(FLValue a, FLValue b, FLSharedKeys sk) {
+        FLValueType type = FLValue_GetType(a);
+        if (type != FLValue_GetType(b))
+            return false;
+        switch (type) {
+            case kFLBoolean:
+                return FLValue_AsBool(a) == FLValue_AsBool(b);
+            case kFLNumber:
+                if (FLValue_IsInteger(a) && FLValue_IsInteger(b))
+                    return FLValue_AsInt(a) == FLValue_AsInt(b)
+                        && FLValue_IsUnsigned(a) == FLValue_IsUnsigned(b);
+                return FLValue_AsDouble(a) == FLValue_AsDouble(b);
+            case kFLString:
+                return slice(FLValue_AsString(a)) == slice(FLValue_AsString(b));
+            case kFLData:
+                return slice(FLValue_AsData(a)) == slice(FLValue_AsData(b));
+            case kFLArray: {
+                FLArray arrayA = FLValue_AsArray(a), arrayB = FLValue_AsArray(b);
+                uint32_t count = FLArray_Count(arrayA);
+                if (count != FLArray_Count(arrayB))
+                    return false;
+                for (uint32_t i = 0; i < count; ++i) {
+                    if (!isEqual(FLArray_Get(arrayA, i), FLArray_Get(arrayB, i), sk))
+                        return false;
+                }
+                return true;
+            }
+            case kFLDict: {
+                Dict dictA(FLValue_AsDict(a)), dictB(FLValue_AsDict(b));
+                if (dictA.count() != dictB.count())
+                    return false;
+                PropertyMap propsA = properties(dictA, sk);
+                for (Dict::iterator i(dictB, sk); i; ++i) {
+                    auto prop = propsA.find(slice(i.keyString()));
+                    if (prop == propsA.end() || !isEqual(prop->second, i.value(), sk))
+                        return false;
+                }
+                return true;
+            }
+            default:
+                return true;    // null or undefined
+        }
+    }
+
+
+    static void writeDelta(Dict old, Dict nuu, FLSharedKeys sk, JSONEncoder &enc) {
+        PropertyMap oldProps = properties(old, sk);
+        enc.beginDict();
+        for (Dict::iterator i(nuu, sk); i; ++i) {
+            slice key = i.keyString();
+            Value value = i.value();
+            auto oldProp = oldProps.find(key);
+            if (oldProp != oldProps.end()) {
+                Value oldValue = oldProp->second;
+                oldProps.erase(oldProp);
+                if (isEqual(oldValue, value, sk))
+                    continue;
+                if (FLValue_GetType(oldValue) == kFLDict && FLValue_GetType(value) == kFLDict) {
+                    enc.writeKey(key);
+                    writeDelta(oldValue.asDict(), value.asDict(), sk, enc);
+                    continue;
+                }
+            }
+            enc.writeKey(key);
+            FLValueType type = FLValue_GetType(value);
+            if (type == kFLArray || type == kFLDict) {
+                // Wrap containers in an array, to distinguish them from nested deltas:
+                enc.beginArray();
+                enc.writeValue(value);
+                enc.endArray();
+            } else {
+                enc.writeValue(value);
+            }
+        }
+        for (auto &removed : oldProps) {
+            enc.writeKey(removed.first);
+            enc.beginArray();
+            enc.endArray();
+        }
+        enc.endDict();
+    }
+
+
+    alloc_slice createJSONDelta(Dict old, Dict nuu, FLSharedKeys sharedKeys) {
+        JSONEncoder enc;
+        enc.setSharedKeys(sharedKeys);
+        writeDelta(old, nuu, sharedKeys, enc);
+        return enc.finish();
+    }
+
+
+    static bool applyChange(slice key, FLValue oldValue, FLValue change,
+                            FLSharedKeys sk, FLEncoder enc)
+    {
+        switch (FLValue_GetType(change)) {
+            case kFLArray: {
+                FLArray array = FLValue_AsArray(change);
+                switch (FLArray_Count(array)) {
+                    case 0:
+                        return true;                    // property removed
+                    case 1:
+                        FLEncoder_WriteKey(enc, {key.buf, key.size});
+                        FLEncoder_WriteValue(enc, FLArray_Get(array, 0));
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+            case kFLDict:
+                if (FLValue_GetType(oldValue) != kFLDict)
+                    return false;
+                FLEncoder_WriteKey(enc, {key.buf, key.size});
+                return applyJSONDelta(Dict(FLValue_AsDict(oldValue)), Dict(FLValue_AsDict(change)),
+                                      sk, enc);
+            default:
+                FLEncoder_WriteKey(enc, {key.buf, key.size});
+                FLEncoder_WriteValue(enc, change);
+                return true;
+        }
+    }
+
+
+    bool applyJSONDelta(Dict old, Dict delta, FLSharedKeys sharedKeys, FLEncoder enc) {
+        PropertyMap changes = properties(delta, nullptr);
+        FLEncoder_BeginDict(enc, old.count() + changes.size());
+        for (Dict::iterator i(old, sharedKeys); i; ++i) {
+            slice key = i.keyString();
+            auto change = changes.find(key);
+            if (change == changes.end()) {
+                FLEncoder_WriteKey(enc, {key.buf, key.size});
+                FLEncoder_WriteValue(enc, i.value());
+            } else {
+                if (!applyChange(key, i.value(), change->second, sharedKeys, enc))
+                    return false;
+                changes.erase(change);
+            }
+        }
+        for (auto &change : changes) {
+            if (!applyChange(change.first, nullptr, change.second, sharedKeys, enc))
+                return false;
+        }
+        FLEncoder_EndDict(enc);
+        return true;
+    }
+
+} }
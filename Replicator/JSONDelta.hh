@@ -0,0 +1,27 @@
+//
+//  JSONDelta.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "Fleece.h"
+#include "FleeceCpp.hh"
+#include "slice.hh"
+
+namespace litecore { namespace repl {
+
+    /** Returns a JSON object describing how to change the dictionary `old` into `nuu`. Each of
+        its properties is either a nested delta object, `[]` to remove the property, `[value]`
+        to set the property to an array or object, or any other value to set the property to.
+        Keys of both dictionaries are decoded with `sharedKeys`. */
+    fleece::alloc_slice createJSONDelta(fleeceapi::Dict old, fleeceapi::Dict nuu,
+                                        FLSharedKeys sharedKeys);
+
+    /** Applies a delta made by createJSONDelta (and converted to Fleece) to `old`, writing the
+        resulting dictionary to the encoder. Returns false if the delta doesn't fit `old`. */
+    bool applyJSONDelta(fleeceapi::Dict old, fleeceapi::Dict delta,
+                        FLSharedKeys sharedKeys, FLEncoder enc);
+
+} }
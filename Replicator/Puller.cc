@@ -16,8 +16,7 @@ using namespace fleeceapi;
 
 namespace litecore { namespace repl {
 
-    static bool hasUnderscoredProperties(Dict);
-    alloc_slice stripUnderscoredProperties(Dict);
+    static bool stripUnderscoredProperties(slice json, alloc_slice &stripped);
 
 
     Puller::Puller(Connection *connection, Replicator *replicator, DBActor *dbActor, Options options)
@@ -83,29 +82,28 @@ namespace litecore { namespace repl {
     }
 
 
-    // Handles an incoming "rev" message, which contains a revision body to insert
+    // Handles an incoming "rev" message, which contains a revision body to insert.
+    // The JSON body isn't parsed here: the DBActor converts it to Fleece in its insertion
+    // transaction, the only place it can be encoded with the database's shared keys.
     void Puller::handleRev(Retained<MessageIn> msg) {
-        FLError err;
-        alloc_slice fleeceBody = Encoder::convertJSON(msg->body(), &err);
-        if (!fleeceBody) {
-            gotError(C4Error{FleeceDomain, err});
-            return;
-        }
-        Dict root = Value::fromTrustedData(fleeceBody).asDict();
-
+        alloc_slice jsonBody = msg->body();
         auto rev = make_shared<RevToInsert>();
-        bool stripUnderscores;
         rev->docID = msg->property("id"_sl);
         if (rev->docID) {
             rev->revID = msg->property("rev"_sl);
             rev->deleted = !!msg->property("deleted"_sl);
-            stripUnderscores = hasUnderscoredProperties(root);
         } else {
-            // No metadata properties; look inside the JSON:
+            // No metadata properties; look inside the JSON (an older protocol, so not optimized):
+            FLError err;
+            alloc_slice fleeceBody = Encoder::convertJSON(jsonBody, &err);
+            if (!fleeceBody) {
+                gotError(C4Error{FleeceDomain, err});
+                return;
+            }
+            Dict root = Value::fromTrustedData(fleeceBody).asDict();
             rev->docID = (slice)root["_id"_sl].asString();
             rev->revID = (slice)root["_rev"_sl].asString();
             rev->deleted = root["_deleted"].asBool();
-            stripUnderscores = true;
         }
         rev->historyBuf = msg->property("history"_sl);
         alloc_slice sequence(msg->property("sequence"_sl));
@@ -123,9 +121,17 @@ namespace litecore { namespace repl {
             return;
         }
 
-        if (stripUnderscores)
-            fleeceBody = stripUnderscoredProperties(root);
-        rev->body = fleeceBody;
+        rev->deltaSrc = msg->property("deltaSrc"_sl);
+        if (rev->deltaSrc) {
+            rev->body = jsonBody;       // the DBActor will apply the delta
+        } else {
+            alloc_slice stripped;
+            if (!stripUnderscoredProperties(jsonBody, stripped)) {
+                gotError(C4Error{LiteCoreDomain, kC4ErrorCorruptData});
+                return;
+            }
+            rev->body = stripped ? stripped : jsonBody;
+        }
 
         function<void(C4Error)> onInserted;
         if (!msg->noReply() || nonPassive()) {
@@ -177,31 +183,124 @@ namespace litecore { namespace repl {
     }
 
 
-    // Returns true if a Fleece Dict contains any keys that begin with an underscore.
-    static bool hasUnderscoredProperties(Dict root) {
-        for (Dict::iterator i(root); i; ++i) {
-            auto key = slice(i.keyString());
-            if (key.size > 0 && key[0] == '_')
-                return true;
+    // Returns the end of the JSON string starting at `pos` (which points to the opening quote),
+    // or nullptr if it's unterminated.
+    static const char* skipJSONString(const char *pos, const char *end) {
+        for (++pos; pos < end; ++pos) {
+            if (*pos == '\\')
+                ++pos;
+            else if (*pos == '"')
+                return pos + 1;
         }
-        return false;
+        return nullptr;
     }
 
 
-    // Encodes a Dict, skipping top-level properties whose names begin with an underscore.
-    alloc_slice stripUnderscoredProperties(Dict root) {
-        Encoder e;
-        e.beginDict(root.count());
-        for (Dict::iterator i(root); i; ++i) {
-            auto key = slice(i.keyString());
-            if (key.size > 0 && key[0] == '_')
-                continue;
-            e.writeKey(key);
-            e.writeValue(i.value());
+    // Returns the end of the JSON value starting at `pos`, or nullptr if it's malformed.
+    // Nested containers are only scanned for their brackets and strings, not validated.
+    static const char* skipJSONValue(const char *pos, const char *end) {
+        if (pos >= end)
+            return nullptr;
+        if (*pos == '"')
+            return skipJSONString(pos, end);
+        int depth = 0;
+        for (; pos < end; ++pos) {
+            switch (*pos) {
+                case '"':
+                    pos = skipJSONString(pos, end);
+                    if (!pos)
+                        return nullptr;
+                    --pos;
+                    break;
+                case '{': case '[':
+                    ++depth;
+                    break;
+                case '}': case ']':
+                    if (depth == 0)
+                        return pos;
+                    if (--depth == 0)
+                        return pos + 1;
+                    break;
+                case ',': case ' ': case '\t': case '\n': case '\r':
+                    if (depth == 0)
+                        return pos;
+                    break;
+            }
         }
-        e.endDict();
-        return e.finish();
+        return depth == 0 ? pos : nullptr;
     }
 
 
+    static const char* skipJSONSpace(const char *pos, const char *end) {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r'))
+            ++pos;
+        return pos;
+    }
+
+
+    // Scans the top level of a JSON object, and if any of its property names begin with an
+    // underscore, sets `stripped` to a copy of the JSON without those properties. This is a
+    // lexical scan, much cheaper than parsing. Returns false if the JSON isn't an object.
+    static bool stripUnderscoredProperties(slice json, alloc_slice &stripped) {
+        auto pos = (const char*)json.buf, end = (const char*)json.end();
+        pos = skipJSONSpace(pos, end);
+        if (pos >= end || *pos++ != '{')
+            return false;
+        vector<slice> keep;             // Properties to copy, if any are stripped
+        bool stripping = false;
+        const char *keepStart = pos;
+        for (;;) {
+            pos = skipJSONSpace(pos, end);
+            if (pos >= end)
+                return false;
+            if (*pos == '}')
+                break;
+            const char *propStart = pos;
+            if (*pos != '"')
+                return false;
+            bool underscored = (pos + 1 < end && pos[1] == '_');
+            pos = skipJSONString(pos, end);
+            if (!pos)
+                return false;
+            pos = skipJSONSpace(pos, end);
+            if (pos >= end || *pos++ != ':')
+                return false;
+            pos = skipJSONValue(skipJSONSpace(pos, end), end);
+            if (!pos)
+                return false;
+            if (underscored) {
+                if (keepStart < propStart)
+                    keep.push_back(slice(keepStart, propStart));
+                stripping = true;
+            }
+            pos = skipJSONSpace(pos, end);
+            if (pos < end && *pos == ',')
+                ++pos;
+            if (underscored)
+                keepStart = pos;
+        }
+        if (!stripping)
+            return true;
+
+        // Copy the remaining properties, separated by commas:
+        keep.push_back(slice(keepStart, pos));
+        string result = "{";
+        for (slice prop : keep) {
+            // Trim the separating comma and whitespace, then add one comma between properties:
+            auto s = (const char*)prop.buf, e = (const char*)prop.end();
+            s = skipJSONSpace(s, e);
+            while (e > s && (e[-1] == ',' || e[-1] == ' ' || e[-1] == '\t'
+                                          || e[-1] == '\n' || e[-1] == '\r'))
+                --e;
+            if (e > s) {
+                if (result.size() > 1)
+                    result += ',';
+                result.append(s, e - s);
+            }
+        }
+        result += '}';
+        stripped = alloc_slice(result);
+        return true;
+    }
+
 } }
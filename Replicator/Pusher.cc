@@ -21,6 +21,7 @@ namespace litecore { namespace repl {
     Pusher::Pusher(Connection *connection, Replicator *replicator, DBActor *dbActor, Options options)
     :ReplActor(connection, replicator, options, "Push")
     ,_dbActor(dbActor)
+    ,_flow(options.flowLimits)
     ,_continuous(options.push == kC4Continuous)
     {
         registerHandler("subChanges",       &Pusher::handleSubChanges);
@@ -65,8 +66,9 @@ namespace litecore { namespace repl {
         if (!_gettingChanges && _changeListsInFlight < kMaxChangeListsInFlight && !_caughtUp ) {
             _gettingChanges = true;
             ++_changeListsInFlight;
-            log("Reading %u changes since sequence %llu ...", _changesBatchSize, _lastSequenceRead);
-            _dbActor->getChanges(_lastSequenceRead, _changesBatchSize, _continuous, this);
+            _changesRequested = _flow.changesBatchSize();
+            log("Reading %u changes since sequence %llu ...", _changesRequested, _lastSequenceRead);
+            _dbActor->getChanges(_lastSequenceRead, _changesRequested, _continuous, this);
             // response will be to call _gotChanges
         }
     }
@@ -105,9 +107,16 @@ namespace litecore { namespace repl {
                 if (progress.reply->isError())
                     return gotError(reply);
 
+                // If every earlier rev has already been sent, the batch was too small to keep
+                // the connection busy; if lots are still queued, it's bigger than it needs to be.
+                _flow.changesAcknowledged(_revsToSend.empty() && _revisionsInFlight == 0,
+                                          _revsToSend.size());
+                setFlowControl(_flow.status());
+
                 // The response contains an array that, for each change in the outgoing message,
                 // contains either a list of known ancestors, or null/false/0 if not interested.
                 int maxHistory = (int)max(0l, reply->intProperty("maxHistory"_sl));
+                bool deltaOK = _options.deltas && reply->property("deltas"_sl);
                 auto requests = reply->JSONBody().asArray();
 
                 unsigned index = 0;
@@ -115,6 +124,7 @@ namespace litecore { namespace repl {
                     Array ancestorArray = requests[index].asArray();
                     if (ancestorArray) {
                         auto request = _revsToSend.emplace(_revsToSend.end(), change, maxHistory);
+                        request->deltaOK = deltaOK;
                         request->ancestorRevIDs.reserve(ancestorArray.count());
                         for (Value a : ancestorArray) {
                             slice revid = a.asString();
@@ -132,7 +142,7 @@ namespace litecore { namespace repl {
             });
         }
 
-        if (changes.size() < _changesBatchSize) {
+        if (changes.size() < _changesRequested) {
             if (!_caughtUp) {
                 log("Caught up, at lastSequence %llu", _lastSequenceRead);
                 _caughtUp = true;
@@ -172,14 +182,14 @@ namespace litecore { namespace repl {
 
 
     void Pusher::maybeSendMoreRevs() {
-        while (_revisionsInFlight < kMaxRevsInFlight
-                   && _revisionBytesAwaitingReply <= kMaxRevBytesAwaitingReply
+        while (_revisionsInFlight < _flow.maxRevsInFlight()
+                   && _revisionBytesAwaitingReply <= _flow.maxRevBytesAwaitingReply()
                    && !_revsToSend.empty()) {
             sendRevision(_revsToSend.front());
             _revsToSend.pop_front();
         }
 //        if (!_revsToSend.empty())
-//            log("Throttling sending revs; _revisionsInFlight=%u, _revisionBytesAwaitingReply=%u",
+//            log("Throttling sending revs; _revisionsInFlight=%u, _revisionBytesAwaitingReply=%zu",
 //                _revisionsInFlight, _revisionBytesAwaitingReply);
     }
 
@@ -191,6 +201,7 @@ namespace litecore { namespace repl {
         if (nonPassive()) {
             // Callback for after the peer receives the "rev" message:
             ++_revisionsInFlight;
+            auto sentAt = FlowController::clock::now();
             logDebug("Uploading rev %.*s #%.*s (seq %llu)",
                 SPLAT(rev.docID), SPLAT(rev.revID), rev.sequence);
             onProgress = asynchronize([=](MessageProgress progress) {
@@ -199,17 +210,21 @@ namespace litecore { namespace repl {
                              SPLAT(rev.docID), SPLAT(rev.revID), rev.sequence);
                     --_revisionsInFlight;
                     _revisionBytesAwaitingReply += progress.bytesSent;
+                    _revisionBytesSent += progress.bytesSent;
                     maybeSendMoreRevs();
                 }
                 if (progress.reply) {
                     _revisionBytesAwaitingReply -= progress.bytesSent;
-                    if (progress.reply->isError())
+                    if (progress.reply->isError()) {
+                        _flow.revFailed();
                         gotError(progress.reply);
-                    else {
+                    } else {
+                        _flow.revAcknowledged(progress.bytesSent, sentAt);
                         logVerbose("Completed rev %.*s #%.*s (seq %llu)",
                                    SPLAT(rev.docID), SPLAT(rev.revID), rev.sequence);
                         markComplete(rev.sequence);
                     }
+                    setFlowControl(_flow.status());
                     maybeSendMoreRevs();
                 }
             });
@@ -242,7 +257,7 @@ namespace litecore { namespace repl {
 
 
     ReplActor::ActivityLevel Pusher::computeActivityLevel() const {
-        logDebug("caughtUp=%d, changeLists=%u, revsInFlight=%u, awaitingReply=%u, revsToSend=%zu, pendingSequences=%zu", _caughtUp, _changeListsInFlight, _revisionsInFlight, _revisionBytesAwaitingReply, _revsToSend.size(), _pendingSequences.size());
+        logDebug("caughtUp=%d, changeLists=%u, revsInFlight=%u, awaitingReply=%zu, revsToSend=%zu, pendingSequences=%zu", _caughtUp, _changeListsInFlight, _revisionsInFlight, _revisionBytesAwaitingReply, _revsToSend.size(), _pendingSequences.size());
         if (ReplActor::computeActivityLevel() == kC4Busy
                 || (_started && !_caughtUp)
                 || _changeListsInFlight > 0
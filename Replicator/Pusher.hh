@@ -10,7 +10,9 @@
 #include "Replicator.hh"
 #include "DBActor.hh"
 #include "Actor.hh"
+#include "FlowController.hh"
 #include "SequenceSet.hh"
+#include <atomic>
 #include <queue>
 
 namespace litecore { namespace repl {
@@ -27,6 +29,9 @@ namespace litecore { namespace repl {
         void gotChanges(RevList chgs, C4Error err)  {enqueue(&Pusher::_gotChanges, chgs, err);
         }
 
+        // Total size of the 'rev' messages sent so far (only tracked when active)
+        uint64_t revisionBytesSent() const          {return _revisionBytesSent;}
+
     private:
         void _start(C4SequenceNumber sinceSequence);
         bool nonPassive() const                         {return _options.push > kC4Passive;}
@@ -42,14 +47,12 @@ namespace litecore { namespace repl {
         void markComplete(C4SequenceNumber sequence);
 
         static const unsigned kMaxPossibleAncestorsToSend = 20;
-        static const unsigned kDefaultChangeBatchSize = 200;  // # of changes to send in one msg
         static const unsigned kMaxChangeListsInFlight = 4;    // How many changes messages can be active at once
         static const bool kChangeMessagesAreUrgent = true;    // Are change msgs high priority?
-        static const unsigned kMaxRevsInFlight = 5;           // max # revs to be transmitting at once
-        static const unsigned kMaxRevBytesAwaitingReply = 2*1024*1024;     // max bytes of revs sent but not replied
 
         DBActor* const _dbActor;
-        unsigned _changesBatchSize {kDefaultChangeBatchSize};   // # changes to get from db
+        FlowController _flow;                           // Adapts batch size & revs in flight
+        unsigned _changesRequested {0};                 // # changes last requested from db
         bool _continuous;
 
         C4SequenceNumber _lastSequence {0};             // Checkpointed last-sequence
@@ -60,7 +63,8 @@ namespace litecore { namespace repl {
         bool _caughtUp {false};                         // Received backlog of existing changes?
         unsigned _changeListsInFlight {0};              // # 'changes' msgs pending replies
         unsigned _revisionsInFlight {0};                // # 'rev' messages being sent
-        unsigned _revisionBytesAwaitingReply {0};       // # 'rev' message bytes sent but not replied
+        size_t _revisionBytesAwaitingReply {0};         // # 'rev' message bytes sent but not replied
+        std::atomic<uint64_t> _revisionBytesSent {0};   // Total # 'rev' message bytes sent
         std::deque<RevRequest> _revsToSend;             // Revs to send to peer but not sent yet
     };
     
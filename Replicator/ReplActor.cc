@@ -123,6 +123,14 @@ namespace litecore { namespace repl {
     }
 
 
+    void ReplActor::setFlowControl(const C4FlowControl &fc) {
+        if (memcmp(&fc, &_status.flowControl, sizeof(fc)) != 0) {
+            _status.flowControl = fc;
+            _statusChanged = true;
+        }
+    }
+
+
 
     ReplActor::ActivityLevel ReplActor::computeActivityLevel() const {
         if (eventCount() > 1 || _pendingResponseCount > 0)
@@ -36,6 +36,23 @@ namespace litecore { namespace repl {
             Mode     push                   {kC4Disabled};
             Mode     pull                   {kC4Disabled};
             duration checkpointSaveDelay    {std::chrono::seconds(5)};
+            bool     deltas                 {false};    // Send/accept revisions as deltas?
+                                                        // (Only used if both peers enable it)
+            unsigned revLoaders             {0};        // # of extra db connections to read
+                                                        // revs to push (0 = use the DBActor's)
+
+            /** Bounds within which the Pusher adapts its flow control. Setting a minimum and
+                maximum equal fixes that limit. Minimums are at least 1, and a maximum below
+                its minimum is raised to it. */
+            struct FlowLimits {
+                unsigned minChangesBatchSize        {50};
+                unsigned maxChangesBatchSize        {1000};
+                unsigned minRevsInFlight            {2};
+                unsigned maxRevsInFlight            {64};
+                size_t   minRevBytesAwaitingReply   {256*1024};
+                size_t   maxRevBytesAwaitingReply   {16*1024*1024};
+            };
+            FlowLimits flowLimits;
 
             Options()
             { }
@@ -101,6 +118,7 @@ namespace litecore { namespace repl {
         virtual void changedActivityLevel();
         void addProgress(C4Progress);
         void setProgress(C4Progress);
+        void setFlowControl(const C4FlowControl&);
 
         virtual void afterEvent() override;
         virtual std::string loggingIdentifier() const override {
@@ -69,6 +69,11 @@ namespace litecore { namespace repl {
     }
 
 
+    uint64_t Replicator::revisionBytesSent() const {
+        return _pusher ? _pusher->revisionBytesSent() : 0;
+    }
+
+
     // Called after the checkpoint is established.
     void Replicator::startReplicating() {
         auto cp = _checkpoint.sequences();
@@ -84,6 +89,7 @@ namespace litecore { namespace repl {
     {
         if (task == _pusher) {
             _pushStatus = taskStatus;
+            setFlowControl(taskStatus.flowControl);
         } else if (task == _puller) {
             _pullStatus = taskStatus;
         } else if (task == _dbActor) {
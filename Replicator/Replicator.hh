@@ -62,6 +62,7 @@ namespace litecore { namespace repl {
         // exposed for unit tests:
         websocket::WebSocket* webSocket() const {return connection()->webSocket();}
         alloc_slice checkpointID() const        {return _checkpointDocID;}
+        uint64_t revisionBytesSent() const;
 
         // internal API for Pusher/Puller:
         void updatePushCheckpoint(C4SequenceNumber s)   {_checkpoint.setLocalSeq(s);}
@@ -55,6 +55,7 @@ namespace litecore { namespace repl {
     struct RevRequest : public Rev {
         std::vector<alloc_slice> ancestorRevIDs;    // Known ancestor revIDs the peer already has
         unsigned maxHistory;                        // Max depth of rev history to send
+        bool deltaOK {false};                       // Peer accepts a delta vs. an ancestor
 
         RevRequest(const Rev &rev, unsigned maxHistory_)
         :Rev(rev)
@@ -74,7 +75,8 @@ namespace litecore { namespace repl {
     struct RevToInsert : public Rev {
         bool deleted {false};
         alloc_slice historyBuf;
-        alloc_slice body;
+        alloc_slice body;           // JSON, without top-level '_' properties
+        alloc_slice deltaSrc;       // If non-null, body is a JSON delta from this revision
         std::function<void(C4Error)> onInserted;
     };
     
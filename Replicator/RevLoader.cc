@@ -0,0 +1,70 @@
+//
+//  RevLoader.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "RevLoader.hh"
+#include "DBActor.hh"
+#include "BLIPConnection.hh"
+#include "Message.hh"
+#include "StringUtil.hh"
+
+using namespace std;
+using namespace fleece;
+using namespace litecore::blip;
+
+namespace litecore { namespace repl {
+
+
+    RevLoader* RevLoader::create(Connection *connection,
+                                 Replicator *replicator,
+                                 DBActor *dbActor,
+                                 C4Database *db,
+                                 bool insertDocumentMetadata,
+                                 Options options)
+    {
+        C4Error err;
+        C4Database *ownDB = c4db_openAgain(db, &err);
+        if (!ownDB)
+            return nullptr;
+        return new RevLoader(connection, replicator, dbActor, ownDB,
+                             insertDocumentMetadata, options);
+    }
+
+
+    RevLoader::RevLoader(Connection *connection,
+                         Replicator *replicator,
+                         DBActor *dbActor,
+                         C4Database *ownDB,
+                         bool insertDocumentMetadata,
+                         Options options)
+    :ReplActor(connection, replicator, options, "Load")
+    ,_dbActor(dbActor)
+    ,_db(ownDB)
+    ,_insertDocumentMetadata(insertDocumentMetadata)
+    { }
+
+
+    RevLoader::~RevLoader() {
+        c4db_free(_db);
+    }
+
+
+    // Same as DBActor::_sendRevision, but on my own database connection.
+    void RevLoader::_sendRevision(RevRequest request, MessageProgressCallback onProgress) {
+        if (!connection())
+            return;
+        logVerbose("Sending revision '%.*s' #%.*s",
+                   SPLAT(request.docID), SPLAT(request.revID));
+        MessageBuilder msg("rev"_sl);
+        bool isDelta;
+        C4Error c4err;
+        if (!DBActor::encodeRevision(_db, request, _insertDocumentMetadata, msg, isDelta, &c4err))
+            return _dbActor->enqueue(&DBActor::_loaderFailed, request, onProgress, c4err);
+        msg.noreply = !onProgress && !isDelta;
+        sendRequest(msg, isDelta ? _dbActor->deltaFallback(request, onProgress) : onProgress);
+    }
+
+} }
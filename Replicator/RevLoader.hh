@@ -0,0 +1,49 @@
+//
+//  RevLoader.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "ReplicatorTypes.hh"
+#include "ReplActor.hh"
+
+namespace litecore { namespace repl {
+    class DBActor;
+
+
+    /** Actor that reads and encodes revisions to push, on its own database connection, so that
+        several of them can run in parallel with each other and with the DBActor.
+        Created and owned by the DBActor, which routes 'rev' requests to them. */
+    class RevLoader : public ReplActor {
+    public:
+        /** Opens a new connection to `db`'s file. Returns null on failure. */
+        static RevLoader* create(blip::Connection*,
+                                 Replicator*,
+                                 DBActor*,
+                                 C4Database *db,
+                                 bool insertDocumentMetadata,
+                                 Options);
+
+        void sendRevision(const RevRequest &request,
+                          blip::MessageProgressCallback onProgress) {
+            enqueue(&RevLoader::_sendRevision, request, onProgress);
+        }
+
+    protected:
+        virtual ~RevLoader();
+        // Status is reported by the Pusher, and errors by the DBActor, not by me:
+        virtual void changedActivityLevel() override    { }
+
+    private:
+        RevLoader(blip::Connection*, Replicator*, DBActor*, C4Database *ownDB,
+                  bool insertDocumentMetadata, Options);
+        void _sendRevision(RevRequest request, blip::MessageProgressCallback onProgress);
+
+        DBActor* const _dbActor;
+        C4Database* const _db;
+        const bool _insertDocumentMetadata;
+    };
+
+} }
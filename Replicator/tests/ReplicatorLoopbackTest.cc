@@ -14,8 +14,10 @@
 #include <iostream>
 #include "c4Test.hh"
 #include "Replicator.hh"
+#include "FlowController.hh"
 #include "LoopbackProvider.hh"
 #include "StringUtil.hh"
+#include "Benchmark.hh"
 #include <algorithm>
 #include <chrono>
 #include <future>
@@ -184,6 +186,53 @@ public:
         validateCheckpoint(remoteDB, false, body, meta);
     }
 
+    // Writes a new revision of each doc "doc-0000000"..., with about 1KB of properties of which
+    // only `generation` differs between revisions.
+    void writeGeneration(unsigned numDocs, unsigned generation, C4RevisionFlags flags =0) {
+        c4::Transaction t(db);
+        REQUIRE(t.begin(nullptr));
+        for (unsigned i = 0; i < numDocs; ++i) {
+            char docID[20], revID[20];
+            sprintf(docID, "doc-%07u", i);
+            sprintf(revID, "%u-%08x", generation, i);
+            string json = "{\"generation\":" + to_string(generation)
+                        + ",\"nested\":{\"generation\":" + to_string(generation)
+                        + ",\"constant\":true}";
+            for (int f = 0; f < 20; ++f)
+                json += ",\"field" + to_string(f) + "\":\"The value of field "
+                      + to_string(f) + " of document " + to_string(i) + "\"";
+            json += "}";
+            C4Error error;
+            C4SliceResult body = c4db_encodeJSON(db, c4str(json.c_str()), &error);
+            REQUIRE(body.buf);
+            createRev(c4str(docID), c4str(revID), {body.buf, body.size}, flags);
+            c4slice_free(body);
+        }
+        REQUIRE(t.commit(nullptr));
+    }
+
+    // Checks that the current revisions in both databases have the same bodies.
+    void compareBodies(unsigned numDocs) {
+        for (unsigned i = 0; i < numDocs; ++i) {
+            char docID[20];
+            sprintf(docID, "doc-%07u", i);
+            C4Error error;
+            c4::ref<C4Document> doc1 = c4doc_get(db, c4str(docID), true, &error);
+            c4::ref<C4Document> doc2 = c4doc_get(db2, c4str(docID), true, &error);
+            REQUIRE(doc1);
+            REQUIRE(doc2);
+            alloc_slice json1 = c4doc_bodyAsJSON(doc1, &error);
+            alloc_slice json2 = c4doc_bodyAsJSON(doc2, &error);
+            INFO("Doc " << docID);
+            CHECK(json1 == json2);
+        }
+    }
+
+    static Replicator::Options withDeltas(Replicator::Options opts) {
+        opts.deltas = true;
+        return opts;
+    }
+
     LoopbackProvider provider;
     C4Database* db2;
     Retained<Replicator> replClient, replServer;
@@ -231,6 +280,56 @@ TEST_CASE_METHOD(ReplicatorLoopbackTest, "Incremental Push", "[Push]") {
 
 }
 
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Flow Control", "[Push]") {
+    // Pin the changes batch size well below the doc count, and let the rest adapt:
+    importJSONLines(sFixturesDir + "names_100.json");
+    auto opts = Replicator::Options::pushing();
+    opts.flowLimits.minChangesBatchSize = opts.flowLimits.maxChangesBatchSize = 10;
+    opts.flowLimits.minRevsInFlight = 1;
+    opts.flowLimits.maxRevsInFlight = 8;
+    runReplicators(opts, Replicator::Options::passive());
+    compareDatabases();
+    validateCheckpoints(db, db2, "{\"local\":100}");
+
+    auto &fc = statusReceived.flowControl;
+    CHECK(fc.changesBatchSize == 10);
+    CHECK(fc.maxRevsInFlight >= 1);
+    CHECK(fc.maxRevsInFlight <= 8);
+    CHECK(fc.maxRevBytesAwaitingReply >= opts.flowLimits.minRevBytesAwaitingReply);
+    CHECK(fc.maxRevBytesAwaitingReply <= opts.flowLimits.maxRevBytesAwaitingReply);
+}
+
+TEST_CASE("Flow Control Limits", "[Push]") {
+    // Minimums of 0 are raised to 1, so the limits never fall to 0 (which would stall the
+    // push, and divide by zero on the next increase):
+    FlowController::Limits limits;
+    limits.minChangesBatchSize = limits.minRevsInFlight = 0;
+    limits.minRevBytesAwaitingReply = 0;
+    FlowController fc(limits);
+    for (int i = 0; i < 32; ++i)
+        fc.revFailed();
+    CHECK(fc.changesBatchSize() >= 1);
+    CHECK(fc.maxRevsInFlight() == 1);
+    CHECK(fc.maxRevBytesAwaitingReply() == 1);
+    for (int i = 0; i < 10; ++i)
+        fc.revAcknowledged(1000, FlowController::clock::now());
+    CHECK(fc.maxRevsInFlight() >= 1);
+
+    // A maximum below its minimum is raised to it:
+    limits = FlowController::Limits();
+    limits.minRevsInFlight = 10;
+    limits.maxRevsInFlight = 4;
+    limits.minRevBytesAwaitingReply = 1000;
+    limits.maxRevBytesAwaitingReply = 10;
+    FlowController fc2(limits);
+    CHECK(fc2.maxRevsInFlight() == 10);
+    CHECK(fc2.maxRevBytesAwaitingReply() == 1000);
+    fc2.revFailed();
+    CHECK(fc2.maxRevsInFlight() == 10);
+    CHECK(fc2.maxRevBytesAwaitingReply() == 1000);
+}
+
+
 TEST_CASE_METHOD(ReplicatorLoopbackTest, "Pull Empty DB", "[Pull]") {
     runReplicators(Replicator::Options::pulling(),
                    Replicator::Options::passive());
@@ -262,6 +361,141 @@ TEST_CASE_METHOD(ReplicatorLoopbackTest, "Incremental Pull", "[Pull]") {
     validateCheckpoints(db2, db, "{\"remote\":102}", "2-cc");
 }
 
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Pull Throughput", "[Pull][Perf][.slow]") {
+    static const unsigned kNumDocs = 50000;
+    {
+        c4::Transaction t(db);
+        REQUIRE(t.begin(nullptr));
+        for (unsigned i = 0; i < kNumDocs; ++i) {
+            char docID[20], json[200];
+            sprintf(docID, "doc-%07u", i);
+            sprintf(json, "{\"name\":\"Person %u\",\"age\":%u,\"tags\":[\"a\",\"b\"],"
+                          "\"address\":{\"street\":\"%u Main St\",\"city\":\"Springfield\"}}",
+                    i, i % 100, i);
+            C4Error error;
+            C4SliceResult body = c4db_encodeJSON(db, c4str(json), &error);
+            REQUIRE(body.buf);
+            createRev(c4str(docID), kRevID, {body.buf, body.size});
+            c4slice_free(body);
+        }
+        REQUIRE(t.commit(nullptr));
+    }
+
+    Stopwatch st;
+    runReplicators(Replicator::Options::passive(),
+                   Replicator::Options::pulling());
+    st.printReport("Pulling docs", kNumDocs, "doc");
+    compareDatabases();
+}
+
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Deltas", "[Push]") {
+    // The first revisions are kept, so the second ones can be sent as deltas:
+    static const unsigned kNumDocs = 20;
+    writeGeneration(kNumDocs, 1, kRevKeepBody);
+    runReplicators(withDeltas(Replicator::Options::pushing()),
+                   withDeltas(Replicator::Options::passive()));
+    compareDatabases();
+
+    Log("-------- Second Replication --------");
+    uint64_t fullBytes = replClient->revisionBytesSent();
+    writeGeneration(kNumDocs, 2);
+    runReplicators(withDeltas(Replicator::Options::pushing()),
+                   withDeltas(Replicator::Options::passive()));
+    compareDatabases();
+    compareBodies(kNumDocs);
+    CHECK(replClient->revisionBytesSent() < fullBytes / 2);
+}
+
+
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Delta With Underscored Property", "[Push]") {
+    writeGeneration(1, 1, kRevKeepBody);
+    runReplicators(withDeltas(Replicator::Options::pushing()),
+                   withDeltas(Replicator::Options::passive()));
+
+    // Add a top-level '_' property, which the receiver strips whether or not it gets a delta:
+    {
+        c4::Transaction t(db);
+        REQUIRE(t.begin(nullptr));
+        c4::ref<C4Document> doc = c4doc_get(db, C4STR("doc-0000000"), true, nullptr);
+        REQUIRE(doc);
+        alloc_slice json = c4doc_bodyAsJSON(doc, nullptr);
+        string newJSON = "{\"_private\":true," + json.asString().substr(1);
+        C4Error error;
+        C4SliceResult body = c4db_encodeJSON(db, c4str(newJSON.c_str()), &error);
+        REQUIRE(body.buf);
+        createRev(C4STR("doc-0000000"), C4STR("2-00000000"), {body.buf, body.size});
+        c4slice_free(body);
+        REQUIRE(t.commit(nullptr));
+    }
+    runReplicators(withDeltas(Replicator::Options::pushing()),
+                   withDeltas(Replicator::Options::passive()));
+
+    C4Error error;
+    c4::ref<C4Document> doc = c4doc_get(db2, C4STR("doc-0000000"), true, &error);
+    REQUIRE(doc);
+    CHECK(doc->revID == C4STR("2-00000000"));
+    alloc_slice json = c4doc_bodyAsJSON(doc, &error);
+    CHECK(json.asString().find("_private") == string::npos);
+    CHECK(json.asString().find("\"generation\":1") != string::npos);
+}
+
+
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Deltas Throughput", "[Push][Perf][.slow]") {
+    static const unsigned kNumDocs = 10000;
+    writeGeneration(kNumDocs, 1);
+    runReplicators(Replicator::Options::pushing(),
+                   Replicator::Options::passive());
+
+    // Push the second revisions whole, and the third ones as deltas:
+    for (bool deltas : {false, true}) {
+        writeGeneration(kNumDocs, deltas ? 3 : 2, kRevKeepBody);
+        auto pushOpts = Replicator::Options::pushing(), passiveOpts = Replicator::Options::passive();
+        pushOpts.deltas = passiveOpts.deltas = deltas;
+        Stopwatch st;
+        runReplicators(pushOpts, passiveOpts);
+        fprintf(stderr, "%s: %llu bytes of revisions; ",
+                (deltas ? "Deltas" : "Whole revisions"),
+                (unsigned long long)replClient->revisionBytesSent());
+        st.printReport("pushing", kNumDocs, "rev");
+        compareDatabases();
+    }
+    compareBodies(kNumDocs);
+}
+
+
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push With Rev Loaders", "[Push]") {
+    importJSONLines(sFixturesDir + "names_100.json");
+    auto opts = Replicator::Options::pushing();
+    opts.revLoaders = 3;
+    runReplicators(opts, Replicator::Options::passive());
+    compareDatabases();
+    validateCheckpoints(db, db2, "{\"local\":100}");
+
+    Log("-------- Second Replication --------");
+    createRev("new1"_sl, kRev2ID, kFleeceBody);
+    createRev("new2"_sl, kRev3ID, kFleeceBody);
+    runReplicators(opts, Replicator::Options::passive());
+    compareDatabases();
+    validateCheckpoints(db, db2, "{\"local\":102}", "2-cc");
+}
+
+
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Rev Loaders Throughput", "[Push][Perf][.slow]") {
+    static const unsigned kNumDocs = 20000;
+    unsigned generation = 0;
+    for (unsigned loaders : {0, 1, 2, 4, 8}) {
+        writeGeneration(kNumDocs, ++generation);
+        auto opts = Replicator::Options::pushing();
+        opts.revLoaders = loaders;
+        Stopwatch st;
+        runReplicators(opts, Replicator::Options::passive());
+        fprintf(stderr, "%u rev loaders: ", loaders);
+        st.printReport("pushing", kNumDocs, "rev");
+        compareDatabases();
+    }
+}
+
+
 TEST_CASE_METHOD(ReplicatorLoopbackTest, "Continuous Push Starting Empty", "[Push][.neverending]") {
     addDocsInParallel(chrono::milliseconds(1500));
     runReplicators(Replicator::Options::pushing(kC4Continuous),